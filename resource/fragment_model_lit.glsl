@@ -0,0 +1,151 @@
+#version 330 core
+#pragma features DIFFUSE_MAP SPECULAR_MAP NORMAL_MAP LIGHTING
+
+in vec2 tex_coords;
+in vec3 view_position;
+in vec3 view_normal;
+#ifdef NORMAL_MAP
+in vec3 view_tangent;
+in vec3 view_bitangent;
+#endif
+
+out vec4 out_frag_color;
+
+const int MAX_MATERIALS = 256;
+
+// cluster grid, has to match Lighting.hpp
+const int CLUSTER_X = 16;
+const int CLUSTER_Y = 9;
+const int CLUSTER_Z = 24;
+
+// maps hold the texture page in the upper and the layer in the lower 16 bits, -1 if unset
+struct Material
+{
+    vec4  diffuse;
+    vec4  specular;
+    ivec4 maps;
+};
+
+layout (std140) uniform Materials
+{
+    Material u_materials[MAX_MATERIALS];
+};
+
+uniform sampler2DArray u_pages[8];
+
+// frame block shared by every program, see UniformRing.hpp
+layout (std140) uniform Frame
+{
+    mat4 u_view;
+    mat4 u_projection;
+    vec2 u_viewport;
+    vec2 u_cluster_depth;  // near and far plane
+    vec3 u_ambient;
+};
+
+// per-draw block, bound per mesh
+layout (std140) uniform Draw
+{
+    mat4  u_model;
+    ivec4 u_draw;  // material in the bound block, bone offset
+};
+
+// view space lights, three texels each: position and range, color and inner cone
+// cosine, direction and outer cone cosine
+uniform samplerBuffer u_lights;
+// first index into u_light_indices and light count per cluster
+uniform usamplerBuffer u_light_clusters;
+uniform usamplerBuffer u_light_indices;
+
+// sampler arrays can only be indexed with constants in GLSL 3.30
+vec4 samplePage(int map, vec2 uv)
+{
+    vec3 uvw = vec3(uv, float(map & 0xffff));
+
+    switch(map >> 16)
+    {
+    case 0: return texture(u_pages[0], uvw);
+    case 1: return texture(u_pages[1], uvw);
+    case 2: return texture(u_pages[2], uvw);
+    case 3: return texture(u_pages[3], uvw);
+    case 4: return texture(u_pages[4], uvw);
+    case 5: return texture(u_pages[5], uvw);
+    case 6: return texture(u_pages[6], uvw);
+    case 7: return texture(u_pages[7], uvw);
+    }
+    return vec4(1.0);
+}
+
+int cluster()
+{
+    ivec2 tile = ivec2(gl_FragCoord.xy / u_viewport * vec2(CLUSTER_X, CLUSTER_Y));
+    tile       = clamp(tile, ivec2(0), ivec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+
+    // slices are spaced exponentially between the near and the far plane
+    float depth = -view_position.z / u_cluster_depth.x;
+    float range = u_cluster_depth.y / u_cluster_depth.x;
+    int   slice = clamp(int(log(depth) / log(range) * CLUSTER_Z), 0, CLUSTER_Z - 1);
+
+    return (slice * CLUSTER_Y + tile.y) * CLUSTER_X + tile.x;
+}
+
+// variants only sample the maps their material has, the key says which those are
+void main()
+{
+    Material material = u_materials[u_draw.x];
+
+    vec4 albedo = material.diffuse;
+#ifdef DIFFUSE_MAP
+    albedo = samplePage(material.maps.x, tex_coords);
+#endif
+
+#ifndef LIGHTING
+    out_frag_color = albedo;
+#else
+    vec3 specular = material.specular.rgb;
+#ifdef SPECULAR_MAP
+    specular *= samplePage(material.maps.y, tex_coords).rgb;
+#endif
+
+    vec3 normal = normalize(view_normal);
+#ifdef NORMAL_MAP
+    // tangent space normal, the frame is re-normalized after interpolation
+    vec3 bump = samplePage(material.maps.z, tex_coords).xyz * 2.0 - 1.0;
+    mat3 tbn  = mat3(normalize(view_tangent), normalize(view_bitangent), normal);
+    normal    = normalize(tbn * bump);
+#endif
+    vec3 eye    = normalize(-view_position);
+    vec3 color  = u_ambient * albedo.rgb;
+
+    // only the lights binned into this fragment's cluster
+    uvec2 list = texelFetch(u_light_clusters, cluster()).xy;
+
+    for(uint i = 0u; i < list.y; i++)
+    {
+        int  light     = int(texelFetch(u_light_indices, int(list.x + i)).x) * 3;
+        vec4 position  = texelFetch(u_lights, light);
+        vec4 radiance  = texelFetch(u_lights, light + 1);
+        vec4 direction = texelFetch(u_lights, light + 2);
+
+        vec3  to_light = position.xyz - view_position;
+        float distance = length(to_light);
+        if(distance >= position.w)
+            continue;
+
+        vec3 l = to_light / distance;
+        vec3 h = normalize(l + eye);
+
+        // inverse square falloff windowed to reach zero at the light's range
+        float window  = clamp(1.0 - pow(distance / position.w, 4.0), 0.0, 1.0);
+        float falloff = window * window / (distance * distance + 1.0);
+        float cone    = smoothstep(direction.w, radiance.w, dot(-l, direction.xyz));
+
+        float lambert = max(dot(normal, l), 0.0);
+        float phong   = lambert > 0.0 ? pow(max(dot(normal, h), 0.0), material.specular.w) : 0.0;
+
+        color += (albedo.rgb * lambert + specular * phong) * radiance.rgb * falloff * cone;
+    }
+
+    out_frag_color = vec4(color, albedo.a);
+#endif
+}
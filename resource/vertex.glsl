@@ -2,9 +2,17 @@
 
 layout (location = 0) in vec3 in_pos;
 
+// frame block shared by every program, see UniformRing.hpp
+layout (std140) uniform Frame
+{
+    mat4 u_view;
+    mat4 u_projection;
+    vec2 u_viewport;
+    vec2 u_cluster_depth;
+    vec3 u_ambient;
+};
+
 uniform mat4 u_model;
-uniform mat4 u_view;
-uniform mat4 u_projection;
 
 void main()
 {
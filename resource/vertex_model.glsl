@@ -1,16 +1,82 @@
 #version 330 core
+#pragma features SKINNED NORMAL_MAP
 layout (location = 0) in vec3 in_pos;
 layout (location = 1) in vec3 in_normal;
 layout (location = 2) in vec2 in_tex_coords;
+layout (location = 3) in vec3 in_tangent;
+layout (location = 4) in vec3 in_bitangent;
+layout (location = 5) in ivec4 in_bone_ids;
+layout (location = 6) in vec4 in_weights;
 
-out vec2 out_tex_coords;
+out vec2 tex_coords;
+out vec3 view_position;
+out vec3 view_normal;
+#ifdef NORMAL_MAP
+out vec3 view_tangent;
+out vec3 view_bitangent;
+#endif
 
-uniform mat4 u_model;
-uniform mat4 u_view;
-uniform mat4 u_projection;
+// frame block shared by every program, see UniformRing.hpp
+layout (std140) uniform Frame
+{
+    mat4 u_view;
+    mat4 u_projection;
+    vec2 u_viewport;
+    vec2 u_cluster_depth;  // near and far plane
+    vec3 u_ambient;
+};
+
+// per-draw block, bound per mesh
+layout (std140) uniform Draw
+{
+    mat4  u_model;
+    ivec4 u_draw;  // material in the bound block, bone offset
+};
+
+#ifdef SKINNED
+// bone palettes of all skinned models, four texels per matrix
+uniform samplerBuffer u_bone_palette;
+
+mat4 bone(int id)
+{
+    int texel = (u_draw.y + id) * 4;
+    return mat4(
+        texelFetch(u_bone_palette, texel),
+        texelFetch(u_bone_palette, texel + 1),
+        texelFetch(u_bone_palette, texel + 2),
+        texelFetch(u_bone_palette, texel + 3));
+}
+#endif
 
 void main()
 {
-    out_tex_coords = in_tex_coords;
-    gl_Position = u_projection * u_view * u_model * vec4(in_pos, 1.0);
+    vec4 position  = vec4(in_pos, 1.0);
+    vec3 normal    = in_normal;
+    vec3 tangent   = in_tangent;
+    vec3 bitangent = in_bitangent;
+
+#ifdef SKINNED
+    mat4 skin = mat4(0.0);
+    for(int i = 0; i < 4; i++)
+    {
+        if(in_bone_ids[i] >= 0)
+            skin += bone(in_bone_ids[i]) * in_weights[i];
+    }
+    position  = skin * position;
+    normal    = mat3(skin) * normal;
+    tangent   = mat3(skin) * tangent;
+    bitangent = mat3(skin) * bitangent;
+#endif
+
+    mat4 model_view = u_view * u_model;
+    vec4 view       = model_view * position;
+
+    tex_coords    = in_tex_coords;
+    view_position = view.xyz;
+    view_normal   = transpose(inverse(mat3(model_view))) * normal;
+#ifdef NORMAL_MAP
+    view_tangent   = mat3(model_view) * tangent;
+    view_bitangent = mat3(model_view) * bitangent;
+#endif
+    gl_Position   = u_projection * view;
 }
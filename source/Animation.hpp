@@ -0,0 +1,551 @@
+#pragma once
+
+// glad
+#include <glad/gl.h>
+
+// lib
+#include <assimp/scene.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// std
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ANIMATION_SSE
+#endif
+
+// inc
+#include "Log.hpp"
+#include "ThreadPool.hpp"
+
+// Texture unit the bone palette buffer texture is bound to
+const int BONE_PALETTE_UNIT = 15;
+
+// Clips are resampled to this rate on import, playback blends between two samples
+const float ANIMATION_SAMPLE_RATE = 30.0f;
+
+// Components of a joint's local transform, each stored in its own array
+enum Track : int
+{
+    TRACK_TX = 0,
+    TRACK_TY,
+    TRACK_TZ,
+    TRACK_RX,
+    TRACK_RY,
+    TRACK_RZ,
+    TRACK_RW,
+    TRACK_SX,
+    TRACK_SY,
+    TRACK_SZ,
+    TRACK_COUNT,
+};
+
+using JointPose = std::array<float, TRACK_COUNT>;
+
+inline glm::mat4 toMat4(const aiMatrix4x4& matrix)
+{
+    // assimp matrices are row major
+    return glm::transpose(glm::make_mat4(&matrix.a1));
+}
+
+inline JointPose toPose(const aiVector3D& t, const aiQuaternion& r, const aiVector3D& s)
+{
+    return {t.x, t.y, t.z, r.x, r.y, r.z, r.w, s.x, s.y, s.z};
+}
+
+// Node hierarchy of a model flattened so that parents always come before children. Every
+// node is a joint, only joints referenced by a mesh bone end up in the bone palette.
+struct Skeleton
+{
+    std::vector<int>         parents;
+    std::vector<std::string> names;
+    std::vector<JointPose>   bind_pose;
+
+    std::vector<int>       bone_joints;  // -1 for bones without a node
+    std::vector<glm::mat4> bone_offsets;
+
+    std::unordered_map<std::string, int> joint_index;
+    std::unordered_map<std::string, int> bone_index;
+
+    glm::mat4 global_inverse = glm::mat4(1.0f);
+
+    size_t joints() const
+    {
+        return parents.size();
+    }
+
+    size_t bones() const
+    {
+        return bone_joints.size();
+    }
+
+    void build(const aiNode* root)
+    {
+        std::vector<std::pair<const aiNode*, int>> stack = {{root, -1}};
+
+        while(!stack.empty())
+        {
+            auto [node, parent] = stack.back();
+            stack.pop_back();
+
+            int index = static_cast<int>(parents.size());
+
+            aiVector3D   position, scaling;
+            aiQuaternion rotation;
+            node->mTransformation.Decompose(scaling, rotation, position);
+
+            parents.push_back(parent);
+            names.push_back(node->mName.C_Str());
+            bind_pose.push_back(toPose(position, rotation, scaling));
+            joint_index[names.back()] = index;
+
+            // reversed so that the first child is visited first
+            for(unsigned int i = node->mNumChildren; i > 0; i--)
+                stack.push_back({node->mChildren[i - 1], index});
+        }
+
+        global_inverse = glm::inverse(toMat4(root->mTransformation));
+    }
+
+    int joint(const std::string& name) const
+    {
+        auto it = joint_index.find(name);
+        return it != joint_index.end() ? it->second : -1;
+    }
+
+    // Returns the palette index of a bone, bones shared by several meshes are added once.
+    // A bone naming no node gets an identity palette entry, its vertices stay in place.
+    int bone(const aiBone* bone)
+    {
+        std::string name = bone->mName.C_Str();
+
+        auto it = bone_index.find(name);
+        if(it != bone_index.end())
+            return it->second;
+
+        int index        = static_cast<int>(bone_joints.size());
+        bone_index[name] = index;
+        bone_joints.push_back(joint(name));
+
+        if(bone_joints.back() < 0)
+            logWarning("Bone %s has no node, its vertices are not animated", name);
+        bone_offsets.push_back(toMat4(bone->mOffsetMatrix));
+
+        return index;
+    }
+};
+
+// Animation resampled at ANIMATION_SAMPLE_RATE into one array per track, laid out as
+// [frame][joint]. Evaluating a pose then streams through two contiguous rows per track
+// instead of searching keyframes of every channel.
+struct AnimationClip
+{
+    std::string        name;
+    float              duration = 0.0f;  // seconds
+    int                frames   = 0;
+    int                joints   = 0;
+    std::vector<float> tracks[TRACK_COUNT];
+
+    void load(const aiAnimation* animation, const Skeleton& skeleton)
+    {
+        double ticks_per_second =
+            animation->mTicksPerSecond > 0.0 ? animation->mTicksPerSecond : 25.0;
+
+        name     = animation->mName.C_Str();
+        duration = static_cast<float>(animation->mDuration / ticks_per_second);
+        frames   = static_cast<int>(std::ceil(duration * ANIMATION_SAMPLE_RATE)) + 1;
+        frames   = std::max(frames, 2);
+        joints   = static_cast<int>(skeleton.joints());
+
+        for(auto& track : tracks)
+            track.resize(static_cast<size_t>(frames) * joints);
+
+        // joints without a channel keep their bind pose
+        for(int frame = 0; frame < frames; frame++)
+            for(int joint = 0; joint < joints; joint++)
+                store(frame, joint, skeleton.bind_pose[joint]);
+
+        for(unsigned int i = 0; i < animation->mNumChannels; i++)
+        {
+            const aiNodeAnim* channel = animation->mChannels[i];
+
+            int joint = skeleton.joint(channel->mNodeName.C_Str());
+            if(joint < 0)
+                continue;
+
+            unsigned int position = 0, rotation = 0, scaling = 0;
+            for(int frame = 0; frame < frames; frame++)
+            {
+                double time = std::min(
+                    frame / ANIMATION_SAMPLE_RATE * ticks_per_second,
+                    animation->mDuration);
+
+                JointPose pose = skeleton.bind_pose[joint];
+
+                auto* t = &pose[TRACK_TX];
+                auto* r = &pose[TRACK_RX];
+                auto* s = &pose[TRACK_SX];
+                sample(channel->mPositionKeys, channel->mNumPositionKeys, time, position, t);
+                sample(channel->mRotationKeys, channel->mNumRotationKeys, time, rotation, r);
+                sample(channel->mScalingKeys, channel->mNumScalingKeys, time, scaling, s);
+
+                store(frame, joint, pose);
+            }
+        }
+    }
+
+private:
+    void store(int frame, int joint, const JointPose& pose)
+    {
+        size_t index = static_cast<size_t>(frame) * joints + joint;
+        for(int track = 0; track < TRACK_COUNT; track++)
+            tracks[track][index] = pose[track];
+    }
+
+    // keys are visited with increasing time, the cursor remembers the last key
+    template<typename Key>
+    static float advance(const Key* keys, unsigned int count, double time, unsigned int& cursor)
+    {
+        while(cursor + 1 < count && keys[cursor + 1].mTime <= time)
+            cursor++;
+
+        if(cursor + 1 >= count)
+            return 0.0f;
+
+        double span = keys[cursor + 1].mTime - keys[cursor].mTime;
+        if(span <= 0.0)
+            return 0.0f;
+
+        return static_cast<float>(std::clamp((time - keys[cursor].mTime) / span, 0.0, 1.0));
+    }
+
+    static void sample(
+        const aiVectorKey* keys,
+        unsigned int       count,
+        double             time,
+        unsigned int&      cursor,
+        float*             out)
+    {
+        if(count == 0)
+            return;
+
+        float             alpha = advance(keys, count, time, cursor);
+        const aiVector3D& a     = keys[cursor].mValue;
+        const aiVector3D& b     = keys[std::min(cursor + 1, count - 1)].mValue;
+
+        out[0] = a.x + (b.x - a.x) * alpha;
+        out[1] = a.y + (b.y - a.y) * alpha;
+        out[2] = a.z + (b.z - a.z) * alpha;
+    }
+
+    static void sample(
+        const aiQuatKey* keys,
+        unsigned int     count,
+        double           time,
+        unsigned int&    cursor,
+        float*           out)
+    {
+        if(count == 0)
+            return;
+
+        float               alpha = advance(keys, count, time, cursor);
+        const aiQuaternion& a     = keys[cursor].mValue;
+        const aiQuaternion& b     = keys[std::min(cursor + 1, count - 1)].mValue;
+
+        glm::quat qa = glm::quat(a.w, a.x, a.y, a.z);
+        glm::quat qb = glm::quat(b.w, b.x, b.y, b.z);
+        glm::quat q  = glm::slerp(qa, qb, alpha);
+
+        out[0] = q.x;
+        out[1] = q.y;
+        out[2] = q.z;
+        out[3] = q.w;
+    }
+};
+
+// Blends two sampled rows of a clip into a local pose. Translation and scale are lerped,
+// rotations are nlerped along the shorter arc; four joints at a time with SSE.
+inline void blendPose(
+    const AnimationClip& clip,
+    int                  frame0,
+    int                  frame1,
+    float                alpha,
+    std::vector<float>*  pose)
+{
+    const size_t joints = clip.joints;
+    const size_t a      = static_cast<size_t>(frame0) * joints;
+    const size_t b      = static_cast<size_t>(frame1) * joints;
+
+    size_t j = 0;
+
+#ifdef ANIMATION_SSE
+    const __m128 t    = _mm_set1_ps(alpha);
+    const __m128 one  = _mm_set1_ps(1.0f);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+
+    const int linear[] = {TRACK_TX, TRACK_TY, TRACK_TZ, TRACK_SX, TRACK_SY, TRACK_SZ};
+
+    for(; j + 4 <= joints; j += 4)
+    {
+        for(int track : linear)
+        {
+            __m128 va = _mm_loadu_ps(&clip.tracks[track][a + j]);
+            __m128 vb = _mm_loadu_ps(&clip.tracks[track][b + j]);
+            _mm_storeu_ps(&pose[track][j], _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), t)));
+        }
+
+        __m128 ra[4], rb[4];
+        for(int c = 0; c < 4; c++)
+        {
+            ra[c] = _mm_loadu_ps(&clip.tracks[TRACK_RX + c][a + j]);
+            rb[c] = _mm_loadu_ps(&clip.tracks[TRACK_RX + c][b + j]);
+        }
+
+        __m128 dot = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(ra[0], rb[0]), _mm_mul_ps(ra[1], rb[1])),
+            _mm_add_ps(_mm_mul_ps(ra[2], rb[2]), _mm_mul_ps(ra[3], rb[3])));
+        __m128 flip = _mm_and_ps(dot, sign);
+
+        __m128 r[4];
+        __m128 length = _mm_setzero_ps();
+        for(int c = 0; c < 4; c++)
+        {
+            __m128 target = _mm_xor_ps(rb[c], flip);
+            r[c]          = _mm_add_ps(ra[c], _mm_mul_ps(_mm_sub_ps(target, ra[c]), t));
+            length        = _mm_add_ps(length, _mm_mul_ps(r[c], r[c]));
+        }
+
+        __m128 inverse = _mm_div_ps(one, _mm_sqrt_ps(length));
+        for(int c = 0; c < 4; c++)
+            _mm_storeu_ps(&pose[TRACK_RX + c][j], _mm_mul_ps(r[c], inverse));
+    }
+#endif
+
+    for(; j < joints; j++)
+    {
+        for(int track : {TRACK_TX, TRACK_TY, TRACK_TZ, TRACK_SX, TRACK_SY, TRACK_SZ})
+        {
+            float va       = clip.tracks[track][a + j];
+            float vb       = clip.tracks[track][b + j];
+            pose[track][j] = va + (vb - va) * alpha;
+        }
+
+        float dot = 0.0f;
+        for(int c = 0; c < 4; c++)
+            dot += clip.tracks[TRACK_RX + c][a + j] * clip.tracks[TRACK_RX + c][b + j];
+
+        float direction = dot < 0.0f ? -1.0f : 1.0f;
+        float r[4];
+        float length = 0.0f;
+        for(int c = 0; c < 4; c++)
+        {
+            float va = clip.tracks[TRACK_RX + c][a + j];
+            float vb = clip.tracks[TRACK_RX + c][b + j] * direction;
+            r[c]     = va + (vb - va) * alpha;
+            length += r[c] * r[c];
+        }
+
+        float inverse = 1.0f / std::sqrt(length);
+        for(int c = 0; c < 4; c++)
+            pose[TRACK_RX + c][j] = r[c] * inverse;
+    }
+}
+
+// One playing clip of a model together with its pose buffers
+struct AnimationInstance
+{
+    const Skeleton*      skeleton = nullptr;
+    const AnimationClip* clip     = nullptr;
+
+    float  time           = 0.0f;
+    float  speed          = 1.0f;
+    size_t palette_offset = 0;
+
+    std::vector<float>     pose[TRACK_COUNT];
+    std::vector<glm::mat4> globals;
+
+    void advance(float delta)
+    {
+        if(clip->duration <= 0.0f)
+            return;
+
+        time = std::fmod(time + delta * speed, clip->duration);
+        if(time < 0.0f)
+            time += clip->duration;
+    }
+
+    void evaluate(glm::mat4* palette)
+    {
+        const size_t joints = skeleton->joints();
+
+        for(auto& track : pose)
+            track.resize(joints);
+        globals.resize(joints);
+
+        float position = time * ANIMATION_SAMPLE_RATE;
+        int   frame0   = std::min(static_cast<int>(position), clip->frames - 1);
+        int   frame1   = std::min(frame0 + 1, clip->frames - 1);
+
+        blendPose(*clip, frame0, frame1, position - frame0, pose);
+
+        // parents precede children, so one pass resolves the hierarchy
+        for(size_t j = 0; j < joints; j++)
+        {
+            glm::mat4 local  = compose(j);
+            int       parent = skeleton->parents[j];
+            globals[j]       = parent < 0 ? local : globals[parent] * local;
+        }
+
+        for(size_t b = 0; b < skeleton->bones(); b++)
+        {
+            int joint = skeleton->bone_joints[b];
+            if(joint < 0)
+            {
+                palette[b] = glm::mat4(1.0f);
+                continue;
+            }
+
+            palette[b] =
+                skeleton->global_inverse * globals[joint] * skeleton->bone_offsets[b];
+        }
+    }
+
+private:
+    glm::mat4 compose(size_t j) const
+    {
+        float x = pose[TRACK_RX][j], y = pose[TRACK_RY][j], z = pose[TRACK_RZ][j];
+        float w = pose[TRACK_RW][j];
+
+        float xx = x * x, yy = y * y, zz = z * z;
+        float xy = x * y, xz = x * z, yz = y * z;
+        float wx = w * x, wy = w * y, wz = w * z;
+
+        float sx = pose[TRACK_SX][j], sy = pose[TRACK_SY][j], sz = pose[TRACK_SZ][j];
+
+        return glm::mat4(
+            glm::vec4(1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy), 0.0f) * sx,
+            glm::vec4(2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx), 0.0f) * sy,
+            glm::vec4(2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy), 0.0f) * sz,
+            glm::vec4(pose[TRACK_TX][j], pose[TRACK_TY][j], pose[TRACK_TZ][j], 1.0f));
+    }
+};
+
+// Evaluates every instance in parallel and packs all bone palettes into one array that
+// is uploaded once per frame.
+struct AnimationSystem
+{
+    std::vector<AnimationInstance> instances;
+    std::vector<glm::mat4>          palettes;
+
+    bool  playing     = true;
+    float speed       = 1.0f;
+    float evaluate_ms = 0.0f;
+
+    // returns the instance index
+    int add(const Skeleton& skeleton, const AnimationClip& clip)
+    {
+        AnimationInstance instance;
+        instance.skeleton = &skeleton;
+        instance.clip     = &clip;
+        instances.push_back(std::move(instance));
+
+        return static_cast<int>(instances.size()) - 1;
+    }
+
+    void update(float delta)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        size_t total = 0;
+        for(auto& instance : instances)
+        {
+            instance.palette_offset = total;
+            total += instance.skeleton->bones();
+        }
+        palettes.resize(total);
+
+        float step = playing ? delta * speed : 0.0f;
+
+        threadPool().parallelFor(instances.size(), 1, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i < end; i++)
+            {
+                instances[i].advance(step);
+                instances[i].evaluate(palettes.data() + instances[i].palette_offset);
+            }
+        });
+
+        auto end    = std::chrono::steady_clock::now();
+        evaluate_ms = std::chrono::duration<float, std::milli>(end - start).count();
+    }
+};
+
+// Buffer texture holding the bone palettes of all skinned models, one mat4 per four
+// RGBA32F texels. Lives on the render thread.
+struct BonePaletteBuffer
+{
+    GLuint buffer   = 0;
+    GLuint texture  = 0;
+    size_t capacity = 0;
+
+    void upload(const std::vector<glm::mat4>& palettes)
+    {
+        if(!buffer)
+        {
+            glGenBuffers(1, &buffer);
+            glGenTextures(1, &texture);
+        }
+
+        size_t size = palettes.size() * sizeof(glm::mat4);
+
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        if(size > capacity)
+        {
+            capacity = size;
+            glBufferData(GL_TEXTURE_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+
+            glBindTexture(GL_TEXTURE_BUFFER, texture);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+        }
+        else
+        {
+            // orphan the previous contents instead of waiting for the GPU
+            glBufferData(GL_TEXTURE_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+        }
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, size, palettes.data());
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void bind()
+    {
+        glActiveTexture(GL_TEXTURE0 + BONE_PALETTE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void release()
+    {
+        glDeleteTextures(1, &texture);
+        glDeleteBuffers(1, &buffer);
+
+        buffer   = 0;
+        texture  = 0;
+        capacity = 0;
+    }
+
+    // Points the palette sampler of a program at its unit right after linking. Left on
+    // unit 0 it would clash with the page samplers even when nothing is skinned.
+    static void setup(GLuint program)
+    {
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "u_bone_palette"), BONE_PALETTE_UNIT);
+    }
+};
@@ -0,0 +1,370 @@
+#pragma once
+
+// lib
+#include <assimp/Importer.hpp>
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// modules
+#include "ClusterStore.hpp"
+#include "Import.hpp"
+#include "Model.hpp"
+
+// Entries imported around the selection: ahead in the direction the list was last
+// stepped through and behind it
+const int BROWSER_AHEAD  = 3;
+const int BROWSER_BEHIND = 1;
+
+// Threads importing entries, every import spreads its own stages over the pool
+const int BROWSER_LOADERS = 2;
+
+// Imported models kept around, estimated from their CPU side arrays and images
+const size_t BROWSER_CACHE_BYTES = size_t(256) << 20;
+
+// Model files of a directory. Entries around the selection are imported speculatively on
+// loader threads, nearest in the scroll direction first, into a cache bounded by
+// BROWSER_CACHE_BYTES. Entries outside the window are evicted farthest first, and a full
+// cache only imports the selection. Imports are deferred: only the CPU side is built in
+// the background, the render thread uploads a model once it is drawn. Queued entries
+// that fall out of the window are never started, imports in flight for them are dropped
+// when they finish.
+struct ModelBrowser
+{
+    struct Entry
+    {
+        std::string path;
+        std::string name;  // file name shown in the list
+
+        // guarded by the mutex
+        std::shared_ptr<Model> model;
+        size_t                 bytes   = 0;
+        bool                   loading = false;
+    };
+
+    std::vector<Entry> entries;
+
+    // models the browser let go of, they may still be on the GPU or in a published frame.
+    // Has to be set before open().
+    std::function<void(Model*)> retire;
+
+    // called by a loader once the selection is imported, if set
+    std::function<void()> imported;
+
+    // Read by the UI
+    std::atomic<size_t> bytes    = 0;  // of all cached models
+    std::atomic<int>    imports  = 0;  // in flight
+    std::atomic<int>    hits     = 0;  // selections that were imported already
+    std::atomic<int>    misses   = 0;
+    std::atomic<int>    canceled = 0;  // imports dropped after leaving the window
+
+    ModelBrowser() = default;
+
+    ModelBrowser(const ModelBrowser&)            = delete;
+    ModelBrowser& operator=(const ModelBrowser&) = delete;
+
+    ~ModelBrowser()
+    {
+        close();
+    }
+
+    // Lists the directory of path and selects it. The selection is imported and uploaded
+    // right away, the calling thread has to own the context.
+    void open(const std::string& path, ImportProfile profile, TangentSource tangents)
+    {
+        this->profile  = profile;
+        this->tangents = tangents;
+
+        std::filesystem::path file   = path;
+        std::filesystem::path folder = file.parent_path();
+        if(folder.empty())
+            folder = ".";
+
+        Assimp::Importer importer;
+        std::error_code  error;
+        for(const auto& item : std::filesystem::directory_iterator(folder, error))
+        {
+            if(!item.is_regular_file(error) || !supported(importer, item.path()))
+                continue;
+
+            Entry entry;
+            entry.path = item.path().string();
+            entry.name = item.path().filename().string();
+            entries.push_back(std::move(entry));
+        }
+
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+            return a.name < b.name;
+        });
+
+        // the model asked for is listed even if the directory can not be read
+        auto named = [&file](const Entry& entry) {
+            return entry.name == file.filename().string();
+        };
+        auto found = std::find_if(entries.begin(), entries.end(), named);
+        if(found == entries.end())
+        {
+            Entry entry;
+            entry.path = path;
+            entry.name = file.filename().string();
+            found      = entries.insert(entries.end(), std::move(entry));
+        }
+        selected = static_cast<int>(found - entries.begin());
+
+        Entry& entry = entries[selected];
+        entry.model  = manage(new Model(entry.path, profile, false, true, tangents));
+        entry.bytes  = estimate(*entry.model);
+        bytes        = entry.bytes;
+
+        running = true;
+        for(int i = 0; i < BROWSER_LOADERS; i++)
+            loaders.emplace_back(&ModelBrowser::run, this);
+
+        logInfo("Browser: %zu models in %s", entries.size(), folder.string());
+    }
+
+    // stops the loaders and lets go of every cached model
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        wake.notify_all();
+
+        for(auto& loader : loaders)
+            loader.join();
+        loaders.clear();
+
+        for(auto& entry : entries)
+            drop(entry);
+    }
+
+    int selection() const
+    {
+        return selected;
+    }
+
+    void select(int index)
+    {
+        if(index < 0 || index >= static_cast<int>(entries.size()))
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(index == selected)
+                return;
+
+            direction = index > selected ? 1 : -1;
+            selected  = index;
+
+            if(entries[index].model)
+                hits++;
+            else
+                misses++;
+
+            evict();
+        }
+        wake.notify_all();
+    }
+
+    // a different profile invalidates every import, including those in flight
+    void reimport(ImportProfile profile)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(profile == this->profile)
+                return;
+
+            this->profile = profile;
+            generation++;
+            for(auto& entry : entries)
+                drop(entry);
+        }
+        wake.notify_all();
+    }
+
+    // model of the selection, nullptr while it is still being imported
+    std::shared_ptr<Model> ready()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries[selected].model;
+    }
+
+    bool cached(int index)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries[index].model != nullptr;
+    }
+
+private:
+    std::vector<std::thread> loaders;
+    std::mutex               mutex;
+    std::condition_variable  wake;
+    bool                     running = false;
+
+    // guarded by the mutex
+    int           selected   = 0;
+    int           direction  = 1;  // of the last step through the list
+    uint64_t      generation = 0;  // bumped whenever cached imports become stale
+    ImportProfile profile    = ImportProfile::DEFAULT;
+    TangentSource tangents   = TangentSource::NATIVE;
+
+    static bool supported(
+        const Assimp::Importer&      importer,
+        const std::filesystem::path& file)
+    {
+        std::string extension = file.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+        return extension == CLUSTER_EXTENSION || importer.IsExtensionSupported(extension);
+    }
+
+    // the last reference goes to retire, GL objects may only be freed by their thread
+    std::shared_ptr<Model> manage(Model* model) const
+    {
+        return std::shared_ptr<Model>(model, [retire = retire](Model* model) {
+            retire(model);
+        });
+    }
+
+    // bytes of the CPU side, uploaded models keep their arrays
+    static size_t estimate(const Model& model)
+    {
+        size_t size = 0;
+        for(const auto& mesh : model.meshes)
+            size += mesh.vertices.size() * sizeof(Vertex) +
+                    mesh.indices.size() * sizeof(unsigned int);
+
+        for(const auto& image : model.materials.images)
+        {
+            if(image.owner != PixelOwner::MAPPED)
+                size += size_t(image.width) * image.height * 4;
+            size += image.mips.pixels.size();
+        }
+
+        if(model.clusters)
+            size += model.clusters->meshlets.size() * sizeof(ClusterMeshlet) +
+                    model.clusters->pages.size() * sizeof(ClusterPage);
+        return size;
+    }
+
+    // steps from the selection, in the scroll direction
+    int offset(int index) const
+    {
+        return (index - selected) * direction;
+    }
+
+    bool window(int index) const
+    {
+        return offset(index) >= -BROWSER_BEHIND && offset(index) <= BROWSER_AHEAD;
+    }
+
+    // the selection, then alternating ahead and behind while both last and there is room
+    int next() const
+    {
+        bool full = bytes >= BROWSER_CACHE_BYTES;
+        int  best = -1;
+        int  rank = 0;
+        for(int i = 0; i < static_cast<int>(entries.size()); i++)
+        {
+            const Entry& entry = entries[i];
+            if(entry.model || entry.loading || !window(i) || (full && i != selected))
+                continue;
+
+            int step    = offset(i);
+            int ordered = step >= 0 ? step * 2 : -step * 2 + 1;
+            if(best < 0 || ordered < rank)
+            {
+                best = i;
+                rank = ordered;
+            }
+        }
+        return best;
+    }
+
+    void drop(Entry& entry)
+    {
+        bytes -= entry.bytes;
+        entry.bytes = 0;
+        entry.model.reset();
+    }
+
+    // entries outside the window, farthest from the selection first
+    void evict()
+    {
+        while(bytes > BROWSER_CACHE_BYTES)
+        {
+            int farthest = -1;
+            for(int i = 0; i < static_cast<int>(entries.size()); i++)
+            {
+                if(!entries[i].model || window(i))
+                    continue;
+
+                if(farthest < 0 || std::abs(i - selected) > std::abs(farthest - selected))
+                    farthest = i;
+            }
+
+            if(farthest < 0)
+                return;
+            drop(entries[farthest]);
+        }
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(running)
+        {
+            int index = next();
+            if(index < 0)
+            {
+                wake.wait(lock);
+                continue;
+            }
+
+            Entry& entry  = entries[index];
+            entry.loading = true;
+            imports++;
+
+            uint64_t      started = generation;
+            ImportProfile import  = profile;
+
+            lock.unlock();
+            Model* loaded = new Model(entry.path, import, false, true, tangents, true);
+            auto   model  = manage(loaded);
+            size_t size   = estimate(*model);
+            lock.lock();
+
+            entry.loading = false;
+            imports--;
+
+            // the selection moved on or the profile changed meanwhile
+            if(started != generation || !window(index))
+            {
+                canceled++;
+                continue;
+            }
+
+            entry.model = std::move(model);
+            entry.bytes = size;
+            bytes += size;
+            evict();
+
+            if(index == selected && imported)
+                imported();
+        }
+    }
+};
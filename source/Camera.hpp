@@ -5,6 +5,8 @@
 #include "glm/gtc/type_ptr.hpp"
 
 const float CAMERA_FOV_FACTOR = 1.0f;
+const float CAMERA_NEAR       = 0.1f;
+const float CAMERA_FAR        = 100.0f;
 
 enum class Direction : char
 {
@@ -27,7 +29,7 @@ struct Camera
     float yaw   = -90.0f;
     float pitch = 0.0f;
 
-    float speed       = 0.5f;
+    float speed       = 5.0f;  // units per second
     float sensitivity = 0.1f;
     float fov         = 45.0f;
 
@@ -62,28 +64,23 @@ struct Camera
         update();
     }
 
-    void move(Direction direction)
+    void move(Direction direction, float delta)
     {
+        float distance = speed * delta;
+
         // clang-format off
         switch(direction)
         {
-            case Direction::FORWARD:    position += front * speed; break;
-            case Direction::BACKWARD:   position -= front * speed; break;
-            case Direction::RIGHT:      position += right * speed; break;
-            case Direction::LEFT:       position -= right * speed; break;
-            case Direction::UPWARD:     position += up * speed; break;
-            case Direction::DOWNWARD:   position -= up * speed; break;
+            case Direction::FORWARD:    position += front * distance; break;
+            case Direction::BACKWARD:   position -= front * distance; break;
+            case Direction::RIGHT:      position += right * distance; break;
+            case Direction::LEFT:       position -= right * distance; break;
+            case Direction::UPWARD:     position += up * distance; break;
+            case Direction::DOWNWARD:   position -= up * distance; break;
         }
         // clang-format on
     }
 
-    glm::mat4 model()
-    {
-        return glm::scale(
-            glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f)),
-            glm::vec3(1.0f, 1.0f, 1.0f));
-    }
-
     glm::mat4 view()
     {
         return glm::lookAt(position, position + front, up);
@@ -91,6 +88,10 @@ struct Camera
 
     glm::mat4 projection(int width, int height)
     {
-        return glm::perspective(glm::radians(fov), (float)width / (float)height, 0.1f, 100.0f);
+        return glm::perspective(
+            glm::radians(fov),
+            (float)width / (float)height,
+            CAMERA_NEAR,
+            CAMERA_FAR);
     }
 };
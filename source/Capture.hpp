@@ -0,0 +1,228 @@
+#pragma once
+
+// std
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// modules
+#include "Frame.hpp"
+#include "Import.hpp"
+
+const uint32_t CAPTURE_MAGIC   = 0x43424c47;  // "GLBC"
+const uint32_t CAPTURE_VERSION = 2;
+
+const char* const CAPTURE_FILE = "capture.glbc";
+
+// Model a capture refers to, reloaded with the same import profile on replay
+struct CaptureModel
+{
+    std::string   path;
+    ImportProfile profile = ImportProfile::DEFAULT;
+};
+
+// Frames recorded as the render thread sees them: camera, matrices, bone palettes and
+// binned lights, with models stored as indices into the capture's model list. ImGui
+// draw data is not recorded, a replay measures the scene alone. Replaying only needs the
+// model files, not the application state that produced the frames.
+struct CaptureWriter
+{
+    std::ofstream file;
+    uint32_t      frames = 0;
+
+    bool begin(const std::string& path, const std::vector<CaptureModel>& models)
+    {
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if(!file)
+            return false;
+
+        frames = 0;
+        write(CAPTURE_MAGIC);
+        write(CAPTURE_VERSION);
+
+        write(uint32_t(models.size()));
+        for(auto& model : models)
+        {
+            writeString(model.path);
+            write(model.profile);
+        }
+
+        // patched with the frame count in finish()
+        count_offset = file.tellp();
+        write(frames);
+        return true;
+    }
+
+    // index maps the frame's model pointers to capture model indices
+    template<typename Index>
+    void add(const Frame& frame, Index&& index)
+    {
+        write(frame.width);
+        write(frame.height);
+        write(frame.clear_color);
+        write(frame.occlusion);
+        write(frame.cone_culling);
+        write(frame.cluster_prefetch);
+        write(frame.lighting);
+        write(frame.ambient);
+        write(frame.camera);
+        write(frame.view);
+        write(frame.projection);
+
+        std::vector<uint32_t> models;
+        for(auto* model : frame.models)
+            models.push_back(index(model));
+
+        writeVector(models);
+        writeVector(frame.mesh_worlds);
+        writeVector(frame.world_offsets);
+        writeVector(frame.bone_palettes);
+        writeVector(frame.bone_offsets);
+
+        writeVector(frame.lights.texels);
+        writeVector(frame.lights.clusters);
+        writeVector(frame.lights.indices);
+        write(frame.lights.count);
+
+        frames++;
+    }
+
+    void finish()
+    {
+        if(!file.is_open())
+            return;
+
+        file.seekp(count_offset);
+        write(frames);
+        file.close();
+    }
+
+private:
+    std::streampos count_offset = 0;
+
+    template<typename T>
+    void write(const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "only plain data is written raw");
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void writeString(const std::string& value)
+    {
+        write(uint32_t(value.size()));
+        file.write(value.data(), value.size());
+    }
+
+    template<typename T>
+    void writeVector(const std::vector<T>& values)
+    {
+        write(uint64_t(values.size()));
+        file.write(
+            reinterpret_cast<const char*>(values.data()),
+            values.size() * sizeof(T));
+    }
+};
+
+// Whole capture in memory, frames point at models loaded by the caller
+struct Capture
+{
+    std::vector<CaptureModel>           models;
+    std::vector<std::unique_ptr<Frame>> frames;
+    std::vector<std::vector<uint32_t>>  frame_models;  // model indices per frame
+
+    bool load(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if(!file)
+            return false;
+
+        uint32_t magic = 0, version = 0, count = 0;
+        if(!read(file, magic) || !read(file, version) || magic != CAPTURE_MAGIC ||
+           version != CAPTURE_VERSION || !read(file, count))
+            return false;
+
+        models.resize(count);
+        for(auto& model : models)
+            if(!readString(file, model.path) || !read(file, model.profile))
+                return false;
+
+        if(!read(file, count))
+            return false;
+
+        for(uint32_t i = 0; i < count; i++)
+        {
+            auto                  frame = std::make_unique<Frame>();
+            std::vector<uint32_t> indices;
+
+            bool valid = read(file, frame->width) && read(file, frame->height) &&
+                         read(file, frame->clear_color) && read(file, frame->occlusion) &&
+                         read(file, frame->cone_culling) &&
+                         read(file, frame->cluster_prefetch) &&
+                         read(file, frame->lighting) && read(file, frame->ambient) &&
+                         read(file, frame->camera) && read(file, frame->view) &&
+                         read(file, frame->projection) && readVector(file, indices) &&
+                         readVector(file, frame->mesh_worlds) &&
+                         readVector(file, frame->world_offsets) &&
+                         readVector(file, frame->bone_palettes) &&
+                         readVector(file, frame->bone_offsets) &&
+                         readVector(file, frame->lights.texels) &&
+                         readVector(file, frame->lights.clusters) &&
+                         readVector(file, frame->lights.indices) &&
+                         read(file, frame->lights.count);
+
+            for(uint32_t index : indices)
+                valid = valid && index < models.size();
+
+            if(!valid)
+                return false;
+
+            frame->sequence = i;
+            frames.push_back(std::move(frame));
+            frame_models.push_back(std::move(indices));
+        }
+
+        return true;
+    }
+
+    // resolves the model indices of every frame, loaded has one entry per capture model
+    void bind(const std::vector<Model*>& loaded)
+    {
+        for(size_t i = 0; i < frames.size(); i++)
+        {
+            frames[i]->models.clear();
+            for(uint32_t index : frame_models[i])
+                frames[i]->models.push_back(loaded[index]);
+        }
+    }
+
+private:
+    template<typename T>
+    static bool read(std::ifstream& file, T& value)
+    {
+        return bool(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+    }
+
+    static bool readString(std::ifstream& file, std::string& value)
+    {
+        uint32_t size = 0;
+        if(!read(file, size) || size > (1u << 16))
+            return false;
+
+        value.resize(size);
+        return bool(file.read(&value[0], size));
+    }
+
+    template<typename T>
+    static bool readVector(std::ifstream& file, std::vector<T>& values)
+    {
+        uint64_t size = 0;
+        if(!read(file, size) || size > (uint64_t(1) << 32) / sizeof(T))
+            return false;
+
+        values.resize(size);
+        return bool(file.read(reinterpret_cast<char*>(values.data()), size * sizeof(T)));
+    }
+};
@@ -0,0 +1,856 @@
+#pragma once
+
+// Glad
+#include "glad/gl.h"
+
+// lib
+#include <glm/glm.hpp>
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+// modules
+#include "MappedFile.hpp"
+#include "Material.hpp"
+#include "Meshlet.hpp"
+#include "ThreadPool.hpp"
+
+const uint32_t CLUSTER_MAGIC   = 0x53434c47;  // "GLCS"
+const uint32_t CLUSTER_VERSION = 1;
+
+const char* const CLUSTER_EXTENSION = ".clusters";
+
+// Meshlets per page, the unit that is read from disk and uploaded at once
+const int CLUSTER_PAGE_MESHLETS = 32;
+const int CLUSTER_PAGE_VERTICES = CLUSTER_PAGE_MESHLETS * MESHLET_MAX_VERTICES;
+const int CLUSTER_PAGE_INDICES  = CLUSTER_PAGE_MESHLETS * MESHLET_MAX_TRIANGLES * 3;
+
+// Pages start at multiples of the file system block size
+const size_t CLUSTER_PAGE_ALIGNMENT = 4096;
+
+// GPU page slots, about 88 KB each
+const int CLUSTER_RESIDENT_PAGES = 1024;
+
+// Page reads in flight on the thread pool and pages uploaded per frame
+const int CLUSTER_MAX_LOADS   = 16;
+const int CLUSTER_MAX_UPLOADS = 16;
+
+// Meshlets culled per task
+const size_t CLUSTER_CULL_GRAIN = 4096;
+
+// Distance in world units pages are streamed in around the camera outside the frustum
+const float CLUSTER_PREFETCH_DISTANCE = 10.0f;
+
+// Vertex of a page, the attributes the model shader reads
+struct ClusterVertex
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 tex_coords;
+};
+
+// Bounds of a meshlet and its 16 bit triangle indices in its page
+struct ClusterMeshlet
+{
+    glm::vec3 center;
+    float     radius;
+    glm::vec3 cone_axis;
+    float     cone_cutoff;
+    uint32_t  page;
+    uint32_t  index_offset;
+    uint32_t  index_count;
+    uint32_t  padding;
+};
+
+// Vertices of the page's meshlets followed by their indices, page local
+struct ClusterPage
+{
+    uint64_t offset;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    int32_t  material;
+    uint32_t padding;
+};
+
+struct ClusterHeader
+{
+    uint32_t  magic           = CLUSTER_MAGIC;
+    uint32_t  version         = CLUSTER_VERSION;
+    uint32_t  meshlet_count   = 0;
+    uint32_t  page_count      = 0;
+    uint32_t  material_count  = 0;
+    uint32_t  padding         = 0;
+    uint64_t  meshlet_offset  = 0;
+    uint64_t  page_offset     = 0;
+    uint64_t  material_offset = 0;
+    uint64_t  vertices        = 0;
+    uint64_t  triangles       = 0;
+    glm::vec3 bounds_min      = glm::vec3(0.0f);
+    glm::vec3 bounds_max      = glm::vec3(0.0f);
+};
+
+// Writes a cluster store: pages of meshlets in the order meshes are added, then the
+// meshlet and page tables and the materials with the paths of their maps. Only the
+// tables stay in memory, every mesh is written out as soon as it is clustered.
+struct ClusterWriter
+{
+    std::ofstream file;
+    ClusterHeader header;
+
+    bool begin(const std::string& path)
+    {
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if(!file)
+            return false;
+
+        header            = ClusterHeader();
+        header.bounds_min = glm::vec3(FLT_MAX);
+        header.bounds_max = glm::vec3(-FLT_MAX);
+        meshlets.clear();
+        pages.clear();
+        materials.clear();
+
+        write(header);
+        return true;
+    }
+
+    // maps of data are ignored, paths are empty for unused maps
+    void addMaterial(const MaterialData& data, const std::string (&maps)[4])
+    {
+        MaterialData plain = data;
+        plain.maps         = glm::ivec4(-1);
+
+        materials.append(reinterpret_cast<const char*>(&plain), sizeof(plain));
+        for(int map = 0; map < 4; map++)
+        {
+            uint32_t size = static_cast<uint32_t>(maps[map].size());
+            materials.append(reinterpret_cast<const char*>(&size), sizeof(size));
+            materials.append(maps[map]);
+        }
+        header.material_count++;
+    }
+
+    void addMesh(
+        const std::vector<ClusterVertex>& vertices,
+        const std::vector<uint32_t>&      indices,
+        int                               material)
+    {
+        std::vector<glm::vec3> positions(vertices.size());
+        for(size_t i = 0; i < vertices.size(); i++)
+        {
+            positions[i]      = vertices[i].position;
+            header.bounds_min = glm::min(header.bounds_min, positions[i]);
+            header.bounds_max = glm::max(header.bounds_max, positions[i]);
+        }
+
+        std::vector<Meshlet> built;
+        MeshletBuilder::build(positions, indices, built);
+
+        for(size_t first = 0; first < built.size(); first += CLUSTER_PAGE_MESHLETS)
+        {
+            size_t count = std::min<size_t>(built.size() - first, CLUSTER_PAGE_MESHLETS);
+            writePage(vertices, &built[first], count, material);
+        }
+
+        header.vertices += vertices.size();
+        header.triangles += indices.size() / 3;
+    }
+
+    bool finish()
+    {
+        align(sizeof(uint64_t));
+        header.meshlet_offset = static_cast<uint64_t>(file.tellp());
+        header.meshlet_count  = static_cast<uint32_t>(meshlets.size());
+        file.write(
+            reinterpret_cast<const char*>(meshlets.data()),
+            meshlets.size() * sizeof(ClusterMeshlet));
+
+        header.page_offset = static_cast<uint64_t>(file.tellp());
+        header.page_count  = static_cast<uint32_t>(pages.size());
+        file.write(
+            reinterpret_cast<const char*>(pages.data()),
+            pages.size() * sizeof(ClusterPage));
+
+        header.material_offset = static_cast<uint64_t>(file.tellp());
+        file.write(materials.data(), materials.size());
+
+        if(header.vertices == 0)
+            header.bounds_min = header.bounds_max = glm::vec3(0.0f);
+
+        file.seekp(0);
+        write(header);
+        file.close();
+
+        return !file.fail();
+    }
+
+private:
+    std::vector<ClusterMeshlet> meshlets;
+    std::vector<ClusterPage>    pages;
+    std::string                 materials;
+
+    template<typename T>
+    void write(const T& value)
+    {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void align(size_t alignment)
+    {
+        size_t position = static_cast<size_t>(file.tellp());
+        size_t padding  = (alignment - position % alignment) % alignment;
+        for(size_t i = 0; i < padding; i++)
+            file.put(0);
+    }
+
+    // meshlets keep their own copy of shared vertices, pages never refer to each other
+    void writePage(
+        const std::vector<ClusterVertex>& source,
+        const Meshlet*                    built,
+        size_t                            count,
+        int                               material)
+    {
+        std::vector<ClusterVertex> vertices;
+        std::vector<uint16_t>      indices;
+
+        for(size_t i = 0; i < count; i++)
+        {
+            const Meshlet& meshlet = built[i];
+
+            ClusterMeshlet record;
+            record.center       = meshlet.center;
+            record.radius       = meshlet.radius;
+            record.cone_axis    = meshlet.cone_axis;
+            record.cone_cutoff  = meshlet.cone_cutoff;
+            record.page         = static_cast<uint32_t>(pages.size());
+            record.index_offset = static_cast<uint32_t>(indices.size());
+            record.index_count  = static_cast<uint32_t>(meshlet.triangles.size());
+            record.padding      = 0;
+            meshlets.push_back(record);
+
+            size_t base = vertices.size();
+            for(uint32_t vertex : meshlet.vertices)
+                vertices.push_back(source[vertex]);
+            for(uint8_t corner : meshlet.triangles)
+                indices.push_back(static_cast<uint16_t>(base + corner));
+        }
+
+        align(CLUSTER_PAGE_ALIGNMENT);
+
+        ClusterPage page;
+        page.offset       = static_cast<uint64_t>(file.tellp());
+        page.vertex_count = static_cast<uint32_t>(vertices.size());
+        page.index_count  = static_cast<uint32_t>(indices.size());
+        page.material     = material;
+        page.padding      = 0;
+        pages.push_back(page);
+
+        file.write(
+            reinterpret_cast<const char*>(vertices.data()),
+            vertices.size() * sizeof(ClusterVertex));
+        file.write(
+            reinterpret_cast<const char*>(indices.data()),
+            indices.size() * sizeof(uint16_t));
+    }
+};
+
+// Where and how a cluster store is drawn
+struct ClusterView
+{
+    glm::mat4 world           = glm::mat4(1.0f);
+    glm::mat4 view_projection = glm::mat4(1.0f);
+    glm::vec3 camera          = glm::vec3(0.0f);  // world space
+    bool      cone_culling    = true;
+    float     prefetch        = CLUSTER_PREFETCH_DISTANCE;
+};
+
+// Out-of-core geometry of a cluster store. The meshlet and page tables stay in memory,
+// the pages themselves stay in the memory mapped file until a meshlet on them is near
+// the camera and not facing away. Pages are then copied out of the mapping on the thread
+// pool, so page faults never stall the render thread, and uploaded into a fixed set of
+// GPU slots that evicts the least recently drawn pages first.
+//
+// Every frame the meshlets are culled against the frustum and their normal cones in
+// parallel. Visible meshlets of resident pages are sorted by material and drawn with
+// one glMultiDrawElementsBaseVertex per material, missing pages are requested nearest
+// first. Culling runs in model space, which assumes worlds without shear or non-uniform
+// scale.
+struct ClusterStore
+{
+    ClusterHeader               header;
+    std::vector<ClusterMeshlet> meshlets;
+    std::vector<ClusterPage>    pages;
+
+    // Read by the UI
+    std::atomic<int>  drawn          = 0;
+    std::atomic<int>  frustum_culled = 0;
+    std::atomic<int>  cone_culled    = 0;
+    std::atomic<int>  resident       = 0;
+    std::atomic<int>  loading        = 0;
+    std::atomic<bool> waiting        = false;  // wanted pages are still on their way
+
+    ClusterStore() = default;
+
+    ClusterStore(const ClusterStore&)            = delete;
+    ClusterStore& operator=(const ClusterStore&) = delete;
+
+    ~ClusterStore()
+    {
+        // page reads refer to the mapping
+        while(in_flight > 0)
+            std::this_thread::yield();
+    }
+
+    // reads the tables and adds the materials to the library
+    bool open(const std::string& path, MaterialLibrary& library, bool textures)
+    {
+        if(!file.open(path) || file.size < sizeof(ClusterHeader))
+            return false;
+
+        file.random();
+        std::memcpy(&header, file.data, sizeof(ClusterHeader));
+        if(header.magic != CLUSTER_MAGIC || header.version != CLUSTER_VERSION)
+            return false;
+
+        size_t meshlet_bytes = size_t(header.meshlet_count) * sizeof(ClusterMeshlet);
+        size_t page_bytes    = size_t(header.page_count) * sizeof(ClusterPage);
+        if(header.meshlet_offset + meshlet_bytes > file.size ||
+           header.page_offset + page_bytes > file.size ||
+           header.material_offset > file.size)
+            return false;
+
+        meshlets.resize(header.meshlet_count);
+        pages.resize(header.page_count);
+        std::memcpy(meshlets.data(), file.data + header.meshlet_offset, meshlet_bytes);
+        std::memcpy(pages.data(), file.data + header.page_offset, page_bytes);
+
+        for(auto& page : pages)
+        {
+            uint64_t size = pageSize(page);
+            if(page.vertex_count > CLUSTER_PAGE_VERTICES ||
+               page.index_count > CLUSTER_PAGE_INDICES || page.offset + size > file.size)
+                return false;
+        }
+
+        for(auto& meshlet : meshlets)
+        {
+            if(meshlet.page >= pages.size())
+                return false;
+
+            uint32_t end = meshlet.index_offset + meshlet.index_count;
+            if(end < meshlet.index_offset || end > pages[meshlet.page].index_count)
+                return false;
+        }
+
+        // material indices in pages are store local
+        std::vector<int> materials;
+        const char*      cursor = file.data + header.material_offset;
+        const char*      end    = file.data + file.size;
+        for(uint32_t i = 0; i < header.material_count; i++)
+        {
+            MaterialData data;
+            std::string  maps[4];
+            if(!read(cursor, end, &data, sizeof(data)))
+                return false;
+
+            for(int map = 0; map < 4; map++)
+            {
+                uint32_t size = 0;
+                if(!read(cursor, end, &size, sizeof(size)) || size_t(end - cursor) < size)
+                    return false;
+
+                maps[map].assign(cursor, size);
+                cursor += size;
+            }
+            materials.push_back(library.add(data, maps, textures));
+        }
+
+        // pages without a known material use the default one
+        int fallback = -1;
+        for(auto& page : pages)
+        {
+            if(page.material >= 0 && page.material < int(materials.size()))
+                page.material = materials[page.material];
+            else
+            {
+                if(fallback < 0)
+                    fallback = library.add(MaterialData());
+                page.material = fallback;
+            }
+        }
+
+        states.assign(pages.size(), PageState());
+        slots.assign(CLUSTER_RESIDENT_PAGES, -1);
+        return true;
+    }
+
+    // culls, streams and draws, material(index) is called before the meshlets of every
+    // material are drawn. Needs the GL context.
+    template<typename F>
+    void draw(const ClusterView& view, F&& material)
+    {
+        if(!vao)
+            setup();
+
+        frame++;
+        upload();
+        cull(view);
+        request();
+
+        glBindVertexArray(vao);
+        for(size_t first = 0; first < items.size();)
+        {
+            size_t last = first;
+            while(last < items.size() && items[last].material == items[first].material)
+                last++;
+
+            counts.clear();
+            offsets.clear();
+            bases.clear();
+
+            size_t end = 0;  // of the last range in bytes
+            for(size_t i = first; i < last; i++)
+            {
+                const DrawItem& item   = items[i];
+                size_t          offset = size_t(item.slot) * CLUSTER_PAGE_INDICES;
+                GLint           base   = item.slot * CLUSTER_PAGE_VERTICES;
+                offset                 = (offset + item.index_offset) * sizeof(uint16_t);
+
+                // consecutive meshlets of a page are one range
+                if(!counts.empty() && bases.back() == base && end == offset)
+                    counts.back() += item.index_count;
+                else
+                {
+                    counts.push_back(item.index_count);
+                    offsets.push_back((void*)offset);
+                    bases.push_back(base);
+                }
+                end = offset + item.index_count * sizeof(uint16_t);
+            }
+
+            material(items[first].material);
+            glMultiDrawElementsBaseVertex(
+                GL_TRIANGLES,
+                counts.data(),
+                GL_UNSIGNED_SHORT,
+                offsets.data(),
+                static_cast<GLsizei>(counts.size()),
+                bases.data());
+
+            first = last;
+        }
+        glBindVertexArray(0);
+    }
+
+    // deletes the GPU slots once the store is no longer drawn, needs the context
+    void release()
+    {
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &vbo);
+        glDeleteBuffers(1, &ebo);
+        vao = vbo = ebo = 0;
+    }
+
+private:
+    struct PageState
+    {
+        int      slot    = -1;
+        bool     loading = false;
+        uint64_t visible = 0;  // last frame a meshlet of the page was in view
+        uint64_t wanted  = 0;  // last frame the page was in view or near
+        float    distance = 0.0f;
+    };
+
+    struct LoadedPage
+    {
+        uint32_t          page = 0;
+        std::vector<char> data;
+    };
+
+    struct DrawItem
+    {
+        int      material;
+        int      slot;
+        uint32_t index_offset;
+        GLsizei  index_count;
+    };
+
+    // meshlets a culling task found, as indices
+    struct CullResult
+    {
+        std::vector<uint32_t> visible;
+        std::vector<uint32_t> near;  // outside the frustum but within prefetch distance
+        int                   frustum = 0;
+        int                   cone    = 0;
+    };
+
+    MappedFile             file;
+    std::vector<PageState> states;
+    std::vector<int>       slots;  // page held by every GPU slot, -1 if free
+    uint64_t               frame = 1;  // the first draw sees nothing as in view
+
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint ebo = 0;
+
+    // pages read by the thread pool and waiting for their upload
+    std::mutex              mutex;
+    std::vector<LoadedPage> loaded;
+    std::atomic<int>        in_flight = 0;
+
+    std::vector<CullResult> results;
+    std::vector<uint32_t>   requests;
+    std::vector<DrawItem>   items;
+    std::vector<GLsizei>    counts;
+    std::vector<void*>      offsets;
+    std::vector<GLint>      bases;
+
+    static uint64_t pageSize(const ClusterPage& page)
+    {
+        return uint64_t(page.vertex_count) * sizeof(ClusterVertex) +
+               uint64_t(page.index_count) * sizeof(uint16_t);
+    }
+
+    static bool read(const char*& cursor, const char* end, void* out, size_t size)
+    {
+        if(size_t(end - cursor) < size)
+            return false;
+
+        std::memcpy(out, cursor, size);
+        cursor += size;
+        return true;
+    }
+
+    void setup()
+    {
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &ebo);
+
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        GLsizeiptr slots = CLUSTER_RESIDENT_PAGES;
+        glBufferData(
+            GL_ARRAY_BUFFER,
+            slots * CLUSTER_PAGE_VERTICES * sizeof(ClusterVertex),
+            nullptr,
+            GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(
+            GL_ELEMENT_ARRAY_BUFFER,
+            slots * CLUSTER_PAGE_INDICES * sizeof(uint16_t),
+            nullptr,
+            GL_STATIC_DRAW);
+
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(ClusterVertex), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(
+            1,
+            3,
+            GL_FLOAT,
+            GL_FALSE,
+            sizeof(ClusterVertex),
+            (void*)offsetof(ClusterVertex, normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(
+            2,
+            2,
+            GL_FLOAT,
+            GL_FALSE,
+            sizeof(ClusterVertex),
+            (void*)offsetof(ClusterVertex, tex_coords));
+        glBindVertexArray(0);
+    }
+
+    // Copies pages read since the last frame into GPU slots. A page that was in view
+    // may replace any page that was not, a prefetched one only pages nobody wants.
+    void upload()
+    {
+        std::vector<LoadedPage> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            size_t count = std::min<size_t>(loaded.size(), CLUSTER_MAX_UPLOADS);
+            ready.assign(
+                std::make_move_iterator(loaded.begin()),
+                std::make_move_iterator(loaded.begin() + count));
+            loaded.erase(loaded.begin(), loaded.begin() + count);
+        }
+
+        uint64_t last = frame - 1;
+        glBindVertexArray(vao);
+
+        for(auto& page : ready)
+        {
+            PageState& state = states[page.page];
+            state.loading    = false;
+
+            // pages with broken indices would read other slots
+            const ClusterPage& info    = pages[page.page];
+            const char*        source  = page.data.data();
+            const uint16_t*    indices = reinterpret_cast<const uint16_t*>(
+                source + size_t(info.vertex_count) * sizeof(ClusterVertex));
+            if(page.data.empty() ||
+               std::any_of(indices, indices + info.index_count, [&](uint16_t index) {
+                   return index >= info.vertex_count;
+               }))
+                continue;
+
+            int slot = acquire(state.visible == last, last);
+            if(slot < 0)
+                continue;
+
+            if(slots[slot] >= 0)
+                states[slots[slot]].slot = -1;
+            slots[slot] = static_cast<int>(page.page);
+            state.slot  = slot;
+
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+            glBufferSubData(
+                GL_ARRAY_BUFFER,
+                GLintptr(slot) * CLUSTER_PAGE_VERTICES * sizeof(ClusterVertex),
+                GLsizeiptr(info.vertex_count) * sizeof(ClusterVertex),
+                source);
+            glBufferSubData(
+                GL_ELEMENT_ARRAY_BUFFER,
+                GLintptr(slot) * CLUSTER_PAGE_INDICES * sizeof(uint16_t),
+                GLsizeiptr(info.index_count) * sizeof(uint16_t),
+                indices);
+        }
+
+        glBindVertexArray(0);
+    }
+
+    // free slot or the one whose page was out of view the longest, -1 if none may go
+    int acquire(bool visible, uint64_t last) const
+    {
+        int                        best = -1;
+        std::tuple<bool, uint64_t> best_key;
+
+        for(int slot = 0; slot < CLUSTER_RESIDENT_PAGES; slot++)
+        {
+            if(slots[slot] < 0)
+                return slot;
+
+            const PageState& state = states[slots[slot]];
+            if(state.visible >= last || (!visible && state.wanted >= last))
+                continue;
+
+            auto key = std::make_tuple(state.wanted >= last, state.visible);
+            if(best < 0 || key < best_key)
+            {
+                best     = slot;
+                best_key = key;
+            }
+        }
+        return best;
+    }
+
+    void cull(const ClusterView& view)
+    {
+        // frustum planes and camera in model space
+        glm::mat4 matrix = view.view_projection * view.world;
+        glm::vec4 rows[4];
+        for(int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(matrix[0][i], matrix[1][i], matrix[2][i], matrix[3][i]);
+
+        glm::vec4 planes[6] = {
+            rows[3] + rows[0],
+            rows[3] - rows[0],
+            rows[3] + rows[1],
+            rows[3] - rows[1],
+            rows[3] + rows[2],
+            rows[3] - rows[2]};
+        for(auto& plane : planes)
+            plane = plane / glm::length(glm::vec3(plane));
+
+        glm::vec4 local  = glm::inverse(view.world) * glm::vec4(view.camera, 1.0f);
+        glm::vec3 camera = glm::vec3(local);
+
+        // prefetch distance in model units
+        float scale = 1e-6f;
+        for(int axis = 0; axis < 3; axis++)
+            scale = std::max(scale, glm::length(glm::vec3(view.world[axis])));
+        float prefetch = view.prefetch / scale;
+
+        size_t chunks = (meshlets.size() + CLUSTER_CULL_GRAIN - 1) / CLUSTER_CULL_GRAIN;
+        results.resize(chunks);
+
+        auto task = [&](size_t begin, size_t end) {
+            CullResult& result = results[begin / CLUSTER_CULL_GRAIN];
+            result.visible.clear();
+            result.near.clear();
+            result.frustum = 0;
+            result.cone    = 0;
+
+            for(size_t i = begin; i < end; i++)
+            {
+                const ClusterMeshlet& meshlet = meshlets[i];
+
+                if(view.cone_culling &&
+                   Meshlet::backfacing(
+                       meshlet.center,
+                       meshlet.radius,
+                       meshlet.cone_axis,
+                       meshlet.cone_cutoff,
+                       camera))
+                {
+                    result.cone++;
+                    continue;
+                }
+
+                bool inside = true;
+                for(auto& plane : planes)
+                {
+                    float distance = glm::dot(glm::vec3(plane), meshlet.center) + plane.w;
+                    inside         = inside && distance >= -meshlet.radius;
+                }
+
+                if(inside)
+                    result.visible.push_back(static_cast<uint32_t>(i));
+                else
+                {
+                    result.frustum++;
+                    float distance = glm::length(meshlet.center - camera);
+                    if(distance - meshlet.radius < prefetch)
+                        result.near.push_back(static_cast<uint32_t>(i));
+                }
+            }
+        };
+        threadPool().parallelFor(meshlets.size(), CLUSTER_CULL_GRAIN, task);
+
+        // visible meshlets of resident pages are drawn, every other wanted page is
+        // requested with its nearest meshlet's distance
+        items.clear();
+        requests.clear();
+
+        int frustum = 0, cone = 0;
+        for(auto& result : results)
+        {
+            frustum += result.frustum;
+            cone += result.cone;
+
+            for(uint32_t index : result.visible)
+            {
+                const ClusterMeshlet& meshlet = meshlets[index];
+                PageState&            state   = states[meshlet.page];
+                want(meshlet, state, camera);
+                state.visible = frame;
+
+                if(state.slot >= 0)
+                    items.push_back(
+                        {pages[meshlet.page].material,
+                         state.slot,
+                         meshlet.index_offset,
+                         static_cast<GLsizei>(meshlet.index_count)});
+            }
+
+            for(uint32_t index : result.near)
+                want(meshlets[index], states[meshlets[index].page], camera);
+        }
+
+        std::sort(items.begin(), items.end(), [](const DrawItem& a, const DrawItem& b) {
+            return std::tie(a.material, a.slot, a.index_offset) <
+                   std::tie(b.material, b.slot, b.index_offset);
+        });
+
+        drawn          = static_cast<int>(items.size());
+        frustum_culled = frustum;
+        cone_culled    = cone;
+    }
+
+    void want(const ClusterMeshlet& meshlet, PageState& state, const glm::vec3& camera)
+    {
+        float distance = glm::length(meshlet.center - camera) - meshlet.radius;
+
+        if(state.wanted != frame)
+        {
+            state.wanted   = frame;
+            state.distance = distance;
+
+            if(state.slot < 0 && !state.loading)
+                requests.push_back(meshlet.page);
+        }
+        else
+            state.distance = std::min(state.distance, distance);
+    }
+
+    // Reads the nearest missing pages on the thread pool, pages in view first. Only as
+    // many as slots could take this frame, otherwise they would be read and dropped.
+    void request()
+    {
+        std::sort(requests.begin(), requests.end(), [this](uint32_t a, uint32_t b) {
+            const PageState& first  = states[a];
+            const PageState& second = states[b];
+            return std::make_tuple(first.visible != frame, first.distance) <
+                   std::make_tuple(second.visible != frame, second.distance);
+        });
+
+        int for_visible = 0, for_near = 0, used = 0;
+        for(int slot = 0; slot < CLUSTER_RESIDENT_PAGES; slot++)
+        {
+            int page = slots[slot];
+            if(page >= 0)
+                used++;
+            if(page < 0 || states[page].visible != frame)
+                for_visible++;
+            if(page < 0 || states[page].wanted != frame)
+                for_near++;
+        }
+
+        int pending = in_flight;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending += static_cast<int>(loaded.size());
+        }
+
+        int issued = 0;
+        for(uint32_t page : requests)
+        {
+            PageState& state     = states[page];
+            int        available = state.visible == frame ? for_visible : for_near;
+            if(pending + issued >= available)
+                continue;
+            if(in_flight >= CLUSTER_MAX_LOADS)
+                break;
+
+            state.loading = true;
+            in_flight++;
+            issued++;
+
+            threadPool().submit([this, page]() {
+                const ClusterPage& info   = pages[page];
+                const char*        source = file.data + info.offset;
+
+                LoadedPage result;
+                result.page = page;
+                result.data.assign(source, source + pageSize(info));
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    loaded.push_back(std::move(result));
+                }
+                in_flight--;
+            });
+        }
+
+        // pages that are neither resident nor on their way yet
+        bool behind = false;
+        for(uint32_t page : requests)
+            behind = behind || !states[page].loading;
+
+        resident = used;
+        loading  = pending + issued;
+        waiting  = loading > 0 || (behind && in_flight >= CLUSTER_MAX_LOADS);
+    }
+};
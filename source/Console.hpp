@@ -0,0 +1,146 @@
+#pragma once
+
+// imgui
+#include "imgui.h"
+
+// std
+#include <cfloat>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// modules
+#include "Log.hpp"
+
+// Colors of the level names, debug and info use the default text color
+const ImVec4 CONSOLE_WARNING = ImVec4(1.0f, 0.8f, 0.3f, 1.0f);
+const ImVec4 CONSOLE_ERROR   = ImVec4(1.0f, 0.4f, 0.4f, 1.0f);
+
+// Console panel over the logger's history. New lines are pulled once per frame and the
+// lines passing the level and text filters are indexed as they arrive, so a frame only
+// touches the rows in view no matter how many lines there are.
+struct Console
+{
+    std::deque<LogLine>  lines;    // at most LOG_HISTORY, oldest first
+    std::deque<uint64_t> visible;  // sequence numbers of the lines passing the filters
+
+    ImGuiTextFilter filter;
+    bool            levels[LOG_LEVEL_COUNT] = {true, true, true, true};
+    bool            follow                  = true;  // keep the newest line in view
+
+    void draw()
+    {
+        update();
+
+        ImGui::Begin("Console");
+        {
+            bool changed = false;
+            for(int level = 0; level < LOG_LEVEL_COUNT; level++)
+            {
+                changed |= ImGui::Checkbox(LOG_LEVEL_NAMES[level], &levels[level]);
+                ImGui::SameLine();
+            }
+            ImGui::Checkbox("Follow", &follow);
+            ImGui::SameLine();
+            if(ImGui::Button("Clear"))
+            {
+                lines.clear();
+                visible.clear();
+            }
+
+            changed |= filter.Draw("Filter", -FLT_MIN);
+            if(changed)
+                refilter();
+
+            ImGui::Text(
+                "%zu of %zu lines, %llu dropped",
+                visible.size(),
+                lines.size(),
+                (unsigned long long)logger().dropped());
+
+            ImGui::BeginChild(
+                "##log", ImVec2(0, 0), 0, ImGuiWindowFlags_HorizontalScrollbar);
+            {
+                bool bottom = ImGui::GetScrollY() >= ImGui::GetScrollMaxY();
+
+                ImGuiListClipper clipper;
+                clipper.Begin(static_cast<int>(visible.size()));
+                while(clipper.Step())
+                    for(int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++)
+                        drawLine(line(visible[row]));
+                clipper.End();
+
+                if(follow && bottom)
+                    ImGui::SetScrollHereY(1.0f);
+            }
+            ImGui::EndChild();
+        }
+        ImGui::End();
+    }
+
+    // lines arrived since the last draw, the panel needs a redraw to show them
+    bool pending() const
+    {
+        return logger().written() != next;
+    }
+
+private:
+    uint64_t             next = 0;  // first sequence number not pulled yet
+    std::vector<LogLine> pulled;
+
+    const LogLine& line(uint64_t sequence) const
+    {
+        return lines[sequence - lines.front().sequence];
+    }
+
+    bool passes(const LogLine& line) const
+    {
+        return levels[line.level] &&
+               filter.PassFilter(line.text.data(), line.text.data() + line.text.size());
+    }
+
+    void update()
+    {
+        pulled.clear();
+        logger().history(next, pulled);
+
+        for(auto& line : pulled)
+        {
+            if(passes(line))
+                visible.push_back(line.sequence);
+            lines.push_back(std::move(line));
+        }
+
+        while(lines.size() > LOG_HISTORY)
+        {
+            if(!visible.empty() && visible.front() == lines.front().sequence)
+                visible.pop_front();
+            lines.pop_front();
+        }
+    }
+
+    void refilter()
+    {
+        visible.clear();
+        for(auto& line : lines)
+            if(passes(line))
+                visible.push_back(line.sequence);
+    }
+
+    static void drawLine(const LogLine& line)
+    {
+        ImGui::Text("%10.3f", line.time);
+        ImGui::SameLine();
+
+        if(line.level >= LOG_WARNING)
+            ImGui::PushStyleColor(
+                ImGuiCol_Text,
+                line.level == LOG_ERROR ? CONSOLE_ERROR : CONSOLE_WARNING);
+        ImGui::TextUnformatted(LOG_LEVEL_NAMES[line.level]);
+        if(line.level >= LOG_WARNING)
+            ImGui::PopStyleColor();
+
+        ImGui::SameLine();
+        ImGui::TextUnformatted(line.text.data(), line.text.data() + line.text.size());
+    }
+};
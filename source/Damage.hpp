@@ -0,0 +1,45 @@
+#pragma once
+
+// SDL
+#include "SDL3/SDL.h"
+
+// std
+#include <atomic>
+
+// Frames rendered after the last change, covers ImGui hover and fade animations
+const int DAMAGE_TRAILING_FRAMES = 3;
+
+// Upper bound for sleeping in the event queue while nothing changes
+const Sint32 DAMAGE_IDLE_TIMEOUT_MS = 500;
+
+// Tracks whether anything visible changed since the last rendered frame. The main loop
+// only renders while the damage is dirty and otherwise sleeps in the SDL event queue.
+struct Damage
+{
+    int              frames  = DAMAGE_TRAILING_FRAMES;
+    std::atomic<int> pending = 0;  // async work that changes the scene once it finishes
+
+    void mark()
+    {
+        frames = DAMAGE_TRAILING_FRAMES;
+    }
+
+    bool dirty() const
+    {
+        return frames > 0 || pending > 0;
+    }
+
+    void rendered()
+    {
+        if(frames > 0)
+            frames--;
+    }
+
+    // Called from worker threads, pushes an event so the main loop wakes up
+    static void wake()
+    {
+        SDL_Event event = {};
+        event.type      = SDL_EVENT_USER;
+        SDL_PushEvent(&event);
+    }
+};
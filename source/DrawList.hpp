@@ -0,0 +1,203 @@
+#pragma once
+
+// lib
+#include <glm/glm.hpp>
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// modules
+#include "Camera.hpp"
+#include "Frame.hpp"
+#include "Model.hpp"
+#include "Shader.hpp"
+#include "ThreadPool.hpp"
+
+// Meshes per job, every job tests and sorts a range of its own
+const size_t DRAW_LIST_GRAIN = 1024;
+
+// Sort key fields from the most significant bits down: model, shader features, material
+// and view depth. Every model is bound once, variants and materials switch as rarely as
+// possible and meshes sharing all of them are drawn front to back.
+const int DRAW_KEY_DEPTH_BITS    = 24;
+const int DRAW_KEY_MATERIAL_BITS = 19;
+const int DRAW_KEY_FEATURE_BITS  = SHADER_FEATURE_COUNT;
+const int DRAW_KEY_MODEL_BITS =
+    64 - DRAW_KEY_DEPTH_BITS - DRAW_KEY_MATERIAL_BITS - DRAW_KEY_FEATURE_BITS;
+
+// Builds the draw list of a frame on the thread pool: the meshes of all models are split
+// into ranges that are frustum culled and sorted in parallel, then the sorted ranges are
+// merged pairwise, one parallel pass per level. The render thread only walks the result.
+struct DrawListBuilder
+{
+    // Read by the UI
+    size_t meshes  = 0;
+    size_t visible = 0;
+    float  ms      = 0.0f;
+
+    void build(Frame& frame)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        // first mesh of every model in the flattened range
+        starts.resize(frame.models.size() + 1);
+        starts[0] = 0;
+        for(size_t i = 0; i < frame.models.size(); i++)
+            starts[i + 1] = starts[i] + frame.models[i]->meshes.size();
+        meshes = starts.back();
+
+        frustumPlanes(frame.projection * frame.view);
+
+        size_t chunks = (meshes + DRAW_LIST_GRAIN - 1) / DRAW_LIST_GRAIN;
+        lists.resize(chunks);
+
+        threadPool().parallelFor(meshes, DRAW_LIST_GRAIN, [&](size_t begin, size_t end) {
+            std::vector<DrawItem>& list = lists[begin / DRAW_LIST_GRAIN];
+            list.clear();
+            collect(frame, begin, end, list);
+            std::sort(list.begin(), list.end(), before);
+        });
+
+        offsets.resize(chunks + 1);
+        offsets[0] = 0;
+        for(size_t chunk = 0; chunk < chunks; chunk++)
+            offsets[chunk + 1] = offsets[chunk] + lists[chunk].size();
+
+        std::vector<DrawItem>& draws = frame.draws;
+        draws.resize(offsets.back());
+
+        threadPool().parallelFor(chunks, 1, [&](size_t begin, size_t end) {
+            for(size_t chunk = begin; chunk < end; chunk++)
+            {
+                const std::vector<DrawItem>& list = lists[chunk];
+                std::copy(list.begin(), list.end(), draws.begin() + offsets[chunk]);
+            }
+        });
+
+        for(size_t width = 1; width < chunks; width *= 2)
+        {
+            size_t pairs = (chunks + width * 2 - 1) / (width * 2);
+            threadPool().parallelFor(pairs, 1, [&](size_t begin, size_t end) {
+                for(size_t pair = begin; pair < end; pair++)
+                {
+                    size_t first  = pair * width * 2;
+                    size_t middle = std::min(first + width, chunks);
+                    size_t last   = std::min(first + width * 2, chunks);
+                    std::inplace_merge(
+                        draws.begin() + offsets[first],
+                        draws.begin() + offsets[middle],
+                        draws.begin() + offsets[last],
+                        before);
+                }
+            });
+        }
+
+        visible = draws.size();
+
+        auto end = std::chrono::steady_clock::now();
+        ms       = std::chrono::duration<float, std::milli>(end - start).count();
+    }
+
+    static uint64_t key(size_t model, uint32_t features, int material, float depth)
+    {
+        const uint64_t models    = uint64_t(1) << DRAW_KEY_MODEL_BITS;
+        const uint64_t materials = uint64_t(1) << DRAW_KEY_MATERIAL_BITS;
+        const uint64_t depths    = uint64_t(1) << DRAW_KEY_DEPTH_BITS;
+
+        float    distance = std::clamp(depth / CAMERA_FAR, 0.0f, 1.0f);
+        uint64_t slot     = std::min<uint64_t>(std::max(material, 0), materials - 1);
+
+        uint64_t bits = std::min<uint64_t>(model, models - 1);
+        bits          = bits << DRAW_KEY_FEATURE_BITS | features;
+        bits          = bits << DRAW_KEY_MATERIAL_BITS | slot;
+        bits          = bits << DRAW_KEY_DEPTH_BITS | uint64_t(distance * (depths - 1));
+        return bits;
+    }
+
+private:
+    std::vector<size_t>                starts;
+    std::vector<std::vector<DrawItem>> lists;
+    std::vector<size_t>                offsets;
+    glm::vec4                          planes[6];
+
+    static bool before(const DrawItem& a, const DrawItem& b)
+    {
+        return a.key < b.key;
+    }
+
+    void frustumPlanes(const glm::mat4& matrix)
+    {
+        glm::vec4 rows[4];
+        for(int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(matrix[0][i], matrix[1][i], matrix[2][i], matrix[3][i]);
+
+        planes[0] = rows[3] + rows[0];
+        planes[1] = rows[3] - rows[0];
+        planes[2] = rows[3] + rows[1];
+        planes[3] = rows[3] - rows[1];
+        planes[4] = rows[3] + rows[2];
+        planes[5] = rows[3] - rows[2];
+    }
+
+    // the corner furthest along each plane normal has to be on the inner side
+    bool inside(const glm::vec3& min, const glm::vec3& max) const
+    {
+        for(const glm::vec4& plane : planes)
+        {
+            glm::vec3 corner = glm::vec3(
+                plane.x >= 0.0f ? max.x : min.x,
+                plane.y >= 0.0f ? max.y : min.y,
+                plane.z >= 0.0f ? max.z : min.z);
+
+            if(glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    void collect(
+        const Frame&           frame,
+        size_t                 begin,
+        size_t                 end,
+        std::vector<DrawItem>& list) const
+    {
+        // last model starting at or before begin, models without meshes are skipped
+        auto   first = std::upper_bound(starts.begin(), starts.end(), begin);
+        size_t model = static_cast<size_t>(first - starts.begin()) - 1;
+
+        for(size_t index = begin; index < end; index++)
+        {
+            while(index >= starts[model + 1])
+                model++;
+
+            auto        mesh    = static_cast<uint32_t>(index - starts[model]);
+            const Mesh& data    = frame.models[model]->meshes[mesh];
+            bool        skinned = frame.bone_offsets[model] >= 0 && data.skinned;
+
+            const glm::mat4& world = frame.mesh_worlds[frame.world_offsets[model] + mesh];
+
+            glm::vec3 min, max;
+            data.worldBounds(world, min, max);
+
+            // skinned meshes leave their bounds, they are never culled
+            if(!skinned && !inside(min, max))
+                continue;
+
+            uint32_t features = data.features;
+            if(!skinned)
+                features &= ~FEATURE_SKINNED;
+
+            glm::vec3 center = (min + max) * 0.5f;
+            float     depth  = -(frame.view * glm::vec4(center, 1.0f)).z;
+
+            DrawItem item;
+            item.key   = key(model, features, data.material, depth);
+            item.model = static_cast<uint32_t>(model);
+            item.mesh  = mesh;
+            list.push_back(item);
+        }
+    }
+};
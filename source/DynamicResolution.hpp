@@ -0,0 +1,201 @@
+#pragma once
+
+// Glad
+#include "glad/gl.h"
+
+// std
+#include <algorithm>
+#include <cmath>
+
+// Scene resolution relative to the window, in steps so that timing noise does not
+// resize the render target every frame
+const float RESOLUTION_MIN_SCALE = 0.25f;
+const float RESOLUTION_STEP      = 0.05f;
+
+// Hysteresis: the scale drops once the GPU time exceeds the target and only rises again
+// once it is below this fraction of it
+const float RESOLUTION_GROW_BELOW = 0.8f;
+
+// Weight of a new GPU time in the running average
+const float RESOLUTION_SMOOTHING = 0.25f;
+
+// Frames to wait after a change, timer results arrive a few frames late and must show
+// the new scale before the next decision
+const int RESOLUTION_SETTLE_FRAMES = 6;
+
+// Frame time target of the controller, about one 60 Hz refresh
+const float RESOLUTION_TARGET_MS = 16.0f;
+
+// Timer queries in flight, results are read once available and never waited for
+const int GPU_TIMER_QUERIES = 4;
+
+// GPU time of a frame from GL_TIME_ELAPSED queries, read a few frames late without
+// stalling the pipeline. Frames whose query slot is still busy are not measured.
+struct GpuTimer
+{
+    GLuint queries[GPU_TIMER_QUERIES] = {};
+    bool   pending[GPU_TIMER_QUERIES] = {};
+    int    index                      = 0;
+    bool   active                     = false;
+    float  ms                         = 0.0f;  // most recent result
+
+    void begin()
+    {
+        if(!queries[0])
+            glGenQueries(GPU_TIMER_QUERIES, queries);
+
+        active = !pending[index];
+        if(active)
+            glBeginQuery(GL_TIME_ELAPSED, queries[index]);
+    }
+
+    void end()
+    {
+        if(!active)
+            return;
+
+        glEndQuery(GL_TIME_ELAPSED);
+        pending[index] = true;
+        index          = (index + 1) % GPU_TIMER_QUERIES;
+        active         = false;
+    }
+
+    // reads the finished queries oldest first, true if ms has a new value
+    bool collect()
+    {
+        bool updated = false;
+        for(int k = 0; k < GPU_TIMER_QUERIES; k++)
+        {
+            int slot = (index + k) % GPU_TIMER_QUERIES;
+            if(!pending[slot])
+                continue;
+
+            GLint available = 0;
+            glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+            if(!available)
+                break;
+
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &elapsed);
+            ms            = elapsed / 1e6f;
+            pending[slot] = false;
+            updated       = true;
+        }
+        return updated;
+    }
+
+    void release()
+    {
+        if(queries[0])
+            glDeleteQueries(GPU_TIMER_QUERIES, queries);
+
+        *this = GpuTimer();
+    }
+};
+
+// Picks the scene scale from measured GPU times. The time is assumed to grow with the
+// pixel count, so a frame over the target jumps straight to the scale that should meet
+// it; growing goes one step at a time and only well below the target, which keeps the
+// scale from oscillating around the point where both would apply.
+struct ResolutionController
+{
+    float scale   = 1.0f;
+    float average = 0.0f;  // smoothed GPU ms at the current scale
+    int   settle  = 0;
+
+    // true if the scale changed
+    bool update(float gpu_ms, float target_ms, float min_scale)
+    {
+        average = average > 0.0f ? average + (gpu_ms - average) * RESOLUTION_SMOOTHING
+                                 : gpu_ms;
+        if(settle > 0)
+        {
+            settle--;
+            return false;
+        }
+
+        // in whole steps, so repeated changes do not drift off the grid
+        int current = static_cast<int>(std::lround(scale / RESOLUTION_STEP));
+        int next    = current;
+        if(average > target_ms)
+        {
+            float fit = scale * std::sqrt(target_ms / average) / RESOLUTION_STEP;
+            next      = std::min(current - 1, static_cast<int>(std::floor(fit)));
+        }
+        else if(average < target_ms * RESOLUTION_GROW_BELOW)
+            next = current + 1;
+
+        float lowest = std::max(min_scale, RESOLUTION_MIN_SCALE) / RESOLUTION_STEP;
+        next         = std::clamp(
+            next,
+            static_cast<int>(std::ceil(lowest - 1e-3f)),
+            static_cast<int>(std::lround(1.0f / RESOLUTION_STEP)));
+        if(next == current)
+            return false;
+
+        // expected time at the new scale, until measurements catch up
+        float value = next * RESOLUTION_STEP;
+        average *= (value * value) / (scale * scale);
+        scale  = value;
+        settle = RESOLUTION_SETTLE_FRAMES;
+        return true;
+    }
+
+    void reset()
+    {
+        *this = ResolutionController();
+    }
+};
+
+// Offscreen color and depth the scene is drawn into at reduced resolution. Storage is
+// allocated for the full window so scale changes only change the viewport.
+struct SceneTarget
+{
+    GLuint framebuffer = 0;
+    GLuint color       = 0;
+    GLuint depth       = 0;
+    int    width       = 0;
+    int    height      = 0;
+
+    void resize(int w, int h)
+    {
+        if(framebuffer && w == width && h == height)
+            return;
+
+        release();
+        width  = w;
+        height = h;
+
+        glGenRenderbuffers(1, &color);
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(
+            GL_FRAMEBUFFER,
+            GL_COLOR_ATTACHMENT0,
+            GL_RENDERBUFFER,
+            color);
+        glFramebufferRenderbuffer(
+            GL_FRAMEBUFFER,
+            GL_DEPTH_STENCIL_ATTACHMENT,
+            GL_RENDERBUFFER,
+            depth);
+    }
+
+    void release()
+    {
+        if(!framebuffer)
+            return;
+
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(1, &color);
+        glDeleteRenderbuffers(1, &depth);
+        *this = SceneTarget();
+    }
+};
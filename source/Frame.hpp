@@ -0,0 +1,108 @@
+#pragma once
+
+// imgui
+#include "imgui.h"
+
+// std
+#include <cstdint>
+#include <vector>
+
+// modules
+#include "Camera.hpp"
+#include "FramePacing.hpp"
+#include "Lighting.hpp"
+
+class Model;
+
+// One mesh to draw, models and meshes index into the frame. Draw lists are sorted by key.
+struct DrawItem
+{
+    uint64_t key   = 0;
+    uint32_t model = 0;
+    uint32_t mesh  = 0;
+};
+
+// Deep copy of ImGui's draw data. ImGui reuses its draw lists on the next NewFrame, so the
+// main thread clones them into the frame before handing it to the render thread.
+struct DrawDataSnapshot
+{
+    ImDrawData data;
+
+    DrawDataSnapshot() = default;
+
+    DrawDataSnapshot(const DrawDataSnapshot&)            = delete;
+    DrawDataSnapshot& operator=(const DrawDataSnapshot&) = delete;
+
+    ~DrawDataSnapshot()
+    {
+        release();
+    }
+
+    void capture(const ImDrawData* source)
+    {
+        release();
+
+        data = *source;
+        for(int i = 0; i < data.CmdLists.Size; i++)
+            data.CmdLists[i] = source->CmdLists[i]->CloneOutput();
+    }
+
+    void release()
+    {
+        for(int i = 0; i < data.CmdLists.Size; i++)
+            IM_DELETE(data.CmdLists[i]);
+
+        data.CmdLists.resize(0);
+        data.CmdListsCount = 0;
+        data.Valid         = false;
+    }
+};
+
+// Everything the render thread needs to draw one frame. Written by the main thread,
+// never modified after it has been published.
+struct Frame
+{
+    uint64_t sequence = 0;
+    int      width    = 0;
+    int      height   = 0;
+    ImVec4   clear_color;
+
+    PacingMode pacing          = PacingMode::VSYNC;
+    uint64_t   input_timestamp = 0;  // oldest input event of the frame (SDL ns) or 0
+    bool       occlusion       = false;
+
+    // scene resolution follows the GPU time, the UI stays at window resolution
+    bool  dynamic_resolution = false;
+    float frame_target_ms    = 0.0f;
+    float min_scale          = 0.0f;
+
+    // meshlet culling of cluster stores, prefetch is the streaming distance around the
+    // camera in world units
+    bool  cone_culling     = true;
+    float cluster_prefetch = 0.0f;
+
+    Camera    camera;
+    glm::mat4 view       = glm::mat4(1.0f);
+    glm::mat4 projection = glm::mat4(1.0f);
+
+    std::vector<Model*> models;
+    DrawDataSnapshot    ui;
+
+    // world matrix of every mesh, models start at their offset into the array
+    std::vector<glm::mat4> mesh_worlds;
+    std::vector<size_t>    world_offsets;
+    uint64_t               transforms = 0;  // scene transform version of mesh_worlds
+
+    // bone palettes of all animated models and the first entry per model, -1 if static
+    std::vector<glm::mat4> bone_palettes;
+    std::vector<int>       bone_offsets;
+
+    // meshes in the view frustum sorted into draw order, see DrawList.hpp. Occlusion
+    // culling and cluster stores do their own visibility and ignore it.
+    std::vector<DrawItem> draws;
+
+    // view space lights binned into the cluster grid, empty with lighting off
+    ClusterLights lights;
+    bool          lighting = true;
+    glm::vec3     ambient  = glm::vec3(0.1f);
+};
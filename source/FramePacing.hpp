@@ -0,0 +1,136 @@
+#pragma once
+
+// Glad
+#include "glad/gl.h"
+
+// SDL
+#include "SDL3/SDL.h"
+
+// std
+#include <atomic>
+
+enum class PacingMode : char
+{
+    VSYNC          = 0,
+    ADAPTIVE_VSYNC = 1,
+    UNCAPPED       = 2,
+    LOW_LATENCY    = 3,
+};
+
+const char* const PACING_MODE_NAMES[] = {
+    "VSync",
+    "Adaptive VSync",
+    "Uncapped",
+    "Low latency"};
+
+// Frames the CPU may queue ahead of the GPU in low latency mode
+const int MAX_QUEUED_FRAMES = 2;
+
+// Wait at most 100ms for a fence, a lost context must not hang the render thread
+const GLuint64 FENCE_TIMEOUT = 100000000;
+
+// Input-to-present latency samples, written by the render thread and read by the UI.
+struct LatencyStats
+{
+    static constexpr int HISTORY = 128;
+
+    std::atomic<float> samples[HISTORY] = {};
+    std::atomic<int>   count            = 0;
+
+    void record(float ms)
+    {
+        int index = count.load(std::memory_order_relaxed);
+        samples[index % HISTORY].store(ms, std::memory_order_relaxed);
+        count.store(index + 1, std::memory_order_release);
+    }
+
+    // Copies the history in chronological order and returns the number of valid samples
+    int history(float (&out)[HISTORY], float& average, float& maximum) const
+    {
+        int total = count.load(std::memory_order_acquire);
+        int valid = total < HISTORY ? total : HISTORY;
+
+        average = 0.0f;
+        maximum = 0.0f;
+
+        for(int i = 0; i < valid; i++)
+        {
+            int   index  = (total - valid + i) % HISTORY;
+            float sample = samples[index].load(std::memory_order_relaxed);
+            out[i]       = sample;
+            average += sample;
+            maximum = sample > maximum ? sample : maximum;
+        }
+
+        if(valid > 0)
+            average /= valid;
+
+        return valid;
+    }
+};
+
+// Swap interval and GPU queue control. Only used on the thread owning the GL context.
+struct FramePacer
+{
+    PacingMode mode = PacingMode::VSYNC;
+
+    GLsync fences[MAX_QUEUED_FRAMES] = {};
+    int    fence_index               = 0;
+
+    void apply(PacingMode requested)
+    {
+        mode = requested;
+
+        // clang-format off
+        switch(mode)
+        {
+            case PacingMode::VSYNC:          SDL_GL_SetSwapInterval(1); break;
+            case PacingMode::UNCAPPED:       SDL_GL_SetSwapInterval(0); break;
+            case PacingMode::LOW_LATENCY:    SDL_GL_SetSwapInterval(1); break;
+            case PacingMode::ADAPTIVE_VSYNC:
+                // Late swap tearing is not available everywhere
+                if(!SDL_GL_SetSwapInterval(-1))
+                    SDL_GL_SetSwapInterval(1);
+                break;
+        }
+        // clang-format on
+
+        if(mode != PacingMode::LOW_LATENCY)
+            release();
+    }
+
+    // Blocks until the GPU has caught up to at most MAX_QUEUED_FRAMES - 1 frames
+    void wait()
+    {
+        if(mode != PacingMode::LOW_LATENCY)
+            return;
+
+        GLsync& fence = fences[fence_index];
+        if(fence)
+        {
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+
+    // Marks the end of the frame that has just been submitted
+    void submitted()
+    {
+        if(mode != PacingMode::LOW_LATENCY)
+            return;
+
+        fences[fence_index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        fence_index         = (fence_index + 1) % MAX_QUEUED_FRAMES;
+    }
+
+    void release()
+    {
+        for(auto& fence : fences)
+        {
+            if(fence)
+                glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+};
@@ -0,0 +1,414 @@
+#pragma once
+
+// Counts GL calls per entry point, bytes uploaded and redundant state changes per frame.
+// The counters hook into glad's pre call callback, which only exists in a loader
+// generated with DEBUG (cmake -DGL_STATS=ON). Without GL_STATS the macros below expand
+// to nothing and none of this is compiled.
+
+#ifdef GL_STATS
+
+// Glad
+#include "glad/gl.h"
+
+// imgui
+#include "imgui.h"
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cstdarg>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+enum GLCallKind : int
+{
+    GL_CALL_OTHER = 0,
+    GL_CALL_DRAW,
+    GL_CALL_BIND,
+    GL_CALL_UNIFORM,
+    GL_CALL_QUERY,  // glGet*, e.g. uniform locations looked up every frame
+    GL_CALL_UPLOAD,
+    GL_CALL_KINDS,
+};
+
+const char* const GL_STATS_FILE = "gl_stats.csv";
+
+const char* const GL_CALL_KIND_NAMES[] = {
+    "Other",
+    "Draw",
+    "Bind",
+    "Uniform",
+    "Query",
+    "Upload"};
+
+struct GLFrameStats
+{
+    uint64_t frame                = 0;
+    uint32_t calls                = 0;
+    uint32_t kinds[GL_CALL_KINDS] = {};
+    uint32_t redundant            = 0;  // binds and enables of the current value
+    uint64_t bytes                = 0;  // buffer and texture data passed to GL
+
+    // calls per entry point, most frequent first
+    std::vector<std::pair<const char*, uint32_t>> entries;
+};
+
+// Collects on the thread that issues GL calls and publishes a copy at every frame end.
+// ImGui's backend loads its own GL pointers, its draws are not counted; it restores the
+// state it changes, so the tracked bindings stay valid.
+struct GLStats
+{
+    static constexpr int HISTORY = 128;
+
+    std::atomic<bool> recording = false;  // appends every frame to GL_STATS_FILE
+
+    static GLStats& instance();
+
+    // The default post callback of the debug loader calls glGetError after every call,
+    // a sync point that would distort the frame it counts
+    void install()
+    {
+        gladSetGLPreCallback(&GLStats::preCall);
+        gladSetGLPostCallback(&GLStats::postCall);
+    }
+
+    void endFrame()
+    {
+        current.entries.clear();
+        for(auto& [name, entry] : entries)
+        {
+            if(entry.count > 0)
+                current.entries.emplace_back(name, entry.count);
+            entry.count = 0;
+        }
+        std::sort(current.entries.begin(), current.entries.end(), [](auto& a, auto& b) {
+            return a.second > b.second;
+        });
+
+        if(recording)
+            record(current);
+        else if(file.is_open())
+            file.close();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            published                        = current;
+            history[current.frame % HISTORY] = float(current.calls);
+        }
+
+        uint64_t frame = current.frame + 1;
+        current        = GLFrameStats();
+        current.frame  = frame;
+    }
+
+    // last complete frame and the call count history in chronological order
+    int snapshot(GLFrameStats& out, float (&calls)[HISTORY])
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        out = published;
+
+        int valid = int(std::min<uint64_t>(published.frame + 1, HISTORY));
+        for(int i = 0; i < valid; i++)
+            calls[i] = history[(published.frame + 1 - valid + i) % HISTORY];
+        return valid;
+    }
+
+private:
+    struct Entry
+    {
+        uint32_t   count = 0;
+        GLCallKind kind  = GL_CALL_OTHER;
+    };
+
+    // entry point names are string literals in the loader, the pointer is the key
+    std::unordered_map<const char*, Entry> entries;
+    GLFrameStats                           current;
+
+    // last value set per binding point, used to spot redundant calls
+    std::unordered_map<uint64_t, uint64_t> bindings;
+
+    std::mutex    mutex;
+    GLFrameStats  published;
+    float         history[HISTORY] = {};
+    std::ofstream file;
+
+    static GLCallKind classify(const char* name)
+    {
+        auto starts = [name](const char* prefix) {
+            return std::strncmp(name, prefix, std::strlen(prefix)) == 0;
+        };
+
+        if(starts("glDraw"))
+            return GL_CALL_DRAW;
+        if(starts("glBind") || starts("glUseProgram") || starts("glActiveTexture") ||
+           starts("glEnable") || starts("glDisable"))
+            return GL_CALL_BIND;
+        if(starts("glUniform"))
+            return GL_CALL_UNIFORM;
+        if(starts("glGet"))
+            return GL_CALL_QUERY;
+        if(starts("glBufferData") || starts("glBufferSubData") || starts("glTexImage") ||
+           starts("glTexSubImage"))
+            return GL_CALL_UPLOAD;
+        return GL_CALL_OTHER;
+    }
+
+    // binding point keys: a name tag in the upper bits, target and index below
+    enum Binding : uint64_t
+    {
+        BIND_PROGRAM = 1,
+        BIND_VERTEX_ARRAY,
+        BIND_ACTIVE_TEXTURE,
+        BIND_TEXTURE,
+        BIND_BUFFER,
+        BIND_BUFFER_RANGE,
+        BIND_FRAMEBUFFER,
+        BIND_CAPABILITY,
+    };
+
+    static uint64_t key(Binding binding, uint64_t target = 0, uint64_t index = 0)
+    {
+        return (uint64_t(binding) << 56) | (index << 32) | target;
+    }
+
+    void set(uint64_t point, uint64_t value)
+    {
+        auto it = bindings.find(point);
+        if(it != bindings.end() && it->second == value)
+            current.redundant++;
+        else
+            bindings[point] = value;
+    }
+
+    static uint64_t pixelSize(GLenum format, GLenum type)
+    {
+        uint64_t components = 4;
+        switch(format)
+        {
+        case GL_RED:
+        case GL_RED_INTEGER:
+        case GL_DEPTH_COMPONENT: components = 1; break;
+        case GL_RG:
+        case GL_RG_INTEGER: components = 2; break;
+        case GL_RGB:
+        case GL_BGR:
+        case GL_RGB_INTEGER: components = 3; break;
+        }
+
+        switch(type)
+        {
+        case GL_UNSIGNED_BYTE:
+        case GL_BYTE: return components;
+        case GL_UNSIGNED_SHORT:
+        case GL_SHORT:
+        case GL_HALF_FLOAT: return components * 2;
+        default: return components * 4;
+        }
+    }
+
+    // arguments follow the GL prototypes, integer types narrower than int are promoted
+    void track(const char* name, va_list args)
+    {
+        if(std::strcmp(name, "glUseProgram") == 0)
+            set(key(BIND_PROGRAM), va_arg(args, GLuint));
+        else if(std::strcmp(name, "glBindVertexArray") == 0)
+        {
+            set(key(BIND_VERTEX_ARRAY), va_arg(args, GLuint));
+            // the element buffer binding belongs to the vertex array
+            bindings.erase(key(BIND_BUFFER, GL_ELEMENT_ARRAY_BUFFER));
+        }
+        else if(std::strcmp(name, "glActiveTexture") == 0)
+            set(key(BIND_ACTIVE_TEXTURE), va_arg(args, GLenum));
+        else if(std::strcmp(name, "glBindTexture") == 0)
+        {
+            GLenum target = va_arg(args, GLenum);
+            GLuint id     = va_arg(args, GLuint);
+            set(key(BIND_TEXTURE, target, bindings[key(BIND_ACTIVE_TEXTURE)]), id);
+        }
+        else if(std::strcmp(name, "glBindBuffer") == 0)
+        {
+            GLenum target = va_arg(args, GLenum);
+            set(key(BIND_BUFFER, target), va_arg(args, GLuint));
+        }
+        else if(std::strcmp(name, "glBindBufferBase") == 0 ||
+                std::strcmp(name, "glBindBufferRange") == 0)
+        {
+            GLenum   target = va_arg(args, GLenum);
+            GLuint   index  = va_arg(args, GLuint);
+            uint64_t buffer = va_arg(args, GLuint);
+            uint64_t offset = name[12] == 'R' ? uint64_t(va_arg(args, GLintptr)) : 0;
+            set(key(BIND_BUFFER_RANGE, target, index), buffer ^ (offset << 32));
+            bindings.erase(key(BIND_BUFFER, target));
+        }
+        else if(std::strcmp(name, "glBindFramebuffer") == 0)
+        {
+            GLenum target = va_arg(args, GLenum);
+            set(key(BIND_FRAMEBUFFER, target), va_arg(args, GLuint));
+        }
+        else if(std::strcmp(name, "glEnable") == 0 || std::strcmp(name, "glDisable") == 0)
+            set(key(BIND_CAPABILITY, va_arg(args, GLenum)), name[2] == 'E');
+        else if(std::strcmp(name, "glBufferData") == 0)
+        {
+            va_arg(args, GLenum);
+            GLsizeiptr  size = va_arg(args, GLsizeiptr);
+            const void* data = va_arg(args, const void*);
+            current.bytes += data ? uint64_t(size) : 0;
+        }
+        else if(std::strcmp(name, "glBufferSubData") == 0)
+        {
+            va_arg(args, GLenum);
+            va_arg(args, GLintptr);
+            current.bytes += uint64_t(va_arg(args, GLsizeiptr));
+        }
+        else if(std::strcmp(name, "glTexImage2D") == 0 ||
+                std::strcmp(name, "glTexImage3D") == 0)
+        {
+            bool     volume = name[10] == '3';
+            uint64_t size   = 1;
+
+            va_arg(args, GLenum);                        // target
+            va_arg(args, GLint);                         // level
+            va_arg(args, GLint);                         // internal format
+            for(int i = 0; i < (volume ? 3 : 2); i++)
+                size *= uint64_t(va_arg(args, GLsizei));  // width, height, depth
+            va_arg(args, GLint);                         // border
+
+            GLenum      format = va_arg(args, GLenum);
+            GLenum      type   = va_arg(args, GLenum);
+            const void* data   = va_arg(args, const void*);
+            current.bytes += data ? size * pixelSize(format, type) : 0;
+        }
+        else if(std::strcmp(name, "glTexSubImage2D") == 0 ||
+                std::strcmp(name, "glTexSubImage3D") == 0)
+        {
+            bool     volume = name[13] == '3';
+            uint64_t size   = 1;
+
+            va_arg(args, GLenum);  // target
+            for(int i = 0; i < (volume ? 4 : 3); i++)
+                va_arg(args, GLint);  // level and offsets
+            for(int i = 0; i < (volume ? 3 : 2); i++)
+                size *= uint64_t(va_arg(args, GLsizei));
+
+            GLenum format = va_arg(args, GLenum);
+            GLenum type   = va_arg(args, GLenum);
+            current.bytes += size * pixelSize(format, type);
+        }
+    }
+
+    void record(const GLFrameStats& stats)
+    {
+        if(!file.is_open())
+        {
+            file.open(GL_STATS_FILE, std::ios::trunc);
+            file << "frame,calls";
+            for(const char* kind : GL_CALL_KIND_NAMES)
+                file << ',' << kind;
+            file << ",redundant,bytes,entries\n";
+        }
+
+        file << stats.frame << ',' << stats.calls;
+        for(uint32_t count : stats.kinds)
+            file << ',' << count;
+        file << ',' << stats.redundant << ',' << stats.bytes << ',';
+
+        for(size_t i = 0; i < stats.entries.size(); i++)
+        {
+            auto& [name, count] = stats.entries[i];
+            file << (i ? " " : "") << name << ':' << count;
+        }
+        file << '\n';
+    }
+
+    static void postCall(void*, const char*, GLADapiproc, int, ...)
+    {
+    }
+
+    static void preCall(const char* name, GLADapiproc, int arguments, ...)
+    {
+        GLStats& stats = instance();
+        Entry&   entry = stats.entries[name];
+
+        if(entry.count++ == 0 && entry.kind == GL_CALL_OTHER)
+            entry.kind = classify(name);
+
+        stats.current.calls++;
+        stats.current.kinds[entry.kind]++;
+
+        if(entry.kind == GL_CALL_BIND || entry.kind == GL_CALL_UPLOAD)
+        {
+            va_list args;
+            va_start(args, arguments);
+            stats.track(name, args);
+            va_end(args);
+        }
+    }
+};
+
+inline GLStats& GLStats::instance()
+{
+    static GLStats stats;
+    return stats;
+}
+
+inline GLStats& glStats()
+{
+    return GLStats::instance();
+}
+
+// window with the last frame's counters, the busiest entry points and a call history
+inline void glStatsOverlay()
+{
+    static GLFrameStats stats;
+    static float        calls[GLStats::HISTORY];
+
+    int count = glStats().snapshot(stats, calls);
+
+    ImGui::Begin("GL Stats");
+    {
+        ImGui::Text("Frame %llu: %u calls", (unsigned long long)stats.frame, stats.calls);
+        for(int kind = GL_CALL_DRAW; kind < GL_CALL_KINDS; kind++)
+            ImGui::Text("%-8s %u", GL_CALL_KIND_NAMES[kind], stats.kinds[kind]);
+        ImGui::Text("Redundant state changes %u", stats.redundant);
+        ImGui::Text("Uploaded %.2f KiB", stats.bytes / 1024.0);
+
+        ImGui::PlotLines("Calls", calls, count, 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 40));
+
+        bool recording = glStats().recording;
+        if(ImGui::Checkbox("Export every frame", &recording))
+            glStats().recording = recording;
+
+        ImGuiTableFlags flags = ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY;
+        if(ImGui::BeginTable("Entries", 2, flags))
+        {
+            for(auto& [name, number] : stats.entries)
+            {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(name);
+                ImGui::TableNextColumn();
+                ImGui::Text("%u", number);
+            }
+            ImGui::EndTable();
+        }
+    }
+    ImGui::End();
+}
+
+#define GL_STATS_INSTALL() glStats().install()
+#define GL_STATS_FRAME()   glStats().endFrame()
+#define GL_STATS_OVERLAY() glStatsOverlay()
+
+#else
+
+#define GL_STATS_INSTALL()
+#define GL_STATS_FRAME()
+#define GL_STATS_OVERLAY()
+
+#endif
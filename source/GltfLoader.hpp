@@ -0,0 +1,686 @@
+#pragma once
+
+// lib
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// std
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// modules
+#include "Json.hpp"
+#include "Log.hpp"
+#include "MappedFile.hpp"
+#include "Material.hpp"
+
+const uint32_t GLB_MAGIC      = 0x46546c67;  // "glTF"
+const uint32_t GLB_CHUNK_JSON = 0x4e4f534a;
+const uint32_t GLB_CHUNK_BIN  = 0x004e4942;
+
+// Typed view into a mapped buffer. glTF component types are the GL enums, so a layout
+// GL accepts is handed to glVertexAttribPointer as is.
+struct GltfAccessor
+{
+    const unsigned char* data       = nullptr;  // first element
+    size_t               count      = 0;
+    GLenum               component  = GL_FLOAT;
+    int                  components = 1;
+    bool                 normalized = false;
+    size_t               stride     = 0;  // bytes between elements, never 0
+    int                  view       = -1;
+    size_t               offset     = 0;  // of the first element inside the view
+};
+
+// Primitive ready to draw, the vertex array points into uploaded buffer views
+struct GltfPrimitive
+{
+    GLuint    vao          = 0;
+    GLsizei   count        = 0;
+    GLenum    index_type   = GL_NONE;
+    size_t    index_offset = 0;
+    int       material     = -1;  // glTF material, -1 for the default one
+    size_t    vertices     = 0;
+    glm::vec3 bounds_min   = glm::vec3(0.0f);
+    glm::vec3 bounds_max   = glm::vec3(0.0f);
+};
+
+// Native glTF 2.0 and GLB reader. The file and external buffers are memory mapped and
+// every buffer view used by a primitive is uploaded straight from the mapping into one GL
+// buffer, normalized and quantized attributes included. Only data GL can not take as is
+// is converted on the CPU; that is generating missing normals and flipping texture
+// coordinates for images loaded bottom row first. Skins, animations, morph targets,
+// sparse accessors and embedded base64 data are left to Assimp, open() returns false
+// for them.
+struct GltfLoader
+{
+    Json        document;
+    std::string directory;
+
+    size_t uploaded  = 0;      // bytes copied from the mapping into GL buffers
+    size_t converted = 0;      // bytes that had to be rewritten on the CPU first
+    bool   flip_uvs  = false;  // v becomes 1 - v, as aiProcess_FlipUVs does
+
+    // GL objects created so far, shared by the primitives. The loader never frees them,
+    // the caller takes them over.
+    std::vector<GLuint> gl_buffers;
+    std::vector<GLuint> gl_arrays;
+
+    bool open(const std::string& path)
+    {
+        if(!file.open(path))
+            return false;
+
+        size_t slash = path.find_last_of("/\\");
+        directory    = slash == std::string::npos ? "." : path.substr(0, slash);
+        name         = path;
+
+        const char* json_begin = file.data;
+        const char* json_end   = file.data + file.size;
+        Span        binary;
+
+        if(file.size >= 12 && read<uint32_t>(file.data) == GLB_MAGIC)
+        {
+            // header, then a JSON chunk and an optional binary chunk
+            size_t length = std::min<size_t>(read<uint32_t>(file.data + 8), file.size);
+            size_t offset = 12;
+
+            while(offset + 8 <= length)
+            {
+                size_t   chunk = read<uint32_t>(file.data + offset);
+                uint32_t type  = read<uint32_t>(file.data + offset + 4);
+                offset += 8;
+
+                if(chunk > length - offset)
+                    return fail("truncated chunk");
+
+                if(type == GLB_CHUNK_JSON)
+                {
+                    json_begin = file.data + offset;
+                    json_end   = json_begin + chunk;
+                }
+                else if(type == GLB_CHUNK_BIN && !binary.data)
+                {
+                    const char* data = file.data + offset;
+                    binary.data      = reinterpret_cast<const unsigned char*>(data);
+                    binary.size      = chunk;
+                }
+
+                offset += (chunk + 3) & ~size_t(3);
+            }
+        }
+
+        if(!Json::parse(json_begin, json_end, document))
+            return fail("invalid JSON");
+
+        if(document["asset"]["version"].str().compare(0, 1, "2") != 0)
+            return fail("only glTF 2.0 is supported");
+
+        if(!supported())
+            return false;
+
+        // buffers without uri are the GLB binary chunk
+        const Json& list = document["buffers"];
+        for(size_t i = 0; i < list.size(); i++)
+        {
+            const Json& buffer = list[i];
+            Span        span;
+
+            if(!buffer.has("uri"))
+                span = binary;
+            else
+            {
+                auto mapping = std::make_unique<MappedFile>();
+                if(!mapping->open(directory + '/' + decodeUri(buffer["uri"].str())))
+                    return fail("missing buffer " + buffer["uri"].str());
+
+                span.data = reinterpret_cast<const unsigned char*>(mapping->data);
+                span.size = mapping->size;
+                external.push_back(std::move(mapping));
+            }
+
+            if(span.size < buffer["byteLength"].offset())
+                return fail("buffer shorter than its byteLength");
+
+            buffers.push_back(span);
+        }
+
+        return true;
+    }
+
+    // adds every glTF material, out maps material indices to library indices
+    void addMaterials(MaterialLibrary& library, bool textures, std::vector<int>& out)
+    {
+        const Json& list = document["materials"];
+
+        // the last entry is the default material of primitives without one
+        for(size_t i = 0; i <= list.size(); i++)
+        {
+            const Json&  material = list[i];
+            const Json&  pbr      = material["pbrMetallicRoughness"];
+            MaterialData data;
+
+            const Json& factor = pbr["baseColorFactor"];
+            if(factor.size() == 4)
+                data.diffuse = glm::vec4(
+                    factor[0].num(1.0),
+                    factor[1].num(1.0),
+                    factor[2].num(1.0),
+                    factor[3].num(1.0));
+
+            if(textures)
+            {
+                const Json& normal     = material["normalTexture"];
+                data.maps[MAP_DIFFUSE] = texture(library, pbr["baseColorTexture"], true);
+                data.maps[MAP_NORMAL]  = texture(library, normal, false);
+            }
+
+            int index = library.add(data);
+            out.push_back(index);
+        }
+    }
+
+    // roots of the default scene, nodes without parent if there is no scene
+    std::vector<int> roots() const
+    {
+        const Json& scenes = document["scenes"];
+        if(scenes.size() > 0)
+        {
+            const Json&      nodes = scenes[document["scene"].offset()]["nodes"];
+            std::vector<int> out;
+            for(size_t i = 0; i < nodes.size(); i++)
+                out.push_back(nodes[i].integer());
+            return out;
+        }
+
+        const Json&       nodes = document["nodes"];
+        std::vector<bool> child(nodes.size(), false);
+        for(size_t i = 0; i < nodes.size(); i++)
+            for(auto& index : nodes[i]["children"].array)
+                if(index.offset(nodes.size()) < nodes.size())
+                    child[index.offset()] = true;
+
+        std::vector<int> out;
+        for(size_t i = 0; i < nodes.size(); i++)
+            if(!child[i])
+                out.push_back(static_cast<int>(i));
+        return out;
+    }
+
+    const Json& node(int index) const
+    {
+        return document["nodes"][size_t(index)];
+    }
+
+    // local transform, either a matrix or translation, rotation and scale
+    glm::mat4 transform(const Json& node) const
+    {
+        const Json& matrix = node["matrix"];
+        if(matrix.size() == 16)
+        {
+            glm::mat4 out;
+            for(int i = 0; i < 16; i++)
+                out[i / 4][i % 4] = static_cast<float>(matrix[i].num());
+            return out;
+        }
+
+        const Json& t = node["translation"];
+        const Json& r = node["rotation"];
+        const Json& s = node["scale"];
+
+        glm::mat4 out(1.0f);
+        if(t.size() == 3)
+            out = glm::translate(out, toVec3(t, 0.0));
+        if(r.size() == 4)
+        {
+            glm::quat q(
+                float(r[3].num(1.0)),
+                float(r[0].num()),
+                float(r[1].num()),
+                float(r[2].num()));
+            out = out * glm::mat4_cast(q);
+        }
+        if(s.size() == 3)
+            out = glm::scale(out, toVec3(s, 1.0));
+        return out;
+    }
+
+    // sets up the vertex array of a primitive, false if it has to be skipped
+    bool primitive(const Json& primitive, GltfPrimitive& out)
+    {
+        const Json& attributes = primitive["attributes"];
+
+        int          position_index = attributes["POSITION"].integer();
+        GltfAccessor position;
+        if(!accessor(position_index, position) || position.components != 3)
+            return false;
+
+        GltfAccessor indices;
+        bool         indexed = primitive.has("indices");
+        if(indexed && (!accessor(primitive["indices"].integer(), indices) ||
+                       indices.components != 1 ||
+                       indices.stride != componentSize(indices.component) ||
+                       (indices.component != GL_UNSIGNED_BYTE &&
+                        indices.component != GL_UNSIGNED_SHORT &&
+                        indices.component != GL_UNSIGNED_INT)))
+            return false;
+
+        out.material = primitive["material"].integer();
+        out.vertices = position.count;
+        out.count    = static_cast<GLsizei>(indexed ? indices.count : position.count);
+        bounds(position_index, position, out.bounds_min, out.bounds_max);
+
+        glGenVertexArrays(1, &out.vao);
+        glBindVertexArray(out.vao);
+        gl_arrays.push_back(out.vao);
+
+        attribute(0, position);
+
+        GltfAccessor normal;
+        if(accessor(attributes["NORMAL"].integer(), normal) && normal.components == 3)
+            attribute(1, normal);
+        else
+            generateNormals(position, indexed ? &indices : nullptr);
+
+        GltfAccessor texcoord;
+        int          texcoord_index = attributes["TEXCOORD_0"].integer();
+        if(accessor(texcoord_index, texcoord) && texcoord.components == 2)
+        {
+            if(flip_uvs)
+                flipTexcoords(texcoord);
+            else
+                attribute(2, texcoord);
+        }
+
+        GltfAccessor tangent;
+        if(accessor(attributes["TANGENT"].integer(), tangent) && tangent.components == 4)
+            attribute(3, tangent);
+
+        if(indexed)
+        {
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer(indices.view));
+            out.index_type   = indices.component;
+            out.index_offset = indices.offset;
+        }
+
+        glBindVertexArray(0);
+        return true;
+    }
+
+private:
+    struct Span
+    {
+        const unsigned char* data = nullptr;
+        size_t               size = 0;
+    };
+
+    MappedFile                               file;
+    std::vector<std::unique_ptr<MappedFile>> external;
+    std::vector<Span>                        buffers;
+    std::map<int, GLuint>                    views;  // uploaded buffer views
+    std::string                              name;
+
+    template<typename T>
+    static T read(const void* data)
+    {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        return value;
+    }
+
+    bool fail(const std::string& reason) const
+    {
+        logWarning("glTF %s: %s, using Assimp", name, reason);
+        return false;
+    }
+
+    static glm::vec3 toVec3(const Json& values, double fallback)
+    {
+        return glm::vec3(
+            values[0].num(fallback),
+            values[1].num(fallback),
+            values[2].num(fallback));
+    }
+
+    static int hex(char c)
+    {
+        if(c >= '0' && c <= '9')
+            return c - '0';
+        if(c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if(c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    }
+
+    // relative uris may escape spaces and other characters as %XX
+    static std::string decodeUri(const std::string& uri)
+    {
+        std::string out;
+        for(size_t i = 0; i < uri.size(); i++)
+        {
+            int high = i + 2 < uri.size() ? hex(uri[i + 1]) : -1;
+            int low  = i + 2 < uri.size() ? hex(uri[i + 2]) : -1;
+
+            if(uri[i] == '%' && high >= 0 && low >= 0)
+            {
+                out += char(high * 16 + low);
+                i += 2;
+            }
+            else
+                out += uri[i];
+        }
+        return out;
+    }
+
+    // everything this loader can not draw the way Assimp would
+    bool supported() const
+    {
+        for(auto& extension : document["extensionsRequired"].array)
+            if(extension.str() != "KHR_mesh_quantization")
+                return fail("requires " + extension.str());
+
+        if(document["skins"].size() > 0 || document["animations"].size() > 0)
+            return fail("skins and animations");
+
+        for(auto& buffer : document["buffers"].array)
+            if(buffer["uri"].str().compare(0, 5, "data:") == 0)
+                return fail("embedded base64 buffer");
+
+        for(auto& image : document["images"].array)
+            if(image["uri"].str().compare(0, 5, "data:") == 0)
+                return fail("embedded base64 image");
+
+        for(auto& accessor : document["accessors"].array)
+            if(accessor.has("sparse") || !accessor.has("bufferView"))
+                return fail("sparse accessor");
+
+        for(auto& mesh : document["meshes"].array)
+            for(auto& primitive : mesh["primitives"].array)
+                if(primitive["mode"].integer(GL_TRIANGLES) != GL_TRIANGLES ||
+                   primitive.has("targets"))
+                    return fail("only triangle primitives without morph targets");
+
+        return true;
+    }
+
+    static size_t componentSize(GLenum component)
+    {
+        switch(component)
+        {
+        case GL_BYTE:
+        case GL_UNSIGNED_BYTE: return 1;
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT: return 2;
+        case GL_UNSIGNED_INT:
+        case GL_FLOAT: return 4;
+        }
+        return 0;
+    }
+
+    static int componentCount(const std::string& type)
+    {
+        if(type == "SCALAR")
+            return 1;
+        if(type == "VEC2")
+            return 2;
+        if(type == "VEC3")
+            return 3;
+        if(type == "VEC4")
+            return 4;
+        return 0;
+    }
+
+    // resolves an accessor and checks that all its elements lie inside the buffer
+    bool accessor(int index, GltfAccessor& out) const
+    {
+        const Json& accessor = document["accessors"][size_t(index)];
+        if(index < 0 || accessor.type != Json::OBJECT)
+            return false;
+
+        out.view       = accessor["bufferView"].integer();
+        out.component  = static_cast<GLenum>(accessor["componentType"].integer(0));
+        out.components = componentCount(accessor["type"].str());
+        out.normalized = accessor["normalized"].boolean;
+        out.count      = accessor["count"].offset();
+        out.offset     = accessor["byteOffset"].offset();
+
+        const Json& view   = document["bufferViews"][size_t(out.view)];
+        size_t      buffer = view["buffer"].offset(buffers.size());
+        size_t      size   = componentSize(out.component) * out.components;
+
+        if(size == 0 || out.count == 0 || buffer >= buffers.size())
+            return false;
+
+        out.stride = std::max(view["byteStride"].offset(), size);
+
+        size_t begin  = view["byteOffset"].offset();
+        size_t length = view["byteLength"].offset();
+        size_t last   = out.offset + out.stride * (out.count - 1) + size;
+
+        if(last > length || begin + length > buffers[buffer].size)
+            return false;
+
+        out.data = buffers[buffer].data + begin + out.offset;
+        return true;
+    }
+
+    // GL buffer holding a whole buffer view, uploaded straight from the mapping once
+    GLuint buffer(int index)
+    {
+        auto it = views.find(index);
+        if(it != views.end())
+            return it->second;
+
+        const Json& view = document["bufferViews"][size_t(index)];
+        const Span& span = buffers[view["buffer"].offset()];
+        size_t      size = view["byteLength"].offset();
+
+        GLuint id = 0;
+        glGenBuffers(1, &id);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+        glBufferData(
+            GL_COPY_WRITE_BUFFER,
+            size,
+            span.data + view["byteOffset"].offset(),
+            GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        uploaded += size;
+        views[index] = id;
+        gl_buffers.push_back(id);
+        return id;
+    }
+
+    void attribute(GLuint location, const GltfAccessor& accessor)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer(accessor.view));
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(
+            location,
+            accessor.components,
+            accessor.component,
+            accessor.normalized ? GL_TRUE : GL_FALSE,
+            static_cast<GLsizei>(accessor.stride),
+            (void*)accessor.offset);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // element of an accessor as float, normalized integers map to [0, 1] or [-1, 1]
+    static float component(const GltfAccessor& accessor, size_t element, int index)
+    {
+        const unsigned char* p = accessor.data + element * accessor.stride +
+                                 index * componentSize(accessor.component);
+        bool normalized = accessor.normalized;
+
+        switch(accessor.component)
+        {
+        case GL_BYTE:
+            return normalized ? std::max(read<int8_t>(p) / 127.0f, -1.0f)
+                              : read<int8_t>(p);
+        case GL_UNSIGNED_BYTE:
+            return normalized ? read<uint8_t>(p) / 255.0f : read<uint8_t>(p);
+        case GL_SHORT:
+            return normalized ? std::max(read<int16_t>(p) / 32767.0f, -1.0f)
+                              : read<int16_t>(p);
+        case GL_UNSIGNED_SHORT:
+            return normalized ? read<uint16_t>(p) / 65535.0f : read<uint16_t>(p);
+        case GL_UNSIGNED_INT: return static_cast<float>(read<uint32_t>(p));
+        case GL_FLOAT: return read<float>(p);
+        }
+        return 0.0f;
+    }
+
+    static uint32_t index(const GltfAccessor& accessor, size_t element)
+    {
+        const unsigned char* p = accessor.data + element * accessor.stride;
+
+        switch(accessor.component)
+        {
+        case GL_UNSIGNED_BYTE: return read<uint8_t>(p);
+        case GL_UNSIGNED_SHORT: return read<uint16_t>(p);
+        default: return read<uint32_t>(p);
+        }
+    }
+
+    static glm::vec3 element(const GltfAccessor& accessor, size_t i)
+    {
+        return glm::vec3(
+            component(accessor, i, 0),
+            component(accessor, i, 1),
+            component(accessor, i, 2));
+    }
+
+    // min and max are required for positions but stored unnormalized, so quantized
+    // positions are measured instead
+    void bounds(int index, const GltfAccessor& position, glm::vec3& min, glm::vec3& max)
+    {
+        const Json& accessor = document["accessors"][size_t(index)];
+        const Json& low  = accessor["min"];
+        const Json& high = accessor["max"];
+        if(!position.normalized && low.size() == 3 && high.size() == 3)
+        {
+            min = toVec3(low, 0.0);
+            max = toVec3(high, 0.0);
+            return;
+        }
+
+        min = max = element(position, 0);
+        for(size_t i = 1; i < position.count; i++)
+        {
+            glm::vec3 value = element(position, i);
+            min             = glm::min(min, value);
+            max             = glm::max(max, value);
+        }
+    }
+
+    // Area weighted normals into a new buffer at location 1. Indexed vertices are
+    // shared and come out smooth, unindexed triangles flat as the spec asks for.
+    void generateNormals(const GltfAccessor& position, const GltfAccessor* indices)
+    {
+        std::vector<glm::vec3> normals(position.count, glm::vec3(0.0f));
+
+        size_t corners = indices ? indices->count : position.count;
+        for(size_t i = 0; i + 2 < corners; i += 3)
+        {
+            uint32_t a = indices ? index(*indices, i) : uint32_t(i);
+            uint32_t b = indices ? index(*indices, i + 1) : uint32_t(i + 1);
+            uint32_t c = indices ? index(*indices, i + 2) : uint32_t(i + 2);
+            if(a >= position.count || b >= position.count || c >= position.count)
+                continue;
+
+            glm::vec3 pa     = element(position, a);
+            glm::vec3 normal =
+                glm::cross(element(position, b) - pa, element(position, c) - pa);
+
+            normals[a] += normal;
+            normals[b] += normal;
+            normals[c] += normal;
+        }
+
+        for(auto& normal : normals)
+        {
+            float length = glm::length(normal);
+            normal       = length > 0.0f ? normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+        }
+
+        GLuint id = 0;
+        glGenBuffers(1, &id);
+        glBindBuffer(GL_ARRAY_BUFFER, id);
+        glBufferData(
+            GL_ARRAY_BUFFER,
+            normals.size() * sizeof(glm::vec3),
+            normals.data(),
+            GL_STATIC_DRAW);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        gl_buffers.push_back(id);
+
+        converted += normals.size() * sizeof(glm::vec3);
+    }
+
+    // texture coordinates as floats with v flipped into a new buffer at location 2
+    void flipTexcoords(const GltfAccessor& texcoord)
+    {
+        std::vector<glm::vec2> texcoords(texcoord.count);
+        for(size_t i = 0; i < texcoord.count; i++)
+        {
+            texcoords[i] =
+                glm::vec2(component(texcoord, i, 0), 1.0f - component(texcoord, i, 1));
+        }
+
+        GLuint id = 0;
+        glGenBuffers(1, &id);
+        glBindBuffer(GL_ARRAY_BUFFER, id);
+        glBufferData(
+            GL_ARRAY_BUFFER,
+            texcoords.size() * sizeof(glm::vec2),
+            texcoords.data(),
+            GL_STATIC_DRAW);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        gl_buffers.push_back(id);
+
+        converted += texcoords.size() * sizeof(glm::vec2);
+    }
+
+    // image index of a texture info, embedded images are decoded from the mapping. Base
+    // colors are sRGB encoded, every other map is linear.
+    int texture(MaterialLibrary& library, const Json& info, bool color)
+    {
+        if(!info.has("index"))
+            return -1;
+
+        const Json& texture = document["textures"][info["index"].offset()];
+        size_t      source  = texture["source"].offset(SIZE_MAX);
+        const Json& image   = document["images"][source];
+
+        if(image.has("uri"))
+        {
+            std::string path = directory + '/' + decodeUri(image["uri"].str());
+            return library.texture(path, color);
+        }
+
+        size_t      index  = image["bufferView"].offset(SIZE_MAX);
+        const Json& view   = document["bufferViews"][index];
+        size_t      buffer = view["buffer"].offset(buffers.size());
+        size_t      begin  = view["byteOffset"].offset();
+        size_t      length = view["byteLength"].offset();
+
+        if(buffer >= buffers.size() || begin + length > buffers[buffer].size)
+            return -1;
+
+        std::string key = name + "#image" + std::to_string(source);
+        return library.texture(key, buffers[buffer].data + begin, length, color);
+    }
+};
@@ -0,0 +1,343 @@
+#pragma once
+
+// lib
+#include <assimp/postprocess.h>
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// modules
+#include "MipChain.hpp"
+#include "Vertex.hpp"
+
+enum class ImportProfile : char
+{
+    PREVIEW  = 0,
+    DEFAULT  = 1,
+    QUALITY  = 2,
+    CLUSTERS = 3,
+};
+
+const char* const IMPORT_PROFILE_NAMES[] = {"Preview", "Default", "Quality", "Clusters"};
+
+enum class WeldMode : char
+{
+    NONE    = 0,
+    EXACT   = 1,  // bitwise identical vertices
+    EPSILON = 2,  // every component within the same epsilon sized cell
+};
+
+// Who generates smooth normals and tangents when a profile asks for them
+enum class TangentSource : char
+{
+    ASSIMP = 0,  // GenSmoothNormals and CalcTangentSpace during the import
+    NATIVE = 1,  // TangentSpace on the welded arrays, see TangentSpace.hpp
+};
+
+const char* const TANGENT_SOURCE_NAMES[] = {"Assimp", "Native"};
+
+struct ImportSettings
+{
+    unsigned int  flags    = 0;  // Assimp post processing steps
+    WeldMode      weld     = WeldMode::EXACT;
+    float         epsilon  = 1e-5f;
+    bool          textures = true;   // decode material textures
+    bool          clusters = false;  // stream meshlets from a cluster store instead
+    bool          gpu      = true;   // upload to GL, headless models stay on the CPU
+    bool          deferred = false;  // GL objects wait for Model::upload()
+    bool          coverage = true;   // keep the alpha tested area of cutout textures
+    MipFilter     mips     = MipFilter::BOX;
+    TangentSource tangents = TangentSource::NATIVE;
+
+    // GL objects are created while importing
+    bool uploads() const
+    {
+        return gpu && !deferred;
+    }
+
+    // steps Assimp runs, native generation takes over smoothing and tangents
+    unsigned int assimpFlags() const
+    {
+        if(tangents == TangentSource::ASSIMP)
+            return flags;
+        return flags & ~(aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
+    }
+
+    bool nativeNormals() const
+    {
+        return tangents == TangentSource::NATIVE && (flags & aiProcess_GenSmoothNormals);
+    }
+
+    bool nativeTangents() const
+    {
+        return tangents == TangentSource::NATIVE && (flags & aiProcess_CalcTangentSpace);
+    }
+};
+
+// Preview skips textures and smoothing to skim through directories, quality validates
+// the scene, welds nearly identical vertices and filters mips with the Kaiser kernel.
+// None of them joins vertices in Assimp, the welding stage below does that faster.
+// Clusters converts the model into a cluster store once and streams it from there, for
+// scans too large to keep in memory.
+inline ImportSettings importSettings(ImportProfile profile)
+{
+    ImportSettings settings;
+
+    switch(profile)
+    {
+    case ImportProfile::PREVIEW:
+        settings.flags = aiProcess_Triangulate | aiProcess_GenNormals |
+                         aiProcess_FlipUVs | aiProcess_LimitBoneWeights;
+        settings.textures = false;
+        break;
+
+    case ImportProfile::DEFAULT:
+        settings.flags = aiProcess_Triangulate | aiProcess_GenSmoothNormals |
+                         aiProcess_FlipUVs | aiProcess_CalcTangentSpace |
+                         aiProcess_LimitBoneWeights;
+        break;
+
+    case ImportProfile::QUALITY:
+        settings.flags = aiProcess_Triangulate | aiProcess_GenSmoothNormals |
+                         aiProcess_FlipUVs | aiProcess_CalcTangentSpace |
+                         aiProcess_LimitBoneWeights | aiProcess_ValidateDataStructure |
+                         aiProcess_FindInvalidData | aiProcess_FindDegenerates |
+                         aiProcess_ImproveCacheLocality;
+        settings.weld = WeldMode::EPSILON;
+        settings.mips = MipFilter::KAISER;
+        break;
+
+    case ImportProfile::CLUSTERS:
+        settings.flags = aiProcess_Triangulate | aiProcess_GenSmoothNormals |
+                         aiProcess_FlipUVs;
+        settings.clusters = true;
+        break;
+    }
+
+    return settings;
+}
+
+// returns native generation for unknown names
+inline TangentSource tangentSource(const std::string& name)
+{
+    return name == "assimp" ? TangentSource::ASSIMP : TangentSource::NATIVE;
+}
+
+// returns the default profile for unknown names
+inline ImportProfile importProfile(const std::string& name)
+{
+    if(name == "preview")
+        return ImportProfile::PREVIEW;
+    if(name == "quality")
+        return ImportProfile::QUALITY;
+    if(name == "clusters")
+        return ImportProfile::CLUSTERS;
+    return ImportProfile::DEFAULT;
+}
+
+enum ImportStage : int
+{
+    STAGE_READ = 0,  // Assimp import and post processing
+    STAGE_CONVERT,
+    STAGE_WELD,
+    STAGE_TANGENTS,  // native normals and tangents, Assimp's are part of reading
+    STAGE_UPLOAD,
+    STAGE_MATERIALS,
+    STAGE_MIPS,  // CPU mip chains of the textures
+    STAGE_ANIMATIONS,
+    STAGE_COUNT,
+};
+
+const char* const IMPORT_STAGE_NAMES[] = {
+    "Read",
+    "Convert",
+    "Weld",
+    "Tangents",
+    "Upload",
+    "Materials",
+    "Mips",
+    "Animations"};
+
+struct ImportStats
+{
+    ImportProfile profile         = ImportProfile::DEFAULT;
+    TangentSource tangents        = TangentSource::NATIVE;
+    float         ms[STAGE_COUNT] = {};
+    size_t        vertices_read   = 0;
+    size_t        vertices        = 0;  // after welding
+    size_t        triangles       = 0;
+
+    float total() const
+    {
+        float sum = 0.0f;
+        for(float stage : ms)
+            sum += stage;
+        return sum;
+    }
+};
+
+// Adds the time between construction and destruction to a stage
+struct StageTimer
+{
+    float&                                stage;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    explicit StageTimer(float& s)
+        : stage(s)
+    {
+    }
+
+    ~StageTimer()
+    {
+        auto end = std::chrono::steady_clock::now();
+        stage += std::chrono::duration<float, std::milli>(end - start).count();
+    }
+};
+
+// Merges duplicate vertices of a mesh and rewrites its indices, keeping the first
+// occurrence. Vertices are looked up in an open addressing hash table, a single linear
+// pass instead of the sort Assimp's JoinIdenticalVertices does per vertex. In epsilon
+// mode the float components are snapped to cells first, values on both sides of a cell
+// border stay apart.
+struct VertexWelder
+{
+    static constexpr size_t   WORDS = sizeof(Vertex) / sizeof(uint32_t);
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    static_assert(sizeof(Vertex) % sizeof(uint32_t) == 0, "Vertex has padding");
+
+    std::vector<uint32_t> table;
+    std::vector<uint32_t> remap;
+    std::vector<int64_t>  cells;
+
+    // returns the number of vertices left
+    size_t weld(
+        std::vector<Vertex>&       vertices,
+        std::vector<unsigned int>& indices,
+        WeldMode                   mode,
+        float                      epsilon)
+    {
+        if(mode == WeldMode::NONE || vertices.empty())
+            return vertices.size();
+
+        if(mode == WeldMode::EXACT)
+        {
+            auto* words = reinterpret_cast<uint32_t*>(vertices.data());
+            return weldKeys(vertices, indices, words, false);
+        }
+
+        quantize(vertices, epsilon);
+        return weldKeys(vertices, indices, cells.data(), true);
+    }
+
+private:
+    void quantize(const std::vector<Vertex>& vertices, float epsilon)
+    {
+        const size_t ids_begin = offsetof(Vertex, m_BoneIDs) / sizeof(uint32_t);
+        const size_t ids_end   = ids_begin + MAX_BONE_INFLUENCE;
+        const double inverse   = 1.0 / std::max(epsilon, 1e-12f);
+
+        cells.resize(vertices.size() * WORDS);
+
+        for(size_t i = 0; i < vertices.size(); i++)
+        {
+            uint32_t words[WORDS];
+            std::memcpy(words, &vertices[i], sizeof(Vertex));
+
+            int64_t* cell = &cells[i * WORDS];
+            for(size_t w = 0; w < WORDS; w++)
+            {
+                if(w >= ids_begin && w < ids_end)
+                {
+                    cell[w] = static_cast<int32_t>(words[w]);
+                    continue;
+                }
+
+                float value;
+                std::memcpy(&value, &words[w], sizeof(float));
+                cell[w] = static_cast<int64_t>(std::floor(value * inverse + 0.5));
+            }
+        }
+    }
+
+    template<typename Key>
+    static uint32_t hash(const Key* key)
+    {
+        // FNV-1a over the words, then a murmur finalizer
+        uint64_t h = 14695981039346656037ull;
+        for(size_t w = 0; w < WORDS; w++)
+            h = (h ^ static_cast<uint64_t>(key[w])) * 1099511628211ull;
+
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        return static_cast<uint32_t>(h);
+    }
+
+    // Kept vertices (and their keys) are compacted to the front while walking, the table
+    // refers to compacted indices so lookups always compare against moved data.
+    template<typename Key>
+    size_t weldKeys(
+        std::vector<Vertex>&       vertices,
+        std::vector<unsigned int>& indices,
+        Key*                       keys,
+        bool                       compact_keys)
+    {
+        const size_t count    = vertices.size();
+        size_t       capacity = 16;
+        while(capacity < count * 2)
+            capacity *= 2;
+
+        table.assign(capacity, EMPTY);
+        remap.resize(count);
+
+        size_t unique = 0;
+        for(size_t i = 0; i < count; i++)
+        {
+            const Key* key  = keys + i * WORDS;
+            size_t     slot = hash(key) & (capacity - 1);
+
+            while(true)
+            {
+                uint32_t other = table[slot];
+
+                if(other == EMPTY)
+                {
+                    table[slot] = static_cast<uint32_t>(unique);
+                    remap[i]    = static_cast<uint32_t>(unique);
+
+                    if(unique != i)
+                    {
+                        if(compact_keys)
+                            std::memmove(keys + unique * WORDS, key, WORDS * sizeof(Key));
+                        vertices[unique] = vertices[i];
+                    }
+                    unique++;
+                    break;
+                }
+
+                const Key* kept = keys + size_t(other) * WORDS;
+                if(std::memcmp(kept, key, WORDS * sizeof(Key)) == 0)
+                {
+                    remap[i] = other;
+                    break;
+                }
+
+                slot = (slot + 1) & (capacity - 1);
+            }
+        }
+
+        vertices.resize(unique);
+        for(auto& index : indices)
+            index = remap[index];
+
+        return unique;
+    }
+};
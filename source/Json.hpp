@@ -0,0 +1,321 @@
+#pragma once
+
+// std
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Minimal JSON document, enough for asset metadata like glTF. Lookups of missing keys or
+// indices return a null value so nested accesses need no checks in between.
+struct Json
+{
+    enum Type : char
+    {
+        NUL = 0,
+        BOOLEAN,
+        NUMBER,
+        STRING,
+        ARRAY,
+        OBJECT,
+    };
+
+    Type                                      type    = NUL;
+    bool                                      boolean = false;
+    double                                    number  = 0.0;
+    std::string                               string;
+    std::vector<Json>                         array;
+    std::vector<std::pair<std::string, Json>> object;
+
+    const Json& operator[](const char* key) const
+    {
+        for(auto& [name, value] : object)
+            if(name == key)
+                return value;
+        return null();
+    }
+
+    const Json& operator[](size_t index) const
+    {
+        return index < array.size() ? array[index] : null();
+    }
+
+    // a literal 0 would otherwise be ambiguous with the key lookup
+    const Json& operator[](int index) const
+    {
+        return index >= 0 ? (*this)[size_t(index)] : null();
+    }
+
+    bool has(const char* key) const
+    {
+        return (*this)[key].type != NUL;
+    }
+
+    size_t size() const
+    {
+        return type == ARRAY ? array.size() : object.size();
+    }
+
+    double num(double fallback = 0.0) const
+    {
+        return type == NUMBER ? number : fallback;
+    }
+
+    int integer(int fallback = -1) const
+    {
+        return type == NUMBER ? static_cast<int>(number) : fallback;
+    }
+
+    size_t offset(size_t fallback = 0) const
+    {
+        return type == NUMBER && number >= 0.0 ? static_cast<size_t>(number) : fallback;
+    }
+
+    const std::string& str() const
+    {
+        return string;
+    }
+
+    static const Json& null()
+    {
+        static const Json value;
+        return value;
+    }
+
+    // parses a whole document, false on syntax errors
+    static bool parse(const char* begin, const char* end, Json& out)
+    {
+        Parser parser{begin, end};
+        if(!parser.value(out, 0))
+            return false;
+
+        parser.space();
+        return parser.p == parser.end;
+    }
+
+private:
+    static constexpr int MAX_DEPTH = 128;
+
+    struct Parser
+    {
+        const char* p;
+        const char* end;
+
+        void space()
+        {
+            while(p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+                p++;
+        }
+
+        bool literal(const char* word)
+        {
+            size_t length = std::strlen(word);
+            if(size_t(end - p) < length || std::memcmp(p, word, length) != 0)
+                return false;
+
+            p += length;
+            return true;
+        }
+
+        bool value(Json& out, int depth)
+        {
+            space();
+            if(p >= end || depth > MAX_DEPTH)
+                return false;
+
+            switch(*p)
+            {
+            case '{': return parseObject(out, depth);
+            case '[': return parseArray(out, depth);
+            case '"': out.type = STRING; return parseString(out.string);
+            case 't': out.type = BOOLEAN; out.boolean = true; return literal("true");
+            case 'f': out.type = BOOLEAN; out.boolean = false; return literal("false");
+            case 'n': out.type = NUL; return literal("null");
+            default: out.type = NUMBER; return parseNumber(out.number);
+            }
+        }
+
+        bool parseObject(Json& out, int depth)
+        {
+            out.type = OBJECT;
+            p++;
+
+            space();
+            if(p < end && *p == '}')
+                return ++p, true;
+
+            while(true)
+            {
+                std::string key;
+                space();
+                if(p >= end || *p != '"' || !parseString(key))
+                    return false;
+
+                space();
+                if(p >= end || *p++ != ':')
+                    return false;
+
+                out.object.emplace_back(std::move(key), Json());
+                if(!value(out.object.back().second, depth + 1))
+                    return false;
+
+                space();
+                if(p >= end)
+                    return false;
+                if(*p == '}')
+                    return ++p, true;
+                if(*p++ != ',')
+                    return false;
+            }
+        }
+
+        bool parseArray(Json& out, int depth)
+        {
+            out.type = ARRAY;
+            p++;
+
+            space();
+            if(p < end && *p == ']')
+                return ++p, true;
+
+            while(true)
+            {
+                out.array.emplace_back();
+                if(!value(out.array.back(), depth + 1))
+                    return false;
+
+                space();
+                if(p >= end)
+                    return false;
+                if(*p == ']')
+                    return ++p, true;
+                if(*p++ != ',')
+                    return false;
+            }
+        }
+
+        static void utf8(unsigned code, std::string& out)
+        {
+            if(code < 0x80)
+                out += char(code);
+            else if(code < 0x800)
+            {
+                out += char(0xc0 | (code >> 6));
+                out += char(0x80 | (code & 0x3f));
+            }
+            else if(code < 0x10000)
+            {
+                out += char(0xe0 | (code >> 12));
+                out += char(0x80 | ((code >> 6) & 0x3f));
+                out += char(0x80 | (code & 0x3f));
+            }
+            else
+            {
+                out += char(0xf0 | (code >> 18));
+                out += char(0x80 | ((code >> 12) & 0x3f));
+                out += char(0x80 | ((code >> 6) & 0x3f));
+                out += char(0x80 | (code & 0x3f));
+            }
+        }
+
+        bool hex(unsigned& code)
+        {
+            if(end - p < 4)
+                return false;
+
+            code = 0;
+            for(int i = 0; i < 4; i++, p++)
+            {
+                char c = *p;
+                code <<= 4;
+                if(c >= '0' && c <= '9')
+                    code |= c - '0';
+                else if(c >= 'a' && c <= 'f')
+                    code |= c - 'a' + 10;
+                else if(c >= 'A' && c <= 'F')
+                    code |= c - 'A' + 10;
+                else
+                    return false;
+            }
+            return true;
+        }
+
+        bool parseString(std::string& out)
+        {
+            p++;
+            while(p < end && *p != '"')
+            {
+                // copy runs without escapes at once
+                const char* run = p;
+                while(p < end && *p != '"' && *p != '\\')
+                    p++;
+                out.append(run, p);
+
+                if(p >= end || *p == '"')
+                    break;
+
+                if(++p >= end)
+                    return false;
+
+                char escape = *p++;
+                switch(escape)
+                {
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u':
+                {
+                    unsigned code = 0;
+                    if(!hex(code))
+                        return false;
+
+                    // surrogate pairs combine into one code point
+                    unsigned low = 0;
+                    if(code >= 0xd800 && code < 0xdc00 && end - p >= 6 && p[0] == '\\' &&
+                       p[1] == 'u')
+                    {
+                        p += 2;
+                        if(!hex(low))
+                            return false;
+                        code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                    }
+                    utf8(code, out);
+                    break;
+                }
+                default: out += escape; break;
+                }
+            }
+
+            if(p >= end)
+                return false;
+
+            p++;
+            return true;
+        }
+
+        // doubles keep byte offsets beyond 2^24 exact
+        bool parseNumber(double& out)
+        {
+            const char* start = p;
+            while(p < end && (unsigned(*p - '0') < 10 || *p == '-' || *p == '+' ||
+                              *p == '.' || *p == 'e' || *p == 'E'))
+                p++;
+
+            char   buffer[64];
+            size_t length = std::min<size_t>(p - start, sizeof(buffer) - 1);
+            if(length == 0)
+                return false;
+
+            std::memcpy(buffer, start, length);
+            buffer[length] = '\0';
+
+            char* stop = nullptr;
+            out        = std::strtod(buffer, &stop);
+            return stop == buffer + length;
+        }
+    };
+};
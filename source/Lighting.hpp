@@ -0,0 +1,437 @@
+#pragma once
+
+// glad
+#include <glad/gl.h>
+
+// lib
+#include <glm/glm.hpp>
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LIGHTING_SSE
+#endif
+
+// modules
+#include "Camera.hpp"
+#include "ThreadPool.hpp"
+
+// Cluster grid of screen tiles times exponential depth slices between the camera planes,
+// has to match the lit model fragment shader
+const int CLUSTER_X     = 16;
+const int CLUSTER_Y     = 9;
+const int CLUSTER_Z     = 24;
+const int CLUSTER_TILES = CLUSTER_X * CLUSTER_Y;
+const int CLUSTER_COUNT = CLUSTER_TILES * CLUSTER_Z;
+
+// Texture units of the light buffers, below BONE_PALETTE_UNIT
+const int LIGHT_UNIT         = 12;
+const int LIGHT_CLUSTER_UNIT = 13;
+const int LIGHT_INDEX_UNIT   = 14;
+
+// RGBA32F texels per light
+const int LIGHT_TEXELS = 3;
+
+enum class LightType : char
+{
+    POINT = 0,
+    SPOT  = 1,
+};
+
+struct Light
+{
+    LightType type      = LightType::POINT;
+    glm::vec3 position  = glm::vec3(0.0f);
+    glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    glm::vec3 color     = glm::vec3(1.0f);
+    float     intensity = 1.0f;
+    float     range     = 10.0f;
+    float     inner     = 0.95f;  // cosines of the spot cone
+    float     outer     = 0.85f;
+};
+
+// Lights moved into view space and the lights touching each cluster. Per light the
+// texels are position and range, color and inner cosine, direction and outer cosine.
+struct ClusterLights
+{
+    std::vector<glm::vec4> texels;
+    std::vector<uint32_t>  clusters;  // first index and count per cluster
+    std::vector<uint32_t>  indices;
+    int                    count = 0;
+};
+
+// Bins lights into the view space cluster grid on the CPU. Depth slices are independent
+// and binned in parallel, each cluster tests four lights at a time with SSE.
+struct LightGrid
+{
+    struct Slice
+    {
+        // lights overlapping the depth range of the slice, padded to a multiple of four
+        std::vector<float>    x, y, z, radius2;
+        std::vector<uint32_t> lights;
+
+        std::vector<uint32_t> indices;
+        uint32_t              offsets[CLUSTER_TILES] = {};
+        uint32_t              counts[CLUSTER_TILES]  = {};
+    };
+
+    // view space bounds of every cluster, rebuilt when the projection changes
+    std::vector<float> min_x, min_y, min_z, max_x, max_y, max_z;
+    float              depths[CLUSTER_Z + 1] = {};
+    glm::mat4          projection            = glm::mat4(0.0f);
+
+    std::vector<glm::vec4> spheres;
+    std::vector<Slice>     slices = std::vector<Slice>(CLUSTER_Z);
+
+    float bin_ms  = 0.0f;
+    int   entries = 0;  // light indices over all clusters
+
+    void build(
+        const std::vector<Light>& lights,
+        const glm::mat4&          view,
+        const glm::mat4&          proj,
+        ClusterLights&            out)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        if(proj != projection)
+        {
+            projection = proj;
+            bounds();
+        }
+
+        out.count = static_cast<int>(lights.size());
+        out.texels.resize(std::max<size_t>(lights.size(), 1) * LIGHT_TEXELS);
+        spheres.resize(lights.size());
+
+        for(size_t i = 0; i < lights.size(); i++)
+        {
+            const Light& light = lights[i];
+
+            glm::vec3 position  = glm::vec3(view * glm::vec4(light.position, 1.0f));
+            glm::vec3 direction = glm::normalize(glm::mat3(view) * light.direction);
+
+            // a point light is a spot light whose cone never cuts anything off
+            bool spot = light.type == LightType::SPOT;
+
+            glm::vec3  color  = light.color * light.intensity;
+            glm::vec4* texels = &out.texels[i * LIGHT_TEXELS];
+            texels[0]         = glm::vec4(position, light.range);
+            texels[1]         = glm::vec4(color, spot ? light.inner : -1.0f);
+            texels[2]         = glm::vec4(direction, spot ? light.outer : -2.0f);
+
+            spheres[i] = glm::vec4(position, light.range);
+        }
+
+        threadPool().parallelFor(CLUSTER_Z, 1, [this](size_t begin, size_t end) {
+            for(size_t slice = begin; slice < end; slice++)
+                bin(static_cast<int>(slice));
+        });
+
+        // slices are joined in order, the result does not depend on the scheduling
+        out.clusters.resize(CLUSTER_COUNT * 2);
+        out.indices.clear();
+
+        for(int s = 0; s < CLUSTER_Z; s++)
+        {
+            const Slice& slice = slices[s];
+            uint32_t     base  = static_cast<uint32_t>(out.indices.size());
+
+            out.indices.insert(
+                out.indices.end(),
+                slice.indices.begin(),
+                slice.indices.end());
+
+            uint32_t* clusters = &out.clusters[size_t(s) * CLUSTER_TILES * 2];
+            for(int tile = 0; tile < CLUSTER_TILES; tile++)
+            {
+                clusters[tile * 2]     = base + slice.offsets[tile];
+                clusters[tile * 2 + 1] = slice.counts[tile];
+            }
+        }
+
+        entries = static_cast<int>(out.indices.size());
+
+        // buffer textures can not be empty
+        if(out.indices.empty())
+            out.indices.push_back(0);
+
+        auto end = std::chrono::steady_clock::now();
+        bin_ms   = std::chrono::duration<float, std::milli>(end - start).count();
+    }
+
+private:
+    void bounds()
+    {
+        min_x.resize(CLUSTER_COUNT);
+        min_y.resize(CLUSTER_COUNT);
+        min_z.resize(CLUSTER_COUNT);
+        max_x.resize(CLUSTER_COUNT);
+        max_y.resize(CLUSTER_COUNT);
+        max_z.resize(CLUSTER_COUNT);
+
+        float ratio = CAMERA_FAR / CAMERA_NEAR;
+        for(int s = 0; s <= CLUSTER_Z; s++)
+            depths[s] = CAMERA_NEAR * std::pow(ratio, float(s) / CLUSTER_Z);
+
+        // view rays through the tile corners, assumes a symmetric perspective projection
+        float scale_x = 1.0f / projection[0][0];
+        float scale_y = 1.0f / projection[1][1];
+
+        for(int s = 0; s < CLUSTER_Z; s++)
+        {
+            float z_near = depths[s];
+            float z_far  = depths[s + 1];
+
+            for(int y = 0; y < CLUSTER_Y; y++)
+            {
+                float y0 = (-1.0f + 2.0f * y / CLUSTER_Y) * scale_y;
+                float y1 = (-1.0f + 2.0f * (y + 1) / CLUSTER_Y) * scale_y;
+
+                for(int x = 0; x < CLUSTER_X; x++)
+                {
+                    float x0 = (-1.0f + 2.0f * x / CLUSTER_X) * scale_x;
+                    float x1 = (-1.0f + 2.0f * (x + 1) / CLUSTER_X) * scale_x;
+
+                    int cluster = (s * CLUSTER_Y + y) * CLUSTER_X + x;
+
+                    // x0 < x1 and the depth is positive, the extremes lie on these edges
+                    min_x[cluster] = std::min(x0 * z_near, x0 * z_far);
+                    max_x[cluster] = std::max(x1 * z_near, x1 * z_far);
+                    min_y[cluster] = std::min(y0 * z_near, y0 * z_far);
+                    max_y[cluster] = std::max(y1 * z_near, y1 * z_far);
+                    min_z[cluster] = -z_far;
+                    max_z[cluster] = -z_near;
+                }
+            }
+        }
+    }
+
+    void bin(int s)
+    {
+        Slice& slice = slices[s];
+
+        slice.x.clear();
+        slice.y.clear();
+        slice.z.clear();
+        slice.radius2.clear();
+        slice.lights.clear();
+        slice.indices.clear();
+
+        for(size_t i = 0; i < spheres.size(); i++)
+        {
+            const glm::vec4& sphere = spheres[i];
+            if(-sphere.z + sphere.w < depths[s] || -sphere.z - sphere.w > depths[s + 1])
+                continue;
+
+            slice.x.push_back(sphere.x);
+            slice.y.push_back(sphere.y);
+            slice.z.push_back(sphere.z);
+            slice.radius2.push_back(sphere.w * sphere.w);
+            slice.lights.push_back(static_cast<uint32_t>(i));
+        }
+
+        // padding never overlaps, no distance is below a negative radius
+        while(slice.lights.size() % 4 != 0)
+        {
+            slice.x.push_back(0.0f);
+            slice.y.push_back(0.0f);
+            slice.z.push_back(0.0f);
+            slice.radius2.push_back(-1.0f);
+            slice.lights.push_back(0);
+        }
+
+        const size_t candidates = slice.lights.size();
+
+        for(int tile = 0; tile < CLUSTER_TILES; tile++)
+        {
+            int cluster = s * CLUSTER_TILES + tile;
+
+            slice.offsets[tile] = static_cast<uint32_t>(slice.indices.size());
+
+#ifdef LIGHTING_SSE
+            const __m128 zero    = _mm_setzero_ps();
+            const __m128 lower_x = _mm_set1_ps(min_x[cluster]);
+            const __m128 lower_y = _mm_set1_ps(min_y[cluster]);
+            const __m128 lower_z = _mm_set1_ps(min_z[cluster]);
+            const __m128 upper_x = _mm_set1_ps(max_x[cluster]);
+            const __m128 upper_y = _mm_set1_ps(max_y[cluster]);
+            const __m128 upper_z = _mm_set1_ps(max_z[cluster]);
+
+            for(size_t j = 0; j < candidates; j += 4)
+            {
+                // squared distance from each sphere center to the box
+                __m128 cx = _mm_loadu_ps(&slice.x[j]);
+                __m128 cy = _mm_loadu_ps(&slice.y[j]);
+                __m128 cz = _mm_loadu_ps(&slice.z[j]);
+
+                __m128 dx = _mm_max_ps(
+                    _mm_max_ps(_mm_sub_ps(lower_x, cx), _mm_sub_ps(cx, upper_x)),
+                    zero);
+                __m128 dy = _mm_max_ps(
+                    _mm_max_ps(_mm_sub_ps(lower_y, cy), _mm_sub_ps(cy, upper_y)),
+                    zero);
+                __m128 dz = _mm_max_ps(
+                    _mm_max_ps(_mm_sub_ps(lower_z, cz), _mm_sub_ps(cz, upper_z)),
+                    zero);
+
+                __m128 distance2 = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                    _mm_mul_ps(dz, dz));
+
+                int mask = _mm_movemask_ps(
+                    _mm_cmple_ps(distance2, _mm_loadu_ps(&slice.radius2[j])));
+
+                for(int k = 0; k < 4; k++)
+                {
+                    if(mask & (1 << k))
+                        slice.indices.push_back(slice.lights[j + k]);
+                }
+            }
+#else
+            for(size_t j = 0; j < candidates; j++)
+            {
+                float x  = slice.x[j];
+                float y  = slice.y[j];
+                float z  = slice.z[j];
+                float dx = std::max({min_x[cluster] - x, x - max_x[cluster], 0.0f});
+                float dy = std::max({min_y[cluster] - y, y - max_y[cluster], 0.0f});
+                float dz = std::max({min_z[cluster] - z, z - max_z[cluster], 0.0f});
+
+                if(dx * dx + dy * dy + dz * dz <= slice.radius2[j])
+                    slice.indices.push_back(slice.lights[j]);
+            }
+#endif
+
+            uint32_t size      = static_cast<uint32_t>(slice.indices.size());
+            slice.counts[tile] = size - slice.offsets[tile];
+        }
+    }
+};
+
+// Scatters point lights with random colors inside a box, the same seed gives the same set
+inline void scatterLights(
+    std::vector<Light>& lights,
+    int                 count,
+    const glm::vec3&    min,
+    const glm::vec3&    max,
+    unsigned            seed = 1)
+{
+    std::mt19937                          random(seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    float extent = glm::length(max - min);
+
+    lights.resize(count);
+    for(auto& light : lights)
+    {
+        glm::vec3 position = glm::vec3(unit(random), unit(random), unit(random));
+        glm::vec3 color    = glm::vec3(unit(random), unit(random), unit(random));
+
+        light.type     = LightType::POINT;
+        light.position = min + (max - min) * position;
+        light.color    = color * 0.8f + 0.2f;
+        light.range    = extent * (0.05f + 0.15f * unit(random));
+    }
+}
+
+// Stream the binned lights to the lit model shader through buffer textures. Lives on the
+// render thread.
+struct LightBuffers
+{
+    struct BufferTexture
+    {
+        GLuint buffer   = 0;
+        GLuint texture  = 0;
+        size_t capacity = 0;
+
+        void upload(GLenum format, const void* data, size_t size)
+        {
+            if(!buffer)
+            {
+                glGenBuffers(1, &buffer);
+                glGenTextures(1, &texture);
+            }
+
+            glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+            if(size > capacity)
+            {
+                capacity = size;
+                glBufferData(GL_TEXTURE_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+
+                glBindTexture(GL_TEXTURE_BUFFER, texture);
+                glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+            }
+            else
+            {
+                // orphan the previous contents instead of waiting for the GPU
+                glBufferData(GL_TEXTURE_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+            }
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        }
+
+        void bind(int unit)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glBindTexture(GL_TEXTURE_BUFFER, texture);
+        }
+
+        void release()
+        {
+            glDeleteTextures(1, &texture);
+            glDeleteBuffers(1, &buffer);
+
+            buffer   = 0;
+            texture  = 0;
+            capacity = 0;
+        }
+    };
+
+    BufferTexture lights;
+    BufferTexture clusters;
+    BufferTexture indices;
+
+    void upload(const ClusterLights& data)
+    {
+        size_t texels = data.texels.size() * sizeof(glm::vec4);
+        size_t ranges = data.clusters.size() * sizeof(uint32_t);
+        size_t lists  = data.indices.size() * sizeof(uint32_t);
+
+        lights.upload(GL_RGBA32F, data.texels.data(), texels);
+        clusters.upload(GL_RG32UI, data.clusters.data(), ranges);
+        indices.upload(GL_R32UI, data.indices.data(), lists);
+
+        lights.bind(LIGHT_UNIT);
+        clusters.bind(LIGHT_CLUSTER_UNIT);
+        indices.bind(LIGHT_INDEX_UNIT);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void release()
+    {
+        lights.release();
+        clusters.release();
+        indices.release();
+    }
+
+    // connects the light samplers of a program to their units
+    static void setup(GLuint program)
+    {
+        GLint lights   = glGetUniformLocation(program, "u_lights");
+        GLint clusters = glGetUniformLocation(program, "u_light_clusters");
+        GLint indices  = glGetUniformLocation(program, "u_light_indices");
+
+        glUseProgram(program);
+        glUniform1i(lights, LIGHT_UNIT);
+        glUniform1i(clusters, LIGHT_CLUSTER_UNIT);
+        glUniform1i(indices, LIGHT_INDEX_UNIT);
+    }
+};
@@ -0,0 +1,598 @@
+#pragma once
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+enum LogLevel : int
+{
+    LOG_DEBUG = 0,
+    LOG_INFO,
+    LOG_WARNING,
+    LOG_ERROR,
+    LOG_LEVEL_COUNT,
+};
+
+const char* const LOG_LEVEL_NAMES[LOG_LEVEL_COUNT] = {
+    "DEBUG",
+    "INFO",
+    "WARNING",
+    "ERROR",
+};
+
+// Written to the working directory by the application, tools only log to stdout
+const char* const LOG_FILE = "log.txt";
+
+// Per thread ring, a full ring drops messages instead of blocking the thread
+const size_t LOG_RING_BYTES = 1 << 18;
+
+// Records are padded to this, so a wrapped ring always has room for a padding header
+const size_t LOG_ALIGNMENT = 32;
+
+// String arguments are cut off after this many bytes
+const size_t LOG_STRING_MAX = 1024;
+
+// Formatted lines kept for the console panel
+const size_t LOG_HISTORY = 8192;
+
+// The sink sleeps this long when every ring was empty
+const std::chrono::milliseconds LOG_IDLE(5);
+
+// Formats a record's payload, instantiated for the argument types of each call site
+using LogRender = void (*)(const char* format, const char* payload, std::string& out);
+
+// Ring entry: this header and the encoded arguments. Padding at the end of the ring has
+// no render function.
+struct LogRecord
+{
+    uint32_t    size;  // with header and padding
+    uint32_t    level;
+    LogRender   render;
+    const char* format;
+    int64_t     time;  // steady clock nanoseconds
+};
+
+static_assert(sizeof(LogRecord) <= LOG_ALIGNMENT, "log records must fit the alignment");
+
+// Encoding of one argument. Numbers and pointers are copied as they are, strings are
+// copied with their length so the caller's buffer may change before the sink runs.
+template<typename T>
+struct LogArgument
+{
+    static_assert(std::is_trivially_copyable_v<T>, "log arguments must be plain values");
+
+    using Value = T;
+
+    static size_t size(const T&)
+    {
+        return sizeof(T);
+    }
+
+    static void write(char*& out, const T& value)
+    {
+        std::memcpy(out, &value, sizeof(T));
+        out += sizeof(T);
+    }
+
+    static T read(const char*& in)
+    {
+        T value;
+        std::memcpy(&value, in, sizeof(T));
+        in += sizeof(T);
+        return value;
+    }
+};
+
+struct LogString
+{
+    using Value = const char*;
+
+    static size_t size(std::string_view text)
+    {
+        return sizeof(uint32_t) + std::min(text.size(), LOG_STRING_MAX) + 1;
+    }
+
+    static void write(char*& out, std::string_view text)
+    {
+        uint32_t length = static_cast<uint32_t>(std::min(text.size(), LOG_STRING_MAX));
+        std::memcpy(out, &length, sizeof(length));
+        std::memcpy(out + sizeof(length), text.data(), length);
+        out[sizeof(length) + length] = '\0';
+        out += sizeof(length) + length + 1;
+    }
+
+    static const char* read(const char*& in)
+    {
+        uint32_t length;
+        std::memcpy(&length, in, sizeof(length));
+        const char* text = in + sizeof(length);
+        in += sizeof(length) + length + 1;
+        return text;
+    }
+
+    static std::string_view view(const char* text)
+    {
+        return text ? std::string_view(text) : std::string_view("(null)");
+    }
+};
+
+template<>
+struct LogArgument<const char*> : LogString
+{
+    static size_t size(const char* text)
+    {
+        return LogString::size(view(text));
+    }
+
+    static void write(char*& out, const char* text)
+    {
+        LogString::write(out, view(text));
+    }
+};
+
+template<>
+struct LogArgument<char*> : LogArgument<const char*>
+{
+};
+
+// glGetString returns its strings unsigned
+template<>
+struct LogArgument<const unsigned char*> : LogArgument<const char*>
+{
+    static size_t size(const unsigned char* text)
+    {
+        return LogArgument<const char*>::size(reinterpret_cast<const char*>(text));
+    }
+
+    static void write(char*& out, const unsigned char* text)
+    {
+        LogArgument<const char*>::write(out, reinterpret_cast<const char*>(text));
+    }
+};
+
+template<>
+struct LogArgument<std::string> : LogString
+{
+};
+
+template<>
+struct LogArgument<std::string_view> : LogString
+{
+};
+
+// Single producer, single consumer byte ring owned by one logging thread
+struct LogRing
+{
+    alignas(64) std::atomic<uint64_t> head = 0;  // written by the owning thread
+    uint64_t tail_cache                    = 0;  // its last look at tail
+    std::atomic<uint64_t> dropped          = 0;
+    uint64_t              reported         = 0;  // drops the sink has reported
+
+    alignas(64) std::atomic<uint64_t> tail = 0;  // written by the sink
+    std::atomic<bool> closed               = false;
+    unsigned          thread               = 0;
+
+    std::unique_ptr<char[]> bytes = std::make_unique<char[]>(LOG_RING_BYTES);
+
+    // space for size bytes at the returned position, nullptr if the ring is full
+    char* reserve(size_t size)
+    {
+        uint64_t position = head.load(std::memory_order_relaxed);
+        size_t   offset   = position % LOG_RING_BYTES;
+        size_t   wrap     = offset + size > LOG_RING_BYTES ? LOG_RING_BYTES - offset : 0;
+
+        if(position + wrap + size - tail_cache > LOG_RING_BYTES)
+        {
+            tail_cache = tail.load(std::memory_order_acquire);
+            if(position + wrap + size - tail_cache > LOG_RING_BYTES)
+                return nullptr;
+        }
+
+        // the sink skips the rest of the ring, the record starts at its beginning
+        if(wrap)
+        {
+            LogRecord padding = {};
+            padding.size      = static_cast<uint32_t>(wrap);
+            std::memcpy(bytes.get() + offset, &padding, sizeof(padding));
+            head.store(position + wrap, std::memory_order_release);
+            offset = 0;
+        }
+        return bytes.get() + offset;
+    }
+
+    void commit(size_t size)
+    {
+        uint64_t position = head.load(std::memory_order_relaxed);
+        head.store(position + size, std::memory_order_release);
+    }
+};
+
+struct LogLine
+{
+    uint64_t    sequence;
+    LogLevel    level;
+    unsigned    thread;
+    double      time;  // seconds since the logger started
+    std::string text;
+};
+
+// Asynchronous logger. Call sites only encode their arguments into a ring of their own
+// thread, without locks, allocations or formatting; a background sink merges the rings
+// in time order, formats the messages, writes them to stdout and the log file and keeps
+// the most recent lines for the console panel. Formats have to be string literals, they
+// are formatted later with printf rules, without arguments they are printed as they are.
+struct Logger
+{
+    std::atomic<int> level = LOG_DEBUG;  // messages below are discarded at the call site
+
+    Logger()
+    {
+        start  = now();
+        thread = std::thread(&Logger::run, this);
+    }
+
+    ~Logger()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        wake.notify_one();
+        thread.join();
+
+        if(file)
+            fclose(file);
+    }
+
+    template<typename... Args>
+    void write(LogLevel message_level, const char* format, const Args&... args)
+    {
+        if(message_level < level.load(std::memory_order_relaxed))
+            return;
+
+        LogRing* ring = local();
+        size_t   size = sizeof(LogRecord);
+        ((size += LogArgument<std::decay_t<Args>>::size(args)), ...);
+        size = (size + LOG_ALIGNMENT - 1) / LOG_ALIGNMENT * LOG_ALIGNMENT;
+
+        char* out = size <= LOG_RING_BYTES / 2 ? ring->reserve(size) : nullptr;
+        if(!out)
+        {
+            ring->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        LogRecord record;
+        record.size   = static_cast<uint32_t>(size);
+        record.level  = message_level;
+        record.render = &render<std::decay_t<Args>...>;
+        record.format = format;
+        record.time   = now();
+        std::memcpy(out, &record, sizeof(record));
+
+        char* payload = out + sizeof(LogRecord);
+        (LogArgument<std::decay_t<Args>>::write(payload, args), ...);
+
+        ring->commit(size);
+    }
+
+    // also write to the file at path, truncating it
+    bool open(const std::string& path)
+    {
+        FILE* opened = fopen(path.c_str(), "w");
+        if(!opened)
+            return false;
+
+        std::lock_guard<std::mutex> lock(sink_mutex);
+        if(file)
+            fclose(file);
+        file = opened;
+        return true;
+    }
+
+    // returns once everything logged before the call has been written
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        uint64_t                     target = passes + 2;
+        wake.notify_one();
+        drained.wait(lock, [&]() { return passes >= target || !running; });
+    }
+
+    // appends the lines from sequence next on and advances next past them
+    void history(uint64_t& next, std::vector<LogLine>& out)
+    {
+        std::lock_guard<std::mutex> lock(sink_mutex);
+        uint64_t last  = sequence.load(std::memory_order_relaxed);
+        uint64_t first = lines.empty() ? last : lines.front().sequence;
+        for(size_t i = std::max(next, first) - first; i < lines.size(); i++)
+            out.push_back(lines[i]);
+        next = last;
+    }
+
+    // number of lines written so far, without waiting for the sink
+    uint64_t written() const
+    {
+        return sequence.load(std::memory_order_relaxed);
+    }
+
+    uint64_t dropped() const
+    {
+        return dropped_total.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::thread             thread;
+    std::mutex              mutex;  // rings, running and passes
+    std::condition_variable wake;
+    std::condition_variable drained;
+    bool                    running = true;
+    uint64_t                passes  = 0;
+    int64_t                 start   = 0;
+
+    std::vector<std::shared_ptr<LogRing>> rings;
+    unsigned                              threads = 0;
+
+    std::mutex            sink_mutex;  // file and lines
+    FILE*                 file = nullptr;
+    std::deque<LogLine>   lines;
+    std::atomic<uint64_t> sequence = 0;  // of the next line, written under sink_mutex
+
+    std::atomic<uint64_t> dropped_total = 0;
+
+    // Owned by the thread and the logger, the sink releases it once the thread has
+    // exited and everything it logged is written
+    struct LocalRing
+    {
+        std::shared_ptr<LogRing> ring;
+
+        ~LocalRing()
+        {
+            if(ring)
+                ring->closed.store(true, std::memory_order_release);
+        }
+    };
+
+    LogRing* local()
+    {
+        thread_local LocalRing local;
+        if(!local.ring)
+        {
+            local.ring = std::make_shared<LogRing>();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            local.ring->thread = threads++;
+            rings.push_back(local.ring);
+        }
+        return local.ring.get();
+    }
+
+    template<typename... Args>
+    static void render(const char* format, const char* payload, std::string& out)
+    {
+        if constexpr(sizeof...(Args) == 0)
+            out += format;
+        else
+        {
+            // braced initialization reads the arguments in order
+            std::tuple<typename LogArgument<Args>::Value...> values{
+                LogArgument<Args>::read(payload)...};
+
+            std::apply(
+                [&](auto... value) {
+                    int length = snprintf(nullptr, 0, format, value...);
+                    if(length <= 0)
+                        return;
+
+                    size_t base = out.size();
+                    out.resize(base + length + 1);
+                    snprintf(&out[base], length + 1, format, value...);
+                    out.resize(base + length);
+                },
+                values);
+        }
+    }
+
+    struct Pending
+    {
+        const LogRecord* record;
+        unsigned         thread;
+    };
+
+    void run()
+    {
+        std::vector<std::shared_ptr<LogRing>> current;
+        std::vector<uint64_t>                 heads;
+        std::vector<Pending>                  pending;
+        std::string                           output;
+
+        while(true)
+        {
+            bool stop;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if(running && pending.empty())
+                    wake.wait_for(lock, LOG_IDLE);
+
+                stop    = !running;
+                current = rings;
+            }
+
+            // records up to the heads seen now, in time order across threads
+            pending.clear();
+            heads.resize(current.size());
+            uint64_t dropped = 0;
+            for(size_t i = 0; i < current.size(); i++)
+            {
+                LogRing& ring  = *current[i];
+                uint64_t drops = ring.dropped.load(std::memory_order_relaxed);
+                heads[i]       = ring.head.load(std::memory_order_acquire);
+                dropped += drops - ring.reported;
+                ring.reported = drops;
+
+                uint64_t position = ring.tail.load(std::memory_order_relaxed);
+                while(position < heads[i])
+                {
+                    auto* record = reinterpret_cast<const LogRecord*>(
+                        ring.bytes.get() + position % LOG_RING_BYTES);
+                    if(record->render)
+                        pending.push_back({record, ring.thread});
+                    position += record->size;
+                }
+            }
+
+            std::stable_sort(
+                pending.begin(),
+                pending.end(),
+                [](const Pending& a, const Pending& b) {
+                    return a.record->time < b.record->time;
+                });
+
+            output.clear();
+            {
+                std::lock_guard<std::mutex> lock(sink_mutex);
+                for(auto& entry : pending)
+                {
+                    const LogRecord& record = *entry.record;
+
+                    LogLine line;
+                    line.level  = static_cast<LogLevel>(record.level);
+                    line.thread = entry.thread;
+                    line.time   = seconds(record.time);
+                    record.render(
+                        record.format,
+                        reinterpret_cast<const char*>(&record + 1),
+                        line.text);
+
+                    // GL info logs and the like end in a line break of their own
+                    while(!line.text.empty() &&
+                          (line.text.back() == '\n' || line.text.back() == '\r'))
+                        line.text.pop_back();
+                    append(line, output);
+                }
+
+                if(dropped > 0)
+                {
+                    LogLine line;
+                    line.level  = LOG_WARNING;
+                    line.thread = 0;
+                    line.time   = seconds(now());
+                    line.text   = std::to_string(dropped) +
+                                " log messages dropped, their thread's ring was full";
+                    append(line, output);
+                }
+
+                if(!output.empty())
+                {
+                    fwrite(output.data(), 1, output.size(), stdout);
+                    fflush(stdout);
+                    if(file)
+                    {
+                        fwrite(output.data(), 1, output.size(), file);
+                        fflush(file);
+                    }
+                }
+            }
+            dropped_total.fetch_add(dropped, std::memory_order_relaxed);
+
+            // the records are formatted, their space goes back to the threads
+            for(size_t i = 0; i < current.size(); i++)
+                current[i]->tail.store(heads[i], std::memory_order_release);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                rings.erase(
+                    std::remove_if(
+                        rings.begin(),
+                        rings.end(),
+                        [](const std::shared_ptr<LogRing>& ring) {
+                            return ring->closed.load(std::memory_order_acquire) &&
+                                   ring->tail.load(std::memory_order_relaxed) ==
+                                       ring->head.load(std::memory_order_acquire);
+                        }),
+                    rings.end());
+                passes++;
+            }
+            drained.notify_all();
+
+            if(stop && pending.empty())
+                return;
+        }
+    }
+
+    static int64_t now()
+    {
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+    }
+
+    double seconds(int64_t time) const
+    {
+        return (time - start) * 1e-9;
+    }
+
+    // sink_mutex is held
+    void append(LogLine& line, std::string& output)
+    {
+        char prefix[64];
+        snprintf(
+            prefix,
+            sizeof(prefix),
+            "%10.3f %-7s [%u] ",
+            line.time,
+            LOG_LEVEL_NAMES[line.level],
+            line.thread);
+        output += prefix;
+        output += line.text;
+        output += '\n';
+
+        line.sequence = sequence.load(std::memory_order_relaxed);
+        sequence.store(line.sequence + 1, std::memory_order_relaxed);
+        lines.push_back(std::move(line));
+        if(lines.size() > LOG_HISTORY)
+            lines.pop_front();
+    }
+};
+
+inline Logger& logger()
+{
+    static Logger instance;
+    return instance;
+}
+
+template<typename... Args>
+void logDebug(const char* format, const Args&... args)
+{
+    logger().write(LOG_DEBUG, format, args...);
+}
+
+template<typename... Args>
+void logInfo(const char* format, const Args&... args)
+{
+    logger().write(LOG_INFO, format, args...);
+}
+
+template<typename... Args>
+void logWarning(const char* format, const Args&... args)
+{
+    logger().write(LOG_WARNING, format, args...);
+}
+
+template<typename... Args>
+void logError(const char* format, const Args&... args)
+{
+    logger().write(LOG_ERROR, format, args...);
+}
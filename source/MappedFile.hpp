@@ -0,0 +1,139 @@
+#pragma once
+
+// std
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file. Pages are faulted in by the OS on access, so
+// parsing reads straight from the page cache without copying into a buffer first.
+struct MappedFile
+{
+    const char* data = nullptr;
+    size_t      size = 0;
+
+    MappedFile() = default;
+
+    explicit MappedFile(const std::string& path)
+    {
+        open(path);
+    }
+
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    bool open(const std::string& path)
+    {
+        close();
+
+#ifdef _WIN32
+        file = CreateFileA(
+            path.c_str(),
+            GENERIC_READ,
+            FILE_SHARE_READ,
+            nullptr,
+            OPEN_EXISTING,
+            FILE_FLAG_SEQUENTIAL_SCAN,
+            nullptr);
+        if(file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER length;
+        GetFileSizeEx(file, &length);
+        size = static_cast<size_t>(length.QuadPart);
+
+        if(size > 0)
+        {
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if(mapping)
+            {
+                void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                data       = static_cast<const char*>(view);
+            }
+        }
+#else
+        descriptor = ::open(path.c_str(), O_RDONLY);
+        if(descriptor < 0)
+            return false;
+
+        struct stat status;
+        fstat(descriptor, &status);
+        size = static_cast<size_t>(status.st_size);
+
+        if(size > 0)
+        {
+            void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if(view != MAP_FAILED)
+            {
+                madvise(view, size, MADV_SEQUENTIAL);
+                data = static_cast<const char*>(view);
+            }
+        }
+#endif
+
+        // an empty file maps to nothing but is still valid
+        if(!data && size > 0)
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    // the file is read in random order, read ahead would only evict useful pages
+    void random()
+    {
+#ifndef _WIN32
+        if(data)
+            madvise(const_cast<char*>(data), size, MADV_RANDOM);
+#endif
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if(data)
+            UnmapViewOfFile(data);
+        if(mapping)
+            CloseHandle(mapping);
+        if(file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+
+        mapping = nullptr;
+        file    = INVALID_HANDLE_VALUE;
+#else
+        if(data)
+            munmap(const_cast<char*>(data), size);
+        if(descriptor >= 0)
+            ::close(descriptor);
+
+        descriptor = -1;
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE file    = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int descriptor = -1;
+#endif
+};
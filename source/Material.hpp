@@ -0,0 +1,581 @@
+#pragma once
+
+// glad
+#include <glad/gl.h>
+
+// lib
+#include <assimp/scene.h>
+#include <glm/glm.hpp>
+#include <stb_image.h>
+
+// std
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// modules
+#include "Log.hpp"
+#include "MipChain.hpp"
+#include "ResourcePack.hpp"
+#include "ThreadPool.hpp"
+
+// Texture arrays bound per model, units 0 to MAX_TEXTURE_PAGES - 1
+const int MAX_TEXTURE_PAGES = 8;
+
+// Layers per texture array, the minimum GL_MAX_ARRAY_TEXTURE_LAYERS guaranteed by 3.3
+const int MAX_PAGE_LAYERS = 256;
+
+// Materials per uniform block range, has to match the model fragment shader
+const int MAX_BLOCK_MATERIALS = 256;
+
+// Uniform block binding point of the material buffer
+const GLuint MATERIAL_BINDING = 1;
+
+enum MaterialMap : int
+{
+    MAP_DIFFUSE = 0,
+    MAP_SPECULAR,
+    MAP_NORMAL,
+    MAP_HEIGHT,
+};
+
+// std140 layout of `Material` in the model fragment shader. A map is the texture array
+// page in the upper and the layer in the lower 16 bits, -1 if the material has none.
+struct MaterialData
+{
+    glm::vec4  diffuse  = glm::vec4(1.0f);                    // rgb color, a opacity
+    glm::vec4  specular = glm::vec4(0.0f, 0.0f, 0.0f, 32.0f);  // rgb color, a shininess
+    glm::ivec4 maps     = glm::ivec4(-1);
+};
+
+// Where the pixels of an image come from, each owner has its own deallocator
+enum class PixelOwner : char
+{
+    STBI   = 0,  // decoded by stb_image, released with stbi_image_free
+    HEAP   = 1,  // copied or resized by the library, released with free
+    MAPPED = 2,  // point into the resource pack, never released
+};
+
+// Decoded image waiting to be copied into a texture array page
+struct MaterialImage
+{
+    std::string    path;
+    int            width  = 0;
+    int            height = 0;
+    GLenum         format = GL_RGBA8;
+    unsigned char* pixels = nullptr;
+    int            handle = -1;
+    PixelOwner     owner  = PixelOwner::STBI;
+    bool           srgb   = false;  // color texels, filtered in linear space
+    MipChain       mips;
+};
+
+// Texture array page laid out by MaterialLibrary::plan() and created by create()
+struct PageLayout
+{
+    int              width  = 0;
+    int              height = 0;
+    GLenum           format = GL_RGBA8;
+    std::vector<int> members;  // image of every layer
+};
+
+struct TexturePage
+{
+    GLuint id     = 0;
+    int    width  = 0;
+    int    height = 0;
+    GLenum format = GL_RGBA8;
+    int    layers = 0;
+};
+
+// All materials of a model. Textures are grouped by size and format into
+// GL_TEXTURE_2D_ARRAY pages and material parameters live in one uniform buffer, so
+// switching materials between draws is a single integer uniform instead of rebinding
+// textures.
+struct MaterialLibrary
+{
+    std::vector<MaterialData>  materials;
+    std::vector<MaterialImage> images;
+    std::vector<TexturePage>   pages;
+    std::vector<PageLayout>    layout;
+    std::map<std::string, int> image_index;
+
+    GLuint buffer  = 0;
+    bool   planned = false;  // maps are page handles instead of image indices
+
+    // how the mips of the images are built, set before textures are added
+    bool      gamma    = false;  // diffuse maps are sampled as sRGB
+    bool      coverage = true;   // cutouts keep their alpha tested area in every level
+    MipFilter filter   = MipFilter::BOX;
+
+    // adds the material and returns its index, without textures only the colors are used
+    int add(const aiMaterial* material, const std::string& directory, bool textures)
+    {
+        MaterialData data;
+
+        aiColor3D color(1.0f);
+        if(material->Get(AI_MATKEY_COLOR_DIFFUSE, color) == aiReturn_SUCCESS)
+            data.diffuse = glm::vec4(color.r, color.g, color.b, 1.0f);
+        if(material->Get(AI_MATKEY_COLOR_SPECULAR, color) == aiReturn_SUCCESS)
+            data.specular = glm::vec4(color.r, color.g, color.b, data.specular.w);
+
+        float value = 0.0f;
+        if(material->Get(AI_MATKEY_OPACITY, value) == aiReturn_SUCCESS)
+            data.diffuse.w = value;
+        if(material->Get(AI_MATKEY_SHININESS, value) == aiReturn_SUCCESS && value > 0.0f)
+            data.specular.w = value;
+
+        // same texture types as the former texture_diffuseN/... convention
+        std::string maps[4];
+        maps[MAP_DIFFUSE]  = texturePath(material, aiTextureType_DIFFUSE, directory);
+        maps[MAP_SPECULAR] = texturePath(material, aiTextureType_SPECULAR, directory);
+        maps[MAP_NORMAL]   = texturePath(material, aiTextureType_HEIGHT, directory);
+        maps[MAP_HEIGHT]   = texturePath(material, aiTextureType_AMBIENT, directory);
+
+        return add(data, maps, textures);
+    }
+
+    // adds a material with the file path of every map, empty paths are unused maps
+    int add(MaterialData data, const std::string (&maps)[4], bool textures)
+    {
+        for(int map = 0; map < 4; map++)
+        {
+            data.maps[map] = -1;
+            if(textures && !maps[map].empty())
+                data.maps[map] = texture(maps[map], map == MAP_DIFFUSE);
+        }
+
+        return add(data);
+    }
+
+    // adds a material whose maps already are image indices
+    int add(const MaterialData& data)
+    {
+        materials.push_back(data);
+        return static_cast<int>(materials.size()) - 1;
+    }
+
+    // path of the first texture of a type, empty if there is none
+    static std::string texturePath(
+        const aiMaterial*  material,
+        aiTextureType      type,
+        const std::string& directory)
+    {
+        if(material->GetTextureCount(type) == 0)
+            return std::string();
+
+        aiString name;
+        material->GetTexture(type, 0, &name);
+
+        return directory + '/' + name.C_Str();
+    }
+
+    // returns the image index of a texture, loads every file once. Color textures are
+    // sRGB encoded, the first map a file is used for decides.
+    int texture(const std::string& path, bool color)
+    {
+        auto it = image_index.find(path);
+        if(it != image_index.end())
+            return it->second;
+
+        MaterialImage image;
+        image.path = path;
+        colorSpace(image, color);
+
+        int components = 0;
+        if(!packed(image))
+            image.pixels =
+                stbi_load(path.c_str(), &image.width, &image.height, &components, 4);
+
+        return insert(image);
+    }
+
+    // same for an encoded image embedded in a model file, the key identifies it
+    int texture(
+        const std::string&   key,
+        const unsigned char* data,
+        size_t               size,
+        bool                 color)
+    {
+        auto it = image_index.find(key);
+        if(it != image_index.end())
+            return it->second;
+
+        MaterialImage image;
+        image.path = key;
+        colorSpace(image, color);
+
+        int components = 0;
+        image.pixels   = stbi_load_from_memory(
+            data,
+            static_cast<int>(size),
+            &image.width,
+            &image.height,
+            &components,
+            4);
+
+        return insert(image);
+    }
+
+    // Builds the mip chains of all images on the thread pool, images that have one
+    // already are skipped. Runs during the import, plan() only catches up on images
+    // it had to resize.
+    void generateMips()
+    {
+        threadPool().parallelFor(images.size(), 1, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i < end; i++)
+            {
+                MaterialImage& image = images[i];
+                if(image.mips.generated() || !image.pixels)
+                    continue;
+
+                image.mips.generate(
+                    image.pixels,
+                    image.width,
+                    image.height,
+                    image.srgb,
+                    coverage && image.srgb,
+                    filter);
+            }
+        });
+    }
+
+    // Groups the images into pages and turns the maps of the materials into page
+    // handles, maps on pages that do not fit are dropped. Touches no GL, deferred
+    // imports plan on their loading thread and only create() on the render thread.
+    void plan()
+    {
+        using Key = std::tuple<int, int, GLenum>;
+
+        std::map<Key, std::vector<int>> groups;
+        for(int i = 0; i < static_cast<int>(images.size()); i++)
+            groups[{images[i].width, images[i].height, images[i].format}].push_back(i);
+
+        // largest other group sharing the format of a group, end() if there is none
+        auto partner = [&groups](std::map<Key, std::vector<int>>::iterator group) {
+            auto best = groups.end();
+            for(auto it = groups.begin(); it != groups.end(); it++)
+            {
+                if(it == group || std::get<2>(it->first) != std::get<2>(group->first))
+                    continue;
+                if(best == groups.end() || it->second.size() > best->second.size())
+                    best = it;
+            }
+            return best;
+        };
+
+        // Too many distinct sizes, scale the smallest groups to the size of the largest
+        // one of their format. sRGB and linear images never share a page, the pages that
+        // still do not fit are dropped.
+        while(pageCount(groups) > MAX_TEXTURE_PAGES)
+        {
+            auto smallest = groups.end();
+            auto largest  = groups.end();
+            for(auto it = groups.begin(); it != groups.end(); it++)
+            {
+                bool larger = smallest != groups.end() &&
+                              it->second.size() >= smallest->second.size();
+                if(larger)
+                    continue;
+
+                auto target = partner(it);
+                if(target == groups.end())
+                    continue;
+
+                smallest = it;
+                largest  = target;
+            }
+            if(smallest == groups.end())
+                break;
+
+            auto [width, height, format] = largest->first;
+            for(int i : smallest->second)
+            {
+                resize(images[i], width, height);
+                largest->second.push_back(i);
+            }
+            groups.erase(smallest);
+        }
+
+        generateMips();
+
+        for(auto& [key, members] : groups)
+        {
+            for(size_t first = 0; first < members.size(); first += MAX_PAGE_LAYERS)
+            {
+                if(static_cast<int>(layout.size()) == MAX_TEXTURE_PAGES)
+                    break;
+
+                size_t count = std::min<size_t>(members.size() - first, MAX_PAGE_LAYERS);
+                int    index = static_cast<int>(layout.size());
+
+                PageLayout page;
+                std::tie(page.width, page.height, page.format) = key;
+                page.members.assign(&members[first], &members[first] + count);
+                for(int layer = 0; layer < static_cast<int>(count); layer++)
+                    images[page.members[layer]].handle = (index << 16) | layer;
+
+                layout.push_back(std::move(page));
+            }
+        }
+
+        // image indices become page/layer handles
+        for(auto& material : materials)
+        {
+            for(int map = 0; map < 4; map++)
+            {
+                if(material.maps[map] >= 0)
+                    material.maps[map] = images[material.maps[map]].handle;
+            }
+        }
+        planned = true;
+    }
+
+    // creates the planned texture arrays and the uniform buffer, needs the GL context
+    void create()
+    {
+        for(auto& page : layout)
+            upload(page);
+        layout.clear();
+
+        releaseImages();
+
+        size_t blocks = (materials.size() + MAX_BLOCK_MATERIALS - 1) / MAX_BLOCK_MATERIALS;
+        std::vector<MaterialData> padded(std::max<size_t>(blocks, 1) * MAX_BLOCK_MATERIALS);
+        std::copy(materials.begin(), materials.end(), padded.begin());
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(
+            GL_UNIFORM_BUFFER,
+            padded.size() * sizeof(MaterialData),
+            padded.data(),
+            GL_STATIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // plans and creates at once, needs the GL context
+    void build()
+    {
+        plan();
+        create();
+    }
+
+    // binds all pages, done once per model and not per mesh
+    void bind()
+    {
+        for(size_t i = 0; i < pages.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, pages[i].id);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // binds the block of MAX_BLOCK_MATERIALS materials that material indices map into
+    void bindBlock(int block)
+    {
+        GLintptr   offset = GLintptr(block) * MAX_BLOCK_MATERIALS * sizeof(MaterialData);
+        GLsizeiptr size   = MAX_BLOCK_MATERIALS * sizeof(MaterialData);
+        glBindBufferRange(GL_UNIFORM_BUFFER, MATERIAL_BINDING, buffer, offset, size);
+    }
+
+    // decoded pixels, kept by libraries that are never built for software rendering
+    void releaseImages()
+    {
+        for(auto& image : images)
+        {
+            releasePixels(image);
+            image.mips = MipChain();
+        }
+    }
+
+    void release()
+    {
+        for(auto& page : pages)
+            glDeleteTextures(1, &page.id);
+        glDeleteBuffers(1, &buffer);
+
+        pages.clear();
+        buffer = 0;
+    }
+
+    // connects the material block and page samplers of a program to their binding points
+    static void setup(GLuint program)
+    {
+        GLuint block = glGetUniformBlockIndex(program, "Materials");
+        if(block != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, block, MATERIAL_BINDING);
+
+        GLint units[MAX_TEXTURE_PAGES];
+        for(int i = 0; i < MAX_TEXTURE_PAGES; i++)
+            units[i] = i;
+
+        glUseProgram(program);
+        glUniform1iv(glGetUniformLocation(program, "u_pages"), MAX_TEXTURE_PAGES, units);
+    }
+
+private:
+    // Decoded texture from the resource pack. Stored pixels are used in place and only
+    // read, compressed ones are copied out of the decoded entry.
+    static bool packed(MaterialImage& image)
+    {
+        PackData data;
+        if(!resourcePack().read(image.path, PACK_TEXTURE, data) ||
+           data.size < sizeof(PackImage))
+            return false;
+
+        PackImage header;
+        std::memcpy(&header, data.data, sizeof(PackImage));
+
+        size_t bytes = size_t(header.width) * size_t(header.height) * 4;
+        if(header.width <= 0 || header.height <= 0 ||
+           data.size - sizeof(PackImage) < bytes)
+            return false;
+
+        const char* pixels = data.data + sizeof(PackImage);
+
+        image.width  = header.width;
+        image.height = header.height;
+        if(data.buffer.empty())
+        {
+            image.pixels = reinterpret_cast<unsigned char*>(const_cast<char*>(pixels));
+            image.owner  = PixelOwner::MAPPED;
+        }
+        else
+        {
+            image.pixels = static_cast<unsigned char*>(malloc(bytes));
+            image.owner  = PixelOwner::HEAP;
+            std::memcpy(image.pixels, pixels, bytes);
+        }
+        return true;
+    }
+
+    static void releasePixels(MaterialImage& image)
+    {
+        if(image.owner == PixelOwner::STBI)
+            stbi_image_free(image.pixels);
+        else if(image.owner == PixelOwner::HEAP)
+            free(image.pixels);
+
+        image.pixels = nullptr;
+        image.owner  = PixelOwner::STBI;
+    }
+
+    // gamma correct libraries sample color textures as sRGB
+    void colorSpace(MaterialImage& image, bool color) const
+    {
+        image.srgb   = color;
+        image.format = color && gamma ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    }
+
+    int insert(const MaterialImage& image)
+    {
+        if(!image.pixels)
+        {
+            logError("Texture failed to load at path: %s", image.path);
+            image_index[image.path] = -1;
+            return -1;
+        }
+
+        image_index[image.path] = static_cast<int>(images.size());
+        images.push_back(image);
+
+        return image_index[image.path];
+    }
+
+    template<typename Groups>
+    static int pageCount(const Groups& groups)
+    {
+        int count = 0;
+        for(auto& [key, members] : groups)
+            count += static_cast<int>((members.size() + MAX_PAGE_LAYERS - 1) / MAX_PAGE_LAYERS);
+        return count;
+    }
+
+    void upload(const PageLayout& layout)
+    {
+        TexturePage page;
+        page.width  = layout.width;
+        page.height = layout.height;
+        page.format = layout.format;
+        page.layers = static_cast<int>(layout.members.size());
+
+        // every level of every layer in one pass, the chains were built on the CPU
+        int levels = MipChain::count(page.width, page.height);
+
+        glGenTextures(1, &page.id);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, page.id);
+        for(int level = 0; level < levels; level++)
+            glTexImage3D(
+                GL_TEXTURE_2D_ARRAY,
+                level,
+                page.format,
+                MipChain::size(page.width, level),
+                MipChain::size(page.height, level),
+                page.layers,
+                0,
+                GL_RGBA,
+                GL_UNSIGNED_BYTE,
+                nullptr);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+        for(int layer = 0; layer < page.layers; layer++)
+        {
+            const MaterialImage& image = images[layout.members[layer]];
+
+            for(int level = 0; level < levels; level++)
+                glTexSubImage3D(
+                    GL_TEXTURE_2D_ARRAY,
+                    level,
+                    0,
+                    0,
+                    layer,
+                    MipChain::size(page.width, level),
+                    MipChain::size(page.height, level),
+                    1,
+                    GL_RGBA,
+                    GL_UNSIGNED_BYTE,
+                    level == 0 ? image.pixels
+                               : image.mips.level(page.width, page.height, level));
+        }
+
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        pages.push_back(page);
+    }
+
+    // nearest neighbour, only used when a model has more texture sizes than pages
+    static void resize(MaterialImage& image, int width, int height)
+    {
+        auto* pixels = static_cast<unsigned char*>(malloc(size_t(width) * height * 4));
+
+        for(int y = 0; y < height; y++)
+        {
+            int sy = y * image.height / height;
+            for(int x = 0; x < width; x++)
+            {
+                int sx = x * image.width / width;
+                std::copy_n(
+                    image.pixels + (size_t(sy) * image.width + sx) * 4,
+                    4,
+                    pixels + (size_t(y) * width + x) * 4);
+            }
+        }
+
+        releasePixels(image);
+        image.pixels = pixels;
+        image.owner  = PixelOwner::HEAP;
+        image.width  = width;
+        image.height = height;
+        image.mips   = MipChain();
+    }
+};
@@ -0,0 +1,309 @@
+#pragma once
+
+// lib
+#include <glm/glm.hpp>
+
+// std
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// modules
+#include "ThreadPool.hpp"
+
+// Limits of one cluster, small enough for 8 bit local indices and tight bounds
+const int MESHLET_MAX_VERTICES  = 64;
+const int MESHLET_MAX_TRIANGLES = 124;
+
+// Triangles clustered per task, every range is partitioned on its own
+const size_t MESHLET_RANGE_TRIANGLES = 1 << 16;
+
+// Small cluster of connected triangles with its bounding sphere and normal cone. The
+// cone is stored as axis and the sine of its half angle, a cutoff of 1 never culls.
+struct Meshlet
+{
+    std::vector<uint32_t> vertices;   // mesh vertex indices
+    std::vector<uint8_t>  triangles;  // three indices into vertices per triangle
+
+    glm::vec3 center      = glm::vec3(0.0f);
+    float     radius      = 0.0f;
+    glm::vec3 cone_axis   = glm::vec3(0.0f, 0.0f, 1.0f);
+    float     cone_cutoff = 1.0f;
+
+    // true if every triangle faces away from a camera at position (same space)
+    static bool backfacing(
+        const glm::vec3& center,
+        float            radius,
+        const glm::vec3& axis,
+        float            cutoff,
+        const glm::vec3& camera)
+    {
+        glm::vec3 direction = center - camera;
+        return glm::dot(direction, axis) >= cutoff * glm::length(direction) + radius;
+    }
+};
+
+// Partitions an indexed triangle mesh into meshlets. Clusters grow greedily from a seed
+// triangle over shared vertices, preferring triangles that add no new vertex, so they
+// stay compact. Triangle ranges are clustered in parallel; index order of scanned and
+// exported meshes is spatially coherent enough that clusters rarely need to cross them.
+struct MeshletBuilder
+{
+    static void build(
+        const std::vector<glm::vec3>& positions,
+        const std::vector<uint32_t>&  indices,
+        std::vector<Meshlet>&         out)
+    {
+        size_t triangles = indices.size() / 3;
+        size_t ranges    = (triangles + MESHLET_RANGE_TRIANGLES - 1) /
+                        MESHLET_RANGE_TRIANGLES;
+
+        std::vector<std::vector<Meshlet>> results(ranges);
+        threadPool().parallelFor(ranges, 1, [&](size_t begin, size_t end) {
+            for(size_t range = begin; range < end; range++)
+            {
+                size_t first = range * MESHLET_RANGE_TRIANGLES;
+                size_t last  = std::min(first + MESHLET_RANGE_TRIANGLES, triangles);
+                partition(
+                    positions,
+                    indices.data() + first * 3,
+                    last - first,
+                    results[range]);
+
+                for(auto& meshlet : results[range])
+                    bounds(positions, meshlet);
+            }
+        });
+
+        for(auto& result : results)
+            for(auto& meshlet : result)
+                out.push_back(std::move(meshlet));
+    }
+
+    // bounding sphere around the box and the cone of all face normals
+    static void bounds(const std::vector<glm::vec3>& positions, Meshlet& meshlet)
+    {
+        glm::vec3 min = positions[meshlet.vertices[0]];
+        glm::vec3 max = min;
+        for(uint32_t vertex : meshlet.vertices)
+        {
+            min = glm::min(min, positions[vertex]);
+            max = glm::max(max, positions[vertex]);
+        }
+
+        meshlet.center = (min + max) * 0.5f;
+        meshlet.radius = 0.0f;
+        for(uint32_t vertex : meshlet.vertices)
+        {
+            float distance = glm::length(positions[vertex] - meshlet.center);
+            meshlet.radius = std::max(meshlet.radius, distance);
+        }
+
+        std::vector<glm::vec3> normals;
+        glm::vec3              sum = glm::vec3(0.0f);
+        for(size_t i = 0; i < meshlet.triangles.size(); i += 3)
+        {
+            const glm::vec3& a = positions[meshlet.vertices[meshlet.triangles[i]]];
+            const glm::vec3& b = positions[meshlet.vertices[meshlet.triangles[i + 1]]];
+            const glm::vec3& c = positions[meshlet.vertices[meshlet.triangles[i + 2]]];
+
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            float     length = glm::length(normal);
+            if(length <= 0.0f)
+                continue;
+
+            normals.push_back(normal / length);
+            sum += normal;
+        }
+
+        meshlet.cone_axis   = glm::vec3(0.0f, 0.0f, 1.0f);
+        meshlet.cone_cutoff = 1.0f;
+
+        float length = glm::length(sum);
+        if(normals.empty() || length <= 0.0f)
+            return;
+
+        glm::vec3 axis    = sum / length;
+        float     minimum = 1.0f;
+        for(auto& normal : normals)
+            minimum = std::min(minimum, glm::dot(normal, axis));
+
+        // cones close to or wider than a half space can not cull anything
+        meshlet.cone_axis = axis;
+        if(minimum > 0.1f)
+            meshlet.cone_cutoff = std::sqrt(1.0f - minimum * minimum);
+    }
+
+private:
+    // clusters count triangles starting at indices
+    static void partition(
+        const std::vector<glm::vec3>& positions,
+        const uint32_t*               indices,
+        size_t                        count,
+        std::vector<Meshlet>&         out)
+    {
+        // range local vertex numbers keep every table proportional to the range
+        std::vector<uint32_t> unique(indices, indices + count * 3);
+        std::sort(unique.begin(), unique.end());
+        unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+
+        std::vector<uint32_t> corners(count * 3);
+        for(size_t i = 0; i < corners.size(); i++)
+        {
+            auto it    = std::lower_bound(unique.begin(), unique.end(), indices[i]);
+            corners[i] = static_cast<uint32_t>(it - unique.begin());
+        }
+
+        // triangles around every vertex
+        std::vector<uint32_t> offsets(unique.size() + 1, 0);
+        for(uint32_t corner : corners)
+            offsets[corner + 1]++;
+        for(size_t i = 1; i < offsets.size(); i++)
+            offsets[i] += offsets[i - 1];
+
+        std::vector<uint32_t> adjacency(corners.size());
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for(size_t i = 0; i < corners.size(); i++)
+            adjacency[fill[corners[i]]++] = static_cast<uint32_t>(i / 3);
+
+        std::vector<uint8_t>  emitted(count, 0);
+        std::vector<int16_t>  slots(unique.size(), -1);  // vertex in the current meshlet
+        std::vector<uint32_t> members;                   // its range local vertices
+
+        // unemitted triangles around the meshlet, queued holds the meshlet generation
+        // that last added a triangle
+        std::vector<uint32_t> candidates;
+        std::vector<uint32_t> queued(count, UINT32_MAX);
+        uint32_t              generation = 0;
+
+        size_t    cursor = 0;
+        int64_t   seed   = -1;  // triangle that did not fit into the last meshlet
+        Meshlet   meshlet;
+        glm::vec3 sum = glm::vec3(0.0f);  // of the meshlet's vertex positions
+
+        auto extra = [&](uint32_t triangle) {
+            const uint32_t* c = &corners[triangle * 3];
+            return int(slots[c[0]] < 0) + int(slots[c[1]] < 0 && c[1] != c[0]) +
+                   int(slots[c[2]] < 0 && c[2] != c[0] && c[2] != c[1]);
+        };
+
+        auto position = [&](uint32_t vertex) -> const glm::vec3& {
+            return positions[unique[vertex]];
+        };
+
+        auto flush = [&]() {
+            for(uint32_t vertex : members)
+                slots[vertex] = -1;
+            members.clear();
+            candidates.clear();
+            sum = glm::vec3(0.0f);
+            generation++;
+
+            if(!meshlet.triangles.empty())
+                out.push_back(std::move(meshlet));
+            meshlet = Meshlet();
+        };
+
+        while(true)
+        {
+            // Neighbour adding the fewest vertices, closest to the centroid among equals
+            // so meshlets grow round instead of into strips. Triangles without a new
+            // vertex are taken right away.
+            int64_t   best          = -1;
+            int       best_extra    = 4;
+            float     best_distance = FLT_MAX;
+            glm::vec3 centroid      = sum / float(std::max<size_t>(members.size(), 1));
+
+            for(size_t i = 0; i < candidates.size();)
+            {
+                uint32_t triangle = candidates[i];
+                if(emitted[triangle])
+                {
+                    candidates[i] = candidates.back();
+                    candidates.pop_back();
+                    continue;
+                }
+                i++;
+
+                int added = extra(triangle);
+                if(added > best_extra)
+                    continue;
+
+                const uint32_t* c      = &corners[triangle * 3];
+                glm::vec3       center = position(c[0]) + position(c[1]) + position(c[2]);
+                glm::vec3       offset = center / 3.0f - centroid;
+
+                float distance = glm::dot(offset, offset);
+
+                if(added < best_extra || distance < best_distance)
+                {
+                    best          = triangle;
+                    best_extra    = added;
+                    best_distance = distance;
+                    if(added == 0)
+                        break;
+                }
+            }
+
+            // A meshlet without connected triangles is done, it would not stay compact.
+            // The next one starts where the last full one stopped or else with the next
+            // triangle in index order.
+            if(best < 0 && !members.empty())
+            {
+                flush();
+                continue;
+            }
+            if(best < 0 && seed >= 0)
+                best = seed;
+            else if(best < 0)
+            {
+                while(cursor < count && emitted[cursor])
+                    cursor++;
+                if(cursor == count)
+                    break;
+
+                best = static_cast<int64_t>(cursor);
+            }
+            if(best_extra > 3)
+                best_extra = extra(static_cast<uint32_t>(best));
+            seed = -1;
+
+            size_t vertices  = members.size() + best_extra;
+            size_t triangles = meshlet.triangles.size() / 3 + 1;
+            if(vertices > MESHLET_MAX_VERTICES || triangles > MESHLET_MAX_TRIANGLES)
+            {
+                seed = best;
+                flush();
+                continue;
+            }
+
+            emitted[best] = 1;
+            for(int k = 0; k < 3; k++)
+            {
+                uint32_t vertex = corners[best * 3 + k];
+                if(slots[vertex] < 0)
+                {
+                    slots[vertex] = static_cast<int16_t>(members.size());
+                    members.push_back(vertex);
+                    meshlet.vertices.push_back(unique[vertex]);
+                    sum += position(vertex);
+
+                    for(uint32_t j = offsets[vertex]; j < offsets[vertex + 1]; j++)
+                    {
+                        uint32_t triangle = adjacency[j];
+                        if(!emitted[triangle] && queued[triangle] != generation)
+                        {
+                            queued[triangle] = generation;
+                            candidates.push_back(triangle);
+                        }
+                    }
+                }
+                meshlet.triangles.push_back(static_cast<uint8_t>(slots[vertex]));
+            }
+        }
+
+        flush();
+    }
+};
@@ -0,0 +1,424 @@
+#pragma once
+
+// lib
+#include <glm/glm.hpp>
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MIP_SSE
+#endif
+
+// modules
+#include "ThreadPool.hpp"
+
+// Kernel every level is reduced with
+enum class MipFilter : char
+{
+    BOX    = 0,  // average of 2x2 texels, what glGenerateMipmap does
+    KAISER = 1,  // Kaiser windowed sinc, sharper levels without ringing
+};
+
+const char* const MIP_FILTER_NAMES[] = {"Box", "Kaiser"};
+
+// Taps of the Kaiser kernel on either side of an output texel, in texels of the larger
+// level, and the window's shape parameter
+const int   MIP_KAISER_RADIUS = 3;
+const float MIP_KAISER_ALPHA  = 4.0f;
+
+// Alpha cutout textures are tested against
+const float MIP_ALPHA_CUTOFF = 0.5f;
+
+// A cutout has texels below the cutoff and at most this share of them in between the
+// ends, anything else is blended and keeps its alpha
+const float MIP_CUTOUT_BLEND = 0.1f;
+
+// Bins of the alpha histogram coverage is matched with
+const int MIP_COVERAGE_BINS = 1024;
+
+// Rows per task of the parallel loops
+const size_t MIP_GRAIN = 16;
+
+// Mip levels of an RGBA8 image below the image itself, built on the CPU instead of
+// with glGenerateMipmap on the GL thread.
+//
+// Every level is filtered from the float texels of the one above, so rounding does not
+// add up down the chain. The color of sRGB images is decoded to linear first and
+// encoded again per level; averaging the encoded values darkens every level. Cutout
+// images scale the alpha of each level so that the share of texels passing
+// MIP_ALPHA_CUTOFF stays that of the image, otherwise fences and foliage thin out with
+// distance. Rows are filtered in parallel on the thread pool, all four channels of a
+// texel in one SSE register.
+struct MipChain
+{
+    std::vector<unsigned char> pixels;      // every level below the image, tightly packed
+    int                        levels = 1;  // including the image
+
+    // levels of a full chain down to 1x1
+    static int count(int width, int height)
+    {
+        int levels = 1;
+        while(width > 1 || height > 1)
+        {
+            width  = std::max(width / 2, 1);
+            height = std::max(height / 2, 1);
+            levels++;
+        }
+        return levels;
+    }
+
+    static int size(int extent, int level)
+    {
+        return std::max(extent >> level, 1);
+    }
+
+    // texels of a level, 1 is the first below the image
+    const unsigned char* level(int width, int height, int index) const
+    {
+        size_t offset = 0;
+        for(int i = 1; i < index; i++)
+            offset += size_t(size(width, i)) * size(height, i) * 4;
+        return pixels.data() + offset;
+    }
+
+    bool generated() const
+    {
+        return levels > 1;
+    }
+
+    void generate(
+        const unsigned char* image,
+        int                  width,
+        int                  height,
+        bool                 srgb,
+        bool                 coverage,
+        MipFilter            filter)
+    {
+        levels = count(width, height);
+        pixels.clear();
+        if(levels == 1)
+            return;
+
+        size_t bytes = 0;
+        for(int i = 1; i < levels; i++)
+            bytes += size_t(size(width, i)) * size(height, i) * 4;
+        pixels.resize(bytes);
+
+        std::vector<glm::vec4> source(size_t(width) * height);
+        threadPool().parallelFor(height, MIP_GRAIN, [&](size_t begin, size_t end) {
+            size_t first = begin * width;
+            decode(image + first * 4, &source[first], (end - begin) * width, srgb);
+        });
+
+        // share of the image passing the alpha test, cutouts keep it in every level
+        float target = coverage ? cutout(source) : -1.0f;
+
+        Kernel kernel(filter);
+
+        std::vector<glm::vec4> rows;
+        std::vector<glm::vec4> reduced;
+        unsigned char*         out = pixels.data();
+
+        for(int i = 1; i < levels; i++)
+        {
+            int source_width  = size(width, i - 1);
+            int source_height = size(height, i - 1);
+            int level_width   = size(width, i);
+            int level_height  = size(height, i);
+
+            // horizontal, then vertical, both halve the extent unless it is 1 already
+            rows.resize(size_t(level_width) * source_height);
+            auto horizontal = [&](size_t begin, size_t end) {
+                for(size_t y = begin; y < end; y++)
+                    kernel.row(
+                        &source[y * source_width],
+                        source_width,
+                        &rows[y * level_width],
+                        level_width);
+            };
+            threadPool().parallelFor(source_height, MIP_GRAIN, horizontal);
+
+            reduced.assign(size_t(level_width) * level_height, glm::vec4(0.0f));
+            auto vertical = [&](size_t begin, size_t end) {
+                for(size_t y = begin; y < end; y++)
+                    kernel.column(
+                        rows.data(),
+                        level_width,
+                        source_height,
+                        int(y),
+                        &reduced[y * level_width],
+                        level_height);
+            };
+            threadPool().parallelFor(level_height, MIP_GRAIN, vertical);
+
+            float scale = target >= 0.0f ? alphaScale(reduced, target) : 1.0f;
+
+            auto store = [&](size_t begin, size_t end) {
+                size_t first = begin * level_width;
+                size_t count = (end - begin) * level_width;
+                encode(&reduced[first], out + first * 4, count, srgb, scale);
+            };
+            threadPool().parallelFor(level_height, MIP_GRAIN, store);
+
+            out += reduced.size() * 4;
+            source.swap(reduced);
+        }
+    }
+
+private:
+    // Weights of one output texel along an axis. Output texel x sits between the source
+    // texels 2x and 2x + 1, the taps start radius - 1 texels before that pair.
+    struct Kernel
+    {
+        std::vector<float> weights;
+        int                radius = 1;
+
+        explicit Kernel(MipFilter filter)
+        {
+            if(filter == MipFilter::BOX)
+            {
+                weights = {0.5f, 0.5f};
+                return;
+            }
+
+            radius = MIP_KAISER_RADIUS;
+            weights.resize(radius * 2);
+
+            float sum = 0.0f;
+            for(int t = 0; t < radius * 2; t++)
+            {
+                // distance from the output texel's center in source texels
+                float distance = float(t - radius) + 0.5f;
+                weights[t]     = sinc(distance * 0.5f) * kaiser(distance / radius);
+                sum += weights[t];
+            }
+            for(float& weight : weights)
+                weight /= sum;
+        }
+
+        static float sinc(float x)
+        {
+            if(std::fabs(x) < 1e-6f)
+                return 1.0f;
+            float angle = 3.14159265f * x;
+            return std::sin(angle) / angle;
+        }
+
+        // zeroth order modified Bessel function of the first kind, as a power series
+        static float bessel(float x)
+        {
+            float sum  = 1.0f;
+            float term = 1.0f;
+            for(int k = 1; k < 32 && term > sum * 1e-8f; k++)
+            {
+                term *= (x * 0.5f / k) * (x * 0.5f / k);
+                sum += term;
+            }
+            return sum;
+        }
+
+        static float kaiser(float x)
+        {
+            float inside = std::max(1.0f - x * x, 0.0f);
+            float window = bessel(MIP_KAISER_ALPHA * std::sqrt(inside));
+            return window / bessel(MIP_KAISER_ALPHA);
+        }
+
+        // textures repeat, so do the taps
+        static int wrap(int index, int extent)
+        {
+            index %= extent;
+            return index < 0 ? index + extent : index;
+        }
+
+        void row(const glm::vec4* source, int extent, glm::vec4* out, int count) const
+        {
+            if(extent == count)
+            {
+                std::copy(source, source + count, out);
+                return;
+            }
+
+            int taps = static_cast<int>(weights.size());
+            for(int x = 0; x < count; x++)
+            {
+                int first = x * 2 - radius + 1;
+#ifdef MIP_SSE
+                __m128 sum = _mm_setzero_ps();
+                for(int t = 0; t < taps; t++)
+                {
+                    __m128 texel  = _mm_loadu_ps(&source[wrap(first + t, extent)].x);
+                    __m128 weight = _mm_set1_ps(weights[t]);
+                    sum           = _mm_add_ps(sum, _mm_mul_ps(weight, texel));
+                }
+                _mm_storeu_ps(&out[x].x, sum);
+#else
+                glm::vec4 sum = glm::vec4(0.0f);
+                for(int t = 0; t < taps; t++)
+                    sum += weights[t] * source[wrap(first + t, extent)];
+                out[x] = sum;
+#endif
+            }
+        }
+
+        // row y of the output from the rows of the horizontal pass, out starts zeroed
+        void column(
+            const glm::vec4* rows,
+            int              width,
+            int              extent,
+            int              y,
+            glm::vec4*       out,
+            int              count) const
+        {
+            if(extent == count)
+            {
+                std::copy(rows + size_t(y) * width, rows + size_t(y + 1) * width, out);
+                return;
+            }
+
+            int first = y * 2 - radius + 1;
+            for(int t = 0; t < static_cast<int>(weights.size()); t++)
+            {
+                const glm::vec4* row = rows + size_t(wrap(first + t, extent)) * width;
+#ifdef MIP_SSE
+                __m128 w = _mm_set1_ps(weights[t]);
+                for(int x = 0; x < width; x++)
+                {
+                    __m128 sum = _mm_loadu_ps(&out[x].x);
+                    sum        = _mm_add_ps(sum, _mm_mul_ps(w, _mm_loadu_ps(&row[x].x)));
+                    _mm_storeu_ps(&out[x].x, sum);
+                }
+#else
+                for(int x = 0; x < width; x++)
+                    out[x] += weights[t] * row[x];
+#endif
+            }
+        }
+    };
+
+    // sRGB encoded byte to linear
+    static const float* decodeTable()
+    {
+        static const std::vector<float> table = []() {
+            std::vector<float> values(256);
+            for(int i = 0; i < 256; i++)
+            {
+                float c = i / 255.0f;
+                if(c <= 0.04045f)
+                    values[i] = c / 12.92f;
+                else
+                    values[i] = std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            return values;
+        }();
+        return table.data();
+    }
+
+    // linear in steps of 1 / 4095 to sRGB encoded bytes, fine enough for the darks
+    static const unsigned char* encodeTable()
+    {
+        static const std::vector<unsigned char> table = []() {
+            std::vector<unsigned char> values(4096);
+            for(int i = 0; i < 4096; i++)
+            {
+                float l = i / 4095.0f;
+                float c = 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+                if(l <= 0.0031308f)
+                    c = l * 12.92f;
+                c         = std::clamp(c, 0.0f, 1.0f);
+                values[i] = static_cast<unsigned char>(c * 255.0f + 0.5f);
+            }
+            return values;
+        }();
+        return table.data();
+    }
+
+    static void decode(const unsigned char* in, glm::vec4* out, size_t count, bool srgb)
+    {
+        const float* table = decodeTable();
+        for(size_t i = 0; i < count; i++)
+        {
+            const unsigned char* texel = in + i * 4;
+
+            out[i] = glm::vec4(texel[0], texel[1], texel[2], texel[3]) / 255.0f;
+            if(srgb)
+            {
+                out[i].x = table[texel[0]];
+                out[i].y = table[texel[1]];
+                out[i].z = table[texel[2]];
+            }
+        }
+    }
+
+    // Kaiser taps overshoot near edges, every channel is clamped
+    static void encode(
+        const glm::vec4* in,
+        unsigned char*   out,
+        size_t           count,
+        bool             srgb,
+        float            scale)
+    {
+        const unsigned char* table = encodeTable();
+        for(size_t i = 0; i < count; i++)
+        {
+            for(int c = 0; c < 3; c++)
+            {
+                float value = std::clamp(in[i][c], 0.0f, 1.0f);
+                if(srgb)
+                    out[i * 4 + c] = table[int(value * 4095.0f + 0.5f)];
+                else
+                    out[i * 4 + c] = static_cast<unsigned char>(value * 255.0f + 0.5f);
+            }
+
+            float alpha    = std::clamp(in[i].w * scale, 0.0f, 1.0f);
+            out[i * 4 + 3] = static_cast<unsigned char>(alpha * 255.0f + 0.5f);
+        }
+    }
+
+    // share of texels passing the alpha test if the image is a cutout, -1 otherwise
+    static float cutout(const std::vector<glm::vec4>& texels)
+    {
+        size_t passed  = 0;
+        size_t blended = 0;
+        for(const glm::vec4& texel : texels)
+        {
+            passed += texel.w >= MIP_ALPHA_CUTOFF;
+            blended += texel.w > MIP_CUTOUT_BLEND && texel.w < 1.0f - MIP_CUTOUT_BLEND;
+        }
+
+        if(passed == texels.size() || blended > texels.size() * MIP_CUTOUT_BLEND)
+            return -1.0f;
+        return float(passed) / texels.size();
+    }
+
+    // Scale of the level's alpha that lets the target share pass the test. The alpha
+    // the target share of texels reaches is looked up in a histogram, it is scaled to
+    // the cutoff.
+    static float alphaScale(const std::vector<glm::vec4>& texels, float target)
+    {
+        std::vector<size_t> bins(MIP_COVERAGE_BINS, 0);
+        for(const glm::vec4& texel : texels)
+        {
+            float alpha = std::clamp(texel.w, 0.0f, 1.0f);
+            bins[std::min(int(alpha * MIP_COVERAGE_BINS), MIP_COVERAGE_BINS - 1)]++;
+        }
+
+        size_t wanted = static_cast<size_t>(target * texels.size() + 0.5f);
+        if(wanted == 0)
+            return 1.0f;
+
+        size_t above = 0;
+        for(int bin = MIP_COVERAGE_BINS - 1; bin > 0; bin--)
+        {
+            above += bins[bin];
+            if(above >= wanted)
+                return MIP_ALPHA_CUTOFF / (float(bin) / MIP_COVERAGE_BINS);
+        }
+        return MIP_ALPHA_CUTOFF * MIP_COVERAGE_BINS;
+    }
+};
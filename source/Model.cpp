@@ -1,19 +1,18 @@
 #include "Model.hpp"
 
-#include <iostream>
+#include "Log.hpp"
 
 Model::Model(const char* filename)
 {
     Assimp::Importer importer;
 
-    auto flags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs |
-                 aiProcess_CalcTangentSpace;
+    auto flags = importSettings(ImportProfile::DEFAULT).flags;
 
     const aiScene* scene = importer.ReadFile(filename, flags);
 
     if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
     {
-        cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+        logError("Assimp could not read %s: %s", filename, importer.GetErrorString());
         return;
     }
 
@@ -184,7 +183,7 @@ unsigned int Model::TextureFromFile(const char* path, const string& directory, b
     }
     else
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
+        logError("Texture failed to load at path: %s", path);
         stbi_image_free(data);
     }
 
@@ -6,6 +6,7 @@
 
 // lib
 #include <assimp/Importer.hpp>
+#include <assimp/config.h>
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 #include <glm/glm.hpp>
@@ -14,113 +15,196 @@
 #include <stb_image.h>
 
 // std
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
-#include <iostream>
 #include <map>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <vector>
 
 // inc
+#include "Animation.hpp"
+#include "ClusterStore.hpp"
+#include "GltfLoader.hpp"
+#include "Import.hpp"
+#include "Material.hpp"
+#include "Log.hpp"
+#include "ObjLoader.hpp"
+#include "ResourcePack.hpp"
+#include "SceneGraph.hpp"
 #include "Shader.hpp"
+#include "TangentSpace.hpp"
+#include "UniformRing.hpp"
+#include "Vertex.hpp"
 
 using namespace std;
 
-unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false);
-
-#define MAX_BONE_INFLUENCE 4
-
-struct Vertex
-{
-    // position
-    glm::vec3 Position;
-    // normal
-    glm::vec3 Normal;
-    // texCoords
-    glm::vec2 TexCoords;
-    // tangent
-    glm::vec3 Tangent;
-    // bitangent
-    glm::vec3 Bitangent;
-    // bone indexes which will influence this vertex
-    int       m_BoneIDs[MAX_BONE_INFLUENCE];
-    // weights from each bone
-    float     m_Weights[MAX_BONE_INFLUENCE];
-};
-
-struct Texture
-{
-    unsigned int id;
-    string       type;
-    string       path;
-};
-
 class Mesh
 {
 public:
     // mesh Data
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
-    vector<Texture>      textures;
-    unsigned int         VAO;
+    int                  material = 0;  // index into the model's material library
+    unsigned int         VAO      = 0;
+    bool                 skinned  = false;  // positions are relative to the bone palette
+    bool                 tangents = false;  // the vertex layout has tangent frames
+    uint32_t             features = 0;      // shader features, see Model::buildFeatures
+
+    // local space bounding box
+    glm::vec3 bounds_min = glm::vec3(0.0f);
+    glm::vec3 bounds_max = glm::vec3(0.0f);
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // draw parameters, meshes uploaded straight from file buffers keep no CPU copy and
+    // may use 8 or 16 bit indices at an offset. GL_NONE draws the vertices in order.
+    GLsizei count        = 0;
+    GLenum  index_type   = GL_UNSIGNED_INT;
+    size_t  index_offset = 0;
+
+    // constructor, meshes that are not uploaded only keep the CPU copy
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, int material, bool upload)
     {
         this->vertices = vertices;
         this->indices  = indices;
-        this->textures = textures;
+        this->material = material;
+
+        if(!vertices.empty())
+        {
+            bounds_min = bounds_max = vertices[0].Position;
+            for(auto& vertex : vertices)
+            {
+                bounds_min = glm::min(bounds_min, vertex.Position);
+                bounds_max = glm::max(bounds_max, vertex.Position);
+            }
+        }
+        tangents = hasTangents(vertices.data(), vertices.size());
 
         // now that we have all the required data, set the vertex buffers and its
         // attribute pointers.
-        setupMesh();
-    }
-
-    // render the mesh
-    void Draw(Shader& shader)
-    {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i);  // active proper texture unit before
-                                               // binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++);  // transfer unsigned int to string
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++);  // transfer unsigned int to string
-            else if(name == "texture_height")
-                number = std::to_string(heightNr++);  // transfer unsigned int to string
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.program, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
-        }
+        count = static_cast<GLsizei>(indices.size());
+        if(upload)
+            setupMesh(
+                this->vertices.data(),
+                this->vertices.size(),
+                this->indices.data());
+    }
 
+    // uploads arrays that stay owned by the caller, e.g. mapped from the resource pack,
+    // without keeping a CPU copy
+    Mesh(
+        const Vertex*       vertex_data,
+        size_t              vertex_count,
+        const unsigned int* index_data,
+        size_t              index_count,
+        int                 material,
+        const glm::vec3&    bounds_min,
+        const glm::vec3&    bounds_max)
+        : material(material)
+        , tangents(hasTangents(vertex_data, vertex_count))
+        , bounds_min(bounds_min)
+        , bounds_max(bounds_max)
+        , count(static_cast<GLsizei>(index_count))
+    {
+        setupMesh(vertex_data, vertex_count, index_data);
+    }
+
+    // mesh whose vertex array was already set up from GPU ready buffers
+    Mesh(
+        unsigned int     VAO,
+        GLsizei          count,
+        GLenum           index_type,
+        size_t           index_offset,
+        int              material,
+        const glm::vec3& bounds_min,
+        const glm::vec3& bounds_max)
+        : material(material)
+        , VAO(VAO)
+        , bounds_min(bounds_min)
+        , bounds_max(bounds_max)
+        , count(count)
+        , index_type(index_type)
+        , index_offset(index_offset)
+        , VBO(0)
+        , EBO(0)
+    {
+    }
+
+    // render the mesh, textures and material parameters are bound per model
+    void Draw()
+    {
         // draw mesh
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+        if(index_type == GL_NONE)
+            glDrawArrays(GL_TRIANGLES, 0, count);
+        else
+            glDrawElements(GL_TRIANGLES, count, index_type, (void*)index_offset);
         glBindVertexArray(0);
+    }
+
+    // axis aligned box around the bounds moved into world space
+    void worldBounds(const glm::mat4& world, glm::vec3& min, glm::vec3& max) const
+    {
+        transformBounds(world, bounds_min, bounds_max, min, max);
+    }
+
+    static void transformBounds(
+        const glm::mat4& world,
+        const glm::vec3& bounds_min,
+        const glm::vec3& bounds_max,
+        glm::vec3&       min,
+        glm::vec3&       max)
+    {
+        glm::vec3 center = (bounds_min + bounds_max) * 0.5f;
+        glm::vec3 extent = (bounds_max - bounds_min) * 0.5f;
+
+        glm::vec3 world_center = glm::vec3(world * glm::vec4(center, 1.0f));
+        glm::vec3 world_extent = glm::abs(glm::vec3(world[0])) * extent.x +
+                                 glm::abs(glm::vec3(world[1])) * extent.y +
+                                 glm::abs(glm::vec3(world[2])) * extent.z;
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+        min = world_center - world_extent;
+        max = world_center + world_extent;
+    }
+
+    // layouts without tangent frames leave them zero
+    static bool hasTangents(const Vertex* vertices, size_t count)
+    {
+        for(size_t i = 0; i < count; i++)
+            if(vertices[i].Tangent != glm::vec3(0.0f))
+                return true;
+        return false;
+    }
+
+    // creates the buffers from the CPU copy of a mesh constructed without upload
+    void upload()
+    {
+        if(!VAO)
+            setupMesh(vertices.data(), vertices.size(), indices.data());
+    }
+
+    // deletes the buffers, the model frees vertex arrays shared from file buffers
+    void release()
+    {
+        if(VBO)
+            glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        VAO = VBO = EBO = 0;
     }
 
 private:
     // render data
-    unsigned int VBO, EBO;
+    unsigned int VBO = 0, EBO = 0;
 
     // initializes all the buffer objects/arrays
-    void setupMesh()
+    void setupMesh(
+        const Vertex*       vertex_data,
+        size_t              vertex_count,
+        const unsigned int* index_data)
     {
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
@@ -134,13 +218,17 @@ private:
         // its items. The effect is that we can simply pass a pointer to the struct and it
         // translates perfectly to a glm::vec3/2 array which again translates to 3/2
         // floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        glBufferData(
+            GL_ARRAY_BUFFER,
+            vertex_count * sizeof(Vertex),
+            vertex_data,
+            GL_STATIC_DRAW);
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
         glBufferData(
             GL_ELEMENT_ARRAY_BUFFER,
-            indices.size() * sizeof(unsigned int),
-            &indices[0],
+            size_t(count) * sizeof(unsigned int),
+            index_data,
             GL_STATIC_DRAW);
 
         // set the vertex attribute pointers
@@ -204,57 +292,797 @@ class Model
 {
 public:
     // model data
-    vector<Texture> textures_loaded;  // stores all the textures loaded so far,
-                                      // optimization to make sure textures aren't loaded
-                                      // more than once.
+    MaterialLibrary materials;
     vector<Mesh>    meshes;
+    string          path;
     string          directory;
     bool            gammaCorrection;
 
-    // constructor, expects a filepath to a 3D model.
-    Model(string const& path, bool gamma = false)
-        : gammaCorrection(gamma)
+    // node hierarchy and the node every mesh is attached to
+    SceneGraph  nodes;
+    vector<int> mesh_nodes;
+
+    // skinning and animation data, empty for static models
+    Skeleton              skeleton;
+    vector<AnimationClip> animations;
+
+    ImportSettings settings;
+    ImportStats    stats;
+
+    // meshlets streamed from a cluster store, replaces the meshes
+    std::unique_ptr<ClusterStore> clusters;
+
+    // buffer views and vertex arrays of a glTF file, shared by its meshes
+    vector<GLuint> file_buffers;
+    vector<GLuint> file_arrays;
+
+    // GL objects exist, only touched by the thread owning the context after the import
+    bool uploaded = false;
+
+    // constructor, expects a filepath to a 3D model. Without gpu nothing touches GL,
+    // meshes and decoded textures stay on the CPU for the software renderer. Deferred
+    // models are imported without GL on any thread and uploaded later with upload().
+    Model(
+        string const& path,
+        ImportProfile profile  = ImportProfile::DEFAULT,
+        bool          gamma    = false,
+        bool          gpu      = true,
+        TangentSource tangents = TangentSource::NATIVE,
+        bool          deferred = false)
+        : path(path)
+        , gammaCorrection(gamma)
     {
+        settings          = importSettings(profile);
+        settings.gpu      = gpu;
+        settings.deferred = deferred;
+        settings.tangents = tangents;
+        stats.profile     = profile;
+        stats.tangents    = tangents;
+        setupMaterials();
         loadModel(path);
+        buildFeatures();
+        uploaded = settings.uploads();
+    }
+
+    // Creates the GL objects of a deferred import, needs the context. The pages, map
+    // handles and features were final when the import finished, draws read them
+    // while this runs.
+    void upload()
+    {
+        for(auto& mesh : meshes)
+            mesh.upload();
+        materials.create();
+        uploaded = true;
+    }
+
+    // frees the GL objects once uploaded, the decoded images of a library that never
+    // was otherwise
+    void release()
+    {
+        if(!uploaded)
+        {
+            materials.releaseImages();
+            return;
+        }
+
+        for(auto& mesh : meshes)
+            mesh.release();
+        materials.release();
+        if(clusters)
+            clusters->release();
+
+        glDeleteVertexArrays(GLsizei(file_arrays.size()), file_arrays.data());
+        glDeleteBuffers(GLsizei(file_buffers.size()), file_buffers.data());
+        file_arrays.clear();
+        file_buffers.clear();
+        uploaded = false;
+    }
+
+    // binds the material pages, has to precede DrawMesh
+    void bind()
+    {
+        materials.bind();
+        bound_block = -1;
+    }
+
+    // Per-draw blocks in slot order: one per mesh, or one per material of a cluster
+    // store. Skinned meshes already get their node transforms from the bone palette,
+    // starting at bone_offset; a negative offset draws them in their bind pose.
+    void drawUniforms(
+        const glm::mat4*      worlds,
+        int                   bone_offset,
+        vector<DrawUniforms>& out) const
+    {
+        if(clusters)
+        {
+            for(size_t material = 0; material < materials.materials.size(); material++)
+            {
+                DrawUniforms& block = out.emplace_back();
+                block.model         = worlds[0];
+                block.draw.x        = int(material) % MAX_BLOCK_MATERIALS;
+            }
+            return;
+        }
+
+        for(size_t i = 0; i < meshes.size(); i++)
+        {
+            const Mesh& mesh    = meshes[i];
+            bool        skinned = bone_offset >= 0 && mesh.skinned;
+
+            DrawUniforms& block = out.emplace_back();
+            block.model         = skinned ? glm::mat4(1.0f) : worlds[i];
+            block.draw.x        = mesh.material % MAX_BLOCK_MATERIALS;
+            block.draw.y        = skinned ? bone_offset : -1;
+        }
+    }
+
+    // draws a mesh with the shader variant of its layout and material, skin says if the
+    // model is animated this frame
+    void DrawMesh(
+        ShaderVariants&  shaders,
+        unsigned int     i,
+        const DrawSlots& slots,
+        bool             skin)
+    {
+        Mesh& mesh = meshes[i];
+
+        uint32_t features = mesh.features;
+        if(!skin || !mesh.skinned)
+            features &= ~FEATURE_SKINNED;
+
+        shaders.use(features);
+        slots.bind(i);
+        useMaterial(mesh.material);
+        mesh.Draw();
+    }
+
+    // draws the meshlets of the cluster store that are in view, streaming in the rest.
+    // Cluster vertices have no tangents, materials with normal maps draw without them.
+    void DrawClusters(
+        ShaderVariants&    shaders,
+        const ClusterView& view,
+        const DrawSlots&   slots)
+    {
+        bind();
+
+        clusters->draw(view, [&](int material) {
+            shaders.use(material_features[material] & ~FEATURE_NORMAL_MAP);
+            slots.bind(material);
+            useMaterial(material);
+        });
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader& shader)
+    // world matrices of all meshes in draw order, cluster stores have a single one
+    void meshWorlds(vector<glm::mat4>& out) const
     {
-        for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        if(clusters)
+            out.push_back(nodes.worlds[0]);
+
+        for(int node : mesh_nodes)
+            out.push_back(nodes.worlds[node]);
     }
 
 private:
+    // material block bound by the last DrawMesh, only touched by the rendering thread
+    int bound_block = -1;
+
+    // library index of every aiMaterial that is used by a mesh, -1 otherwise
+    vector<int> scene_materials;
+
+    // shader features of every material in the library, see buildFeatures
+    vector<uint32_t> material_features;
+
+    VertexWelder welder;
+    TangentSpace tangent_space;
+
+    // the file is only read to write a cluster store, its textures need no mips
+    bool converting = false;
+
+    // the index into the block is part of the draw's uniforms, see drawUniforms
+    void useMaterial(int material)
+    {
+        // materials beyond the first block only switch the bound buffer range
+        if(material / MAX_BLOCK_MATERIALS != bound_block)
+        {
+            bound_block = material / MAX_BLOCK_MATERIALS;
+            materials.bindBlock(bound_block);
+        }
+    }
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting
     // meshes in the meshes vector.
     void loadModel(string const& path)
     {
-        // read file via ASSIMP
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        string extension = path.substr(std::min(path.find_last_of('.'), path.size()));
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+        // cluster stores only exist on the GPU
+        if((extension == CLUSTER_EXTENSION || settings.clusters) && settings.gpu)
+            loadClusters(path, extension);
+        else
+            loadSource(path, extension);
+
+        logStats(path);
+    }
+
+    void loadSource(string const& path, string const& extension)
+    {
+        // models in the resource pack are ready to upload, there is nothing to parse
+        if(!settings.clusters && loadPacked(path))
+            return;
+
+        // OBJ and glTF files are read natively, Assimp handles every other format. glTF
+        // buffers go to the GPU without a CPU copy, clustering and headless models need
+        // one.
+        if(extension == ".obj" && loadObj(path))
+            return;
+        if((extension == ".gltf" || extension == ".glb") && !settings.clusters &&
+           settings.uploads() && loadGltf(path))
+            return;
+
+        // read file via ASSIMP, degenerate triangles are removed instead of made lines
         Assimp::Importer importer;
-        const aiScene*   scene = importer.ReadFile(
-            path,
-            aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs |
-                aiProcess_CalcTangentSpace);
+        importer.SetPropertyBool(AI_CONFIG_PP_FD_REMOVE, true);
+
+        const aiScene* scene = nullptr;
+        {
+            StageTimer timer(stats.ms[STAGE_READ]);
+            scene = importer.ReadFile(path, settings.assimpFlags());
+        }
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE ||
            !scene->mRootNode)  // if is Not Zero
         {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+            logError("Assimp could not read %s: %s", path, importer.GetErrorString());
             return;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
+        // the joint hierarchy has to exist before meshes register their bones
+        skeleton.build(scene->mRootNode);
 
         // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        scene_materials.assign(scene->mNumMaterials, -1);
+        processNode(scene->mRootNode, scene, -1);
+        nodes.update();
+        buildMaterials();
+
+        // animations are only useful if some mesh is actually skinned
+        if(skeleton.bones() > 0)
+        {
+            StageTimer timer(stats.ms[STAGE_ANIMATIONS]);
+
+            animations.resize(scene->mNumAnimations);
+            for(unsigned int i = 0; i < scene->mNumAnimations; i++)
+                animations[i].load(scene->mAnimations[i], skeleton);
+        }
+    }
+
+    // Opens a cluster store instead of creating meshes. Other files are converted into a
+    // store next to them first, unless it is newer than the file. OBJ files are streamed
+    // into the store, other formats are loaded whole once. Afterwards only the pages in
+    // view are read.
+    void loadClusters(string const& path, string const& extension)
+    {
+        bool   store = extension == CLUSTER_EXTENSION;
+        string file  = store ? path : path + CLUSTER_EXTENSION;
+
+        std::error_code ignored;
+        if(!store && !(std::filesystem::last_write_time(file, ignored) >=
+                       std::filesystem::last_write_time(path, ignored)))
+        {
+            bool written = false;
+            if(extension == ".obj")
+                written = streamClusters(path, file);
+            else
+            {
+                converting = true;
+                loadSource(path, extension);
+                converting = false;
+
+                StageTimer timer(stats.ms[STAGE_CONVERT]);
+                written = writeClusters(file);
+            }
+
+            if(!written)
+            {
+                logError("Could not write the cluster store %s", file);
+                return;
+            }
+
+            // the store replaces everything the file was loaded into
+            for(auto& mesh : meshes)
+                mesh.release();
+            materials.release();
+            materials.releaseImages();
+
+            meshes.clear();
+            mesh_nodes.clear();
+            materials  = MaterialLibrary();
+            nodes      = SceneGraph();
+            skeleton   = Skeleton();
+            animations.clear();
+            setupMaterials();
+        }
+
+        auto loaded = std::make_unique<ClusterStore>();
+        {
+            StageTimer timer(stats.ms[STAGE_READ]);
+            if(!loaded->open(file, materials, settings.textures))
+            {
+                logError("Could not read the cluster store %s", file);
+                return;
+            }
+        }
+        buildMaterials();
+
+        if(stats.vertices_read == 0)
+            stats.vertices_read = loaded->header.vertices;
+        stats.vertices  = loaded->header.vertices;
+        stats.triangles = loaded->header.triangles;
+
+        nodes.add(-1, glm::mat4(1.0f));
+        nodes.close(0);
+        nodes.update();
+        clusters = std::move(loaded);
+    }
+
+    // Clusters every mesh with its node transform applied, skinned meshes in bind pose.
+    // Meshes are freed once written, the store replaces them.
+    bool writeClusters(string const& file)
+    {
+        ClusterWriter writer;
+        if(!writer.begin(file))
+            return false;
+
+        // texture paths, maps of a planned library are handles that map back to their
+        // images, unplanned ones still have the image indices
+        for(auto& material : materials.materials)
+        {
+            string maps[4];
+            for(int map = 0; map < 4; map++)
+            {
+                int value = material.maps[map];
+                if(value >= 0 && !materials.planned)
+                    maps[map] = materials.images[value].path;
+
+                for(auto& image : materials.images)
+                    if(value >= 0 && materials.planned && image.handle == value)
+                        maps[map] = image.path;
+            }
+
+            writer.addMaterial(material, maps);
+        }
+
+        vector<ClusterVertex> vertices;
+        vector<uint32_t>      indices;
+        for(size_t i = 0; i < meshes.size(); i++)
+        {
+            Mesh& mesh = meshes[i];
+            clusterVertices(mesh.vertices, nodes.worlds[mesh_nodes[i]], vertices);
+
+            indices.assign(mesh.indices.begin(), mesh.indices.end());
+            writer.addMesh(vertices, indices, mesh.material);
+
+            mesh.vertices = vector<Vertex>();
+            mesh.indices  = vector<unsigned int>();
+        }
+
+        return writer.finish();
+    }
+
+    // Converts an OBJ file into a cluster store without creating meshes. Faces are read,
+    // built and clustered one window at a time, only the vertex attributes of the whole
+    // file are held in memory. False if the file can not be read or the store written.
+    bool streamClusters(string const& path, string const& file)
+    {
+        ObjLoader loader;
+        {
+            StageTimer timer(stats.ms[STAGE_READ]);
+            if(!loader.parse(path, false))
+                return false;
+        }
+
+        ClusterWriter writer;
+        if(!writer.begin(file))
+            return false;
+
+        StageTimer timer(stats.ms[STAGE_CONVERT]);
+
+        vector<ObjMaterial>   library;
+        vector<ClusterVertex> vertices;
+        vector<uint32_t>      indices;
+        loader.stream(settings, library, [&](vector<ObjMesh>& window) {
+            for(auto& mesh : window)
+            {
+                stats.vertices_read += mesh.vertices.size();
+                clusterVertices(mesh.vertices, glm::mat4(1.0f), vertices);
+
+                indices.assign(mesh.indices.begin(), mesh.indices.end());
+                writer.addMesh(vertices, indices, mesh.material);
+            }
+        });
+
+        for(auto& material : library)
+            writer.addMaterial(material.data, material.maps);
+
+        return writer.finish();
+    }
+
+    // attributes of a cluster page, moved into world space
+    static void clusterVertices(
+        const vector<Vertex>&  vertices,
+        const glm::mat4&       world,
+        vector<ClusterVertex>& out)
+    {
+        glm::mat3 rotation = glm::transpose(glm::inverse(glm::mat3(world)));
+
+        out.resize(vertices.size());
+        for(size_t v = 0; v < vertices.size(); v++)
+        {
+            const Vertex&  vertex  = vertices[v];
+            ClusterVertex& cluster = out[v];
+            glm::vec3      normal  = rotation * vertex.Normal;
+            float          length  = glm::length(normal);
+
+            cluster.position   = glm::vec3(world * glm::vec4(vertex.Position, 1.0f));
+            cluster.normal     = length > 0.0f ? normal / length : normal;
+            cluster.tex_coords = vertex.TexCoords;
+        }
+    }
+
+    // Creates the meshes of a model in the resource pack, one node per mesh below a
+    // single root. Vertex and index arrays are uploaded straight from the mapping unless
+    // the entry is compressed. Returns false if the pack has no valid entry for the path.
+    bool loadPacked(string const& path)
+    {
+        PackData data;
+        {
+            StageTimer timer(stats.ms[STAGE_READ]);
+            if(!resourcePack().read(path, PACK_MODEL, data) ||
+               data.size < sizeof(PackModel))
+                return false;
+        }
+
+        PackModel header;
+        std::memcpy(&header, data.data, sizeof(PackModel));
+
+        size_t material_bytes = size_t(header.material_count) * sizeof(PackMaterial);
+        size_t mesh_bytes     = size_t(header.mesh_count) * sizeof(PackMesh);
+        if(header.material_offset + material_bytes > data.size ||
+           header.mesh_offset + mesh_bytes > data.size ||
+           header.string_offset + header.string_size > data.size)
+            return false;
+
+        auto* packed_materials = packed<PackMaterial>(data, header.material_offset);
+        auto* packed_meshes    = packed<PackMesh>(data, header.mesh_offset);
+        auto* strings          = packed<char>(data, header.string_offset);
+
+        // a corrupt entry must not reach the GPU
+        for(uint32_t i = 0; i < header.mesh_count; i++)
+        {
+            const PackMesh& mesh         = packed_meshes[i];
+            size_t          vertex_bytes = size_t(mesh.vertex_count) * sizeof(Vertex);
+            size_t          index_bytes  = size_t(mesh.index_count) * sizeof(GLuint);
+            if(mesh.vertex_offset + vertex_bytes > data.size ||
+               mesh.index_offset + index_bytes > data.size || mesh.material < 0 ||
+               uint32_t(mesh.material) >= header.material_count)
+                return false;
+
+            auto* indices = packed<unsigned int>(data, mesh.index_offset);
+            for(uint32_t j = 0; j < mesh.index_count; j++)
+                if(indices[j] >= mesh.vertex_count)
+                    return false;
+        }
+
+        vector<int> library(header.material_count);
+        {
+            StageTimer timer(stats.ms[STAGE_MATERIALS]);
+            for(uint32_t i = 0; i < header.material_count; i++)
+            {
+                const PackMaterial& packed = packed_materials[i];
+
+                MaterialData material;
+                material.diffuse  = packed.diffuse;
+                material.specular = packed.specular;
+
+                string maps[4];
+                for(int map = 0; map < 4; map++)
+                {
+                    size_t offset = packed.map_offsets[map];
+                    if(offset + packed.map_sizes[map] <= header.string_size)
+                        maps[map].assign(strings + offset, packed.map_sizes[map]);
+                }
+                library[i] = materials.add(material, maps, settings.textures);
+            }
+        }
+
+        int root = nodes.add(-1, glm::mat4(1.0f));
+        {
+            StageTimer timer(stats.ms[STAGE_UPLOAD]);
+
+            meshes.reserve(header.mesh_count);
+            for(uint32_t i = 0; i < header.mesh_count; i++)
+            {
+                const PackMesh& mesh = packed_meshes[i];
+
+                auto* vertices = packed<Vertex>(data, mesh.vertex_offset);
+                auto* indices  = packed<unsigned int>(data, mesh.index_offset);
+
+                if(settings.uploads())
+                    meshes.emplace_back(
+                        vertices,
+                        mesh.vertex_count,
+                        indices,
+                        mesh.index_count,
+                        library[mesh.material],
+                        mesh.bounds_min,
+                        mesh.bounds_max);
+                else
+                    meshes.emplace_back(
+                        vector<Vertex>(vertices, vertices + mesh.vertex_count),
+                        vector<unsigned int>(indices, indices + mesh.index_count),
+                        library[mesh.material],
+                        false);
+
+                int node = nodes.add(root, mesh.world);
+                nodes.close(node);
+                mesh_nodes.push_back(node);
+
+                stats.vertices_read += mesh.vertex_count;
+                stats.vertices += mesh.vertex_count;
+                stats.triangles += mesh.index_count / 3;
+            }
+        }
+
+        nodes.close(root);
+        nodes.update();
+        buildMaterials();
+        return true;
+    }
+
+    // array in a pack entry, aligned by the pack builder
+    template<typename T>
+    static const T* packed(const PackData& data, uint64_t offset)
+    {
+        return reinterpret_cast<const T*>(data.data + offset);
+    }
+
+    // Reads an OBJ file with the native loader, one mesh per material below a single
+    // root node. Returns false if the file can not be read.
+    bool loadObj(string const& path)
+    {
+        ObjLoader loader;
+        ObjScene  scene;
+        {
+            StageTimer timer(stats.ms[STAGE_READ]);
+            if(!loader.parse(path))
+                return false;
+        }
+        {
+            StageTimer timer(stats.ms[STAGE_CONVERT]);
+            loader.build(settings, scene);
+        }
+
+        vector<int> library(scene.materials.size());
+        {
+            StageTimer timer(stats.ms[STAGE_MATERIALS]);
+            for(size_t i = 0; i < scene.materials.size(); i++)
+                library[i] = materials.add(
+                    scene.materials[i].data,
+                    scene.materials[i].maps,
+                    settings.textures);
+        }
+
+        int root = nodes.add(-1, glm::mat4(1.0f));
+
+        meshes.reserve(scene.meshes.size());
+        for(auto& mesh : scene.meshes)
+        {
+            stats.vertices_read += mesh.vertices.size();
+            // corners are already unique, only epsilon welding can merge more
+            if(settings.weld == WeldMode::EPSILON)
+            {
+                StageTimer timer(stats.ms[STAGE_WELD]);
+                welder.weld(mesh.vertices, mesh.indices, settings.weld, settings.epsilon);
+            }
+            generateTangentSpace(mesh.vertices, mesh.indices, mesh.texcoords);
+            stats.vertices += mesh.vertices.size();
+            stats.triangles += mesh.indices.size() / 3;
+
+            StageTimer timer(stats.ms[STAGE_UPLOAD]);
+            meshes.emplace_back(
+                std::move(mesh.vertices),
+                std::move(mesh.indices),
+                library[mesh.material],
+                settings.uploads());
+            mesh_nodes.push_back(root);
+        }
+
+        nodes.close(root);
+        nodes.update();
+        buildMaterials();
+        return true;
+    }
+
+    // Reads glTF and GLB files with buffer views uploaded straight from the mapped file.
+    // Returns false for content the native loader leaves to Assimp.
+    bool loadGltf(string const& path)
+    {
+        GltfLoader loader;
+        loader.flip_uvs = settings.flags & aiProcess_FlipUVs;
+        {
+            StageTimer timer(stats.ms[STAGE_READ]);
+            if(!loader.open(path))
+                return false;
+        }
+
+        vector<int> library;
+        {
+            StageTimer timer(stats.ms[STAGE_MATERIALS]);
+            loader.addMaterials(materials, settings.textures, library);
+        }
+
+        // all scene roots below one node, primitives of meshes used twice are set up
+        // once and share their vertex arrays
+        std::map<int, vector<GltfPrimitive>> primitives;
+
+        StageTimer timer(stats.ms[STAGE_UPLOAD]);
+        int        root = nodes.add(-1, glm::mat4(1.0f));
+
+        auto visit = [&](auto& self, int index, int parent, int depth) -> void {
+            const Json& node = loader.node(index);
+            if(node.type != Json::OBJECT || depth > 256)
+                return;
+
+            int current = nodes.add(parent, loader.transform(node));
+
+            int mesh = node["mesh"].integer();
+            if(mesh >= 0)
+            {
+                auto it = primitives.find(mesh);
+                if(it == primitives.end())
+                {
+                    it               = primitives.emplace(mesh, vector<GltfPrimitive>()).first;
+                    const Json& list = loader.document["meshes"][size_t(mesh)]["primitives"];
+
+                    for(auto& entry : list.array)
+                    {
+                        GltfPrimitive primitive;
+                        if(loader.primitive(entry, primitive))
+                            it->second.push_back(primitive);
+                    }
+                }
+
+                for(auto& primitive : it->second)
+                {
+                    int material = primitive.material >= 0 &&
+                                           primitive.material + 1 < int(library.size())
+                                       ? library[primitive.material]
+                                       : library.back();
+
+                    meshes.emplace_back(
+                        primitive.vao,
+                        primitive.count,
+                        primitive.index_type,
+                        primitive.index_offset,
+                        material,
+                        primitive.bounds_min,
+                        primitive.bounds_max);
+                    mesh_nodes.push_back(current);
+
+                    stats.vertices_read += primitive.vertices;
+                    stats.vertices += primitive.vertices;
+                    stats.triangles += primitive.count / 3;
+                }
+            }
+
+            for(auto& child : node["children"].array)
+                self(self, child.integer(), current, depth + 1);
+
+            nodes.close(current);
+        };
+
+        for(int index : loader.roots())
+            visit(visit, index, root, 0);
+
+        nodes.close(root);
+        nodes.update();
+        buildMaterials();
+
+        file_buffers = std::move(loader.gl_buffers);
+        file_arrays  = std::move(loader.gl_arrays);
+
+        logDebug(
+            "glTF %s: %zu bytes uploaded from the mapping, %zu bytes converted",
+            path,
+            loader.uploaded,
+            loader.converted);
+        return true;
+    }
+
+    // Builds the mip chains of every model meant for GL on the importing thread, then
+    // uploads the textures. Deferred libraries are only planned and keep the decoded
+    // images until upload(), headless ones keep them for good.
+    void buildMaterials()
+    {
+        if(settings.gpu && !converting)
+        {
+            StageTimer timer(stats.ms[STAGE_MIPS]);
+            materials.generateMips();
+        }
+
+        StageTimer timer(stats.ms[STAGE_MATERIALS]);
+        if(settings.uploads())
+            materials.build();
+        else if(settings.gpu && !converting)
+            materials.plan();
+    }
+
+    // mip settings of the library, before any texture is added
+    void setupMaterials()
+    {
+        materials.gamma    = gammaCorrection;
+        materials.coverage = settings.coverage;
+        materials.filter   = settings.mips;
+    }
+
+    // Shader features of the materials and meshes, picking a variant per draw is then a
+    // mask and an array access. Maps of a planned library are page handles, before that
+    // image indices; both are -1 for maps the material does not have.
+    void buildFeatures()
+    {
+        material_features.resize(materials.materials.size());
+        for(size_t i = 0; i < material_features.size(); i++)
+        {
+            const glm::ivec4& maps     = materials.materials[i].maps;
+            uint32_t&         features = material_features[i];
+
+            features = 0;
+            if(maps[MAP_DIFFUSE] >= 0)
+                features |= FEATURE_DIFFUSE_MAP;
+            if(maps[MAP_SPECULAR] >= 0)
+                features |= FEATURE_SPECULAR_MAP;
+            if(maps[MAP_NORMAL] >= 0)
+                features |= FEATURE_NORMAL_MAP;
+        }
+
+        for(auto& mesh : meshes)
+        {
+            size_t material = static_cast<size_t>(mesh.material);
+            mesh.features   = 0;
+            if(material < material_features.size())
+                mesh.features = material_features[material];
+            if(!mesh.tangents)
+                mesh.features &= ~FEATURE_NORMAL_MAP;
+            if(mesh.skinned)
+                mesh.features |= FEATURE_SKINNED;
+        }
+    }
+
+    void logStats(string const& path) const
+    {
+        logInfo(
+            "Loaded %s (%s): %zu -> %zu vertices, %zu triangles in %.3f ms",
+            path,
+            IMPORT_PROFILE_NAMES[int(stats.profile)],
+            stats.vertices_read,
+            stats.vertices,
+            stats.triangles,
+            stats.total());
+        for(int stage = 0; stage < STAGE_COUNT; stage++)
+            logDebug("  %s: %.3f ms", IMPORT_STAGE_NAMES[stage], stats.ms[stage]);
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at
-    // the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode* node, const aiScene* scene)
+    // the node and repeats this process on its children nodes (if any). Nodes are stored
+    // in the same depth-first order as the skeleton joints.
+    void processNode(aiNode* node, const aiScene* scene, int parent)
     {
-        meshes.reserve(node->mNumMeshes);
+        int index = nodes.add(parent, toMat4(node->mTransformation));
+
+        meshes.reserve(meshes.size() + node->mNumMeshes);
 
         // process each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
@@ -264,13 +1092,16 @@ private:
             // organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
             meshes.push_back(processMesh(mesh, scene));
+            mesh_nodes.push_back(index);
         }
         // after we've processed all of the meshes (if any) we then recursively process
         // each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, index);
         }
+
+        nodes.close(index);
     }
 
     Mesh processMesh(aiMesh* mesh, const aiScene* scene)
@@ -278,14 +1109,16 @@ private:
         // data to fill
         vector<Vertex>       vertices;
         vector<unsigned int> indices;
-        vector<Texture>      textures;
+
+        auto convert_start = std::chrono::steady_clock::now();
 
         vertices.reserve(mesh->mNumVertices);
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
-            Vertex    vertex;
+            // zeroed, welding compares every byte
+            Vertex    vertex = {};
             glm::vec3 vector;  // we declare a placeholder vector since assimp uses its
                                // own vector class that doesn't directly convert to glm's
                                // vec3 class so we transfer the data to this placeholder
@@ -313,6 +1146,13 @@ private:
                 vec.x            = mesh->mTextureCoords[0][i].x;
                 vec.y            = mesh->mTextureCoords[0][i].y;
                 vertex.TexCoords = vec;
+            }
+            else
+                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+
+            // tangent space, not generated by every import profile
+            if(mesh->mTangents && mesh->mBitangents)
+            {
                 // tangent
                 vector.x         = mesh->mTangents[i].x;
                 vector.y         = mesh->mTangents[i].y;
@@ -324,125 +1164,119 @@ private:
                 vector.z         = mesh->mBitangents[i].z;
                 vertex.Bitangent = vector;
             }
-            else
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+
+            // no bone influences until processBones assigns them
+            for(int j = 0; j < MAX_BONE_INFLUENCE; j++)
+            {
+                vertex.m_BoneIDs[j] = -1;
+                vertex.m_Weights[j] = 0.0f;
+            }
 
             vertices.push_back(vertex);
         }
+        // bone influences are stored per bone, distribute them to the vertices
+        processBones(mesh, vertices);
+
         // now wak through each of the mesh's faces (a face is a mesh its triangle) and
-        // retrieve the corresponding vertex indices.
+        // retrieve the corresponding vertex indices. Points and lines are skipped.
+        indices.reserve(size_t(mesh->mNumFaces) * 3);
         for(unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
             aiFace face = mesh->mFaces[i];
+            if(face.mNumIndices != 3)
+                continue;
             // retrieve all indices of the face and store them in the indices vector
             for(unsigned int j = 0; j < face.mNumIndices; j++)
                 indices.push_back(face.mIndices[j]);
         }
-        // process materials
-        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-        // we assume a convention for sampler names in the shaders. Each diffuse texture
-        // should be named as 'texture_diffuseN' where N is a sequential number ranging
-        // from 1 to MAX_SAMPLER_NUMBER. Same applies to other texture as the following
-        // list summarizes: diffuse: texture_diffuseN specular: texture_specularN normal:
-        // texture_normalN
-
-        // 1. diffuse maps
-        vector<Texture> diffuseMaps =
-            loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-        // 2. specular maps
-        vector<Texture> specularMaps =
-            loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-        // 3. normal maps
-        std::vector<Texture> normalMaps =
-            loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-        // 4. height maps
-        std::vector<Texture> heightMaps =
-            loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+
+        auto convert_end = std::chrono::steady_clock::now();
+        stats.ms[STAGE_CONVERT] +=
+            std::chrono::duration<float, std::milli>(convert_end - convert_start).count();
+
+        stats.vertices_read += vertices.size();
+        {
+            StageTimer timer(stats.ms[STAGE_WELD]);
+            welder.weld(vertices, indices, settings.weld, settings.epsilon);
+        }
+        generateTangentSpace(vertices, indices, mesh->mTextureCoords[0] != nullptr);
+        stats.vertices += vertices.size();
+        stats.triangles += indices.size() / 3;
+
+        // process materials, meshes sharing a material share the library entry
+        int& material = scene_materials[mesh->mMaterialIndex];
+        if(material < 0)
+        {
+            StageTimer timer(stats.ms[STAGE_MATERIALS]);
+            material = materials.add(
+                scene->mMaterials[mesh->mMaterialIndex],
+                directory,
+                settings.textures);
+        }
 
         // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        StageTimer timer(stats.ms[STAGE_UPLOAD]);
+        Mesh       result(vertices, indices, material, settings.uploads());
+        result.skinned = mesh->mNumBones > 0;
+        return result;
+    }
+
+    // native normals and tangents on the welded arrays, if the settings ask for them
+    void generateTangentSpace(
+        vector<Vertex>&             vertices,
+        const vector<unsigned int>& indices,
+        bool                        texcoords)
+    {
+        bool normals  = settings.nativeNormals();
+        bool tangents = settings.nativeTangents();
+        if(!normals && !tangents)
+            return;
+
+        StageTimer timer(stats.ms[STAGE_TANGENTS]);
+        tangent_space.generate(vertices, indices, normals, tangents, texcoords);
     }
 
-    // checks all material textures of a given type and loads the textures if they're not
-    // loaded yet. the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
+    // assigns up to MAX_BONE_INFLUENCE bones with the largest weights to every vertex
+    void processBones(aiMesh* mesh, vector<Vertex>& vertices)
     {
-        vector<Texture> textures;
-        for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+        for(unsigned int i = 0; i < mesh->mNumBones; i++)
         {
-            aiString str;
-            mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration:
-            // skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
+            aiBone* bone = mesh->mBones[i];
+            int     id   = skeleton.bone(bone);
+
+            for(unsigned int j = 0; j < bone->mNumWeights; j++)
             {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
+                Vertex& vertex = vertices[bone->mWeights[j].mVertexId];
+                float   weight = bone->mWeights[j].mWeight;
+
+                // replace the weakest influence, empty slots have a weight of zero
+                int slot = 0;
+                for(int k = 1; k < MAX_BONE_INFLUENCE; k++)
+                    if(vertex.m_Weights[k] < vertex.m_Weights[slot])
+                        slot = k;
+
+                if(weight > vertex.m_Weights[slot])
                 {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true;  // a texture with the same filepath has already been
-                                  // loaded, continue to next one. (optimization)
-                    break;
+                    vertex.m_BoneIDs[slot] = id;
+                    vertex.m_Weights[slot] = weight;
                 }
             }
-            if(!skip)
-            {  // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id   = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for
-                                                     // entire model, to ensure we won't
-                                                     // unnecessary load duplicate
-                                                     // textures.
-            }
         }
-        return textures;
-    }
-};
-
-unsigned int TextureFromFile(const char* path, const string& directory, bool gamma)
-{
-    string filename = string(path);
-    filename        = directory + '/' + filename;
-
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
 
-    int            width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if(data)
-    {
-        GLenum format;
-        if(nrComponents == 1)
-            format = GL_RED;
-        else if(nrComponents == 3)
-            format = GL_RGB;
-        else if(nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        if(mesh->mNumBones == 0)
+            return;
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        for(auto& vertex : vertices)
+        {
+            float sum = 0.0f;
+            for(int j = 0; j < MAX_BONE_INFLUENCE; j++)
+                sum += vertex.m_Weights[j];
 
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+            if(sum > 0.0f)
+                for(int j = 0; j < MAX_BONE_INFLUENCE; j++)
+                    vertex.m_Weights[j] /= sum;
+        }
     }
+};
 
-    return textureID;
-}
 #endif
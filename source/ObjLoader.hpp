@@ -0,0 +1,1026 @@
+#pragma once
+
+// lib
+#include <glm/glm.hpp>
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// modules
+#include "Import.hpp"
+#include "MappedFile.hpp"
+#include "Material.hpp"
+#include "ThreadPool.hpp"
+#include "Vertex.hpp"
+
+// Files are split into chunks of at least this size for parallel parsing
+const size_t OBJ_CHUNK_SIZE = 1 << 20;
+
+// Bytes of the file whose faces are parsed and built at once while streaming
+const size_t OBJ_STREAM_WINDOW = size_t(64) << 20;
+
+struct ObjMaterial
+{
+    std::string  name;
+    MaterialData data;
+    std::string  maps[4];  // file paths per MaterialMap, empty if unused
+};
+
+// Geometry of all faces sharing a material, vertices are unique per v/vt/vn triple
+struct ObjMesh
+{
+    int                       material  = 0;
+    bool                      texcoords = false;  // some vertex has a texture coordinate
+    std::vector<Vertex>       vertices;
+    std::vector<unsigned int> indices;
+};
+
+struct ObjScene
+{
+    std::vector<ObjMesh>     meshes;
+    std::vector<ObjMaterial> materials;
+};
+
+// Native Wavefront OBJ/MTL reader. The file is memory mapped and cut into chunks at line
+// breaks that are parsed in parallel; face indices are then resolved per chunk in
+// parallel and merged per material in parallel into interleaved vertices and indices.
+//
+// Files too large to hold as meshes are parsed without faces and then streamed: faces
+// are parsed and built one window of chunks at a time, only the vertex attributes of
+// the whole file stay in memory.
+struct ObjLoader
+{
+    static constexpr uint32_t NONE     = UINT32_MAX;
+    static constexpr uint32_t RELATIVE = 1u << 31;  // index counts from the chunk start
+
+    // Relative indices are stored biased, they may reach back into earlier chunks
+    static constexpr long long RELATIVE_BIAS = 1ll << 30;
+
+    struct Corner
+    {
+        uint32_t position = NONE;
+        uint32_t texcoord = NONE;
+        uint32_t normal   = NONE;
+    };
+
+    struct Chunk
+    {
+        const char* begin = nullptr;
+        const char* end   = nullptr;
+
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> texcoords;
+        std::vector<glm::vec3> normals;
+        std::vector<Corner>    corners;  // three per triangle
+
+        // usemtl and mtllib in file order, a switch applies from its triangle on
+        std::vector<std::pair<size_t, std::string>> switches;
+        std::vector<std::string>                    libraries;
+
+        size_t position_base = 0;
+        size_t texcoord_base = 0;
+        size_t normal_base   = 0;
+    };
+
+    // range of triangles of one chunk drawn with one material
+    struct Segment
+    {
+        size_t chunk;
+        size_t begin;
+        size_t end;
+    };
+
+    // Corners of a segment with absolute indices, every v/vt/vn triple once in order of
+    // first use, and the triangles as indices into them
+    struct SegmentCorners
+    {
+        std::vector<Corner>   unique;
+        std::vector<uint32_t> indices;
+    };
+
+    // v/vt/vn triple to a value, open addressing like the vertex welder. Key and value
+    // sit side by side, a lookup touches a single cache line.
+    struct CornerTable
+    {
+        struct Slot
+        {
+            Corner   key;
+            uint32_t value = NONE;
+        };
+
+        std::vector<Slot> slots;
+        size_t            mask = 0;
+
+        explicit CornerTable(size_t count)
+        {
+            size_t capacity = 16;
+            while(capacity < count + count / 2)
+                capacity *= 2;
+            slots.resize(capacity);
+            mask = capacity - 1;
+        }
+
+        // slot of a corner, its value is NONE while the corner is new
+        Slot& find(const Corner& corner)
+        {
+            uint64_t h = corner.position * 0x9e3779b97f4a7c15ull;
+            h ^= (corner.texcoord + 1ull) * 0xc2b2ae3d27d4eb4full;
+            h ^= (corner.normal + 1ull) * 0x165667b19e3779f9ull;
+            h ^= h >> 29;
+
+            size_t slot = h & mask;
+            while(slots[slot].value != NONE &&
+                  std::memcmp(&slots[slot].key, &corner, sizeof(Corner)) != 0)
+                slot = (slot + 1) & mask;
+            return slots[slot];
+        }
+    };
+
+    MappedFile             file;
+    std::string            directory;
+    std::vector<Chunk>     chunks;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texcoords;
+    std::vector<glm::vec3> normals;
+
+    // generated per position, see smoothNormals()
+    bool position_normals = false;
+
+    // Maps the file and parses all chunks, false if the file can not be read. Without
+    // faces only attributes and material libraries are read and the file is cut into
+    // chunks of OBJ_CHUNK_SIZE, faces are then read by stream().
+    bool parse(const std::string& path, bool faces = true)
+    {
+        if(!file.open(path))
+            return false;
+
+        size_t slash = path.find_last_of("/\\");
+        directory    = slash == std::string::npos ? "." : path.substr(0, slash);
+
+        const char* data = file.data;
+        const char* end  = file.data + file.size;
+
+        size_t count = file.size / OBJ_CHUNK_SIZE;
+        if(faces)
+            count = std::min<size_t>(count, (threadPool().size() + 1) * 4);
+        count = std::max<size_t>(count, 1);
+        chunks.assign(count, Chunk());
+
+        // chunk borders move forward to the next line start
+        const char* begin = data;
+        for(size_t i = 0; i < count; i++)
+        {
+            const char* border = data + file.size / count * (i + 1);
+            border             = i + 1 == count ? end : std::max(border, begin);
+            while(border < end && border[-1] != '\n')
+                border++;
+
+            chunks[i].begin = begin;
+            chunks[i].end   = border;
+            begin           = border;
+        }
+
+        threadPool().parallelFor(count, 1, [this, faces](size_t first, size_t last) {
+            for(size_t i = first; i < last; i++)
+                parseChunk(chunks[i], true, faces);
+        });
+
+        // global attribute arrays, chunks copy their part in parallel
+        size_t position_count = 0;
+        size_t texcoord_count = 0;
+        size_t normal_count   = 0;
+        for(auto& chunk : chunks)
+        {
+            chunk.position_base = position_count;
+            chunk.texcoord_base = texcoord_count;
+            chunk.normal_base   = normal_count;
+
+            position_count += chunk.positions.size();
+            texcoord_count += chunk.texcoords.size();
+            normal_count += chunk.normals.size();
+        }
+
+        positions.resize(position_count);
+        texcoords.resize(texcoord_count);
+        normals.resize(normal_count);
+
+        threadPool().parallelFor(count, 1, [this](size_t first, size_t last) {
+            for(size_t i = first; i < last; i++)
+            {
+                Chunk& chunk = chunks[i];
+                std::copy(
+                    chunk.positions.begin(),
+                    chunk.positions.end(),
+                    positions.begin() + chunk.position_base);
+                std::copy(
+                    chunk.texcoords.begin(),
+                    chunk.texcoords.end(),
+                    texcoords.begin() + chunk.texcoord_base);
+                std::copy(
+                    chunk.normals.begin(),
+                    chunk.normals.end(),
+                    normals.begin() + chunk.normal_base);
+
+                chunk.positions = std::vector<glm::vec3>();
+                chunk.texcoords = std::vector<glm::vec2>();
+                chunk.normals   = std::vector<glm::vec3>();
+            }
+        });
+
+        return true;
+    }
+
+    // builds one mesh per used material, Assimp post processing flags of the settings
+    // that make sense for OBJ data are honored
+    void build(const ImportSettings& settings, ObjScene& scene)
+    {
+        std::unordered_map<std::string, int> material_index;
+        libraries(scene.materials, material_index);
+
+        // faces before the first usemtl get a default material after the others
+        int current  = -1;
+        int fallback = static_cast<int>(scene.materials.size());
+
+        buildMeshes(
+            settings,
+            0,
+            chunks.size(),
+            material_index,
+            fallback,
+            current,
+            scene.meshes);
+
+        for(auto& mesh : scene.meshes)
+        {
+            if(mesh.material != fallback)
+                continue;
+
+            ObjMaterial material;
+            material.name = "default";
+            scene.materials.push_back(material);
+            break;
+        }
+    }
+
+    // Calls function(meshes) with the meshes of every window of OBJ_STREAM_WINDOW bytes
+    // in file order, then frees them. Needs parse() without faces. Materials are read up
+    // front and shared by all windows, the last one is the default material. Missing
+    // normals are generated by the loader, the native stage would only see a window, and
+    // no tangents are generated since the clusters do not store them.
+    template<typename F>
+    void stream(
+        const ImportSettings&     settings,
+        std::vector<ObjMaterial>& materials,
+        F&&                       function)
+    {
+        std::unordered_map<std::string, int> material_index;
+        libraries(materials, material_index);
+
+        int current  = -1;
+        int fallback = static_cast<int>(materials.size());
+
+        ObjMaterial material;
+        material.name = "default";
+        materials.push_back(material);
+
+        ImportSettings window = settings;
+        window.flags &= ~(aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
+
+        if(normals.empty() && !positions.empty())
+            smoothNormals();
+
+        size_t step = std::max<size_t>(OBJ_STREAM_WINDOW / OBJ_CHUNK_SIZE, 1);
+        for(size_t first = 0; first < chunks.size(); first += step)
+        {
+            size_t last = std::min(first + step, chunks.size());
+            parseFaces(first, last);
+
+            std::vector<ObjMesh> meshes;
+            buildMeshes(window, first, last, material_index, fallback, current, meshes);
+            releaseFaces(first, last);
+
+            function(meshes);
+        }
+    }
+
+    // Parses a float without locale lookups. Up to 19 significant digits are kept in an
+    // integer and scaled once by an exact power of ten, which is within an ulp of the
+    // correctly rounded float.
+    static const char* parseFloat(const char* p, const char* end, float& out)
+    {
+        static const double POWERS[] = {
+            1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+        bool negative = false;
+        if(p < end && (*p == '-' || *p == '+'))
+            negative = *p++ == '-';
+
+        uint64_t mantissa = 0;
+        int      digits   = 0;
+        int      exponent = 0;
+
+        for(; p < end && unsigned(*p - '0') < 10; p++)
+        {
+            if(digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa > 0;
+            }
+            else
+                exponent++;
+        }
+
+        if(p < end && *p == '.')
+        {
+            for(p++; p < end && unsigned(*p - '0') < 10; p++)
+            {
+                if(digits < 19)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    digits += mantissa > 0;
+                    exponent--;
+                }
+            }
+        }
+
+        if(p < end && (*p == 'e' || *p == 'E'))
+        {
+            p++;
+            bool negative_exponent = false;
+            if(p < end && (*p == '-' || *p == '+'))
+                negative_exponent = *p++ == '-';
+
+            int value = 0;
+            for(; p < end && unsigned(*p - '0') < 10; p++)
+                value = std::min(value * 10 + (*p - '0'), 1000);
+
+            exponent += negative_exponent ? -value : value;
+        }
+
+        double value = static_cast<double>(mantissa);
+        if(exponent < -22 || exponent > 22)
+            value *= std::pow(10.0, exponent);
+        else if(exponent < 0)
+            value /= POWERS[-exponent];
+        else
+            value *= POWERS[exponent];
+
+        out = static_cast<float>(negative ? -value : value);
+        return p;
+    }
+
+private:
+    // material libraries named by any chunk, in file order
+    void libraries(
+        std::vector<ObjMaterial>&             materials,
+        std::unordered_map<std::string, int>& material_index)
+    {
+        for(auto& chunk : chunks)
+            for(auto& library : chunk.libraries)
+                parseLibrary(directory + '/' + library, materials, material_index);
+    }
+
+    // faces of a range of chunks parsed without attributes
+    void parseFaces(size_t first, size_t last)
+    {
+        threadPool().parallelFor(last - first, 1, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i < end; i++)
+                parseChunk(chunks[first + i], false, true);
+        });
+    }
+
+    void releaseFaces(size_t first, size_t last)
+    {
+        for(size_t i = first; i < last; i++)
+        {
+            chunks[i].corners  = std::vector<Corner>();
+            chunks[i].switches = std::vector<std::pair<size_t, std::string>>();
+        }
+    }
+
+    // Appends one mesh per material used by the faces of a range of chunks. current is
+    // the material active at the first chunk and is left at the one active after the
+    // last, materials below fallback come from material_index.
+    void buildMeshes(
+        const ImportSettings&                       settings,
+        size_t                                      first,
+        size_t                                      last,
+        const std::unordered_map<std::string, int>& material_index,
+        int                                         fallback,
+        int&                                        current,
+        std::vector<ObjMesh>&                       meshes)
+    {
+        size_t offset = meshes.size();
+
+        std::vector<std::vector<Segment>> segments(fallback + 1);
+        for(size_t c = first; c < last; c++)
+        {
+            const Chunk& chunk = chunks[c];
+            size_t       start = 0;
+
+            for(auto& [triangle, name] : chunk.switches)
+            {
+                if(triangle > start)
+                    segments[current + 1].push_back({c, start, triangle});
+
+                auto it = material_index.find(name);
+                current = it == material_index.end() ? -1 : it->second;
+                start   = triangle;
+            }
+
+            size_t triangles = chunk.corners.size() / 3;
+            if(triangles > start)
+                segments[current + 1].push_back({c, start, triangles});
+        }
+
+        for(size_t m = 0; m < segments.size(); m++)
+        {
+            if(segments[m].empty())
+                continue;
+
+            ObjMesh mesh;
+            mesh.material = m == 0 ? fallback : static_cast<int>(m) - 1;
+            meshes.push_back(std::move(mesh));
+        }
+
+        // segments are resolved independently, then each mesh merges its own in order
+        std::vector<const Segment*> order;
+        std::vector<size_t>         mesh_begin;
+        for(auto& list : segments)
+        {
+            if(list.empty())
+                continue;
+
+            mesh_begin.push_back(order.size());
+            for(auto& segment : list)
+                order.push_back(&segment);
+        }
+        mesh_begin.push_back(order.size());
+
+        std::vector<SegmentCorners> resolved(order.size());
+        threadPool().parallelFor(order.size(), 1, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i < end; i++)
+                resolveSegment(*order[i], resolved[i]);
+        });
+
+        size_t count = meshes.size() - offset;
+        threadPool().parallelFor(count, 1, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i < end; i++)
+            {
+                SegmentCorners* first_segment = resolved.data() + mesh_begin[i];
+                SegmentCorners* last_segment  = resolved.data() + mesh_begin[i + 1];
+                buildMesh(first_segment, last_segment, settings, meshes[offset + i]);
+            }
+        });
+    }
+
+    // Area weighted normals per position for files without any. Faces are summed one
+    // window at a time so that streamed windows share normals along their borders.
+    void smoothNormals()
+    {
+        normals.assign(positions.size(), glm::vec3(0.0f));
+
+        size_t step = std::max<size_t>(OBJ_STREAM_WINDOW / OBJ_CHUNK_SIZE, 1);
+        for(size_t first = 0; first < chunks.size(); first += step)
+        {
+            size_t last = std::min(first + step, chunks.size());
+            parseFaces(first, last);
+
+            for(size_t index = first; index < last; index++)
+            {
+                const Chunk& chunk = chunks[index];
+                for(size_t i = 0; i + 2 < chunk.corners.size(); i += 3)
+                {
+                    uint32_t corner[3];
+                    for(int k = 0; k < 3; k++)
+                        corner[k] = absolute(
+                            chunk.corners[i + k].position,
+                            chunk.position_base,
+                            positions.size());
+
+                    if(corner[0] == NONE || corner[1] == NONE || corner[2] == NONE)
+                        continue;
+
+                    const glm::vec3& a = positions[corner[0]];
+                    const glm::vec3& b = positions[corner[1]];
+                    const glm::vec3& c = positions[corner[2]];
+
+                    glm::vec3 normal = glm::cross(b - a, c - a);
+                    for(int k = 0; k < 3; k++)
+                        normals[corner[k]] += normal;
+                }
+            }
+            releaseFaces(first, last);
+        }
+
+        for(auto& normal : normals)
+        {
+            float length = glm::length(normal);
+            normal       = length > 0.0f ? normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+        }
+        position_normals = true;
+    }
+
+    static const char* skipSpace(const char* p, const char* end)
+    {
+        while(p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        return p;
+    }
+
+    static const char* lineEnd(const char* p, const char* end)
+    {
+        if(p >= end)
+            return end;
+        const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        return newline ? newline : end;
+    }
+
+    // rest of the line without surrounding white space
+    static std::string text(const char* p, const char* end)
+    {
+        p = skipSpace(p, end);
+        while(end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+            end--;
+        return std::string(p, end);
+    }
+
+    static const char* parseIndex(const char* p, const char* end, long long& out)
+    {
+        bool negative = false;
+        if(p < end && (*p == '-' || *p == '+'))
+            negative = *p++ == '-';
+
+        long long value = 0;
+        for(; p < end && unsigned(*p - '0') < 10; p++)
+            value = value * 10 + (*p - '0');
+
+        out = negative ? -value : value;
+        return p;
+    }
+
+    // 1-based absolute indices become 0-based. Negative ones count back from the
+    // attributes parsed so far in this chunk, the offset from the chunk start may be
+    // negative and is rebased once all chunks are known.
+    static uint32_t resolve(long long index, size_t count)
+    {
+        if(index > 0)
+            return static_cast<uint32_t>(index - 1);
+
+        long long offset = static_cast<long long>(count) + index;
+        if(index < 0 && offset >= -RELATIVE_BIAS && offset < RELATIVE_BIAS - 1)
+            return static_cast<uint32_t>(offset + RELATIVE_BIAS) | RELATIVE;
+        return NONE;
+    }
+
+    // Attributes and faces are optional, indices of faces count the attributes either
+    // way. Material libraries come with the attributes.
+    static void parseChunk(Chunk& chunk, bool attributes, bool faces)
+    {
+        const char* p   = chunk.begin;
+        const char* end = chunk.end;
+
+        std::vector<Corner> polygon;
+
+        size_t position_count = 0;
+        size_t texcoord_count = 0;
+        size_t normal_count   = 0;
+
+        while(p < end)
+        {
+            const char* line = skipSpace(p, end);
+            const char* stop = lineEnd(line, end);
+            p                = stop + 1;
+
+            if(line >= stop)
+                continue;
+
+            if(line[0] == 'v' && line + 1 < stop && (line[1] == ' ' || line[1] == '\t'))
+            {
+                position_count++;
+                if(!attributes)
+                    continue;
+
+                glm::vec3 position;
+                const char* q = line + 1;
+                for(int i = 0; i < 3; i++)
+                    q = parseFloat(skipSpace(q, stop), stop, position[i]);
+                chunk.positions.push_back(position);
+            }
+            else if(line[0] == 'v' && line + 1 < stop && line[1] == 't')
+            {
+                texcoord_count++;
+                if(!attributes)
+                    continue;
+
+                glm::vec2   texcoord;
+                const char* q = line + 2;
+                for(int i = 0; i < 2; i++)
+                    q = parseFloat(skipSpace(q, stop), stop, texcoord[i]);
+                chunk.texcoords.push_back(texcoord);
+            }
+            else if(line[0] == 'v' && line + 1 < stop && line[1] == 'n')
+            {
+                normal_count++;
+                if(!attributes)
+                    continue;
+
+                glm::vec3   normal;
+                const char* q = line + 2;
+                for(int i = 0; i < 3; i++)
+                    q = parseFloat(skipSpace(q, stop), stop, normal[i]);
+                chunk.normals.push_back(normal);
+            }
+            else if(
+                faces && line[0] == 'f' && line + 1 < stop &&
+                (line[1] == ' ' || line[1] == '\t'))
+            {
+                polygon.clear();
+
+                const char* q = skipSpace(line + 1, stop);
+                while(q < stop && *q != '\r' && *q != '#')
+                {
+                    Corner    corner;
+                    long long index = 0;
+
+                    q               = parseIndex(q, stop, index);
+                    corner.position = resolve(index, position_count);
+
+                    if(q < stop && *q == '/')
+                    {
+                        if(++q < stop && *q != '/')
+                        {
+                            q               = parseIndex(q, stop, index);
+                            corner.texcoord = resolve(index, texcoord_count);
+                        }
+                        if(q < stop && *q == '/')
+                        {
+                            q             = parseIndex(q + 1, stop, index);
+                            corner.normal = resolve(index, normal_count);
+                        }
+                    }
+
+                    // skip anything unexpected up to the next corner
+                    while(q < stop && *q != ' ' && *q != '\t')
+                        q++;
+                    q = skipSpace(q, stop);
+
+                    polygon.push_back(corner);
+                }
+
+                // polygons are fanned into triangles
+                for(size_t i = 2; i < polygon.size(); i++)
+                {
+                    chunk.corners.push_back(polygon[0]);
+                    chunk.corners.push_back(polygon[i - 1]);
+                    chunk.corners.push_back(polygon[i]);
+                }
+            }
+            else if(faces && stop - line > 7 && std::memcmp(line, "usemtl", 6) == 0)
+            {
+                size_t triangle = chunk.corners.size() / 3;
+                chunk.switches.emplace_back(triangle, text(line + 6, stop));
+            }
+            else if(
+                attributes && stop - line > 7 && std::memcmp(line, "mtllib", 6) == 0)
+            {
+                chunk.libraries.push_back(text(line + 6, stop));
+            }
+        }
+    }
+
+    // absolute index of a corner attribute, NONE if missing or out of range
+    static uint32_t absolute(uint32_t index, size_t base, size_t count)
+    {
+        if(index == NONE)
+            return NONE;
+
+        long long value = index;
+        if(index & RELATIVE)
+            value = static_cast<long long>(base) + (index & ~RELATIVE) - RELATIVE_BIAS;
+
+        return value >= 0 && value < static_cast<long long>(count)
+                   ? static_cast<uint32_t>(value)
+                   : NONE;
+    }
+
+    // absolute corners of the valid triangles of a segment, deduplicated locally
+    void resolveSegment(const Segment& segment, SegmentCorners& out) const
+    {
+        const Chunk& chunk   = chunks[segment.chunk];
+        size_t       corners = (segment.end - segment.begin) * 3;
+
+        CornerTable table(corners);
+        out.indices.reserve(corners);
+
+        for(size_t t = segment.begin; t < segment.end; t++)
+        {
+            Corner triangle[3];
+            for(int k = 0; k < 3; k++)
+            {
+                const Corner& raw = chunk.corners[t * 3 + k];
+
+                triangle[k].position =
+                    absolute(raw.position, chunk.position_base, positions.size());
+                triangle[k].texcoord =
+                    absolute(raw.texcoord, chunk.texcoord_base, texcoords.size());
+                triangle[k].normal =
+                    absolute(raw.normal, chunk.normal_base, normals.size());
+
+                if(position_normals)
+                    triangle[k].normal = triangle[k].position;
+            }
+
+            if(triangle[0].position == NONE || triangle[1].position == NONE ||
+               triangle[2].position == NONE)
+                continue;
+
+            for(const Corner& corner : triangle)
+            {
+                auto& slot = table.find(corner);
+                if(slot.value == NONE)
+                {
+                    slot.key   = corner;
+                    slot.value = static_cast<uint32_t>(out.unique.size());
+                    out.unique.push_back(corner);
+                }
+                out.indices.push_back(slot.value);
+            }
+        }
+    }
+
+    // Merges resolved segments in order into one mesh. Only the corners unique to a
+    // segment are looked up again, so vertices come out in order of first use exactly
+    // as if the triangles were walked one by one.
+    void buildMesh(
+        SegmentCorners*       first,
+        SegmentCorners*       last,
+        const ImportSettings& settings,
+        ObjMesh&              mesh)
+    {
+        size_t unique  = 0;
+        size_t corners = 0;
+        for(SegmentCorners* segment = first; segment != last; segment++)
+        {
+            unique += segment->unique.size();
+            corners += segment->indices.size();
+        }
+
+        CornerTable table(unique);
+
+        // position of every vertex, normals are shared by position when generated
+        std::vector<uint32_t> vertex_positions;
+        std::vector<uint32_t> remap;
+
+        bool flip         = settings.flags & aiProcess_FlipUVs;
+        bool missing      = false;
+        bool has_texcoord = false;
+
+        mesh.vertices.reserve(unique);
+        mesh.indices.reserve(corners);
+
+        for(SegmentCorners* segment = first; segment != last; segment++)
+        {
+            remap.resize(segment->unique.size());
+            for(size_t u = 0; u < segment->unique.size(); u++)
+            {
+                const Corner& corner = segment->unique[u];
+                auto&         slot   = table.find(corner);
+
+                if(slot.value == NONE)
+                {
+                    Vertex vertex   = {};
+                    vertex.Position = positions[corner.position];
+
+                    if(corner.texcoord != NONE)
+                    {
+                        glm::vec2 uv     = texcoords[corner.texcoord];
+                        vertex.TexCoords = flip ? glm::vec2(uv.x, 1.0f - uv.y) : uv;
+                        has_texcoord     = true;
+                    }
+
+                    if(corner.normal != NONE)
+                        vertex.Normal = normals[corner.normal];
+                    else
+                        missing = true;
+
+                    for(int j = 0; j < MAX_BONE_INFLUENCE; j++)
+                        vertex.m_BoneIDs[j] = -1;
+
+                    slot.key   = corner;
+                    slot.value = static_cast<uint32_t>(mesh.vertices.size());
+                    mesh.vertices.push_back(vertex);
+                    vertex_positions.push_back(corner.position);
+                }
+
+                remap[u] = slot.value;
+            }
+
+            for(uint32_t index : segment->indices)
+                mesh.indices.push_back(remap[index]);
+
+            *segment = SegmentCorners();
+        }
+
+        mesh.texcoords = has_texcoord;
+
+        // native generation runs on the welded mesh instead, see Model::loadObj
+        if(missing && !settings.nativeNormals())
+            generateNormals(mesh, vertex_positions);
+
+        if(has_texcoord && (settings.flags & aiProcess_CalcTangentSpace) &&
+           !settings.nativeTangents())
+            generateTangents(mesh);
+    }
+
+    // area weighted face normals summed per position, for vertices without a normal
+    static void generateNormals(
+        ObjMesh&                     mesh,
+        const std::vector<uint32_t>& vertex_positions)
+    {
+        // vertices sorted by position, each run of equal positions shares one sum
+        std::vector<uint32_t> order(mesh.vertices.size());
+        for(size_t v = 0; v < order.size(); v++)
+            order[v] = static_cast<uint32_t>(v);
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return vertex_positions[a] < vertex_positions[b];
+        });
+
+        std::vector<uint32_t> slots(order.size());
+        uint32_t              count = 0;
+        for(size_t i = 0; i < order.size(); i++)
+        {
+            if(i > 0 && vertex_positions[order[i]] != vertex_positions[order[i - 1]])
+                count++;
+            slots[order[i]] = count;
+        }
+
+        std::vector<glm::vec3> sums(order.empty() ? 0 : count + 1, glm::vec3(0.0f));
+
+        for(size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+        {
+            const Vertex& a = mesh.vertices[mesh.indices[i]];
+            const Vertex& b = mesh.vertices[mesh.indices[i + 1]];
+            const Vertex& c = mesh.vertices[mesh.indices[i + 2]];
+
+            glm::vec3 normal =
+                glm::cross(b.Position - a.Position, c.Position - a.Position);
+            for(int k = 0; k < 3; k++)
+                sums[slots[mesh.indices[i + k]]] += normal;
+        }
+
+        for(size_t v = 0; v < mesh.vertices.size(); v++)
+        {
+            Vertex& vertex = mesh.vertices[v];
+            if(vertex.Normal != glm::vec3(0.0f))
+                continue;
+
+            glm::vec3 sum = sums[slots[v]];
+            float     len = glm::length(sum);
+            vertex.Normal = len > 0.0f ? sum / len : glm::vec3(0.0f, 0.0f, 1.0f);
+        }
+    }
+
+    // per triangle tangents from the uv gradients, summed and orthogonalized per vertex
+    static void generateTangents(ObjMesh& mesh)
+    {
+        for(size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+        {
+            Vertex& a = mesh.vertices[mesh.indices[i]];
+            Vertex& b = mesh.vertices[mesh.indices[i + 1]];
+            Vertex& c = mesh.vertices[mesh.indices[i + 2]];
+
+            glm::vec3 e1  = b.Position - a.Position;
+            glm::vec3 e2  = c.Position - a.Position;
+            glm::vec2 d1  = b.TexCoords - a.TexCoords;
+            glm::vec2 d2  = c.TexCoords - a.TexCoords;
+            float     det = d1.x * d2.y - d2.x * d1.y;
+            if(std::fabs(det) < 1e-12f)
+                continue;
+
+            float     r         = 1.0f / det;
+            glm::vec3 tangent   = (e1 * d2.y - e2 * d1.y) * r;
+            glm::vec3 bitangent = (e2 * d1.x - e1 * d2.x) * r;
+
+            for(Vertex* vertex : {&a, &b, &c})
+            {
+                vertex->Tangent += tangent;
+                vertex->Bitangent += bitangent;
+            }
+        }
+
+        for(auto& vertex : mesh.vertices)
+        {
+            glm::vec3 n = vertex.Normal;
+            glm::vec3 t = vertex.Tangent - n * glm::dot(n, vertex.Tangent);
+            float     l = glm::length(t);
+            if(l < 1e-12f)
+                continue;
+
+            // the bitangent keeps the handedness of the uv mapping
+            glm::vec3 b      = glm::normalize(glm::cross(n, t));
+            vertex.Tangent   = t / l;
+            vertex.Bitangent = glm::dot(b, vertex.Bitangent) < 0.0f ? -b : b;
+        }
+    }
+
+    // reads newmtl blocks, maps are stored as paths next to the library
+    static void parseLibrary(
+        const std::string&                    path,
+        std::vector<ObjMaterial>&             materials,
+        std::unordered_map<std::string, int>& index)
+    {
+        MappedFile library;
+        if(!library.open(path) || !library.data)
+            return;
+
+        size_t      slash     = path.find_last_of("/\\");
+        std::string directory = slash == std::string::npos ? "." : path.substr(0, slash);
+
+        const char*  p        = library.data;
+        const char*  end      = library.data + library.size;
+        ObjMaterial* material = nullptr;
+
+        auto keyword = [](const char* line, const char* stop, const char* word) {
+            size_t length = std::strlen(word);
+            return size_t(stop - line) > length && std::memcmp(line, word, length) == 0 &&
+                   (line[length] == ' ' || line[length] == '\t');
+        };
+
+        auto color = [](const char* q, const char* stop) {
+            glm::vec3 value;
+            for(int i = 0; i < 3; i++)
+                q = parseFloat(skipSpace(q, stop), stop, value[i]);
+            return value;
+        };
+
+        // options like -bm come first, the file name is the last token
+        auto map = [&directory](const char* q, const char* stop) {
+            std::string line = text(q, stop);
+            size_t      last = line.find_last_of(" \t");
+            std::string file = last == std::string::npos ? line : line.substr(last + 1);
+            return directory + '/' + file;
+        };
+
+        while(p < end)
+        {
+            const char* line = skipSpace(p, end);
+            const char* stop = lineEnd(line, end);
+            p                = stop + 1;
+
+            if(keyword(line, stop, "newmtl"))
+            {
+                std::string name = text(line + 6, stop);
+
+                index[name] = static_cast<int>(materials.size());
+                materials.emplace_back();
+                material       = &materials.back();
+                material->name = name;
+                continue;
+            }
+
+            if(!material)
+                continue;
+
+            MaterialData& data = material->data;
+
+            if(keyword(line, stop, "Kd"))
+                data.diffuse = glm::vec4(color(line + 2, stop), data.diffuse.w);
+            else if(keyword(line, stop, "Ks"))
+                data.specular = glm::vec4(color(line + 2, stop), data.specular.w);
+            else if(keyword(line, stop, "Ns"))
+                parseFloat(skipSpace(line + 2, stop), stop, data.specular.w);
+            else if(keyword(line, stop, "d"))
+                parseFloat(skipSpace(line + 1, stop), stop, data.diffuse.w);
+            else if(keyword(line, stop, "Tr"))
+            {
+                float transparency = 0.0f;
+                parseFloat(skipSpace(line + 2, stop), stop, transparency);
+                data.diffuse.w = 1.0f - transparency;
+            }
+            // same slots Assimp's OBJ importer fills
+            else if(keyword(line, stop, "map_Kd"))
+                material->maps[MAP_DIFFUSE] = map(line + 6, stop);
+            else if(keyword(line, stop, "map_Ks"))
+                material->maps[MAP_SPECULAR] = map(line + 6, stop);
+            else if(keyword(line, stop, "map_Bump") || keyword(line, stop, "map_bump"))
+                material->maps[MAP_NORMAL] = map(line + 8, stop);
+            else if(keyword(line, stop, "bump"))
+                material->maps[MAP_NORMAL] = map(line + 4, stop);
+            else if(keyword(line, stop, "map_Ka"))
+                material->maps[MAP_HEIGHT] = map(line + 6, stop);
+        }
+
+        for(auto& entry : materials)
+            if(entry.data.specular.w <= 0.0f)
+                entry.data.specular.w = 32.0f;
+    }
+};
@@ -0,0 +1,291 @@
+#pragma once
+
+// Glad
+#include "glad/gl.h"
+
+// lib
+#include <glm/glm.hpp>
+
+// std
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// modules
+#include "Camera.hpp"
+#include "Frame.hpp"
+#include "FramePacing.hpp"
+#include "Model.hpp"
+#include "Shader.hpp"
+
+// Queries per mesh, a query is read back this many frames after it was issued
+const int OCCLUSION_QUERY_FRAMES = MAX_QUEUED_FRAMES + 1;
+
+// Visible meshes are only tested every few frames, occluded ones every frame
+const int VISIBLE_QUERY_INTERVAL = 4;
+
+// Culling with hardware occlusion queries, only used by the rendering thread.
+//
+// Meshes that were visible in the last known result are drawn first and lay down the
+// depth buffer. Then the bounding box of every mesh that needs testing is drawn with
+// color and depth writes off inside a GL_ANY_SAMPLES_PASSED query. Meshes believed to be
+// occluded are finally drawn inside glBeginConditionalRender of their query, so the GPU
+// discards them without a readback and newly revealed meshes still appear this frame.
+// Results are read one query ring later, when they are available without stalling.
+struct OcclusionCuller
+{
+    struct MeshState
+    {
+        GLuint queries[OCCLUSION_QUERY_FRAMES]     = {};
+        bool   issued[OCCLUSION_QUERY_FRAMES]      = {};
+        bool   conditional[OCCLUSION_QUERY_FRAMES] = {};  // query gated a draw
+        bool   visible                             = true;
+        bool   tested                              = false;  // query issued this frame
+    };
+
+    std::vector<MeshState> states;
+    std::vector<glm::mat4> boxes;  // world space bounds of the meshes tested this frame
+    std::vector<Model*>    models;
+    uint64_t               frame = 0;
+
+    std::unique_ptr<Shader> box_shader;
+    GLuint                  box_vao = 0;
+    GLuint                  box_vbo = 0;
+    GLuint                  box_ebo = 0;
+
+    // Read by the UI
+    std::atomic<int> meshes      = 0;
+    std::atomic<int> queried     = 0;
+    std::atomic<int> conditional = 0;  // draws submitted under conditional render
+    std::atomic<int> skipped     = 0;  // of those a ring ago, their query passed nothing
+
+    // slots are the per-draw blocks of every model in the uniform ring, the frame block
+    // has to be bound
+    void draw(
+        const Frame&                  frame_data,
+        ShaderVariants&               shaders,
+        const std::vector<DrawSlots>& slots)
+    {
+        if(!box_shader)
+            setup();
+
+        reset(frame_data);
+
+        int  slot   = static_cast<int>(frame % OCCLUSION_QUERY_FRAMES);
+        auto camera = frame_data.camera.position;
+
+        // Results of the queries issued a ring ago. Conditional draws whose query passed
+        // no samples were skipped, unless GL_QUERY_NO_WAIT drew them before the result.
+        int skipped_count = 0;
+        for(auto& state : states)
+        {
+            if(state.issued[slot])
+            {
+                GLuint available = GL_FALSE;
+                GLuint query     = state.queries[slot];
+                glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+                if(available)
+                {
+                    GLuint passed = 0;
+                    glGetQueryObjectuiv(query, GL_QUERY_RESULT, &passed);
+                    state.visible = passed != 0;
+
+                    if(state.conditional[slot] && !passed)
+                        skipped_count++;
+                }
+                state.issued[slot]      = false;
+                state.conditional[slot] = false;
+            }
+            state.tested = false;
+        }
+
+        // Meshes that can not be tested count as visible
+        int queried_count = 0;
+        boxes.resize(states.size());
+        for(size_t i = 0; i < frame_data.models.size(); i++)
+        {
+            Model& model  = *frame_data.models[i];
+            size_t offset = frame_data.world_offsets[i];
+            bool   skin   = frame_data.bone_offsets[i] >= 0;
+
+            for(unsigned int mesh = 0; mesh < model.meshes.size(); mesh++)
+            {
+                size_t     index = offset + mesh;
+                MeshState& state = states[index];
+
+                // skinned meshes leave their bounds, they are never culled
+                if(skin && model.meshes[mesh].skinned)
+                {
+                    state.visible = true;
+                    continue;
+                }
+
+                if(state.visible && (frame + index) % VISIBLE_QUERY_INTERVAL != 0)
+                    continue;
+
+                glm::vec3 min, max;
+                model.meshes[mesh].worldBounds(frame_data.mesh_worlds[index], min, max);
+
+                // the near plane would clip the box away while the camera is inside
+                glm::vec3 margin = glm::vec3(CAMERA_NEAR * 2.0f);
+                if(glm::all(glm::greaterThan(camera, min - margin)) &&
+                   glm::all(glm::lessThan(camera, max + margin)))
+                {
+                    state.visible = true;
+                    continue;
+                }
+
+                glm::mat4& box = boxes[index];
+                box            = glm::mat4(1.0f);
+                box[0][0]      = max.x - min.x;
+                box[1][1]      = max.y - min.y;
+                box[2][2]      = max.z - min.z;
+                box[3]         = glm::vec4(min, 1.0f);
+
+                state.tested = true;
+                queried_count++;
+            }
+        }
+
+        // Occluders, everything that was visible
+        auto occluders = [&](size_t i, unsigned mesh, size_t index, bool skin) {
+            if(states[index].visible)
+                frame_data.models[i]->DrawMesh(shaders, mesh, slots[i], skin);
+        };
+        forEachMesh(frame_data, occluders);
+
+        // Bounding boxes against the depth of the occluders
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+
+        box_shader->activate();
+        glBindVertexArray(box_vao);
+
+        for(size_t index = 0; index < states.size(); index++)
+        {
+            MeshState& state = states[index];
+            if(!state.tested)
+                continue;
+
+            box_shader->set("u_model", boxes[index]);
+
+            glBeginQuery(GL_ANY_SAMPLES_PASSED, state.queries[slot]);
+            glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, 0);
+            glEndQuery(GL_ANY_SAMPLES_PASSED);
+
+            state.issued[slot] = true;
+        }
+        glBindVertexArray(0);
+
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_TRUE);
+        shaders.invalidate();
+
+        // Occluded meshes, the GPU decides with this frame's query
+        int conditional_count = 0;
+
+        auto gated = [&](size_t i, unsigned mesh, size_t index, bool skin) {
+            MeshState& state = states[index];
+            if(state.visible || !state.tested)
+                return;
+
+            glBeginConditionalRender(state.queries[slot], GL_QUERY_NO_WAIT);
+            frame_data.models[i]->DrawMesh(shaders, mesh, slots[i], skin);
+            glEndConditionalRender();
+
+            state.conditional[slot] = true;
+            conditional_count++;
+        };
+        forEachMesh(frame_data, gated);
+
+        meshes      = static_cast<int>(states.size());
+        queried     = queried_count;
+        conditional = conditional_count;
+        skipped     = skipped_count;
+
+        frame++;
+    }
+
+    void release()
+    {
+        for(auto& state : states)
+            glDeleteQueries(OCCLUSION_QUERY_FRAMES, state.queries);
+        states.clear();
+        models.clear();
+
+        glDeleteVertexArrays(1, &box_vao);
+        glDeleteBuffers(1, &box_vbo);
+        glDeleteBuffers(1, &box_ebo);
+        box_shader.reset();
+    }
+
+private:
+    template<typename F>
+    void forEachMesh(const Frame& frame_data, F&& function)
+    {
+        for(size_t i = 0; i < frame_data.models.size(); i++)
+        {
+            Model& model  = *frame_data.models[i];
+            size_t offset = frame_data.world_offsets[i];
+            bool   skin   = frame_data.bone_offsets[i] >= 0;
+
+            model.bind();
+
+            for(unsigned int mesh = 0; mesh < model.meshes.size(); mesh++)
+                function(i, mesh, offset + mesh, skin);
+        }
+    }
+
+    // Queries belong to meshes, a different set of models starts over
+    void reset(const Frame& frame_data)
+    {
+        if(frame_data.models == models && states.size() == frame_data.mesh_worlds.size())
+            return;
+
+        for(auto& state : states)
+            glDeleteQueries(OCCLUSION_QUERY_FRAMES, state.queries);
+
+        models = frame_data.models;
+        states.assign(frame_data.mesh_worlds.size(), MeshState());
+
+        for(auto& state : states)
+            glGenQueries(OCCLUSION_QUERY_FRAMES, state.queries);
+    }
+
+    void setup()
+    {
+        box_shader = std::make_unique<Shader>();
+        box_shader->vertexShader("resource/vertex.glsl");
+        box_shader->fragmentShader("resource/fragment_color.glsl");
+        box_shader->link();
+        UniformRing::setup(box_shader->program);
+
+        // unit cube, scaled and moved onto the world space bounds per mesh
+        // clang-format off
+        const float corners[] = {
+            0, 0, 0,  1, 0, 0,  1, 1, 0,  0, 1, 0,
+            0, 0, 1,  1, 0, 1,  1, 1, 1,  0, 1, 1,
+        };
+        const unsigned char faces[] = {
+            0, 2, 1,  0, 3, 2,  4, 5, 6,  4, 6, 7,
+            0, 1, 5,  0, 5, 4,  3, 6, 2,  3, 7, 6,
+            0, 4, 7,  0, 7, 3,  1, 2, 6,  1, 6, 5,
+        };
+        // clang-format on
+
+        glGenVertexArrays(1, &box_vao);
+        glGenBuffers(1, &box_vbo);
+        glGenBuffers(1, &box_ebo);
+
+        glBindVertexArray(box_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, box_vbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, box_ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(faces), faces, GL_STATIC_DRAW);
+
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glBindVertexArray(0);
+    }
+};
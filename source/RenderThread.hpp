@@ -0,0 +1,417 @@
+#pragma once
+
+// Glad
+#include "glad/gl.h"
+
+// imgui
+#include "imgui.h"
+#include "imgui_impl_opengl3.h"
+
+// SDL
+#include "SDL3/SDL.h"
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// modules
+#include "Animation.hpp"
+#include "DynamicResolution.hpp"
+#include "Frame.hpp"
+#include "FramePacing.hpp"
+#include "GLStats.hpp"
+#include "Lighting.hpp"
+#include "Model.hpp"
+#include "Occlusion.hpp"
+#include "Shader.hpp"
+#include "TripleBuffer.hpp"
+#include "UniformRing.hpp"
+
+// Owns the GL context while running and draws the most recent frame published by the
+// main thread. Swapping (and waiting for vsync) only ever blocks this thread.
+struct RenderThread
+{
+    SDL_Window*          window  = nullptr;
+    SDL_GLContext        context = nullptr;
+    TripleBuffer<Frame>* frames  = nullptr;
+    ShaderVariants*      shaders = nullptr;
+
+    std::thread        thread;
+    std::atomic<bool>  running         = false;
+    std::atomic<bool>  frame_requested = false;
+    std::atomic<float> frame_ms        = 0.0f;
+    std::atomic<float> gpu_ms          = 0.0f;
+    std::atomic<float> scene_scale     = 1.0f;
+
+    FramePacer        pacer;
+    LatencyStats      latency;
+    BonePaletteBuffer palette_buffer;
+    LightBuffers      light_buffers;
+    OcclusionCuller   occlusion;
+
+    GpuTimer             gpu_timer;
+    ResolutionController resolution;
+    SceneTarget          scene_target;
+    float                scale   = 1.0f;   // of the scene in the next render()
+    bool                 reduced = false;  // last frame shown below full resolution
+
+    // framebuffer frames end up in, the window's unless the replay tool renders offscreen
+    GLuint output = 0;
+
+    // Only used to sleep while no frame is published, frames are handed over lock-free
+    std::mutex              wake_mutex;
+    std::condition_variable wake;
+
+    int viewport_width  = 0;
+    int viewport_height = 0;
+
+    // frame and per-draw blocks of render(), slots per model of the frame
+    UniformRing               uniforms;
+    std::vector<DrawUniforms> draw_blocks;
+    std::vector<DrawSlots>    draw_slots;
+
+    // Models the main thread let go of. A frame already published may still draw one,
+    // it is released and deleted once a frame from its sequence on is drawn.
+    struct Retired
+    {
+        std::unique_ptr<Model> model;
+        uint64_t               sequence = 0;
+    };
+
+    std::mutex           retire_mutex;
+    std::vector<Retired> retired;
+
+    void start(
+        SDL_Window*          w,
+        SDL_GLContext        c,
+        TripleBuffer<Frame>& f,
+        ShaderVariants&      s)
+    {
+        window  = w;
+        context = c;
+        frames  = &f;
+        shaders = &s;
+
+        // The context can only be current on one thread at a time
+        SDL_GL_MakeCurrent(window, nullptr);
+
+        running = true;
+        thread  = std::thread(&RenderThread::run, this);
+    }
+
+    // Call after publishing. Taking the mutex orders the notify after a waiter that has
+    // just found no fresh frame, so the wakeup can not fall between its check and wait.
+    void notify()
+    {
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+        }
+        wake.notify_one();
+    }
+
+    // takes over a model that frames from sequence on no longer refer to, any thread
+    void retire(Model* model, uint64_t sequence)
+    {
+        std::lock_guard<std::mutex> lock(retire_mutex);
+        retired.push_back({std::unique_ptr<Model>(model), sequence});
+    }
+
+    void stop()
+    {
+        running = false;
+        notify();
+
+        if(thread.joinable())
+            thread.join();
+
+        SDL_GL_MakeCurrent(window, context);
+    }
+
+    void run()
+    {
+        SDL_GL_MakeCurrent(window, context);
+        pacer.apply(pacer.mode);
+
+        while(running)
+        {
+            // In low latency mode the GPU has to drain first, only then is the main
+            // thread asked for a frame so that input is sampled as late as possible.
+            pacer.wait();
+            if(pacer.mode == PacingMode::LOW_LATENCY)
+                frame_requested = true;
+
+            if(!frames->consume())
+            {
+                bool fresh;
+                {
+                    std::unique_lock<std::mutex> lock(wake_mutex);
+                    fresh = wake.wait_for(lock, std::chrono::milliseconds(100), [this]() {
+                        return frames->fresh() || !running;
+                    });
+                }
+
+                // Without new frames the view has come to rest, a reduced frame is
+                // drawn once more at full resolution
+                if(!fresh && reduced)
+                {
+                    scale = 1.0f;
+                    render(frames->read());
+                    SDL_GL_SwapWindow(window);
+                    pacer.submitted();
+                    scene_scale = scale;
+                }
+                continue;
+            }
+
+            auto         frame_start = SDL_GetTicksNS();
+            const Frame& frame       = frames->read();
+            collect(frame.sequence);
+
+            if(frame.pacing != pacer.mode)
+                pacer.apply(frame.pacing);
+
+            scale = frame.dynamic_resolution ? resolution.scale : 1.0f;
+
+            gpu_timer.begin();
+            render(frame);
+            gpu_timer.end();
+            SDL_GL_SwapWindow(window);
+            pacer.submitted();
+            GL_STATS_FRAME();
+
+            if(gpu_timer.collect())
+            {
+                gpu_ms = gpu_timer.ms;
+                if(frame.dynamic_resolution)
+                    resolution.update(
+                        gpu_timer.ms,
+                        frame.frame_target_ms,
+                        frame.min_scale);
+            }
+            if(!frame.dynamic_resolution)
+                resolution.reset();
+            scene_scale = scale;
+
+            auto frame_end = SDL_GetTicksNS();
+            frame_ms       = (frame_end - frame_start) / 1e6f;
+
+            if(frame.input_timestamp)
+                latency.record((frame_end - frame.input_timestamp) / 1e6f);
+        }
+
+        pacer.release();
+        release();
+
+        SDL_GL_MakeCurrent(window, nullptr);
+    }
+
+    // GL resources of render(), needs the context
+    void release()
+    {
+        palette_buffer.release();
+        light_buffers.release();
+        occlusion.release();
+        gpu_timer.release();
+        scene_target.release();
+        uniforms.release();
+        shaders->release();
+        collect(UINT64_MAX);
+    }
+
+    // releases retired models no frame from sequence on can refer to
+    void collect(uint64_t sequence)
+    {
+        std::vector<Retired> done;
+        {
+            std::lock_guard<std::mutex> lock(retire_mutex);
+            auto pending = std::partition(
+                retired.begin(),
+                retired.end(),
+                [sequence](const Retired& entry) { return entry.sequence > sequence; });
+
+            std::move(pending, retired.end(), std::back_inserter(done));
+            retired.erase(pending, retired.end());
+        }
+
+        for(auto& entry : done)
+            entry.model->release();
+    }
+
+    // programs render() draws models with, shared with the replay tool
+    static void setupShader(ShaderVariants& shaders)
+    {
+        shaders.load("resource/vertex_model.glsl", "resource/fragment_model_lit.glsl");
+        shaders.setup = [](Shader& shader) {
+            MaterialLibrary::setup(shader.program);
+            LightBuffers::setup(shader.program);
+            UniformRing::setup(shader.program);
+            BonePaletteBuffer::setup(shader.program);
+        };
+    }
+
+    // Packs the frame block and the per-draw blocks of every model into the ring with a
+    // single write, the draws only bind their ranges
+    void uploadUniforms(const Frame& frame, int width, int height)
+    {
+        uniforms.begin();
+
+        FrameUniforms block;
+        block.view          = frame.view;
+        block.projection    = frame.projection;
+        block.viewport      = glm::vec2(width, height);
+        block.cluster_depth = glm::vec2(CAMERA_NEAR, CAMERA_FAR);
+        block.ambient       = glm::vec4(frame.ambient, 0.0f);
+        size_t offset       = uniforms.push(&block, sizeof(block));
+
+        draw_blocks.clear();
+        draw_slots.resize(frame.models.size());
+        for(size_t i = 0; i < frame.models.size(); i++)
+        {
+            size_t first = draw_blocks.size();
+            frame.models[i]->drawUniforms(
+                &frame.mesh_worlds[frame.world_offsets[i]],
+                frame.bone_offsets[i],
+                draw_blocks);
+
+            draw_slots[i].ring   = &uniforms;
+            draw_slots[i].first  = first;
+            draw_slots[i].stride = uniforms.stride(sizeof(DrawUniforms));
+        }
+
+        size_t draws = uniforms.push(
+            draw_blocks.data(),
+            sizeof(DrawUniforms),
+            draw_blocks.size());
+        for(auto& slots : draw_slots)
+            slots.first = draws + slots.first * slots.stride;
+
+        uniforms.upload();
+        uniforms.bind(FRAME_BINDING, offset, sizeof(FrameUniforms));
+    }
+
+    void render(const Frame& frame)
+    {
+        // the scene goes offscreen at reduced resolution and is stretched to the window
+        int width  = frame.width;
+        int height = frame.height;
+
+        reduced = scale < 1.0f;
+        if(reduced)
+        {
+            scene_target.resize(frame.width, frame.height);
+            width  = std::max(1, static_cast<int>(frame.width * scale + 0.5f));
+            height = std::max(1, static_cast<int>(frame.height * scale + 0.5f));
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, reduced ? scene_target.framebuffer : output);
+        viewport(width, height);
+
+        glClearColor(
+            frame.clear_color.x * frame.clear_color.w,
+            frame.clear_color.y * frame.clear_color.w,
+            frame.clear_color.z * frame.clear_color.w,
+            frame.clear_color.w);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        glm::mat4 view       = frame.view;
+        glm::mat4 projection = frame.projection;
+
+        // models imported in the background arrive without GL objects
+        for(auto* model : frame.models)
+            if(!model->uploaded)
+                model->upload();
+
+        uploadUniforms(frame, width, height);
+        shaders->begin(frame.lighting ? FEATURE_LIGHTING : 0u);
+
+        if(!frame.bone_palettes.empty())
+        {
+            palette_buffer.upload(frame.bone_palettes);
+            palette_buffer.bind();
+        }
+
+        if(frame.lighting)
+            light_buffers.upload(frame.lights);
+
+        if(frame.occlusion)
+            occlusion.draw(frame, *shaders, draw_slots);
+
+        if(!frame.occlusion)
+            drawList(frame);
+
+        // cluster stores cull per meshlet, with and without occlusion culling
+        for(size_t i = 0; i < frame.models.size(); i++)
+        {
+            if(!frame.models[i]->clusters)
+                continue;
+
+            ClusterView clusters;
+            clusters.world           = frame.mesh_worlds[frame.world_offsets[i]];
+            clusters.view_projection = projection * view;
+            clusters.camera          = frame.camera.position;
+            clusters.cone_culling    = frame.cone_culling;
+            clusters.prefetch        = frame.cluster_prefetch;
+
+            frame.models[i]->DrawClusters(*shaders, clusters, draw_slots[i]);
+        }
+        uniforms.end();
+
+        if(reduced)
+        {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, scene_target.framebuffer);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, output);
+            glBlitFramebuffer(
+                0,
+                0,
+                width,
+                height,
+                0,
+                0,
+                frame.width,
+                frame.height,
+                GL_COLOR_BUFFER_BIT,
+                GL_LINEAR);
+            glBindFramebuffer(GL_FRAMEBUFFER, output);
+            viewport(frame.width, frame.height);
+        }
+
+        ImGui_ImplOpenGL3_NewFrame();
+        ImGui_ImplOpenGL3_RenderDrawData(const_cast<ImDrawData*>(&frame.ui.data));
+    }
+
+    // the sorted draw list of the main thread, a model is bound whenever it changes
+    void drawList(const Frame& frame)
+    {
+        Model* bound = nullptr;
+        for(const DrawItem& item : frame.draws)
+        {
+            Model* model = frame.models[item.model];
+            if(model != bound)
+            {
+                model->bind();
+                bound = model;
+            }
+
+            bool skin = frame.bone_offsets[item.model] >= 0;
+            model->DrawMesh(*shaders, item.mesh, draw_slots[item.model], skin);
+        }
+    }
+
+    void viewport(int width, int height)
+    {
+        if(width != viewport_width || height != viewport_height)
+        {
+            viewport_width  = width;
+            viewport_height = height;
+            glViewport(0, 0, viewport_width, viewport_height);
+        }
+    }
+};
@@ -0,0 +1,500 @@
+#pragma once
+
+// lib
+#include <glm/glm.hpp>
+
+// std
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// modules
+#include "MappedFile.hpp"
+
+const uint32_t PACK_MAGIC   = 0x50524c47;  // "GLRP"
+const uint32_t PACK_VERSION = 1;
+
+// Opened at startup if it exists, relative to the working directory like the resources
+const char* const RESOURCE_PACK = "resource.pack";
+
+// Entries start at cache line boundaries, their headers and arrays are used in place
+const size_t PACK_ALIGNMENT = 64;
+
+// Compressed entries are only kept if they save at least an eighth
+const size_t PACK_MIN_SAVING = 8;
+
+enum PackKind : uint32_t
+{
+    PACK_SHADER  = 0,  // source text
+    PACK_TEXTURE = 1,  // PackImage followed by decoded RGBA8 rows
+    PACK_MODEL   = 2,  // PackModel, see below
+};
+
+enum PackFlags : uint32_t
+{
+    PACK_COMPRESSED = 1,
+};
+
+struct PackHeader
+{
+    uint32_t magic        = PACK_MAGIC;
+    uint32_t version      = PACK_VERSION;
+    uint32_t entry_count  = 0;
+    uint32_t padding      = 0;
+    uint64_t entry_offset = 0;
+    uint64_t name_offset  = 0;
+    uint64_t name_size    = 0;
+};
+
+// Table entries are sorted by name, names are file paths as the application opens them
+struct PackEntry
+{
+    uint64_t offset;
+    uint64_t size;      // stored bytes
+    uint64_t original;  // bytes after decompression
+    uint32_t name_offset;
+    uint32_t name_size;
+    uint32_t kind;
+    uint32_t flags;
+};
+
+// Texture as the image loader returns it, already flipped for GL
+struct PackImage
+{
+    int32_t  width;
+    int32_t  height;
+    uint32_t padding[14];  // rows start at a cache line
+};
+
+// Model entry: the header, its materials and meshes, then the vertex and index arrays
+// and the paths of the material maps. Offsets are relative to the entry. Meshes carry
+// their node's world matrix, the hierarchy is flattened when the pack is built.
+struct PackModel
+{
+    uint32_t mesh_count;
+    uint32_t material_count;
+    uint64_t material_offset;
+    uint64_t mesh_offset;
+    uint64_t string_offset;
+    uint64_t string_size;
+};
+
+// maps are offsets and sizes into the model's strings, empty for unused maps
+struct PackMaterial
+{
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+    uint32_t  map_offsets[4];
+    uint32_t  map_sizes[4];
+};
+
+struct PackMesh
+{
+    glm::mat4 world;
+    glm::vec3 bounds_min;
+    uint32_t  vertex_count;
+    glm::vec3 bounds_max;
+    uint32_t  index_count;
+    int32_t   material;
+    uint32_t  padding;
+    uint64_t  vertex_offset;  // Vertex array
+    uint64_t  index_offset;   // uint32 array
+};
+
+// Byte oriented LZ77 in the LZ4 block layout: a token with the literal count in the high
+// and the match length minus 4 in the low nibble, 255 continuation bytes for longer
+// counts, the literals and a 16 bit offset. The last sequence has literals only. Fast
+// to decode and good enough for shader text and index arrays.
+struct PackCodec
+{
+    static constexpr int    MIN_MATCH  = 4;
+    static constexpr int    HASH_BITS  = 14;
+    static constexpr size_t MAX_OFFSET = 65535;
+
+    static void compress(const uint8_t* in, size_t size, std::vector<uint8_t>& out)
+    {
+        out.clear();
+        out.reserve(size + size / 255 + 16);
+
+        std::vector<uint32_t> table(size_t(1) << HASH_BITS, UINT32_MAX);
+
+        size_t anchor = 0;
+        size_t i      = 0;
+        while(i + MIN_MATCH <= size)
+        {
+            uint32_t word      = read32(in + i);
+            uint32_t hash      = (word * 2654435761u) >> (32 - HASH_BITS);
+            uint32_t candidate = table[hash];
+            table[hash]        = static_cast<uint32_t>(i);
+
+            if(candidate == UINT32_MAX || i - candidate > MAX_OFFSET ||
+               read32(in + candidate) != word)
+            {
+                i++;
+                continue;
+            }
+
+            size_t length = MIN_MATCH;
+            while(i + length < size && in[candidate + length] == in[i + length])
+                length++;
+
+            sequence(in + anchor, i - anchor, i - candidate, length, out);
+            i += length;
+            anchor = i;
+        }
+
+        sequence(in + anchor, size - anchor, 0, 0, out);
+    }
+
+    // false if the data is corrupt or does not decode to exactly size bytes
+    static bool decompress(const uint8_t* in, size_t in_size, uint8_t* out, size_t size)
+    {
+        const uint8_t* end    = in + in_size;
+        size_t         cursor = 0;
+
+        while(in < end)
+        {
+            uint8_t token = *in++;
+
+            size_t literals = token >> 4;
+            if(literals == 15 && !extend(in, end, literals))
+                return false;
+            if(literals > size_t(end - in) || literals > size - cursor)
+                return false;
+
+            std::memcpy(out + cursor, in, literals);
+            in += literals;
+            cursor += literals;
+
+            if(in == end)
+                break;
+            if(end - in < 2)
+                return false;
+
+            size_t offset = size_t(in[0]) | size_t(in[1]) << 8;
+            in += 2;
+
+            size_t length = token & 15;
+            if(length == 15 && !extend(in, end, length))
+                return false;
+            length += MIN_MATCH;
+
+            if(offset == 0 || offset > cursor || length > size - cursor)
+                return false;
+
+            // byte by byte, matches may overlap the bytes they produce
+            for(size_t k = 0; k < length; k++, cursor++)
+                out[cursor] = out[cursor - offset];
+        }
+
+        return cursor == size;
+    }
+
+private:
+    static uint32_t read32(const uint8_t* p)
+    {
+        uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static bool extend(const uint8_t*& in, const uint8_t* end, size_t& value)
+    {
+        uint8_t byte;
+        do
+        {
+            if(in == end)
+                return false;
+            byte = *in++;
+            value += byte;
+        } while(byte == 255);
+        return true;
+    }
+
+    static void count(size_t value, std::vector<uint8_t>& out)
+    {
+        for(; value >= 255; value -= 255)
+            out.push_back(255);
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    // a match length of 0 ends the block after the literals
+    static void sequence(
+        const uint8_t*        literals,
+        size_t                literal_count,
+        size_t                offset,
+        size_t                length,
+        std::vector<uint8_t>& out)
+    {
+        size_t match = length ? length - MIN_MATCH : 0;
+        out.push_back(static_cast<uint8_t>(std::min<size_t>(literal_count, 15) << 4 |
+                                           std::min<size_t>(match, 15)));
+        if(literal_count >= 15)
+            count(literal_count - 15, out);
+
+        out.insert(out.end(), literals, literals + literal_count);
+        if(!length)
+            return;
+
+        out.push_back(static_cast<uint8_t>(offset));
+        out.push_back(static_cast<uint8_t>(offset >> 8));
+        if(match >= 15)
+            count(match - 15, out);
+    }
+};
+
+// Bytes of an entry, in the mapping unless the entry had to be decompressed
+struct PackData
+{
+    const char*       data = nullptr;
+    size_t            size = 0;
+    std::vector<char> buffer;
+};
+
+// Writes a pack: entries in the order they are added, then the name table and the
+// entry table sorted by name. Entries with a name that was already added are skipped.
+struct PackWriter
+{
+    std::ofstream file;
+    PackHeader    header;
+    size_t        stored   = 0;  // bytes of all entries as written
+    size_t        original = 0;  // and before compression
+
+    bool begin(const std::string& path)
+    {
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if(!file)
+            return false;
+
+        header   = PackHeader();
+        stored   = 0;
+        original = 0;
+        entries.clear();
+        names.clear();
+
+        write(header);
+        return true;
+    }
+
+    bool contains(const std::string& name) const
+    {
+        return names.count(name) > 0;
+    }
+
+    void add(
+        const std::string& name,
+        PackKind           kind,
+        const void*        data,
+        size_t             size,
+        bool               compress)
+    {
+        if(contains(name))
+            return;
+
+        PackEntry entry;
+        entry.size     = size;
+        entry.original = size;
+        entry.kind     = kind;
+        entry.flags    = 0;
+
+        const char* bytes = static_cast<const char*>(data);
+        if(compress && size > 0)
+        {
+            PackCodec::compress(static_cast<const uint8_t*>(data), size, packed);
+            if(packed.size() <= size - size / PACK_MIN_SAVING)
+            {
+                bytes       = reinterpret_cast<const char*>(packed.data());
+                entry.size  = packed.size();
+                entry.flags = PACK_COMPRESSED;
+            }
+        }
+
+        align(PACK_ALIGNMENT);
+        entry.offset = static_cast<uint64_t>(file.tellp());
+        file.write(bytes, entry.size);
+
+        stored += entry.size;
+        original += entry.original;
+        names[name] = entries.size();
+        entries.push_back(entry);
+    }
+
+    bool finish()
+    {
+        std::string           table;
+        std::vector<PackEntry> sorted;
+        for(auto& [name, index] : names)
+        {
+            PackEntry entry   = entries[index];
+            entry.name_offset = static_cast<uint32_t>(table.size());
+            entry.name_size   = static_cast<uint32_t>(name.size());
+            sorted.push_back(entry);
+            table += name;
+        }
+
+        header.name_offset = static_cast<uint64_t>(file.tellp());
+        header.name_size   = table.size();
+        file.write(table.data(), table.size());
+
+        align(sizeof(uint64_t));
+        header.entry_offset = static_cast<uint64_t>(file.tellp());
+        header.entry_count  = static_cast<uint32_t>(sorted.size());
+        file.write(
+            reinterpret_cast<const char*>(sorted.data()),
+            sorted.size() * sizeof(PackEntry));
+
+        file.seekp(0);
+        write(header);
+        file.close();
+
+        return !file.fail();
+    }
+
+private:
+    std::vector<PackEntry>        entries;
+    std::map<std::string, size_t> names;
+    std::vector<uint8_t>          packed;
+
+    template<typename T>
+    void write(const T& value)
+    {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void align(size_t alignment)
+    {
+        size_t position = static_cast<size_t>(file.tellp());
+        size_t padding  = (alignment - position % alignment) % alignment;
+        for(size_t i = 0; i < padding; i++)
+            file.put(0);
+    }
+};
+
+// Shaders, textures and models bundled into one memory mapped file, so a cold start opens
+// a single file instead of one per resource. Lookups binary search the sorted entry table
+// in the mapping and stored entries are returned in place. Loaders ask the pack first and
+// fall back to the file system for names it does not contain.
+struct ResourcePack
+{
+    PackHeader header;
+
+    bool open(const std::string& path)
+    {
+        close();
+        if(!file.open(path) || file.size < sizeof(PackHeader))
+            return false;
+
+        file.random();
+        std::memcpy(&header, file.data, sizeof(PackHeader));
+        size_t table = size_t(header.entry_count) * sizeof(PackEntry);
+        if(header.magic != PACK_MAGIC || header.version != PACK_VERSION ||
+           header.entry_offset % alignof(PackEntry) != 0 ||
+           header.entry_offset + table > file.size ||
+           header.name_offset + header.name_size > file.size)
+        {
+            close();
+            return false;
+        }
+
+        entries = reinterpret_cast<const PackEntry*>(file.data + header.entry_offset);
+        names   = file.data + header.name_offset;
+
+        for(uint32_t i = 0; i < header.entry_count; i++)
+        {
+            const PackEntry& entry = entries[i];
+            if(entry.offset + entry.size > file.size ||
+               size_t(entry.name_offset) + entry.name_size > header.name_size)
+            {
+                close();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void close()
+    {
+        file.close();
+        header  = PackHeader();
+        entries = nullptr;
+        names   = nullptr;
+    }
+
+    bool isOpen() const
+    {
+        return entries != nullptr;
+    }
+
+    // index of the entry, -1 if the pack has none of that name and kind
+    int find(std::string_view name, PackKind kind) const
+    {
+        if(!isOpen())
+            return -1;
+
+        const PackEntry* end = entries + header.entry_count;
+        const PackEntry* it  = std::lower_bound(
+            entries,
+            end,
+            name,
+            [this](const PackEntry& entry, std::string_view key) {
+                return this->name(entry) < key;
+            });
+
+        if(it == end || this->name(*it) != name || it->kind != kind)
+            return -1;
+        return static_cast<int>(it - entries);
+    }
+
+    // zero copy for stored entries, compressed ones are decoded into the buffer
+    bool read(int index, PackData& out) const
+    {
+        const PackEntry& entry  = entries[index];
+        const char*      stored = file.data + entry.offset;
+
+        if(!(entry.flags & PACK_COMPRESSED))
+        {
+            out.data = stored;
+            out.size = entry.size;
+            return true;
+        }
+
+        out.buffer.resize(entry.original);
+        if(!PackCodec::decompress(
+               reinterpret_cast<const uint8_t*>(stored),
+               entry.size,
+               reinterpret_cast<uint8_t*>(out.buffer.data()),
+               entry.original))
+            return false;
+
+        out.data = out.buffer.data();
+        out.size = out.buffer.size();
+        return true;
+    }
+
+    bool read(std::string_view name, PackKind kind, PackData& out) const
+    {
+        int index = find(name, kind);
+        return index >= 0 && read(index, out);
+    }
+
+    std::string_view name(const PackEntry& entry) const
+    {
+        return std::string_view(names + entry.name_offset, entry.name_size);
+    }
+
+private:
+    MappedFile       file;
+    const PackEntry* entries = nullptr;
+    const char*      names   = nullptr;
+};
+
+inline ResourcePack& resourcePack()
+{
+    static ResourcePack pack;
+    return pack;
+}
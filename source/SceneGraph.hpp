@@ -0,0 +1,96 @@
+#pragma once
+
+// lib
+#include <glm/glm.hpp>
+
+// std
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Node hierarchy stored as flat arrays in depth-first order, so every parent precedes its
+// children and every subtree is the contiguous range [node, ends[node]). Changing a local
+// transform marks the node dirty; update() then recomputes only the dirty subtrees with
+// a linear pass over each range instead of walking the whole tree.
+struct SceneGraph
+{
+    std::vector<int>       parents;
+    std::vector<int>       ends;
+    std::vector<glm::mat4> locals;
+    std::vector<glm::mat4> worlds;
+    std::vector<uint8_t>   dirty;
+
+    std::vector<int> dirty_roots;
+    uint64_t         version = 0;
+
+    int size() const
+    {
+        return static_cast<int>(parents.size());
+    }
+
+    // Nodes have to be added in depth-first order, close() a node after its children
+    int add(int parent, const glm::mat4& local)
+    {
+        int node = size();
+
+        parents.push_back(parent);
+        ends.push_back(node + 1);
+        locals.push_back(local);
+        worlds.push_back(local);
+        dirty.push_back(0);
+
+        setLocal(node, local);
+
+        return node;
+    }
+
+    void close(int node)
+    {
+        ends[node] = size();
+    }
+
+    void setLocal(int node, const glm::mat4& local)
+    {
+        locals[node] = local;
+
+        if(!dirty[node])
+        {
+            dirty[node] = 1;
+            dirty_roots.push_back(node);
+        }
+    }
+
+    // returns true if any world transform changed
+    bool update()
+    {
+        if(dirty_roots.empty())
+            return false;
+
+        // ancestors sort first, their ranges cover dirty descendants
+        std::sort(dirty_roots.begin(), dirty_roots.end());
+
+        int covered = 0;
+        for(int root : dirty_roots)
+        {
+            if(root < covered)
+                continue;
+
+            int parent   = parents[root];
+            worlds[root] = parent < 0 ? locals[root] : worlds[parent] * locals[root];
+            dirty[root]  = 0;
+
+            for(int node = root + 1; node < ends[root]; node++)
+            {
+                worlds[node] = worlds[parents[node]] * locals[node];
+                dirty[node]  = 0;
+            }
+
+            covered = ends[root];
+        }
+
+        dirty_roots.clear();
+        version++;
+
+        return true;
+    }
+};
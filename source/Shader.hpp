@@ -1,12 +1,44 @@
+#pragma once
+
 #include "glad/gl.h"
 
+#include <atomic>
+#include <cstdint>
 #include <fstream>
-#include <iostream>
+#include <functional>
+#include <memory>
+#include <sstream>
 #include <stdio.h>
+#include <string>
+#include <string_view>
 #include <vector>
 
+#include "Log.hpp"
+#include "ResourcePack.hpp"
+
 static GLchar info[512] = {0};
 
+// Features a shader pair can be compiled with, a variant key is a combination of these
+// bits. Sources list the ones they implement in a `#pragma features` line and are
+// compiled with a `#define` of the name for every bit set in the key.
+enum ShaderFeature : uint32_t
+{
+    FEATURE_SKINNED      = 1 << 0,  // bone palette skinning
+    FEATURE_DIFFUSE_MAP  = 1 << 1,
+    FEATURE_SPECULAR_MAP = 1 << 2,
+    FEATURE_NORMAL_MAP   = 1 << 3,  // needs tangents in the vertex layout
+    FEATURE_LIGHTING     = 1 << 4,  // clustered lights, unlit variants show the albedo
+};
+
+const int SHADER_FEATURE_COUNT = 5;
+
+const char* const SHADER_FEATURE_NAMES[] = {
+    "SKINNED",
+    "DIFFUSE_MAP",
+    "SPECULAR_MAP",
+    "NORMAL_MAP",
+    "LIGHTING"};
+
 const char* getError()
 {
     // clang-format off
@@ -38,15 +70,54 @@ std::vector<char> readMyFile(const char* filename)
     return buffer;
 }
 
-GLuint createShader(GLenum shader_type, const char* filename)
+// sources in the resource pack are compiled straight from the mapping
+PackData readShader(const char* filename)
+{
+    PackData content;
+    if(!resourcePack().read(filename, PACK_SHADER, content))
+    {
+        content.buffer = readMyFile(filename);
+        content.data   = content.buffer.data();
+        content.size   = content.buffer.size();
+    }
+    return content;
+}
+
+// Compiles source with the given #define lines inserted after its #version line. A #line
+// directive keeps the line numbers of compiler messages those of the file.
+GLuint compileShader(
+    GLenum             shader_type,
+    const char*        filename,
+    const char*        source,
+    size_t             size,
+    const std::string& defines = std::string())
 {
     GLuint shader = glCreateShader(shader_type);
 
-    auto          content = readMyFile(filename);
-    const GLchar* buffer  = content.data();
-    const GLint   size    = content.size();
+    // nothing but comments may precede the #version line, it stays in front
+    size_t      version = 0;
+    std::string injected;
+    if(!defines.empty())
+    {
+        std::string_view text(source, size);
+        size_t           start = text.find("#version");
+        size_t           end   = start == text.npos ? text.npos : text.find('\n', start);
+        if(end != text.npos)
+            version = end + 1;
+
+        int lines = 0;
+        for(size_t i = 0; i < version; i++)
+            lines += source[i] == '\n';
+        injected = defines + "#line " + std::to_string(lines + 1) + "\n";
+    }
+
+    const GLchar* buffers[3] = {source, injected.data(), source + version};
+    const GLint   sizes[3]   = {
+        static_cast<GLint>(version),
+        static_cast<GLint>(injected.size()),
+        static_cast<GLint>(size - version)};
 
-    glShaderSource(shader, 1, &buffer, &size);
+    glShaderSource(shader, 3, buffers, sizes);
     glCompileShader(shader);
 
     GLint status = 0;
@@ -55,15 +126,46 @@ GLuint createShader(GLenum shader_type, const char* filename)
     if(status == GL_FALSE)
     {
         glGetShaderInfoLog(shader, sizeof(info), nullptr, info);
-        std::cout << "Shader compilation:\n"
-                  << "Status: " << status << "\n"
-                  << "Error: " << getError() << "\n"
-                  << "Message: " << info << std::endl;
+        logError("Shader compilation of %s failed (%s): %s", filename, getError(), info);
     }
 
     return shader;
 }
 
+GLuint createShader(GLenum shader_type, const char* filename)
+{
+    PackData content = readShader(filename);
+    return compileShader(shader_type, filename, content.data, content.size);
+}
+
+// feature bits a source lists in its `#pragma features` lines
+uint32_t shaderFeatures(const char* filename, const char* source, size_t size)
+{
+    const std::string_view pragma = "#pragma features";
+
+    uint32_t         features = 0;
+    std::string_view text(source, size);
+    for(size_t at = text.find(pragma); at != text.npos; at = text.find(pragma, at + 1))
+    {
+        size_t             end = text.find('\n', at);
+        std::istringstream names(std::string(text.substr(at + pragma.size(), end - at)));
+
+        std::string name;
+        while(names >> name)
+        {
+            int feature = 0;
+            while(feature < SHADER_FEATURE_COUNT && name != SHADER_FEATURE_NAMES[feature])
+                feature++;
+
+            if(feature < SHADER_FEATURE_COUNT)
+                features |= 1u << feature;
+            else
+                logWarning("Unknown shader feature %s in %s", name, filename);
+        }
+    }
+    return features;
+}
+
 struct Shader
 {
     GLuint program  = 0;
@@ -77,6 +179,8 @@ struct Shader
 
     ~Shader()
     {
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
         glDeleteProgram(program);
     }
 
@@ -92,6 +196,27 @@ struct Shader
         glAttachShader(program, fragment);
     }
 
+    // compiles a source that is already read, with the defines of a variant
+    void vertexShader(
+        const char*        filename,
+        const std::string& source,
+        const std::string& defines)
+    {
+        vertex = compileShader(
+            GL_VERTEX_SHADER, filename, source.data(), source.size(), defines);
+        glAttachShader(program, vertex);
+    }
+
+    void fragmentShader(
+        const char*        filename,
+        const std::string& source,
+        const std::string& defines)
+    {
+        fragment = compileShader(
+            GL_FRAGMENT_SHADER, filename, source.data(), source.size(), defines);
+        glAttachShader(program, fragment);
+    }
+
     void link()
     {
         glLinkProgram(program);
@@ -103,10 +228,7 @@ struct Shader
         {
             glGetProgramInfoLog(program, sizeof(info), nullptr, info);
 
-            std::cout << "Program linking:\n"
-                      << "Status: " << status << "\n"
-                      << "Error: " << getError() << "\n"
-                      << "Message: " << info << std::endl;
+            logError("Program linking failed (%s): %s", getError(), info);
         }
     }
 
@@ -120,10 +242,7 @@ struct Shader
         if(status == GL_FALSE)
         {
             glGetProgramInfoLog(program, sizeof(info), nullptr, info);
-            std::cout << "Program validation:\n"
-                      << "Status: " << status << "\n"
-                      << "Error: " << getError() << "\n"
-                      << "Message: " << info << std::endl;
+            logError("Program validation failed (%s): %s", getError(), info);
         }
     }
 
@@ -169,3 +288,103 @@ struct Shader
         glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]);
     }
 };
+
+// Variants of a vertex and fragment shader pair, compiled on first use. Keys are masked
+// by the features the sources declare, so features a pair does not implement do not
+// multiply its variants, and finding the variant of a draw is one array access.
+//
+// setup() runs once after a variant is linked, for sampler units and block bindings.
+// Frame and draw uniforms live in blocks, see UniformRing.hpp, so no variant needs its
+// uniforms set again when it is bound. Only used by the rendering thread.
+struct ShaderVariants
+{
+    static constexpr uint32_t KEYS = 1u << SHADER_FEATURE_COUNT;
+
+    std::string vertex_file;
+    std::string fragment_file;
+    uint32_t    declared = 0;  // features of either source
+    uint32_t    global   = 0;  // features of the whole frame, added to every key
+
+    std::function<void(Shader&)> setup;
+
+    std::atomic<int> compiled = 0;  // read by the UI
+
+    void load(const char* vertex, const char* fragment)
+    {
+        release();
+
+        vertex_file   = vertex;
+        fragment_file = fragment;
+
+        PackData content = readShader(vertex);
+        vertex_source.assign(content.data, content.size);
+        declared = shaderFeatures(vertex, content.data, content.size);
+
+        content = readShader(fragment);
+        fragment_source.assign(content.data, content.size);
+        declared |= shaderFeatures(fragment, content.data, content.size);
+    }
+
+    // starts a frame, features are added to every key until the next one
+    void begin(uint32_t features)
+    {
+        global  = features;
+        current = nullptr;
+    }
+
+    // another program was made current, the next use() binds its variant again
+    void invalidate()
+    {
+        current = nullptr;
+    }
+
+    // the variant for the features of a draw, made the current program
+    Shader& use(uint32_t features)
+    {
+        uint32_t                 key     = (features | global) & declared;
+        std::unique_ptr<Shader>& variant = variants[key];
+        if(!variant)
+            variant = build(key);
+
+        if(variant.get() != current)
+        {
+            current = variant.get();
+            current->activate();
+        }
+        return *current;
+    }
+
+    void release()
+    {
+        for(auto& variant : variants)
+            variant.reset();
+
+        current  = nullptr;
+        compiled = 0;
+    }
+
+private:
+    std::string             vertex_source;
+    std::string             fragment_source;
+    std::unique_ptr<Shader> variants[KEYS];
+    Shader*                 current = nullptr;
+
+    std::unique_ptr<Shader> build(uint32_t key)
+    {
+        std::string defines;
+        for(int feature = 0; feature < SHADER_FEATURE_COUNT; feature++)
+            if(key & (1u << feature))
+                defines += std::string("#define ") + SHADER_FEATURE_NAMES[feature] + "\n";
+
+        auto shader = std::make_unique<Shader>();
+        shader->vertexShader(vertex_file.c_str(), vertex_source, defines);
+        shader->fragmentShader(fragment_file.c_str(), fragment_source, defines);
+        shader->link();
+        if(setup)
+            setup(*shader);
+
+        logDebug("Compiled %s/%s variant %#x", vertex_file, fragment_file, key);
+        compiled++;
+        return shader;
+    }
+};
@@ -0,0 +1,607 @@
+#pragma once
+
+// lib
+#include <glm/glm.hpp>
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// modules
+#include "Camera.hpp"
+#include "Material.hpp"
+#include "Model.hpp"
+#include "ThreadPool.hpp"
+
+// Square screen tiles, every tile is rasterized by one thread
+const int RASTER_TILE_SIZE = 64;
+
+// Pixels of a row tested at once, enough for 8 float lanes. Tiles are a multiple of it.
+const int RASTER_LANES = 8;
+
+// Vertices transformed and triangles set up and binned per task
+const size_t RASTER_VERTEX_GRAIN   = 1 << 14;
+const size_t RASTER_TRIANGLE_GRAIN = 1 << 14;
+
+enum RasterStage : int
+{
+    RASTER_VERTEX = 0,  // transform into clip space
+    RASTER_SETUP,       // clipping, edge functions and binning into tiles
+    RASTER_PIXELS,      // depth test and shading per tile
+    RASTER_STAGE_COUNT,
+};
+
+const char* const RASTER_STAGE_NAMES[] = {"Vertex", "Setup", "Pixels"};
+
+// Color and depth of a software rendered image. Color rows are stored top to bottom as
+// image files expect them. Depth rows are padded to whole tiles so the lanes of a row
+// never read past it.
+struct SoftwareTarget
+{
+    int                  width  = 0;
+    int                  height = 0;
+    int                  pitch  = 0;  // floats per depth row
+    std::vector<uint8_t> color;       // RGBA8
+    std::vector<float>   depth;       // window depth, 0 near to 1 far
+
+    void resize(int w, int h)
+    {
+        width  = std::max(w, 1);
+        height = std::max(h, 1);
+        pitch  = (width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE * RASTER_TILE_SIZE;
+
+        int rows = (height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE * RASTER_TILE_SIZE;
+        color.resize(size_t(width) * height * 4);
+        depth.resize(size_t(pitch) * rows);
+    }
+
+    void clear(const glm::vec4& clear_color)
+    {
+        uint8_t texel[4];
+        for(int i = 0; i < 4; i++)
+            texel[i] = quantize(clear_color[i]);
+
+        for(size_t i = 0; i < color.size(); i += 4)
+            std::copy_n(texel, 4, &color[i]);
+        std::fill(depth.begin(), depth.end(), 1.0f);
+    }
+
+    static uint8_t quantize(float value)
+    {
+        float clamped = std::min(std::max(value, 0.0f), 1.0f);
+        return static_cast<uint8_t>(clamped * 255.0f + 0.5f);
+    }
+};
+
+// Vertex after the vertex stage, normals in view space like in the model shader
+struct RasterVertex
+{
+    glm::vec4 clip;
+    glm::vec3 normal;
+    glm::vec2 tex_coords;
+};
+
+// Triangle ready for the tiles. The edge functions a x + b y + c are divided by the
+// area, so at a pixel center they are the barycentric weights of the opposite vertices.
+// Attributes are divided by w for perspective correct interpolation.
+struct RasterTriangle
+{
+    float     a[3];
+    float     b[3];
+    float     c[3];
+    int       top_left[3];  // pixels exactly on the edge belong to the triangle
+    float     z[3];
+    float     inv_w[3];
+    glm::vec2 tex_coords[3];
+    glm::vec3 normal[3];
+    int       min_x, min_y, max_x, max_y;
+    int       material;
+};
+
+// Triangles set up by one task with the triangles touching every tile in their order
+struct RasterBin
+{
+    std::vector<RasterTriangle> triangles;
+    std::vector<uint32_t>       offsets;  // per tile into items, one more than tiles
+    std::vector<uint32_t>       items;
+};
+
+// Renders models into a SoftwareTarget without a GL context, for previews and image
+// comparisons on machines without a GPU. Vertices are transformed and triangles set up in
+// parallel tasks that bin them into screen tiles; the tiles are then rasterized in
+// parallel, each one walking the bins in task order so the image does not depend on the
+// thread count. Rows are evaluated RASTER_LANES pixels at a time in branch free loops the
+// compiler vectorizes.
+//
+// Shading follows the model shader: the diffuse map or color, lit by the ambient term
+// and a headlight since scenes carry no lights of their own. Models have to be loaded
+// without gpu so meshes and textures keep their CPU data; meshes without vertices,
+// glTF buffers uploaded straight from the file and cluster stores, are skipped. Skinned
+// meshes are drawn in their bind pose.
+struct SoftwareRenderer
+{
+    bool      lighting = true;
+    glm::vec3 ambient  = glm::vec3(0.25f);
+    glm::vec3 light    = glm::vec3(0.75f);  // headlight color
+
+    float  ms[RASTER_STAGE_COUNT] = {};
+    size_t triangles              = 0;  // after clipping and culling
+
+    void render(const Model& model, Camera& camera, SoftwareTarget& target)
+    {
+        std::vector<glm::mat4> worlds;
+        model.meshWorlds(worlds);
+
+        glm::mat4 projection = camera.projection(target.width, target.height);
+        render(model, worlds.data(), camera.view(), projection, target);
+    }
+
+    // draws every mesh with its world matrix over the target's current content
+    void render(
+        const Model&     model,
+        const glm::mat4* worlds,
+        const glm::mat4& view,
+        const glm::mat4& projection,
+        SoftwareTarget&  target)
+    {
+        auto start = std::chrono::steady_clock::now();
+        transform(model, worlds, view, projection);
+        auto transformed = std::chrono::steady_clock::now();
+        setup(model, target);
+        auto binned = std::chrono::steady_clock::now();
+
+        threadPool().parallelFor(tiles_x * tiles_y, 1, [&](size_t begin, size_t end) {
+            for(size_t tile = begin; tile < end; tile++)
+                rasterize(model, static_cast<int>(tile), target);
+        });
+        auto rasterized = std::chrono::steady_clock::now();
+
+        using Ms          = std::chrono::duration<float, std::milli>;
+        ms[RASTER_VERTEX] = Ms(transformed - start).count();
+        ms[RASTER_SETUP]  = Ms(binned - transformed).count();
+        ms[RASTER_PIXELS] = Ms(rasterized - binned).count();
+
+        triangles = 0;
+        for(auto& bin : bins)
+            triangles += bin.triangles.size();
+    }
+
+private:
+    std::vector<RasterVertex> vertices;
+    std::vector<size_t>       vertex_offsets;    // first vertex of every mesh
+    std::vector<size_t>       triangle_offsets;  // first triangle, one more than meshes
+    std::vector<RasterBin>    bins;
+
+    int tiles_x = 0;
+    int tiles_y = 0;
+
+    void transform(
+        const Model&     model,
+        const glm::mat4* worlds,
+        const glm::mat4& view,
+        const glm::mat4& projection)
+    {
+        size_t count = model.meshes.size();
+
+        vertex_offsets.assign(count, 0);
+        triangle_offsets.assign(count + 1, 0);
+
+        size_t total = 0;
+        for(size_t i = 0; i < count; i++)
+        {
+            const Mesh& mesh = model.meshes[i];
+            size_t      tris = mesh.vertices.empty() ? 0 : mesh.indices.size() / 3;
+
+            vertex_offsets[i]       = total;
+            triangle_offsets[i + 1] = triangle_offsets[i] + tris;
+            total += mesh.vertices.size();
+        }
+        vertices.resize(total);
+
+        for(size_t i = 0; i < count; i++)
+        {
+            const Mesh&   mesh       = model.meshes[i];
+            glm::mat4     model_view = view * worlds[i];
+            glm::mat4     mvp        = projection * model_view;
+            glm::mat3     rotation   = glm::mat3(model_view);
+            glm::mat3     normal     = glm::transpose(glm::inverse(rotation));
+            RasterVertex* out        = vertices.data() + vertex_offsets[i];
+
+            threadPool().parallelFor(
+                mesh.vertices.size(),
+                RASTER_VERTEX_GRAIN,
+                [&](size_t begin, size_t end) {
+                    for(size_t v = begin; v < end; v++)
+                    {
+                        const Vertex& vertex = mesh.vertices[v];
+                        out[v].clip          = mvp * glm::vec4(vertex.Position, 1.0f);
+                        out[v].normal        = normal * vertex.Normal;
+                        out[v].tex_coords    = vertex.TexCoords;
+                    }
+                });
+        }
+    }
+
+    void setup(const Model& model, const SoftwareTarget& target)
+    {
+        tiles_x = (target.width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+        tiles_y = (target.height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+
+        size_t total  = triangle_offsets.back();
+        size_t chunks = (total + RASTER_TRIANGLE_GRAIN - 1) / RASTER_TRIANGLE_GRAIN;
+        bins.resize(chunks);
+
+        threadPool().parallelFor(chunks, 1, [&](size_t begin, size_t end) {
+            for(size_t chunk = begin; chunk < end; chunk++)
+            {
+                size_t first = chunk * RASTER_TRIANGLE_GRAIN;
+                size_t last  = std::min(first + RASTER_TRIANGLE_GRAIN, total);
+                setupChunk(model, first, last, target, bins[chunk]);
+            }
+        });
+    }
+
+    void setupChunk(
+        const Model&          model,
+        size_t                first,
+        size_t                last,
+        const SoftwareTarget& target,
+        RasterBin&            bin)
+    {
+        bin.triangles.clear();
+        bin.triangles.reserve(last - first);
+
+        // mesh of the first triangle, meshes without triangles are passed over
+        size_t mesh = std::upper_bound(
+                          triangle_offsets.begin(),
+                          triangle_offsets.end(),
+                          first) -
+                      triangle_offsets.begin() - 1;
+
+        for(size_t triangle = first; triangle < last; triangle++)
+        {
+            while(triangle >= triangle_offsets[mesh + 1])
+                mesh++;
+
+            const Mesh&         source = model.meshes[mesh];
+            const RasterVertex* base   = vertices.data() + vertex_offsets[mesh];
+            size_t              local  = triangle - triangle_offsets[mesh];
+            const unsigned int* index  = &source.indices[local * 3];
+
+            const RasterVertex* corners[3] = {
+                &base[index[0]],
+                &base[index[1]],
+                &base[index[2]]};
+            if(outside(corners))
+                continue;
+
+            // only triangles crossing the near plane need to be copied and clipped
+            if(!crossesNear(corners))
+            {
+                setupTriangle(
+                    *corners[0],
+                    *corners[1],
+                    *corners[2],
+                    source.material,
+                    target,
+                    bin);
+                continue;
+            }
+
+            RasterVertex polygon[4];
+            int          count = clipNear(corners, polygon);
+            for(int i = 1; i + 1 < count; i++)
+                setupTriangle(
+                    polygon[0],
+                    polygon[i],
+                    polygon[i + 1],
+                    source.material,
+                    target,
+                    bin);
+        }
+
+        // tile lists by counting sort, triangles keep their order within every tile
+        bin.offsets.assign(size_t(tiles_x) * tiles_y + 1, 0);
+        forEachTile(bin, [&](uint32_t, int tile) { bin.offsets[tile + 1]++; });
+
+        for(size_t i = 1; i < bin.offsets.size(); i++)
+            bin.offsets[i] += bin.offsets[i - 1];
+
+        bin.items.resize(bin.offsets.back());
+        std::vector<uint32_t> fill(bin.offsets.begin(), bin.offsets.end() - 1);
+        forEachTile(bin, [&](uint32_t triangle, int tile) {
+            bin.items[fill[tile]++] = triangle;
+        });
+    }
+
+    template<typename F>
+    void forEachTile(const RasterBin& bin, F&& function) const
+    {
+        for(size_t i = 0; i < bin.triangles.size(); i++)
+        {
+            const RasterTriangle& triangle = bin.triangles[i];
+
+            int x0 = triangle.min_x / RASTER_TILE_SIZE;
+            int x1 = triangle.max_x / RASTER_TILE_SIZE;
+            int y0 = triangle.min_y / RASTER_TILE_SIZE;
+            int y1 = triangle.max_y / RASTER_TILE_SIZE;
+
+            for(int y = y0; y <= y1; y++)
+                for(int x = x0; x <= x1; x++)
+                    function(static_cast<uint32_t>(i), y * tiles_x + x);
+        }
+    }
+
+    // true if all corners are beyond the same clip plane
+    static bool outside(const RasterVertex* const* corners)
+    {
+        for(int axis = 0; axis < 3; axis++)
+        {
+            bool below = true;
+            bool above = true;
+            for(int i = 0; i < 3; i++)
+            {
+                const glm::vec4& clip = corners[i]->clip;
+                below                 = below && clip[axis] < -clip.w;
+                above                 = above && clip[axis] > clip.w;
+            }
+            if(below || above)
+                return true;
+        }
+        return false;
+    }
+
+    static bool crossesNear(const RasterVertex* const* corners)
+    {
+        return corners[0]->clip.z < -corners[0]->clip.w ||
+               corners[1]->clip.z < -corners[1]->clip.w ||
+               corners[2]->clip.z < -corners[2]->clip.w;
+    }
+
+    // clips against the near plane z = -w, the other planes only need the scissor of the
+    // bounding box. Returns the corner count of the convex polygon, at most 4.
+    static int clipNear(const RasterVertex* const* corners, RasterVertex* polygon)
+    {
+        int count = 0;
+        for(int i = 0; i < 3; i++)
+        {
+            const RasterVertex& from = *corners[i];
+            const RasterVertex& to   = *corners[(i + 1) % 3];
+
+            float d0 = from.clip.z + from.clip.w;
+            float d1 = to.clip.z + to.clip.w;
+
+            if(d0 >= 0.0f)
+                polygon[count++] = from;
+
+            if((d0 >= 0.0f) != (d1 >= 0.0f))
+            {
+                float         t     = d0 / (d0 - d1);
+                glm::vec2     delta = to.tex_coords - from.tex_coords;
+                RasterVertex& out   = polygon[count++];
+
+                out.clip       = glm::mix(from.clip, to.clip, t);
+                out.normal     = glm::mix(from.normal, to.normal, t);
+                out.tex_coords = from.tex_coords + delta * t;
+            }
+        }
+        return count;
+    }
+
+    static void setupTriangle(
+        const RasterVertex&   v0,
+        const RasterVertex&   v1,
+        const RasterVertex&   v2,
+        int                   material,
+        const SoftwareTarget& target,
+        RasterBin&            bin)
+    {
+        const RasterVertex* corners[3] = {&v0, &v1, &v2};
+
+        RasterTriangle triangle;
+        float          x[3], y[3];
+        for(int i = 0; i < 3; i++)
+        {
+            const glm::vec4& clip  = corners[i]->clip;
+            float            inv_w = 1.0f / clip.w;
+
+            x[i] = (clip.x * inv_w * 0.5f + 0.5f) * target.width;
+            y[i] = (0.5f - clip.y * inv_w * 0.5f) * target.height;
+
+            triangle.z[i]     = clip.z * inv_w * 0.5f + 0.5f;
+            triangle.inv_w[i] = inv_w;
+        }
+
+        // pixels whose centers lie in the bounding box, most tiny triangles cover none
+        float right  = float(target.width - 1);
+        float bottom = float(target.height - 1);
+        float min_x  = std::max(std::min({x[0], x[1], x[2]}) - 0.5f, 0.0f);
+        float min_y  = std::max(std::min({y[0], y[1], y[2]}) - 0.5f, 0.0f);
+        float max_x  = std::min(std::max({x[0], x[1], x[2]}) - 0.5f, right);
+        float max_y  = std::min(std::max({y[0], y[1], y[2]}) - 0.5f, bottom);
+
+        // also fails for non finite coordinates
+        if(!(min_x <= max_x && min_y <= max_y))
+            return;
+
+        triangle.min_x = static_cast<int>(std::ceil(min_x));
+        triangle.min_y = static_cast<int>(std::ceil(min_y));
+        triangle.max_x = static_cast<int>(max_x);
+        triangle.max_y = static_cast<int>(max_y);
+        if(triangle.min_x > triangle.max_x || triangle.min_y > triangle.max_y)
+            return;
+
+        // zero and degenerate areas cover nothing, both windings are drawn
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if(!(std::fabs(area) > 0.0f))
+            return;
+
+        float inverse = 1.0f / area;
+        for(int k = 0; k < 3; k++)
+        {
+            int i = (k + 1) % 3;
+            int j = (k + 2) % 3;
+
+            triangle.a[k] = (y[i] - y[j]) * inverse;
+            triangle.b[k] = (x[j] - x[i]) * inverse;
+            triangle.c[k] = (x[i] * y[j] - x[j] * y[i]) * inverse;
+
+            // the weight grows into the triangle, top and left edges face down or right
+            triangle.top_left[k] =
+                triangle.a[k] > 0.0f || (triangle.a[k] == 0.0f && triangle.b[k] > 0.0f);
+
+            triangle.tex_coords[k] = corners[k]->tex_coords * triangle.inv_w[k];
+            triangle.normal[k]     = corners[k]->normal * triangle.inv_w[k];
+        }
+
+        triangle.material = material;
+        bin.triangles.push_back(triangle);
+    }
+
+    void rasterize(const Model& model, int tile, SoftwareTarget& target) const
+    {
+        int tile_x = tile % tiles_x * RASTER_TILE_SIZE;
+        int tile_y = tile / tiles_x * RASTER_TILE_SIZE;
+
+        for(const RasterBin& bin : bins)
+        {
+            for(uint32_t i = bin.offsets[tile]; i < bin.offsets[tile + 1]; i++)
+            {
+                const RasterTriangle& triangle = bin.triangles[bin.items[i]];
+
+                int x0 = std::max(triangle.min_x, tile_x);
+                int x1 = std::min(triangle.max_x, tile_x + RASTER_TILE_SIZE - 1);
+                int y0 = std::max(triangle.min_y, tile_y);
+                int y1 = std::min(triangle.max_y, tile_y + RASTER_TILE_SIZE - 1);
+
+                for(int y = y0; y <= y1; y++)
+                    rasterizeRow(model, triangle, y, x0, x1, target);
+            }
+        }
+    }
+
+    // Covers pixels x0 to x1 of a row. Spans start on a lane boundary, the padded depth
+    // rows keep the whole span inside the tile.
+    void rasterizeRow(
+        const Model&          model,
+        const RasterTriangle& t,
+        int                   y,
+        int                   x0,
+        int                   x1,
+        SoftwareTarget&       target) const
+    {
+        float  center = float(y) + 0.5f;
+        float  row[3];
+        float* depth = &target.depth[size_t(y) * target.pitch];
+
+        for(int k = 0; k < 3; k++)
+            row[k] = t.b[k] * center + t.c[k];
+
+        for(int x = x0 & ~(RASTER_LANES - 1); x <= x1; x += RASTER_LANES)
+        {
+            float w0[RASTER_LANES], w1[RASTER_LANES], w2[RASTER_LANES], z[RASTER_LANES];
+            int   mask[RASTER_LANES];
+            int   covered = 0;
+
+            for(int lane = 0; lane < RASTER_LANES; lane++)
+            {
+                float px = float(x + lane) + 0.5f;
+
+                w0[lane] = t.a[0] * px + row[0];
+                w1[lane] = t.a[1] * px + row[1];
+                w2[lane] = t.a[2] * px + row[2];
+                z[lane]  = w0[lane] * t.z[0] + w1[lane] * t.z[1] + w2[lane] * t.z[2];
+
+                int inside = ((w0[lane] > 0.0f) | ((w0[lane] == 0.0f) & t.top_left[0])) &
+                             ((w1[lane] > 0.0f) | ((w1[lane] == 0.0f) & t.top_left[1])) &
+                             ((w2[lane] > 0.0f) | ((w2[lane] == 0.0f) & t.top_left[2]));
+
+                mask[lane] = inside & (x + lane >= x0) & (x + lane <= x1) &
+                             (z[lane] >= 0.0f) & (z[lane] < depth[x + lane]);
+                covered |= mask[lane];
+            }
+
+            if(!covered)
+                continue;
+
+            for(int lane = 0; lane < RASTER_LANES; lane++)
+            {
+                if(!mask[lane])
+                    continue;
+
+                int      column = x + lane;
+                uint8_t* color  = &target.color[(size_t(y) * target.width + column) * 4];
+
+                depth[column] = z[lane];
+                shade(model, t, w0[lane], w1[lane], w2[lane], color);
+            }
+        }
+    }
+
+    void shade(
+        const Model&          model,
+        const RasterTriangle& t,
+        float                 w0,
+        float                 w1,
+        float                 w2,
+        uint8_t*              out) const
+    {
+        const MaterialData& material = model.materials.materials[t.material];
+
+        float     inv_w = w0 * t.inv_w[0] + w1 * t.inv_w[1] + w2 * t.inv_w[2];
+        glm::vec2 uv    = t.tex_coords[0] * w0 + t.tex_coords[1] * w1;
+        uv              = (uv + t.tex_coords[2] * w2) * (1.0f / inv_w);
+
+        glm::vec4 albedo = material.diffuse;
+        int       map    = material.maps[MAP_DIFFUSE];
+        if(map >= 0 && map < int(model.materials.images.size()) &&
+           model.materials.images[map].pixels)
+            albedo = sample(model.materials.images[map], uv);
+
+        glm::vec3 color = glm::vec3(albedo);
+        if(lighting)
+        {
+            // the headlight sits at the camera, facing surfaces have view space normals
+            // towards +z
+            glm::vec3 normal  = t.normal[0] * w0 + t.normal[1] * w1 + t.normal[2] * w2;
+            float     length  = glm::length(normal);
+            float     lambert = length > 0.0f ? std::max(normal.z / length, 0.0f) : 0.0f;
+
+            color = color * (ambient + light * lambert);
+        }
+
+        out[0] = SoftwareTarget::quantize(color.x);
+        out[1] = SoftwareTarget::quantize(color.y);
+        out[2] = SoftwareTarget::quantize(color.z);
+        out[3] = SoftwareTarget::quantize(albedo.w);
+    }
+
+    // bilinear with repeat wrapping, like the texture pages without their mipmaps
+    static glm::vec4 sample(const MaterialImage& image, const glm::vec2& uv)
+    {
+        float x = (uv.x - std::floor(uv.x)) * image.width - 0.5f;
+        float y = (uv.y - std::floor(uv.y)) * image.height - 0.5f;
+
+        float fx = std::floor(x);
+        float fy = std::floor(y);
+        float tx = x - fx;
+        float ty = y - fy;
+
+        int x0 = (static_cast<int>(fx) + image.width) % image.width;
+        int y0 = (static_cast<int>(fy) + image.height) % image.height;
+        int x1 = (x0 + 1) % image.width;
+        int y1 = (y0 + 1) % image.height;
+
+        auto texel = [&](int column, int row) {
+            const uint8_t* p = image.pixels + (size_t(row) * image.width + column) * 4;
+            return glm::vec4(p[0], p[1], p[2], p[3]);
+        };
+
+        glm::vec4 top    = glm::mix(texel(x0, y0), texel(x1, y0), tx);
+        glm::vec4 bottom = glm::mix(texel(x0, y1), texel(x1, y1), tx);
+        return glm::mix(top, bottom, ty) * (1.0f / 255.0f);
+    }
+};
@@ -0,0 +1,647 @@
+#pragma once
+
+// lib
+#include <glm/glm.hpp>
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TANGENT_SSE
+#endif
+
+// modules
+#include "ThreadPool.hpp"
+#include "Vertex.hpp"
+
+// Triangles or vertices per task of the parallel loops
+const size_t TANGENT_GRAIN = 1 << 14;
+
+// Below this a length, area or weight counts as zero
+const float TANGENT_EPSILON = 1e-20f;
+
+// Size of the cells positions are smoothed over, relative to the largest mesh extent
+const float TANGENT_CELL = 1e-5f;
+
+// Corners of up to four triangles, one lane per triangle
+struct TangentBatch
+{
+    float x[3][4], y[3][4], z[3][4];     // positions
+    float nx[3][4], ny[3][4], nz[3][4];  // vertex normals, tangents only
+    float u[3][4], v[3][4];              // texture coordinates, tangents only
+};
+
+// Weighted direction per corner, w is the signed weight of the tangent handedness
+struct TangentCorners
+{
+    float x[3][4], y[3][4], z[3][4], w[3][4];
+};
+
+// The math of the kernels on plain floats, the fallback without SSE
+template<typename F>
+struct TangentMath
+{
+    using Mask = bool;
+
+    static constexpr int WIDTH = 1;
+
+    static F load(const float* p)
+    {
+        return *p;
+    }
+
+    static void store(float* p, F value)
+    {
+        *p = value;
+    }
+
+    static F sqrt(F a)
+    {
+        return std::sqrt(a);
+    }
+
+    static F abs(F a)
+    {
+        return std::fabs(a);
+    }
+
+    static F max(F a, F b)
+    {
+        return a > b ? a : b;
+    }
+
+    static F min(F a, F b)
+    {
+        return a < b ? a : b;
+    }
+
+    static Mask greater(F a, F b)
+    {
+        return a > b;
+    }
+
+    static Mask both(Mask a, Mask b)
+    {
+        return a && b;
+    }
+
+    static F select(Mask mask, F a, F b)
+    {
+        return mask ? a : b;
+    }
+};
+
+#ifdef TANGENT_SSE
+// Four lanes with the arithmetic operators of a float, so the kernels are written once
+struct TangentLanes
+{
+    __m128 v;
+
+    TangentLanes() = default;
+    TangentLanes(__m128 value)
+        : v(value)
+    {
+    }
+    TangentLanes(float value)
+        : v(_mm_set1_ps(value))
+    {
+    }
+
+    friend TangentLanes operator+(TangentLanes a, TangentLanes b)
+    {
+        return _mm_add_ps(a.v, b.v);
+    }
+    friend TangentLanes operator-(TangentLanes a, TangentLanes b)
+    {
+        return _mm_sub_ps(a.v, b.v);
+    }
+    friend TangentLanes operator*(TangentLanes a, TangentLanes b)
+    {
+        return _mm_mul_ps(a.v, b.v);
+    }
+    friend TangentLanes operator/(TangentLanes a, TangentLanes b)
+    {
+        return _mm_div_ps(a.v, b.v);
+    }
+};
+
+template<>
+struct TangentMath<TangentLanes>
+{
+    using F    = TangentLanes;
+    using Mask = TangentLanes;
+
+    static constexpr int WIDTH = 4;
+
+    static F load(const float* p)
+    {
+        return _mm_loadu_ps(p);
+    }
+
+    static void store(float* p, F value)
+    {
+        _mm_storeu_ps(p, value.v);
+    }
+
+    static F sqrt(F a)
+    {
+        return _mm_sqrt_ps(a.v);
+    }
+
+    static F abs(F a)
+    {
+        return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v);
+    }
+
+    static F max(F a, F b)
+    {
+        return _mm_max_ps(a.v, b.v);
+    }
+
+    static F min(F a, F b)
+    {
+        return _mm_min_ps(a.v, b.v);
+    }
+
+    static Mask greater(F a, F b)
+    {
+        return _mm_cmpgt_ps(a.v, b.v);
+    }
+
+    static Mask both(Mask a, Mask b)
+    {
+        return _mm_and_ps(a.v, b.v);
+    }
+
+    static F select(Mask mask, F a, F b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+    }
+};
+
+using TangentFloat = TangentLanes;
+#else
+using TangentFloat = float;
+#endif
+
+// Smooth normals and tangent frames generated on the final, welded index and vertex
+// arrays, in place of Assimp's GenSmoothNormals and CalcTangentSpace steps.
+//
+// Tangents follow MikkTSpace: every corner contributes its triangle's uv gradient
+// projected onto the vertex normal, weighted by the corner angle between the projected
+// edges, and the handedness comes from the triangle's uv winding. Vertices are the
+// groups MikkTSpace builds from identical position, normal and uv, except that a vertex
+// shared across a mirrored uv seam is not split; it takes the handedness of the larger
+// side. The bitangent is stored as sign * cross(normal, tangent), the frame a
+// MikkTSpace baker expects. Vertices without a normal get the face normals around their
+// position, weighted by the corner angle, like Assimp's smoothing within a small
+// distance; normals of the file are kept.
+//
+// Triangles are processed in parallel, four at a time with SSE, and write their
+// contributions per corner. Every vertex then sums its corners in index order, so the
+// results do not depend on the number of threads. Without texture coordinates, or where
+// they are degenerate, the tangent frame is an orthonormal basis around the normal.
+struct TangentSpace
+{
+    // missing normals and tangent frames where asked for, the frames come from the
+    // texture coordinates if the mesh has some
+    void generate(
+        std::vector<Vertex>&             vertices,
+        const std::vector<unsigned int>& indices,
+        bool                             normals,
+        bool                             tangents,
+        bool                             texcoords)
+    {
+        if(normals)
+            generateNormals(vertices, indices);
+        if(tangents && texcoords)
+            generateTangents(vertices, indices);
+        else if(tangents)
+            defaults(vertices);
+    }
+
+    void generateNormals(
+        std::vector<Vertex>&             vertices,
+        const std::vector<unsigned int>& indices)
+    {
+        auto missing = [](const Vertex& vertex) {
+            return vertex.Normal == glm::vec3(0.0f);
+        };
+        if(std::none_of(vertices.begin(), vertices.end(), missing))
+            return;
+
+        size_t triangles = indices.size() / 3;
+        size_t positions = groupPositions(vertices);
+        adjacency(indices, positions, groups.data());
+
+        threadPool().parallelFor(triangles, TANGENT_GRAIN, [&](size_t begin, size_t end) {
+            batches<TangentFloat>(vertices, indices, begin, end, false);
+        });
+
+        // the sum per position is shared by every vertex there
+        summed.resize(positions);
+        threadPool().parallelFor(positions, TANGENT_GRAIN, [&](size_t begin, size_t end) {
+            for(size_t group = begin; group < end; group++)
+            {
+                glm::vec3 sum    = glm::vec3(gather(group));
+                float     length = glm::dot(sum, sum);
+                summed[group]    = length > TANGENT_EPSILON ? sum / std::sqrt(length)
+                                                            : glm::vec3(0.0f);
+            }
+        });
+
+        size_t count = vertices.size();
+        threadPool().parallelFor(count, TANGENT_GRAIN, [&](size_t begin, size_t end) {
+            for(size_t v = begin; v < end; v++)
+            {
+                const glm::vec3& normal = summed[groups[v]];
+                if(missing(vertices[v]))
+                    vertices[v].Normal =
+                        normal != glm::vec3(0.0f) ? normal : glm::vec3(0.0f, 0.0f, 1.0f);
+            }
+        });
+    }
+
+    void generateTangents(
+        std::vector<Vertex>&             vertices,
+        const std::vector<unsigned int>& indices)
+    {
+        size_t triangles = indices.size() / 3;
+        size_t count     = vertices.size();
+        adjacency(indices, count, nullptr);
+
+        threadPool().parallelFor(triangles, TANGENT_GRAIN, [&](size_t begin, size_t end) {
+            batches<TangentFloat>(vertices, indices, begin, end, true);
+        });
+
+        threadPool().parallelFor(count, TANGENT_GRAIN, [&](size_t begin, size_t end) {
+            for(size_t v = begin; v < end; v++)
+            {
+                Vertex&   vertex = vertices[v];
+                glm::vec4 sum    = gather(v);
+                glm::vec3 normal = vertex.Normal;
+                glm::vec3 along  = glm::vec3(sum);
+                glm::vec3 t      = along - normal * glm::dot(normal, along);
+                float     length = glm::dot(t, t);
+
+                if(length <= TANGENT_EPSILON)
+                {
+                    basis(normal, vertex.Tangent, vertex.Bitangent);
+                    continue;
+                }
+
+                float sign       = sum.w < 0.0f ? -1.0f : 1.0f;
+                vertex.Tangent   = t / std::sqrt(length);
+                vertex.Bitangent = sign * glm::cross(normal, vertex.Tangent);
+            }
+        });
+    }
+
+    // tangent frames around the normals, for meshes without texture coordinates
+    static void defaults(std::vector<Vertex>& vertices)
+    {
+        size_t count = vertices.size();
+        threadPool().parallelFor(count, TANGENT_GRAIN, [&](size_t begin, size_t end) {
+            for(size_t v = begin; v < end; v++)
+                basis(vertices[v].Normal, vertices[v].Tangent, vertices[v].Bitangent);
+        });
+    }
+
+    // Orthonormal basis around n without branches on its direction (Duff et al. 2017,
+    // "Building an Orthonormal Basis, Revisited"). A zero normal gets the x and y axes.
+    static void basis(const glm::vec3& n, glm::vec3& tangent, glm::vec3& bitangent)
+    {
+        if(n == glm::vec3(0.0f))
+        {
+            tangent   = glm::vec3(1.0f, 0.0f, 0.0f);
+            bitangent = glm::vec3(0.0f, 1.0f, 0.0f);
+            return;
+        }
+
+        float sign = std::copysign(1.0f, n.z);
+        float a    = -1.0f / (sign + n.z);
+        float b    = n.x * n.y * a;
+        tangent    = glm::vec3(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+        bitangent  = glm::vec3(b, sign + n.y * n.y * a, -n.y);
+    }
+
+private:
+    std::vector<TangentCorners> corners;  // per batch of four triangles, see index()
+    std::vector<uint32_t>       offsets;  // corners of every vertex or position
+    std::vector<uint32_t>       members;
+    std::vector<uint32_t>       groups;  // position of every vertex
+    std::vector<uint32_t>       table;
+    std::vector<int32_t>        cells;  // of every position group
+    std::vector<glm::vec3>      summed;
+
+    // Corner c of triangle t is lane t % 4 of entry t / 4, corner k. The kernel writes
+    // whole lanes; the vector has room for the batch a triangle range starts in.
+    void adjacency(
+        const std::vector<unsigned int>& indices,
+        size_t                           count,
+        const uint32_t*                  map)
+    {
+        size_t triangles = indices.size() / 3;
+        corners.resize((triangles + 3) / 4);
+
+        offsets.assign(count + 1, 0);
+        for(size_t c = 0; c < triangles * 3; c++)
+            offsets[entry(indices[c], map) + 1]++;
+        for(size_t i = 1; i <= count; i++)
+            offsets[i] += offsets[i - 1];
+
+        // ascending corner order per entry, the order sums are taken in
+        members.resize(triangles * 3);
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for(size_t c = 0; c < triangles * 3; c++)
+            members[fill[entry(indices[c], map)]++] = static_cast<uint32_t>(c);
+    }
+
+    static uint32_t entry(unsigned int index, const uint32_t* map)
+    {
+        return map ? map[index] : index;
+    }
+
+    glm::vec4 gather(size_t entry) const
+    {
+        glm::vec4 sum = glm::vec4(0.0f);
+        for(uint32_t i = offsets[entry]; i < offsets[entry + 1]; i++)
+        {
+            uint32_t              corner   = members[i];
+            uint32_t              triangle = corner / 3;
+            uint32_t              k        = corner % 3;
+            uint32_t              lane     = triangle % 4;
+            const TangentCorners& batch    = corners[triangle / 4];
+            sum += glm::vec4(
+                batch.x[k][lane], batch.y[k][lane], batch.z[k][lane], batch.w[k][lane]);
+        }
+        return sum;
+    }
+
+    // Vertices in the same position cell share a group, found with open addressing like
+    // the vertex welder. Cells are TANGENT_CELL of the mesh extent, positions on both
+    // sides of a cell border stay apart. Returns the number of groups.
+    size_t groupPositions(const std::vector<Vertex>& vertices)
+    {
+        glm::vec3 low  = glm::vec3(0.0f);
+        glm::vec3 high = glm::vec3(0.0f);
+        if(!vertices.empty())
+            low = high = vertices[0].Position;
+        for(auto& vertex : vertices)
+        {
+            low  = glm::min(low, vertex.Position);
+            high = glm::max(high, vertex.Position);
+        }
+
+        glm::vec3 size    = high - low;
+        float     extent  = std::max(size.x, std::max(size.y, size.z));
+        float     inverse = 1.0f / std::max(extent * TANGENT_CELL, 1e-30f);
+
+        size_t capacity = 16;
+        while(capacity < vertices.size() * 2)
+            capacity *= 2;
+
+        table.assign(capacity, UINT32_MAX);
+        groups.resize(vertices.size());
+        cells.clear();
+        cells.reserve(vertices.size() * 3);
+
+        for(size_t v = 0; v < vertices.size(); v++)
+        {
+            // offsets from the low corner are positive, truncating rounds them
+            glm::vec3 scaled = (vertices[v].Position - low) * inverse + 0.5f;
+            int32_t   cell[3];
+            for(int k = 0; k < 3; k++)
+                cell[k] = static_cast<int32_t>(scaled[k]);
+
+            uint64_t h = uint32_t(cell[0]) * 0x9e3779b97f4a7c15ull;
+            h ^= uint32_t(cell[1]) * 0xc2b2ae3d27d4eb4full;
+            h ^= uint32_t(cell[2]) * 0x165667b19e3779f9ull;
+            h ^= h >> 29;
+
+            size_t slot = h & (capacity - 1);
+            while(table[slot] != UINT32_MAX &&
+                  std::memcmp(&cells[table[slot] * 3], cell, sizeof(cell)) != 0)
+                slot = (slot + 1) & (capacity - 1);
+
+            if(table[slot] == UINT32_MAX)
+            {
+                table[slot] = static_cast<uint32_t>(cells.size() / 3);
+                cells.insert(cells.end(), cell, cell + 3);
+            }
+            groups[v] = table[slot];
+        }
+        return cells.size() / 3;
+    }
+
+    // triangles begin to end, in batches of the lane width
+    template<typename F>
+    void batches(
+        const std::vector<Vertex>&       vertices,
+        const std::vector<unsigned int>& indices,
+        size_t                           begin,
+        size_t                           end,
+        bool                             tangents)
+    {
+        using M = TangentMath<F>;
+
+        TangentBatch   batch;
+        TangentCorners out;
+
+        for(size_t first = begin; first < end; first += M::WIDTH)
+        {
+            // short batches repeat their last triangle, those lanes are not stored
+            int lanes = static_cast<int>(std::min<size_t>(M::WIDTH, end - first));
+            for(int lane = 0; lane < M::WIDTH; lane++)
+            {
+                size_t triangle = first + std::min(lane, lanes - 1);
+                for(int k = 0; k < 3; k++)
+                {
+                    const Vertex& vertex = vertices[indices[triangle * 3 + k]];
+                    batch.x[k][lane]     = vertex.Position.x;
+                    batch.y[k][lane]     = vertex.Position.y;
+                    batch.z[k][lane]     = vertex.Position.z;
+                    batch.nx[k][lane]    = vertex.Normal.x;
+                    batch.ny[k][lane]    = vertex.Normal.y;
+                    batch.nz[k][lane]    = vertex.Normal.z;
+                    batch.u[k][lane]     = vertex.TexCoords.x;
+                    batch.v[k][lane]     = vertex.TexCoords.y;
+                }
+            }
+
+            if(tangents)
+                tangentKernel<F>(batch, out);
+            else
+                normalKernel<F>(batch, out);
+
+            for(int lane = 0; lane < lanes; lane++)
+            {
+                size_t          triangle = first + lane;
+                TangentCorners& target   = corners[triangle / 4];
+                size_t          slot     = triangle % 4;
+                for(int k = 0; k < 3; k++)
+                {
+                    target.x[k][slot] = out.x[k][lane];
+                    target.y[k][slot] = out.y[k][lane];
+                    target.z[k][slot] = out.z[k][lane];
+                    target.w[k][slot] = out.w[k][lane];
+                }
+            }
+        }
+    }
+
+    // acos within 7e-5 (Abramowitz and Stegun 4.4.45), only used as a weight
+    template<typename F>
+    static F acos(F x)
+    {
+        using M = TangentMath<F>;
+
+        F a = M::abs(x);
+        F r = M::sqrt(F(1.0f) - a) *
+              (((F(-0.0187293f) * a + F(0.0742610f)) * a - F(0.2121144f)) * a +
+               F(1.5707288f));
+        return M::select(M::greater(F(0.0f), x), F(3.14159265f) - r, r);
+    }
+
+    // angle between a and b, zero if either is degenerate
+    template<typename F>
+    static F angle(F ax, F ay, F az, F bx, F by, F bz)
+    {
+        using M = TangentMath<F>;
+
+        F lengths = (ax * ax + ay * ay + az * az) * (bx * bx + by * by + bz * bz);
+        F dot     = ax * bx + ay * by + az * bz;
+        F cosine  = dot / M::sqrt(M::max(lengths, F(TANGENT_EPSILON)));
+        cosine    = M::max(M::min(cosine, F(1.0f)), F(-1.0f));
+
+        auto valid = M::greater(lengths, F(TANGENT_EPSILON));
+        return M::select(valid, acos<F>(cosine), F(0.0f));
+    }
+
+    // unit face normal times the angle at each corner
+    template<typename F>
+    static void normalKernel(const TangentBatch& in, TangentCorners& out)
+    {
+        using M = TangentMath<F>;
+
+        F x[3], y[3], z[3];
+        for(int k = 0; k < 3; k++)
+        {
+            x[k] = M::load(in.x[k]);
+            y[k] = M::load(in.y[k]);
+            z[k] = M::load(in.z[k]);
+        }
+
+        F e1x = x[1] - x[0], e1y = y[1] - y[0], e1z = z[1] - z[0];
+        F e2x = x[2] - x[0], e2y = y[2] - y[0], e2z = z[2] - z[0];
+        F nx  = e1y * e2z - e1z * e2y;
+        F ny  = e1z * e2x - e1x * e2z;
+        F nz  = e1x * e2y - e1y * e2x;
+
+        F length = nx * nx + ny * ny + nz * nz;
+        F scale  = M::select(
+            M::greater(length, F(TANGENT_EPSILON)),
+            F(1.0f) / M::sqrt(M::max(length, F(TANGENT_EPSILON))),
+            F(0.0f));
+
+        for(int k = 0; k < 3; k++)
+        {
+            int next     = (k + 1) % 3;
+            int previous = (k + 2) % 3;
+            F   weight   = scale * angle<F>(
+                                     x[next] - x[k],
+                                     y[next] - y[k],
+                                     z[next] - z[k],
+                                     x[previous] - x[k],
+                                     y[previous] - y[k],
+                                     z[previous] - z[k]);
+
+            M::store(out.x[k], nx * weight);
+            M::store(out.y[k], ny * weight);
+            M::store(out.z[k], nz * weight);
+            M::store(out.w[k], F(0.0f));
+        }
+    }
+
+    // per corner: the uv gradient in the plane of the vertex normal, times the corner
+    // angle in that plane; w carries the same weight signed by the uv winding
+    template<typename F>
+    static void tangentKernel(const TangentBatch& in, TangentCorners& out)
+    {
+        using M = TangentMath<F>;
+
+        F x[3], y[3], z[3];
+        for(int k = 0; k < 3; k++)
+        {
+            x[k] = M::load(in.x[k]);
+            y[k] = M::load(in.y[k]);
+            z[k] = M::load(in.z[k]);
+        }
+
+        F d1x = x[1] - x[0], d1y = y[1] - y[0], d1z = z[1] - z[0];
+        F d2x = x[2] - x[0], d2y = y[2] - y[0], d2z = z[2] - z[0];
+
+        F u0 = M::load(in.u[0]), v0 = M::load(in.v[0]);
+        F t21x = M::load(in.u[1]) - u0, t21y = M::load(in.v[1]) - v0;
+        F t31x = M::load(in.u[2]) - u0, t31y = M::load(in.v[2]) - v0;
+        F area = t21x * t31y - t21y * t31x;
+
+        // the direction of increasing u, flipped with the winding like MikkTSpace
+        F ox = t31y * d1x - t21y * d2x;
+        F oy = t31y * d1y - t21y * d2y;
+        F oz = t31y * d1z - t21y * d2z;
+
+        F length = ox * ox + oy * oy + oz * oz;
+        F sign   = M::select(M::greater(area, F(0.0f)), F(1.0f), F(-1.0f));
+        F scale  = sign / M::sqrt(M::max(length, F(TANGENT_EPSILON)));
+        ox       = ox * scale;
+        oy       = oy * scale;
+        oz       = oz * scale;
+
+        auto valid = M::both(
+            M::greater(M::abs(area), F(TANGENT_EPSILON)),
+            M::greater(length, F(TANGENT_EPSILON)));
+
+        for(int k = 0; k < 3; k++)
+        {
+            F nx = M::load(in.nx[k]), ny = M::load(in.ny[k]), nz = M::load(in.nz[k]);
+
+            F along = nx * ox + ny * oy + nz * oz;
+            F tx    = ox - nx * along;
+            F ty    = oy - ny * along;
+            F tz    = oz - nz * along;
+            F tl    = tx * tx + ty * ty + tz * tz;
+            F inv   = F(1.0f) / M::sqrt(M::max(tl, F(TANGENT_EPSILON)));
+
+            // the edges leaving the corner, projected like the tangent
+            int next     = (k + 1) % 3;
+            int previous = (k + 2) % 3;
+            F   ax = x[next] - x[k], ay = y[next] - y[k], az = z[next] - z[k];
+            F   bx = x[previous] - x[k], by = y[previous] - y[k], bz = z[previous] - z[k];
+            F   pa = nx * ax + ny * ay + nz * az;
+            F   pb = nx * bx + ny * by + nz * bz;
+
+            F weight = angle<F>(
+                ax - nx * pa,
+                ay - ny * pa,
+                az - nz * pa,
+                bx - nx * pb,
+                by - ny * pb,
+                bz - nz * pb);
+            weight = M::select(
+                M::both(valid, M::greater(tl, F(TANGENT_EPSILON))),
+                weight * inv,
+                F(0.0f));
+
+            M::store(out.x[k], tx * weight);
+            M::store(out.y[k], ty * weight);
+            M::store(out.z[k], tz * weight);
+            M::store(out.w[k], sign * weight / inv);
+        }
+    }
+};
@@ -0,0 +1,278 @@
+#pragma once
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Jobs submitted against a counter and not finished yet. Jobs that depend on others wait
+// for their counter, ThreadPool::wait() runs the counted jobs still queued meanwhile.
+struct JobCounter
+{
+    std::atomic<size_t> pending = 0;
+
+    bool done() const
+    {
+        return pending == 0;
+    }
+};
+
+// Fixed set of worker threads shared by everything that wants to run in parallel.
+//
+// Every worker owns a deque: jobs submitted from a worker go to the back of its own deque
+// and are taken from there newest first, while cache lines of their parent are still
+// warm. Idle workers steal the oldest job of another worker's deque, so one worker
+// splitting up a large task spreads it over the whole pool. Jobs from other threads go
+// to a shared queue that every worker takes from.
+struct ThreadPool
+{
+    std::vector<std::thread> workers;
+
+    ThreadPool(unsigned count = std::max(2u, std::thread::hardware_concurrency()) - 1)
+    {
+        // the last queue is the shared one, fixed before any worker looks at it
+        shared = count;
+        for(unsigned i = 0; i <= count; i++)
+            queues.push_back(std::make_unique<Queue>());
+
+        workers.reserve(count);
+        for(unsigned i = 0; i < count; i++)
+            workers.emplace_back(&ThreadPool::run, this, size_t(i));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            running = false;
+        }
+        wake.notify_all();
+
+        for(auto& worker : workers)
+            worker.join();
+    }
+
+    size_t size() const
+    {
+        return workers.size();
+    }
+
+    // counter, if any, stays pending until the task has run
+    void submit(std::function<void()> task, JobCounter* counter = nullptr)
+    {
+        if(counter)
+            counter->pending++;
+
+        // counted first and under the lock, so no worker goes to sleep past the job
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            queued++;
+        }
+
+        Queue& queue = *queues[own()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back({std::move(task), counter});
+        }
+        wake.notify_one();
+    }
+
+    // Returns once every job of the counter has run. Jobs of the counter that no worker
+    // has taken yet run on the calling thread, unrelated jobs are left to the workers.
+    void wait(JobCounter& counter)
+    {
+        while(!counter.done())
+        {
+            Job job;
+            if(takeCounted(&counter, job))
+                execute(job);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    // Calls function(begin, end) for consecutive ranges of at most grain elements. The
+    // calling thread takes part in the work and returns once every range is done.
+    template<typename F>
+    void parallelFor(size_t count, size_t grain, F&& function)
+    {
+        if(count == 0)
+            return;
+
+        grain         = std::max<size_t>(grain, 1);
+        size_t chunks = (count + grain - 1) / grain;
+
+        if(chunks == 1 || workers.empty())
+        {
+            function(size_t(0), count);
+            return;
+        }
+
+        struct Batch
+        {
+            std::atomic<size_t> next = 0;
+            std::atomic<size_t> done = 0;
+        };
+
+        auto batch = std::make_shared<Batch>();
+        auto work  = [batch, chunks, grain, count, &function]() {
+            for(size_t chunk = batch->next++; chunk < chunks; chunk = batch->next++)
+            {
+                size_t begin = chunk * grain;
+                function(begin, std::min(begin + grain, count));
+                batch->done++;
+            }
+        };
+
+        size_t helpers = std::min(chunks - 1, workers.size());
+        for(size_t i = 0; i < helpers; i++)
+            submit(work);
+
+        work();
+
+        // every chunk has been claimed, the rest is running on other threads
+        while(batch->done < chunks)
+            std::this_thread::yield();
+    }
+
+private:
+    struct Job
+    {
+        std::function<void()> task;
+        JobCounter*           counter = nullptr;
+    };
+
+    // own cache line per queue, owner and thieves only meet on the same deque
+    struct alignas(64) Queue
+    {
+        std::mutex      mutex;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    size_t                              shared = 0;  // index of the shared queue
+    std::atomic<size_t>                 queued = 0;  // jobs in all queues
+
+    std::mutex              sleep_mutex;
+    std::condition_variable wake;
+    bool                    running = true;
+
+    // pool and worker index of the calling thread
+    struct Worker
+    {
+        const ThreadPool* pool  = nullptr;
+        size_t            index = 0;
+    };
+
+    static Worker& worker()
+    {
+        thread_local Worker current;
+        return current;
+    }
+
+    // queue jobs of the calling thread go to
+    size_t own() const
+    {
+        const Worker& current = worker();
+        return current.pool == this ? current.index : shared;
+    }
+
+    void run(size_t index)
+    {
+        worker() = {this, index};
+
+        while(true)
+        {
+            Job job;
+            if(take(index, job))
+            {
+                execute(job);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            wake.wait(lock, [this]() { return !running || queued > 0; });
+
+            if(!running && queued == 0)
+                return;
+        }
+    }
+
+    static void execute(Job& job)
+    {
+        job.task();
+        if(job.counter)
+            job.counter->pending--;
+    }
+
+    // own deque newest first, then the shared queue, then the oldest job of the others
+    bool take(size_t index, Job& job)
+    {
+        if(pop(*queues[index], job, true))
+            return true;
+
+        if(pop(*queues[shared], job, false))
+            return true;
+
+        for(size_t i = 1; i < shared; i++)
+            if(pop(*queues[(index + i) % shared], job, false))
+                return true;
+
+        return false;
+    }
+
+    bool pop(Queue& queue, Job& job, bool newest)
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if(queue.jobs.empty())
+            return false;
+
+        if(newest)
+        {
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+        }
+        else
+        {
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+        }
+        queued--;
+        return true;
+    }
+
+    // oldest queued job of a counter in any queue
+    bool takeCounted(const JobCounter* counter, Job& job)
+    {
+        for(auto& queue : queues)
+        {
+            std::lock_guard<std::mutex> lock(queue->mutex);
+
+            auto counted = [counter](const Job& other) {
+                return other.counter == counter;
+            };
+            auto found = std::find_if(queue->jobs.begin(), queue->jobs.end(), counted);
+
+            if(found != queue->jobs.end())
+            {
+                job = std::move(*found);
+                queue->jobs.erase(found);
+                queued--;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+inline ThreadPool& threadPool()
+{
+    static ThreadPool pool;
+    return pool;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Single producer / single consumer triple buffer.
+//
+// The producer owns one slot to write into, the consumer owns one slot to read from and
+// the third slot is the hand-over slot. Publishing and consuming are a single atomic
+// exchange of the hand-over slot index, so neither side ever waits for the other. The
+// consumer always sees the most recently published slot; intermediate ones are dropped.
+template<typename T>
+struct TripleBuffer
+{
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t FRESH_BIT  = 0x4;
+
+    T slots[3];
+
+    uint8_t              write_index = 0;
+    uint8_t              read_index  = 1;
+    std::atomic<uint8_t> shared      = 2;
+
+    // Producer side
+
+    T& write()
+    {
+        return slots[write_index];
+    }
+
+    void publish()
+    {
+        uint8_t previous = shared.exchange(write_index | FRESH_BIT, std::memory_order_acq_rel);
+        write_index      = previous & INDEX_MASK;
+    }
+
+    // Consumer side
+
+    bool fresh() const
+    {
+        return shared.load(std::memory_order_acquire) & FRESH_BIT;
+    }
+
+    bool consume()
+    {
+        if(!fresh())
+            return false;
+
+        uint8_t previous = shared.exchange(read_index, std::memory_order_acq_rel);
+        read_index       = previous & INDEX_MASK;
+        return true;
+    }
+
+    const T& read() const
+    {
+        return slots[read_index];
+    }
+};
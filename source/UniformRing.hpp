@@ -0,0 +1,195 @@
+#pragma once
+
+// Glad
+#include "glad/gl.h"
+
+// lib
+#include <glm/glm.hpp>
+
+// std
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// modules
+#include "FramePacing.hpp"
+
+// Uniform block binding points, MATERIAL_BINDING sits between them in Material.hpp
+const GLuint FRAME_BINDING = 0;
+const GLuint DRAW_BINDING  = 2;
+
+// Regions of the ring, one more than frames the GPU may have queued
+const int UNIFORM_RING_FRAMES = MAX_QUEUED_FRAMES + 1;
+
+// std140 layout of the `Frame` block, shared by every program that draws the scene
+struct FrameUniforms
+{
+    glm::mat4 view          = glm::mat4(1.0f);
+    glm::mat4 projection    = glm::mat4(1.0f);
+    glm::vec2 viewport      = glm::vec2(0.0f);
+    glm::vec2 cluster_depth = glm::vec2(0.0f);  // near and far plane
+    glm::vec4 ambient       = glm::vec4(0.0f);  // rgb
+};
+
+// std140 layout of the `Draw` block of the model program
+struct DrawUniforms
+{
+    glm::mat4  model = glm::mat4(1.0f);
+    glm::ivec4 draw  = glm::ivec4(0, -1, 0, 0);  // material in its block, bone offset
+};
+
+// Uniform buffer all blocks of a frame are packed into. The frame's data is collected in
+// memory and written with a single unsynchronized map into one region of the buffer,
+// draws then only bind ranges of it. A fence per region keeps a frame from overwriting
+// blocks the GPU may still read, the buffer itself is reused for the whole run.
+// Lives on the render thread.
+struct UniformRing
+{
+    GLuint buffer    = 0;
+    size_t capacity  = 0;  // bytes per region
+    size_t used      = 0;  // bytes pushed this frame
+    int    region    = 0;
+    GLint  alignment = 256;  // of bound ranges
+
+    GLsync                     fences[UNIFORM_RING_FRAMES] = {};
+    std::vector<unsigned char> staging;
+
+    // starts a frame, waits for the GPU to finish the frame that last used the region
+    void begin()
+    {
+        if(!buffer)
+        {
+            glGenBuffers(1, &buffer);
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+            alignment = std::max(alignment, 1);
+        }
+
+        GLsync& fence = fences[region];
+        if(fence)
+        {
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+        used = 0;
+    }
+
+    // distance of consecutive blocks of a size, bound ranges have to be aligned
+    size_t stride(size_t size) const
+    {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    // appends count blocks of size bytes, returns the offset of the first in the frame
+    size_t push(const void* data, size_t size, size_t count = 1)
+    {
+        size_t offset = stride(used);
+        size_t step   = stride(size);
+        size_t end    = offset + step * count;
+        if(staging.size() < end)
+            staging.resize(std::max(end, staging.size() * 2));
+
+        auto* source = static_cast<const unsigned char*>(data);
+        for(size_t i = 0; i < count; i++)
+            std::memcpy(&staging[offset + i * step], source + i * size, size);
+
+        used = end;
+        return offset;
+    }
+
+    // writes everything pushed this frame into its region
+    void upload()
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+
+        if(used > capacity)
+        {
+            // the old storage is orphaned and kept by the driver while frames use it
+            capacity = stride(std::max(used, capacity * 2));
+            glBufferData(
+                GL_UNIFORM_BUFFER,
+                capacity * UNIFORM_RING_FRAMES,
+                nullptr,
+                GL_STREAM_DRAW);
+            release(fences);
+        }
+
+        if(used > 0)
+        {
+            GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+                                GL_MAP_UNSYNCHRONIZED_BIT;
+            void* target = glMapBufferRange(GL_UNIFORM_BUFFER, base(), used, access);
+            if(target)
+            {
+                std::memcpy(target, staging.data(), used);
+                glUnmapBuffer(GL_UNIFORM_BUFFER);
+            }
+        }
+
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void bind(GLuint binding, size_t offset, size_t size) const
+    {
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, base() + offset, size);
+    }
+
+    // the GPU is done with the region once the commands issued so far have completed
+    void end()
+    {
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        region         = (region + 1) % UNIFORM_RING_FRAMES;
+    }
+
+    void release()
+    {
+        release(fences);
+        glDeleteBuffers(1, &buffer);
+
+        buffer   = 0;
+        capacity = 0;
+        used     = 0;
+    }
+
+    // connects the frame and draw blocks of a program to their binding points
+    static void setup(GLuint program)
+    {
+        GLuint block = glGetUniformBlockIndex(program, "Frame");
+        if(block != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, block, FRAME_BINDING);
+
+        block = glGetUniformBlockIndex(program, "Draw");
+        if(block != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, block, DRAW_BINDING);
+    }
+
+private:
+    GLintptr base() const
+    {
+        return GLintptr(region) * capacity;
+    }
+
+    static void release(GLsync (&syncs)[UNIFORM_RING_FRAMES])
+    {
+        for(auto& sync : syncs)
+        {
+            if(sync)
+                glDeleteSync(sync);
+            sync = nullptr;
+        }
+    }
+};
+
+// Per-draw blocks of one model in the ring: one per mesh, or one per material of a
+// cluster store
+struct DrawSlots
+{
+    const UniformRing* ring   = nullptr;
+    size_t             first  = 0;
+    size_t             stride = 0;
+
+    void bind(size_t slot) const
+    {
+        ring->bind(DRAW_BINDING, first + slot * stride, sizeof(DrawUniforms));
+    }
+};
@@ -11,9 +11,27 @@
 #include "SDL3/SDL_hints.h"
 #include "SDL3/SDL_opengl.h"
 
+// std
+#include <atomic>
+#include <memory>
+
 // modules
+#include "Browser.hpp"
 #include "Camera.hpp"
+#include "Capture.hpp"
+#include "Console.hpp"
+#include "Damage.hpp"
+#include "DrawList.hpp"
+#include "Frame.hpp"
+#include "GLStats.hpp"
+#include "Log.hpp"
 #include "Model.hpp"
+#include "RenderThread.hpp"
+#include "TripleBuffer.hpp"
+
+// Camera movement and other time-scaled state advance in fixed steps on the main thread
+const Uint64 SIMULATION_RATE = 120;
+const Uint64 SIMULATION_STEP = SDL_NS_PER_SECOND / SIMULATION_RATE;
 
 struct Application
 {
@@ -26,6 +44,11 @@ struct Application
     void init()
     {
         stbi_set_flip_vertically_on_load(true);
+        logger().open(LOG_FILE);
+
+        // shaders, textures and models are read from the pack first if there is one
+        if(resourcePack().open(RESOURCE_PACK))
+            logInfo("Resource pack: %u entries", resourcePack().header.entry_count);
 
         // SDL
 
@@ -46,13 +69,13 @@ struct Application
         context = SDL_GL_CreateContext(window);
 
         SDL_GL_MakeCurrent(window, context);
-        SDL_GL_SetSwapInterval(1);  // Enable vsync
 
         // glad
 
         int version = gladLoadGL((GLADloadfunc)SDL_GL_GetProcAddress);
-        printf("GL %d.%d\n", GLAD_VERSION_MAJOR(version), GLAD_VERSION_MINOR(version));
-        printf("%s\n", glGetString(GL_VERSION));
+        logInfo("GL %d.%d", GLAD_VERSION_MAJOR(version), GLAD_VERSION_MINOR(version));
+        logInfo("%s", glGetString(GL_VERSION));
+        GL_STATS_INSTALL();
 
         // imgui
 
@@ -82,16 +105,155 @@ struct Application
     }
 };
 
+struct Scene
+{
+    std::vector<Model*> models;
+    std::vector<int>    instances;  // animation instance per model, -1 if static
+    AnimationSystem     animation;
+    uint64_t            transforms = 0;  // bumped whenever a world transform changes
+    std::vector<Light>  lights;
+
+    void add(Model& model)
+    {
+        models.push_back(&model);
+        transforms++;
+
+        if(!model.animations.empty())
+            instances.push_back(animation.add(model.skeleton, model.animations[0]));
+        else
+            instances.push_back(-1);
+    }
+
+    // drops every model, the lights stay
+    void clear()
+    {
+        models.clear();
+        instances.clear();
+        animation.instances.clear();
+        animation.palettes.clear();
+        transforms++;
+    }
+
+    void update()
+    {
+        for(auto* model : models)
+            if(model->nodes.update())
+                transforms++;
+    }
+
+    bool animated() const
+    {
+        return animation.playing && !animation.instances.empty();
+    }
+
+    // cluster stores still streaming pages in need more frames
+    bool streaming() const
+    {
+        for(auto* model : models)
+            if(model->clusters && model->clusters->waiting)
+                return true;
+        return false;
+    }
+
+    // world space box around every mesh
+    void bounds(glm::vec3& min, glm::vec3& max) const
+    {
+        min = glm::vec3(FLT_MAX);
+        max = glm::vec3(-FLT_MAX);
+
+        for(auto* model : models)
+        {
+            if(model->clusters)
+            {
+                glm::vec3 store_min, store_max;
+                Mesh::transformBounds(
+                    model->nodes.worlds[0],
+                    model->clusters->header.bounds_min,
+                    model->clusters->header.bounds_max,
+                    store_min,
+                    store_max);
+
+                min = glm::min(min, store_min);
+                max = glm::max(max, store_max);
+            }
+
+            for(size_t i = 0; i < model->meshes.size(); i++)
+            {
+                glm::vec3 mesh_min, mesh_max;
+                model->meshes[i].worldBounds(
+                    model->nodes.worlds[model->mesh_nodes[i]],
+                    mesh_min,
+                    mesh_max);
+
+                min = glm::min(min, mesh_min);
+                max = glm::max(max, mesh_max);
+            }
+        }
+
+        if(min.x > max.x)
+            min = max = glm::vec3(0.0f);
+    }
+
+    void scatterLights(int count)
+    {
+        glm::vec3 min, max;
+        bounds(min, max);
+        ::scatterLights(lights, count, min, max);
+    }
+};
+
 struct Renderer
 {
     ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
     Camera camera      = Camera();
 
-    void drawImGui()
+    float render_ms       = 0.0f;
+    float gpu_ms          = 0.0f;
+    int   shader_variants = 0;
+
+    bool  dynamic_resolution = true;
+    float frame_target_ms    = RESOLUTION_TARGET_MS;
+    float min_scale          = 0.5f;
+    float scene_scale        = 1.0f;
+
+    PacingMode pacing       = PacingMode::VSYNC;
+    int        pacing_index = 0;
+    bool       on_demand    = true;
+
+    DrawListBuilder draw_list;
+
+    LightGrid light_grid;
+    bool      lighting    = true;
+    int       light_count = 64;
+    glm::vec3 ambient     = glm::vec3(0.1f);
+
+    int import_profile = int(ImportProfile::DEFAULT);
+
+    bool occlusion         = false;
+    int  occlusion_meshes  = 0;
+    int  occlusion_queries = 0;
+    int  occlusion_drawn   = 0;  // under conditional render
+    int  occlusion_culled  = 0;  // skipped by the GPU
+
+    bool  cone_culling     = true;
+    float cluster_prefetch = CLUSTER_PREFETCH_DISTANCE;
+
+    Console console;
+
+    // published frames are written to CAPTURE_FILE while capture_left is positive
+    CaptureWriter capture;
+    int           capture_frames = 60;
+    int           capture_left   = 0;
+
+    float latency_history[LatencyStats::HISTORY] = {};
+    int   latency_count                          = 0;
+    float latency_average                        = 0.0f;
+    float latency_maximum                        = 0.0f;
+
+    void drawImGui(Scene& scene, ModelBrowser& browser)
     {
         ImGuiIO& io = ImGui::GetIO();
 
-        ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplSDL3_NewFrame();
 
         // imgui
@@ -105,6 +267,94 @@ struct Renderer
                     "Average %.3f ms/frame (%.1f FPS)",
                     1000.0f / io.Framerate,
                     io.Framerate);
+                ImGui::Text(
+                    "Render thread %.3f ms/frame, GPU %.3f ms", render_ms, gpu_ms);
+                ImGui::Text("Shader variants %d", shader_variants);
+
+                // the scene is drawn smaller when the GPU misses the target, not the UI
+                ImGui::Checkbox("Dynamic resolution", &dynamic_resolution);
+                if(dynamic_resolution)
+                {
+                    ImGui::SliderFloat(
+                        "Frame target",
+                        &frame_target_ms,
+                        4.0f,
+                        50.0f,
+                        "%.1f ms");
+                    ImGui::SliderFloat(
+                        "Minimum scale",
+                        &min_scale,
+                        RESOLUTION_MIN_SCALE,
+                        1.0f);
+                    ImGui::Text(
+                        "Scene at %.0f%%, %dx%d",
+                        scene_scale * 100.0f,
+                        int(io.DisplaySize.x * scene_scale + 0.5f),
+                        int(io.DisplaySize.y * scene_scale + 0.5f));
+                }
+                ImGui::Checkbox("Render on demand", &on_demand);
+
+                if(ImGui::Combo(
+                       "Pacing",
+                       &pacing_index,
+                       PACING_MODE_NAMES,
+                       IM_ARRAYSIZE(PACING_MODE_NAMES)))
+                    pacing = static_cast<PacingMode>(pacing_index);
+
+                ImGui::Text(
+                    "Input to swap %.2f ms avg, %.2f ms max",
+                    latency_average,
+                    latency_maximum);
+                ImGui::PlotLines(
+                    "Latency",
+                    latency_history,
+                    latency_count,
+                    0,
+                    nullptr,
+                    0.0f,
+                    FLT_MAX,
+                    ImVec2(0, 40));
+
+                ImGui::InputInt("Capture frames", &capture_frames);
+                if(capture_left > 0)
+                    ImGui::Text("Capturing, %d frames left", capture_left);
+                else if(ImGui::Button("Capture"))
+                    startCapture(scene);
+
+                ImGui::Text(
+                    "Draw list %zu of %zu meshes, %.3f ms",
+                    draw_list.visible,
+                    draw_list.meshes,
+                    draw_list.ms);
+
+                ImGui::Checkbox("Occlusion culling", &occlusion);
+                if(occlusion)
+                    ImGui::Text(
+                        "%d of %d meshes skipped, %d conditional draws, %d queries",
+                        occlusion_culled,
+                        occlusion_meshes,
+                        occlusion_drawn,
+                        occlusion_queries);
+
+                ImGui::Checkbox("Cone culling", &cone_culling);
+                ImGui::SliderFloat("Cluster prefetch", &cluster_prefetch, 0.0f, 100.0f);
+            }
+            ImGui::End();
+
+            GL_STATS_OVERLAY();
+
+            ImGui::Begin("Lighting");
+            {
+                ImGui::Checkbox("Enabled", &lighting);
+                ImGui::ColorEdit3("Ambient", &ambient[0]);
+
+                if(ImGui::SliderInt("Lights", &light_count, 0, 1024))
+                    scene.scatterLights(light_count);
+
+                ImGui::Text(
+                    "%d cluster entries, binning %.3f ms",
+                    light_grid.entries,
+                    light_grid.bin_ms);
             }
             ImGui::End();
 
@@ -113,7 +363,7 @@ struct Renderer
                 ImGui::SliderFloat("Pitch", &camera.pitch, -89.0f, 89.0f);
                 ImGui::SliderFloat("Yaw", &camera.yaw, -360.0f, 360.0f);
                 ImGui::SliderFloat("FOV", &camera.fov, 1.0f, 100.0f);
-                ImGui::SliderFloat("Speed", &camera.speed, 0.1f, 10.0f);
+                ImGui::SliderFloat("Speed", &camera.speed, 0.1f, 50.0f);
                 ImGui::SliderFloat("Sensitivity", &camera.sensitivity, 0.1f, 10.0f);
 
                 ImGui::SliderFloat3("Position", &camera.position[0], -100.0f, 100.0f);
@@ -124,57 +374,113 @@ struct Renderer
             }
             ImGui::End();
 
-            ImGui::Begin("Console");
+            ImGui::Begin("Animation");
             {
-                static char text[1024 * 16] = "bli bla blub\n";
-
-                ImGui::InputTextMultiline(
-                    "##source",
-                    text,
-                    IM_ARRAYSIZE(text),
-                    ImVec2(-FLT_MIN, ImGui::GetTextLineHeight() * 8));
+                ImGui::Checkbox("Playing", &scene.animation.playing);
+                ImGui::SliderFloat("Speed", &scene.animation.speed, 0.0f, 4.0f);
+                ImGui::Text(
+                    "%d instances, %d bones",
+                    (int)scene.animation.instances.size(),
+                    (int)scene.animation.palettes.size());
+                ImGui::Text("Evaluation %.3f ms", scene.animation.evaluate_ms);
             }
             ImGui::End();
 
+            console.draw();
+
             ImGui::Begin("Browser");
             {
+                // the selection follows the keyboard focus, stepping through the list
+                // with the arrow keys sets the direction the browser prefetches in
                 if(ImGui::BeginListBox("Model"))
                 {
-                    const char* items[] = {
-                        "AAAA",
-                        "BBBB",
-                        "CCCC",
-                        "DDDD",
-                        "EEEE",
-                        "FFFF",
-                        "GGGG",
-                        "HHHH",
-                        "IIII",
-                        "JJJJ",
-                        "KKKK",
-                        "LLLLLLL",
-                        "MMMM",
-                        "OOOOOOO"};
-
-                    static bool item_highlight       = false;
-                    static int  item_selected_idx    = 0;
-                    int         item_highlighted_idx = -1;
-
-                    for(int n = 0; n < IM_ARRAYSIZE(items); n++)
+                    for(int n = 0; n < static_cast<int>(browser.entries.size()); n++)
                     {
-                        const bool is_selected = (item_selected_idx == n);
-                        if(ImGui::Selectable(items[n], is_selected))
-                            item_selected_idx = n;
+                        const char* name        = browser.entries[n].name.c_str();
+                        const bool  is_selected = browser.selection() == n;
 
-                        if(item_highlight && ImGui::IsItemHovered())
-                            item_highlighted_idx = n;
+                        ImGui::PushID(n);
+                        if(ImGui::Selectable(name, is_selected) ||
+                           (ImGui::IsItemFocused() && !is_selected))
+                            browser.select(n);
 
                         if(is_selected)
                             ImGui::SetItemDefaultFocus();
+
+                        if(browser.cached(n))
+                        {
+                            ImGui::SameLine();
+                            ImGui::TextDisabled("cached");
+                        }
+                        ImGui::PopID();
                     }
                     ImGui::EndListBox();
                 }
 
+                if(ImGui::Combo(
+                       "Profile",
+                       &import_profile,
+                       IMPORT_PROFILE_NAMES,
+                       IM_ARRAYSIZE(IMPORT_PROFILE_NAMES)))
+                    browser.reimport(ImportProfile(import_profile));
+
+                if(!browser.ready())
+                    ImGui::Text(
+                        "Importing %s",
+                        browser.entries[browser.selection()].name.c_str());
+                ImGui::Text(
+                    "%.1f of %zu MB cached, %d importing",
+                    browser.bytes / 1048576.0,
+                    BROWSER_CACHE_BYTES >> 20,
+                    browser.imports.load());
+                ImGui::Text(
+                    "%d hits, %d misses, %d canceled",
+                    browser.hits.load(),
+                    browser.misses.load(),
+                    browser.canceled.load());
+
+                for(size_t i = 0; i < scene.models.size(); i++)
+                {
+                    const ImportStats& stats = scene.models[i]->stats;
+
+                    ImGui::PushID(static_cast<int>(i));
+                    if(ImGui::TreeNode(
+                           "",
+                           "%s import, %s tangents, %.2f ms",
+                           IMPORT_PROFILE_NAMES[int(stats.profile)],
+                           TANGENT_SOURCE_NAMES[int(stats.tangents)],
+                           stats.total()))
+                    {
+                        ImGui::Text(
+                            "%zu -> %zu vertices, %zu triangles",
+                            stats.vertices_read,
+                            stats.vertices,
+                            stats.triangles);
+                        for(int stage = 0; stage < STAGE_COUNT; stage++)
+                            ImGui::Text(
+                                "%s %.2f ms",
+                                IMPORT_STAGE_NAMES[stage],
+                                stats.ms[stage]);
+
+                        const ClusterStore* clusters = scene.models[i]->clusters.get();
+                        if(clusters)
+                        {
+                            ImGui::Text(
+                                "%d meshlets drawn, %d frustum, %d cone culled",
+                                clusters->drawn.load(),
+                                clusters->frustum_culled.load(),
+                                clusters->cone_culled.load());
+                            ImGui::Text(
+                                "%d of %zu pages resident, %d loading",
+                                clusters->resident.load(),
+                                clusters->pages.size(),
+                                clusters->loading.load());
+                        }
+                        ImGui::TreePop();
+                    }
+                    ImGui::PopID();
+                }
+
                 if(ImGui::TreeNode("Trees"))
                 {
                     for(int i = 0; i < 5; i++)
@@ -197,7 +503,119 @@ struct Renderer
 
             ImGui::Render();
         }
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    }
+
+    void startCapture(const Scene& scene)
+    {
+        std::vector<CaptureModel> models;
+        for(auto* model : scene.models)
+            models.push_back({model->path, model->stats.profile});
+
+        if(capture_frames > 0 && capture.begin(CAPTURE_FILE, models))
+            capture_left = capture_frames;
+    }
+
+    // appends a published frame to a running capture
+    void record(const Frame& frame, const Scene& scene)
+    {
+        if(capture_left <= 0)
+            return;
+
+        capture.add(frame, [&scene](const Model* model) {
+            auto it = std::find(scene.models.begin(), scene.models.end(), model);
+            return uint32_t(it - scene.models.begin());
+        });
+
+        if(--capture_left == 0)
+        {
+            capture.finish();
+            logInfo("Captured %u frames to %s", capture.frames, CAPTURE_FILE);
+        }
+    }
+
+    // Changes of the view that did not come through an input event
+    bool changed(const Frame& frame, const Application& app, const Scene& scene)
+    {
+        return frame.width != app.width || frame.height != app.height ||
+               frame.view != camera.view() ||
+               frame.projection != camera.projection(app.width, app.height) ||
+               frame.models != scene.models || frame.transforms != scene.transforms ||
+               scene.animated() || scene.streaming() || console.pending();
+    }
+
+    void simulate(const bool* key_states, float delta)
+    {
+        if(key_states[SDL_SCANCODE_W])
+            camera.move(Direction::FORWARD, delta);
+        else if(key_states[SDL_SCANCODE_S])
+            camera.move(Direction::BACKWARD, delta);
+
+        if(key_states[SDL_SCANCODE_A])
+            camera.move(Direction::LEFT, delta);
+        else if(key_states[SDL_SCANCODE_D])
+            camera.move(Direction::RIGHT, delta);
+
+        if(key_states[SDL_SCANCODE_PAGEUP])
+            camera.move(Direction::UPWARD, delta);
+        else if(key_states[SDL_SCANCODE_PAGEDOWN])
+            camera.move(Direction::DOWNWARD, delta);
+    }
+
+    void snapshot(Frame& frame, const Application& app, const Scene& scene)
+    {
+        frame.width              = app.width;
+        frame.height             = app.height;
+        frame.clear_color        = clear_color;
+        frame.pacing             = pacing;
+        frame.occlusion          = occlusion;
+        frame.dynamic_resolution = dynamic_resolution;
+        frame.frame_target_ms    = frame_target_ms;
+        frame.min_scale          = min_scale;
+        frame.cone_culling       = cone_culling;
+        frame.cluster_prefetch   = cluster_prefetch;
+        frame.lighting           = lighting;
+        frame.ambient            = ambient;
+        frame.camera             = camera;
+        frame.view               = camera.view();
+        frame.projection         = camera.projection(app.width, app.height);
+        frame.models             = scene.models;
+        frame.ui.capture(ImGui::GetDrawData());
+
+        // world matrices only change with the scene, not every frame
+        if(frame.transforms != scene.transforms)
+        {
+            frame.transforms = scene.transforms;
+            frame.mesh_worlds.clear();
+            frame.world_offsets.clear();
+
+            for(auto* model : scene.models)
+            {
+                frame.world_offsets.push_back(frame.mesh_worlds.size());
+                model->meshWorlds(frame.mesh_worlds);
+            }
+        }
+
+        // lights are binned on the pool while this thread builds the draw list
+        JobCounter lights;
+        auto       bin = [&]() {
+            light_grid.build(scene.lights, frame.view, frame.projection, frame.lights);
+        };
+        if(lighting)
+            threadPool().submit(bin, &lights);
+
+        frame.bone_palettes = scene.animation.palettes;
+        frame.bone_offsets.resize(scene.models.size());
+        for(size_t i = 0; i < scene.models.size(); i++)
+        {
+            int instance          = scene.instances[i];
+            frame.bone_offsets[i] = -1;
+
+            if(instance >= 0)
+                frame.bone_offsets[i] = scene.animation.instances[instance].palette_offset;
+        }
+
+        draw_list.build(frame);
+        threadPool().wait(lights);
     }
 };
 
@@ -208,51 +626,93 @@ int main(int argc, char** argv)
 
     app.init();
 
-    auto shader = Shader();
-    shader.vertexShader("resource/vertex_model.glsl");
-    shader.fragmentShader("resource/fragment_model.glsl");
-    shader.link();
-    shader.validate();
+    ShaderVariants shaders;
+    RenderThread::setupShader(shaders);
 
-    auto model = Model("resource/model/model.obj");
+    // gl-browser [model] [preview|default|quality|clusters] [native|assimp]
+    const char*   path     = argc > 1 ? argv[1] : "resource/model/model.obj";
+    TangentSource tangents = argc > 3 ? tangentSource(argv[3]) : TangentSource::NATIVE;
+    if(argc > 2)
+        renderer.import_profile = int(importProfile(argv[2]));
+
+    auto frames        = TripleBuffer<Frame>();
+    auto render_thread = RenderThread();
+
+    // sequence of the next published frame, models the browser lets go of are deleted
+    // once the render thread has moved on to it
+    std::atomic<Uint64> sequence = 0;
+
+    auto browser     = ModelBrowser();
+    browser.retire   = [&](Model* model) { render_thread.retire(model, sequence); };
+    browser.imported = []() { Damage::wake(); };
+    browser.open(path, ImportProfile(renderer.import_profile), tangents);
+
+    std::shared_ptr<Model> model = browser.ready();
+
+    auto scene = Scene();
+    scene.add(*model);
+    scene.scatterLights(renderer.light_count);
 
     // Renderer
 
-    glViewport(0, 0, app.width, app.height);
+    // Font texture and imgui programs have to exist before the context moves away
+    ImGui_ImplOpenGL3_CreateDeviceObjects();
+
+    render_thread.start(app.window, app.context, frames, shaders);
 
     // Main loop
 
     SDL_Event event;
-    bool      running     = true;
-    auto      frame_start = SDL_GetTicks();
-    auto      frame_time  = SDL_GetTicks();
+    bool      running       = true;
+    Uint64    previous_tick = SDL_GetTicksNS();
+    Uint64    accumulator   = 0;
+    Uint64    input_time    = 0;
+    Uint64    publish_time  = SDL_GetTicksNS();
+    Damage    damage;
+    Frame     published;
 
     while(running)
     {
-        frame_start = SDL_GetTicks();
-
         const bool* key_states = SDL_GetKeyboardState(nullptr);
 
-        if(key_states[SDL_SCANCODE_W])
-            renderer.camera.move(Direction::FORWARD);
-        else if(key_states[SDL_SCANCODE_S])
-            renderer.camera.move(Direction::BACKWARD);
+        // Nothing changed, sleep until an event arrives
+        if(renderer.on_demand && !damage.dirty())
+        {
+            SDL_WaitEventTimeout(nullptr, DAMAGE_IDLE_TIMEOUT_MS);
 
-        if(key_states[SDL_SCANCODE_A])
-            renderer.camera.move(Direction::LEFT);
-        else if(key_states[SDL_SCANCODE_D])
-            renderer.camera.move(Direction::RIGHT);
+            previous_tick = SDL_GetTicksNS();
+            accumulator   = 0;
+        }
 
-        if(key_states[SDL_SCANCODE_PAGEUP])
-            renderer.camera.move(Direction::UPWARD);
-        else if(key_states[SDL_SCANCODE_PAGEDOWN])
-            renderer.camera.move(Direction::DOWNWARD);
+        // Low latency mode samples input only once the render thread asks for a frame
+        if(renderer.pacing == PacingMode::LOW_LATENCY)
+        {
+            Uint64 deadline = SDL_GetTicksNS() + SIMULATION_STEP;
+            while(!render_thread.frame_requested.exchange(false) &&
+                  SDL_GetTicksNS() < deadline)
+                SDL_DelayNS(100000);
+        }
 
         while(SDL_PollEvent(&event))
         {
             // imgui event handler
             {
                 ImGui_ImplSDL3_ProcessEvent(&event);
+                damage.mark();
+            }
+
+            // Remember the oldest input of the frame to measure input-to-swap latency
+            switch(event.type)
+            {
+            case SDL_EVENT_KEY_DOWN:
+            case SDL_EVENT_KEY_UP:
+            case SDL_EVENT_MOUSE_MOTION:
+            case SDL_EVENT_MOUSE_BUTTON_DOWN:
+            case SDL_EVENT_MOUSE_BUTTON_UP:
+            case SDL_EVENT_MOUSE_WHEEL:
+                if(!input_time)
+                    input_time = event.common.timestamp;
+                break;
             }
 
             // SDL event handler
@@ -264,7 +724,6 @@ int main(int argc, char** argv)
 
             case SDL_EVENT_WINDOW_RESIZED:
                 SDL_GetWindowSize(app.window, &app.width, &app.height);
-                glViewport(0, 0, app.width, app.height);
                 break;
 
             case SDL_EVENT_KEY_DOWN:
@@ -283,39 +742,106 @@ int main(int argc, char** argv)
             }
         }
 
+        // Simulation
+        {
+            Uint64 now = SDL_GetTicksNS();
+            accumulator += now - previous_tick;
+            previous_tick = now;
+
+            // Drop the backlog after a stall instead of trying to catch up
+            if(accumulator > SIMULATION_STEP * 8)
+                accumulator = SIMULATION_STEP * 8;
+
+            while(accumulator >= SIMULATION_STEP)
+            {
+                renderer.simulate(key_states, SIMULATION_STEP / 1e9f);
+                accumulator -= SIMULATION_STEP;
+            }
+        }
+
         // Window is minimized
         if(SDL_GetWindowFlags(app.window) & SDL_WINDOW_MINIMIZED)
         {
-            // Wait 16ms
-            SDL_Delay(16);
+            // Wait for the restore event
+            SDL_WaitEvent(nullptr);
             continue;
         }
 
-        // Render
+        // the selection replaces the scene once the browser has imported it
+        std::shared_ptr<Model> selection = browser.ready();
+        if(selection && selection != model)
         {
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            glClearColor(
-                renderer.clear_color.x * renderer.clear_color.w,
-                renderer.clear_color.y * renderer.clear_color.w,
-                renderer.clear_color.z * renderer.clear_color.w,
-                renderer.clear_color.w);
-
-            shader.activate();
-
-            shader.set("u_model", renderer.camera.model());
-            shader.set("u_view", renderer.camera.view());
-            shader.set("u_projection", renderer.camera.projection(app.width, app.height));
-
-            model.Draw(shader);
+            model = selection;
+            scene.clear();
+            scene.add(*model);
+            scene.scatterLights(renderer.light_count);
+        }
 
-            renderer.drawImGui();
+        if(renderer.changed(published, app, scene))
+            damage.mark();
 
-            SDL_GL_SwapWindow(app.window);
+        // Publish
+        if(!renderer.on_demand || damage.dirty())
+        {
+            renderer.render_ms       = render_thread.frame_ms;
+            renderer.gpu_ms          = render_thread.gpu_ms;
+            renderer.shader_variants = shaders.compiled;
+            renderer.scene_scale     = render_thread.scene_scale;
+            renderer.latency_count   = render_thread.latency.history(
+                renderer.latency_history,
+                renderer.latency_average,
+                renderer.latency_maximum);
+
+            renderer.occlusion_meshes  = render_thread.occlusion.meshes;
+            renderer.occlusion_queries = render_thread.occlusion.queried;
+            renderer.occlusion_drawn   = render_thread.occlusion.conditional;
+            renderer.occlusion_culled  = render_thread.occlusion.skipped;
+
+            // Animations advance by wall time once per published frame
+            Uint64 now = SDL_GetTicksNS();
+            scene.animation.update((now - publish_time) / 1e9f);
+            scene.update();
+            publish_time = now;
+
+            renderer.drawImGui(scene, browser);
+
+            // Keep going while ImGui animates, e.g. a blinking text cursor, and while
+            // capturing consecutive frames
+            if(ImGui::IsAnyItemActive() || renderer.capture_left > 0)
+                damage.mark();
+
+            Frame& frame          = frames.write();
+            frame.sequence        = sequence++;
+            frame.input_timestamp = input_time;
+            renderer.snapshot(frame, app, scene);
+            renderer.record(frame, scene);
+            frames.publish();
+            render_thread.notify();
+
+            published.width      = frame.width;
+            published.height     = frame.height;
+            published.view       = frame.view;
+            published.projection = frame.projection;
+            published.models     = frame.models;
+            published.transforms = frame.transforms;
+
+            input_time = 0;
+            damage.rendered();
         }
 
-        frame_time = SDL_GetTicks() - frame_start;
+        // Sleep until the next simulation step is due
+        Uint64 elapsed = SDL_GetTicksNS() - previous_tick;
+        if(renderer.pacing != PacingMode::LOW_LATENCY && elapsed < SIMULATION_STEP)
+            SDL_DelayNS(SIMULATION_STEP - elapsed);
     }
 
+    // the last references to the models, the render thread releases them when stopping
+    browser.close();
+    scene.clear();
+    model.reset();
+
+    render_thread.stop();
+
     app.deinit();
 
     return 0;
@@ -0,0 +1,216 @@
+// lib
+#include <glm/glm.hpp>
+
+// std
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// modules
+#include "Model.hpp"
+#include "ResourcePack.hpp"
+
+// Bundles shaders, textures and models into a resource pack, no GPU required:
+//
+//   pack output.pack [--compress] [--profile name] files...
+//
+// Names are the paths as given, so run it from the directory the application starts in
+// and pass the paths the application opens. GLSL files are stored as text, images
+// decoded and flipped for GL, everything else is imported as a model with the given
+// profile together with the textures of its materials. Skinned models are left out,
+// bones and animations are not part of the pack and those load from their files.
+
+// appends values at the next aligned offset of blob and returns that offset
+template<typename T>
+static uint64_t append(std::vector<char>& blob, const T* values, size_t count)
+{
+    blob.resize((blob.size() + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT);
+
+    uint64_t offset = blob.size();
+    blob.insert(
+        blob.end(),
+        reinterpret_cast<const char*>(values),
+        reinterpret_cast<const char*>(values + count));
+    return offset;
+}
+
+static void addImage(
+    PackWriter&          writer,
+    const std::string&   name,
+    int                  width,
+    int                  height,
+    const unsigned char* pixels,
+    bool                 compress)
+{
+    PackImage header = {};
+    header.width     = width;
+    header.height    = height;
+
+    std::vector<char> blob;
+    append(blob, &header, 1);
+    append(blob, pixels, size_t(width) * height * 4);
+    writer.add(name, PACK_TEXTURE, blob.data(), blob.size(), compress);
+}
+
+static bool addModel(
+    PackWriter&        writer,
+    const std::string& path,
+    ImportProfile      profile,
+    bool               compress)
+{
+    Model model(path, profile, false, false);
+    if(model.meshes.empty() || model.skeleton.bones() > 0)
+        return false;
+
+    const MaterialLibrary& library = model.materials;
+    for(auto& image : library.images)
+        if(image.pixels)
+            addImage(
+                writer, image.path, image.width, image.height, image.pixels, compress);
+
+    // the library is not built, maps are still indices of its images
+    std::string               strings;
+    std::vector<PackMaterial> materials(library.materials.size());
+    for(size_t i = 0; i < materials.size(); i++)
+    {
+        const MaterialData& data = library.materials[i];
+        materials[i]             = {};
+        materials[i].diffuse     = data.diffuse;
+        materials[i].specular    = data.specular;
+
+        for(int map = 0; map < 4; map++)
+        {
+            if(data.maps[map] < 0)
+                continue;
+
+            const std::string& name = library.images[data.maps[map]].path;
+            materials[i].map_offsets[map] = static_cast<uint32_t>(strings.size());
+            materials[i].map_sizes[map]   = static_cast<uint32_t>(name.size());
+            strings += name;
+        }
+    }
+
+    PackModel header = {};
+    header.mesh_count     = static_cast<uint32_t>(model.meshes.size());
+    header.material_count = static_cast<uint32_t>(materials.size());
+
+    std::vector<PackMesh> meshes(model.meshes.size());
+    std::vector<char>     blob;
+    append(blob, &header, 1);
+    header.material_offset = append(blob, materials.data(), materials.size());
+    header.mesh_offset     = append(blob, meshes.data(), meshes.size());
+    header.string_offset   = append(blob, strings.data(), strings.size());
+    header.string_size     = strings.size();
+
+    for(size_t i = 0; i < model.meshes.size(); i++)
+    {
+        const Mesh& mesh   = model.meshes[i];
+        PackMesh&   packed = meshes[i];
+
+        packed.world         = model.nodes.worlds[model.mesh_nodes[i]];
+        packed.bounds_min    = mesh.bounds_min;
+        packed.bounds_max    = mesh.bounds_max;
+        packed.vertex_count  = static_cast<uint32_t>(mesh.vertices.size());
+        packed.index_count   = static_cast<uint32_t>(mesh.indices.size());
+        packed.material      = mesh.material;
+        packed.padding       = 0;
+        packed.vertex_offset = append(blob, mesh.vertices.data(), mesh.vertices.size());
+        packed.index_offset  = append(blob, mesh.indices.data(), mesh.indices.size());
+    }
+
+    // offsets are known now, patch the tables in place
+    std::memcpy(blob.data(), &header, sizeof(header));
+    std::memcpy(
+        blob.data() + header.mesh_offset,
+        meshes.data(),
+        meshes.size() * sizeof(PackMesh));
+
+    model.materials.releaseImages();
+    writer.add(path, PACK_MODEL, blob.data(), blob.size(), compress);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 3)
+    {
+        printf("usage: %s output.pack [--compress] [--profile name] files...\n", argv[0]);
+        return 1;
+    }
+
+    bool          compress = false;
+    ImportProfile profile  = ImportProfile::DEFAULT;
+
+    PackWriter writer;
+    if(!writer.begin(argv[1]))
+    {
+        printf("Could not write %s\n", argv[1]);
+        return 1;
+    }
+
+    stbi_set_flip_vertically_on_load(true);
+
+    for(int i = 2; i < argc; i++)
+    {
+        if(std::strcmp(argv[i], "--compress") == 0)
+        {
+            compress = true;
+            continue;
+        }
+        if(std::strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+        {
+            profile = importProfile(argv[++i]);
+            continue;
+        }
+
+        std::string path = argv[i];
+        if(writer.contains(path))
+            continue;
+
+        int width = 0, height = 0, components = 0;
+        if(std::filesystem::path(path).extension() == ".glsl")
+        {
+            std::ifstream     file(path, std::ios::binary);
+            std::vector<char> text(
+                (std::istreambuf_iterator<char>(file)),
+                std::istreambuf_iterator<char>());
+            if(!file)
+            {
+                printf("Could not read %s\n", path.c_str());
+                continue;
+            }
+            writer.add(path, PACK_SHADER, text.data(), text.size(), compress);
+        }
+        else if(stbi_info(path.c_str(), &width, &height, &components))
+        {
+            auto* pixels = stbi_load(path.c_str(), &width, &height, &components, 4);
+            if(!pixels)
+            {
+                printf("Could not read %s\n", path.c_str());
+                continue;
+            }
+            addImage(writer, path, width, height, pixels, compress);
+            stbi_image_free(pixels);
+        }
+        else if(!addModel(writer, path, profile, compress))
+            printf("Skipped %s, not loadable or skinned\n", path.c_str());
+    }
+
+    if(!writer.finish())
+    {
+        printf("Could not write %s\n", argv[1]);
+        return 1;
+    }
+
+    printf(
+        "Packed %u entries into %s: %zu bytes stored, %zu before compression\n",
+        writer.header.entry_count,
+        argv[1],
+        writer.stored,
+        writer.original);
+    return 0;
+}
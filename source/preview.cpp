@@ -0,0 +1,182 @@
+// lib
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+// std
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// modules
+#include "Camera.hpp"
+#include "Model.hpp"
+#include "SoftwareRenderer.hpp"
+
+// Renders a model with the software renderer and writes it as PNG, no GPU or window
+// system required:
+//
+//   preview model [output.png] [--size WxH] [--profile name] [--unlit]
+//                 [--reference image.png] [--tolerance value]
+//
+// The camera looks at the model's bounds from the front left and slightly above, the
+// same framing for every model so previews of a directory line up. With a reference
+// image the mean absolute difference per channel (0 to 255) is printed and the exit code
+// is 2 if it exceeds the tolerance, for image based regression checks.
+
+const int   PREVIEW_WIDTH     = 512;
+const int   PREVIEW_HEIGHT    = 512;
+const float PREVIEW_TOLERANCE = 1.0f;
+const float PREVIEW_YAW       = -60.0f;
+const float PREVIEW_PITCH     = -20.0f;
+
+// mean absolute difference per channel, negative if the sizes differ
+static float compare(const SoftwareTarget& target, const char* path)
+{
+    // the texture loader flips images for GL, references are compared as stored
+    stbi_set_flip_vertically_on_load(false);
+
+    int   width = 0, height = 0, components = 0;
+    auto* pixels = stbi_load(path, &width, &height, &components, 4);
+    if(!pixels || width != target.width || height != target.height)
+    {
+        stbi_image_free(pixels);
+        return -1.0f;
+    }
+
+    double sum = 0.0;
+    for(size_t i = 0; i < target.color.size(); i++)
+        sum += std::abs(int(target.color[i]) - int(pixels[i]));
+
+    stbi_image_free(pixels);
+    return static_cast<float>(sum / target.color.size());
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        printf("usage: %s model [output.png] [--size WxH] [--profile name] [--unlit]\n"
+               "       [--reference image.png] [--tolerance value]\n",
+               argv[0]);
+        return 1;
+    }
+
+    std::string   output    = "preview.png";
+    const char*   reference = nullptr;
+    float         tolerance = PREVIEW_TOLERANCE;
+    int           width     = PREVIEW_WIDTH;
+    int           height    = PREVIEW_HEIGHT;
+    ImportProfile profile   = ImportProfile::DEFAULT;
+
+    SoftwareRenderer renderer;
+
+    for(int i = 2; i < argc; i++)
+    {
+        bool value = i + 1 < argc;
+
+        if(std::strcmp(argv[i], "--size") == 0 && value)
+            sscanf(argv[++i], "%dx%d", &width, &height);
+        else if(std::strcmp(argv[i], "--profile") == 0 && value)
+            profile = importProfile(argv[++i]);
+        else if(std::strcmp(argv[i], "--reference") == 0 && value)
+            reference = argv[++i];
+        else if(std::strcmp(argv[i], "--tolerance") == 0 && value)
+            tolerance = static_cast<float>(atof(argv[++i]));
+        else if(std::strcmp(argv[i], "--unlit") == 0)
+            renderer.lighting = false;
+        else
+            output = argv[i];
+    }
+
+    stbi_set_flip_vertically_on_load(true);
+
+    Model model(argv[1], profile, false, false);
+
+    std::vector<glm::mat4> worlds;
+    model.meshWorlds(worlds);
+
+    glm::vec3 min   = glm::vec3(FLT_MAX);
+    glm::vec3 max   = glm::vec3(-FLT_MAX);
+    bool      empty = true;
+    for(size_t i = 0; i < model.meshes.size(); i++)
+    {
+        if(model.meshes[i].vertices.empty())
+            continue;
+
+        glm::vec3 mesh_min, mesh_max;
+        model.meshes[i].worldBounds(worlds[i], mesh_min, mesh_max);
+        min   = glm::min(min, mesh_min);
+        max   = glm::max(max, mesh_max);
+        empty = false;
+    }
+
+    if(empty)
+    {
+        printf("Nothing to render in %s\n", argv[1]);
+        return 1;
+    }
+
+    // far enough for the bounding sphere to fit the vertical field of view
+    glm::vec3 center   = (min + max) * 0.5f;
+    float     radius   = std::max(glm::length(max - min) * 0.5f, 1e-4f);
+    Camera    camera;
+    float     distance = radius / std::sin(glm::radians(camera.fov) * 0.5f);
+
+    camera.yaw   = PREVIEW_YAW;
+    camera.pitch = PREVIEW_PITCH;
+    camera.update();
+    camera.position = center - camera.front * distance;
+
+    glm::mat4 projection = glm::perspective(
+        glm::radians(camera.fov),
+        float(width) / float(height),
+        (distance - radius) * 0.5f,
+        distance + radius);
+
+    SoftwareTarget target;
+    target.resize(width, height);
+    target.clear(glm::vec4(0.0f));
+    renderer.render(model, worlds.data(), camera.view(), projection, target);
+
+    printf("Rendered %zu triangles at %dx%d:", renderer.triangles, width, height);
+    for(int stage = 0; stage < RASTER_STAGE_COUNT; stage++)
+        printf(" %s %.2f ms", RASTER_STAGE_NAMES[stage], renderer.ms[stage]);
+    printf("\n");
+
+    model.materials.releaseImages();
+
+    if(!stbi_write_png(
+           output.c_str(),
+           target.width,
+           target.height,
+           4,
+           target.color.data(),
+           target.width * 4))
+    {
+        printf("Could not write %s\n", output.c_str());
+        return 1;
+    }
+
+    if(reference)
+    {
+        float difference = compare(target, reference);
+        if(difference < 0.0f)
+        {
+            printf("Could not compare with %s\n", reference);
+            return 1;
+        }
+
+        printf("Difference to %s: %.3f\n", reference, difference);
+        if(difference > tolerance)
+            return 2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,245 @@
+// Glad
+#include "glad/gl.h"
+
+// imgui
+#include "imgui.h"
+#include "imgui_impl_opengl3.h"
+
+// SDL
+#include "SDL3/SDL.h"
+
+// std
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+// modules
+#include "Capture.hpp"
+#include "DrawList.hpp"
+#include "Model.hpp"
+#include "RenderThread.hpp"
+
+// Replays a frame capture in a hidden window and reports CPU and GPU times per frame:
+//
+//   replay capture.glbc [iterations]
+//
+// Frames render into an offscreen framebuffer of the captured size and every frame is
+// finished before the next one starts, so the numbers do not depend on vsync or the
+// window system. Without a display SDL_VIDEODRIVER=offscreen with a software GL driver
+// such as llvmpipe works as well.
+
+const int REPLAY_ITERATIONS = 10;
+
+struct ReplayTarget
+{
+    GLuint framebuffer = 0;
+    GLuint color       = 0;
+    GLuint depth       = 0;
+
+    void create(int width, int height)
+    {
+        glGenRenderbuffers(1, &color);
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(
+            GL_FRAMEBUFFER,
+            GL_COLOR_ATTACHMENT0,
+            GL_RENDERBUFFER,
+            color);
+        glFramebufferRenderbuffer(
+            GL_FRAMEBUFFER,
+            GL_DEPTH_STENCIL_ATTACHMENT,
+            GL_RENDERBUFFER,
+            depth);
+    }
+
+    void release()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(1, &color);
+        glDeleteRenderbuffers(1, &depth);
+    }
+};
+
+// minimum, median and maximum of a sample set
+static void summarize(std::vector<float> samples, float& min, float& median, float& max)
+{
+    std::sort(samples.begin(), samples.end());
+    min    = samples.front();
+    median = samples[samples.size() / 2];
+    max    = samples.back();
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        printf("usage: %s capture.glbc [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    int iterations = argc > 2 ? std::max(1, atoi(argv[2])) : REPLAY_ITERATIONS;
+
+    Capture capture;
+    if(!capture.load(argv[1]) || capture.frames.empty())
+    {
+        printf("Could not read capture %s\n", argv[1]);
+        return 1;
+    }
+
+    stbi_set_flip_vertically_on_load(true);
+    resourcePack().open(RESOURCE_PACK);
+
+    SDL_Init(SDL_INIT_VIDEO);
+
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+
+    SDL_WindowFlags flags  = SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN;
+    SDL_Window*     window = SDL_CreateWindow("Replay", 64, 64, flags);
+    if(!window)
+    {
+        printf("Could not create a window: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    SDL_GLContext context = SDL_GL_CreateContext(window);
+    SDL_GL_MakeCurrent(window, context);
+    gladLoadGL((GLADloadfunc)SDL_GL_GetProcAddress);
+    printf("%s, %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+
+    // render() finishes with the (empty) UI draw data
+    IMGUI_CHECKVERSION();
+    ImGui::CreateContext();
+    ImGui_ImplOpenGL3_Init("#version 330");
+    glEnable(GL_DEPTH_TEST);
+
+    ShaderVariants shaders;
+    RenderThread::setupShader(shaders);
+
+    std::vector<std::unique_ptr<Model>> models;
+    std::vector<Model*>                 loaded;
+    for(auto& model : capture.models)
+    {
+        models.push_back(std::make_unique<Model>(model.path, model.profile));
+        loaded.push_back(models.back().get());
+    }
+    capture.bind(loaded);
+
+    // draw lists are derived from the frames, they are not part of a capture
+    DrawListBuilder draw_list;
+    for(auto& frame : capture.frames)
+        draw_list.build(*frame);
+
+    int width  = 1;
+    int height = 1;
+    for(auto& frame : capture.frames)
+    {
+        width  = std::max(width, frame->width);
+        height = std::max(height, frame->height);
+    }
+
+    ReplayTarget target;
+    target.create(width, height);
+
+    RenderThread renderer;
+    renderer.shaders = &shaders;
+    renderer.output  = target.framebuffer;
+
+    GLuint query = 0;
+    glGenQueries(1, &query);
+
+    size_t                          count = capture.frames.size();
+    std::vector<std::vector<float>> cpu(count);
+    std::vector<std::vector<float>> gpu(count);
+
+    // the first pass warms up caches and driver state and is not measured
+    for(int iteration = 0; iteration <= iterations; iteration++)
+    {
+        for(size_t i = 0; i < count; i++)
+        {
+            Uint64 start = SDL_GetTicksNS();
+            glBeginQuery(GL_TIME_ELAPSED, query);
+
+            renderer.render(*capture.frames[i]);
+
+            glEndQuery(GL_TIME_ELAPSED);
+            glFinish();
+            Uint64 end = SDL_GetTicksNS();
+
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+
+            if(iteration > 0)
+            {
+                cpu[i].push_back((end - start) / 1e6f);
+                gpu[i].push_back(elapsed / 1e6f);
+            }
+        }
+    }
+
+    printf("frame,cpu_min_ms,cpu_median_ms,cpu_max_ms,");
+    printf("gpu_min_ms,gpu_median_ms,gpu_max_ms\n");
+
+    std::vector<float> cpu_total(iterations, 0.0f);
+    std::vector<float> gpu_total(iterations, 0.0f);
+    for(size_t i = 0; i < count; i++)
+    {
+        float cpu_min, cpu_median, cpu_max, gpu_min, gpu_median, gpu_max;
+        summarize(cpu[i], cpu_min, cpu_median, cpu_max);
+        summarize(gpu[i], gpu_min, gpu_median, gpu_max);
+
+        printf(
+            "%zu,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+            i,
+            cpu_min,
+            cpu_median,
+            cpu_max,
+            gpu_min,
+            gpu_median,
+            gpu_max);
+
+        for(int iteration = 0; iteration < iterations; iteration++)
+        {
+            cpu_total[iteration] += cpu[i][iteration];
+            gpu_total[iteration] += gpu[i][iteration];
+        }
+    }
+
+    float cpu_min, cpu_median, cpu_max, gpu_min, gpu_median, gpu_max;
+    summarize(cpu_total, cpu_min, cpu_median, cpu_max);
+    summarize(gpu_total, gpu_min, gpu_median, gpu_max);
+    printf(
+        "total,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+        cpu_min,
+        cpu_median,
+        cpu_max,
+        gpu_min,
+        gpu_median,
+        gpu_max);
+
+    glDeleteQueries(1, &query);
+    renderer.release();
+    target.release();
+    models.clear();
+
+    ImGui_ImplOpenGL3_Shutdown();
+    ImGui::DestroyContext();
+
+    SDL_GL_DestroyContext(context);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+
+    return 0;
+}
@@ -0,0 +1,331 @@
+// lib
+#include <assimp/Importer.hpp>
+#include <assimp/config.h>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+#include <glm/glm.hpp>
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// modules
+#include "Model.hpp"
+#include "TangentSpace.hpp"
+
+// Compares the native normal and tangent generation with Assimp's steps, no GPU
+// required:
+//
+//   tangents model [--profile name] [--runs n]
+//
+// Timings are the best of the runs for the whole import with either source; Assimp's
+// steps are part of reading, the native ones have a stage of their own. For the quality
+// the arrays of the Assimp import are regenerated natively and compared vertex by
+// vertex. Normals are regenerated for every vertex, so hard edges and authored normals
+// of the file show up as differences too.
+//
+// The welding stage is compared with Assimp's JoinIdenticalVertices on a plain read of
+// the file with the steps Assimp runs for the profile: once joined by Assimp, once
+// converted and welded natively.
+
+const int TANGENT_RUNS = 5;
+
+struct Timing
+{
+    float read    = 1e30f;
+    float tangent = 1e30f;
+    float total   = 1e30f;
+};
+
+struct Difference
+{
+    double sum      = 0.0;
+    float  max      = 0.0f;
+    size_t count    = 0;
+    size_t flipped  = 0;  // tangent frames of opposite handedness
+    size_t degraded = 0;  // over a degree apart
+
+    void add(const glm::vec3& a, const glm::vec3& b)
+    {
+        float length = glm::length(a) * glm::length(b);
+        if(length <= 0.0f)
+            return;
+
+        float cosine = std::clamp(glm::dot(a, b) / length, -1.0f, 1.0f);
+        float angle  = glm::degrees(std::acos(cosine));
+        sum += angle;
+        max = std::max(max, angle);
+        count++;
+        degraded += angle > 1.0f;
+    }
+
+    void print(const char* name) const
+    {
+        printf(
+            "%-10s %8zu vertices, mean %.3f deg, max %.3f deg, %.2f%% over 1 deg",
+            name,
+            count,
+            count ? sum / count : 0.0,
+            max,
+            count ? 100.0 * degraded / count : 0.0);
+        if(flipped)
+            printf(", %zu flipped", flipped);
+        printf("\n");
+    }
+};
+
+struct WeldTiming
+{
+    float  read     = 1e30f;
+    float  weld     = 1e30f;
+    size_t vertices = 0;
+};
+
+// attributes of a mesh as the import converts them before welding, without bones
+static void convert(
+    const aiMesh*              mesh,
+    std::vector<Vertex>&       vertices,
+    std::vector<unsigned int>& indices)
+{
+    vertices.clear();
+    vertices.reserve(mesh->mNumVertices);
+    for(unsigned int i = 0; i < mesh->mNumVertices; i++)
+    {
+        const aiVector3D& p = mesh->mVertices[i];
+
+        Vertex vertex   = {};
+        vertex.Position = glm::vec3(p.x, p.y, p.z);
+        if(mesh->HasNormals())
+        {
+            const aiVector3D& n = mesh->mNormals[i];
+            vertex.Normal       = glm::vec3(n.x, n.y, n.z);
+        }
+        if(mesh->mTextureCoords[0])
+        {
+            const aiVector3D& uv = mesh->mTextureCoords[0][i];
+            vertex.TexCoords     = glm::vec2(uv.x, uv.y);
+        }
+        if(mesh->mTangents && mesh->mBitangents)
+        {
+            const aiVector3D& t = mesh->mTangents[i];
+            const aiVector3D& b = mesh->mBitangents[i];
+            vertex.Tangent      = glm::vec3(t.x, t.y, t.z);
+            vertex.Bitangent    = glm::vec3(b.x, b.y, b.z);
+        }
+        for(int j = 0; j < MAX_BONE_INFLUENCE; j++)
+            vertex.m_BoneIDs[j] = -1;
+        vertices.push_back(vertex);
+    }
+
+    indices.clear();
+    indices.reserve(size_t(mesh->mNumFaces) * 3);
+    for(unsigned int i = 0; i < mesh->mNumFaces; i++)
+    {
+        const aiFace& face = mesh->mFaces[i];
+        if(face.mNumIndices == 3)
+            indices.insert(indices.end(), face.mIndices, face.mIndices + 3);
+    }
+}
+
+// Best read and weld times of the file joined by Assimp or welded natively, and the
+// vertices left. Assimp's join is part of reading.
+static WeldTiming measureWeld(
+    const char*           path,
+    const ImportSettings& settings,
+    bool                  assimp,
+    int                   runs)
+{
+    unsigned int flags = settings.assimpFlags();
+    if(assimp)
+        flags |= aiProcess_JoinIdenticalVertices;
+
+    WeldTiming                timing;
+    VertexWelder              welder;
+    std::vector<Vertex>       vertices;
+    std::vector<unsigned int> indices;
+
+    for(int run = 0; run < runs; run++)
+    {
+        Assimp::Importer importer;
+        importer.SetPropertyBool(AI_CONFIG_PP_FD_REMOVE, true);
+
+        const aiScene* scene = nullptr;
+        float          read  = 0.0f;
+        float          weld  = 0.0f;
+        {
+            StageTimer timer(read);
+            scene = importer.ReadFile(path, flags);
+        }
+        if(!scene)
+            return timing;
+
+        size_t count = 0;
+        for(unsigned int m = 0; m < scene->mNumMeshes; m++)
+        {
+            const aiMesh* mesh = scene->mMeshes[m];
+            if(assimp)
+            {
+                count += mesh->mNumVertices;
+                continue;
+            }
+
+            convert(mesh, vertices, indices);
+            StageTimer timer(weld);
+            count += welder.weld(vertices, indices, settings.weld, settings.epsilon);
+        }
+
+        timing.read     = std::min(timing.read, read);
+        timing.weld     = std::min(timing.weld, weld);
+        timing.vertices = count;
+    }
+    return timing;
+}
+
+static Timing measure(
+    const char*   path,
+    ImportProfile profile,
+    TangentSource source,
+    int           runs)
+{
+    Timing timing;
+    for(int run = 0; run < runs; run++)
+    {
+        Model              model(path, profile, false, false, source);
+        const ImportStats& stats = model.stats;
+
+        timing.read    = std::min(timing.read, stats.ms[STAGE_READ]);
+        timing.tangent = std::min(timing.tangent, stats.ms[STAGE_TANGENTS]);
+        timing.total   = std::min(
+            timing.total,
+            stats.ms[STAGE_READ] + stats.ms[STAGE_CONVERT] + stats.ms[STAGE_WELD] +
+                stats.ms[STAGE_TANGENTS]);
+        model.materials.releaseImages();
+    }
+    return timing;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        printf("usage: %s model [--profile name] [--runs n]\n", argv[0]);
+        return 1;
+    }
+
+    ImportProfile profile = ImportProfile::DEFAULT;
+    int           runs    = TANGENT_RUNS;
+    for(int i = 2; i + 1 < argc; i += 2)
+    {
+        if(std::strcmp(argv[i], "--profile") == 0)
+            profile = importProfile(argv[i + 1]);
+        else if(std::strcmp(argv[i], "--runs") == 0)
+            runs = std::max(1, std::atoi(argv[i + 1]));
+    }
+
+    const char* path = argv[1];
+
+    Timing assimp = measure(path, profile, TangentSource::ASSIMP, runs);
+    Timing native = measure(path, profile, TangentSource::NATIVE, runs);
+
+    printf(
+        "%s, %s profile, best of %d\n",
+        path,
+        IMPORT_PROFILE_NAMES[int(profile)],
+        runs);
+    printf(
+        "Assimp  read %8.2f ms                      import %8.2f ms\n",
+        assimp.read,
+        assimp.total);
+    printf(
+        "Native  read %8.2f ms, tangents %8.2f ms, import %8.2f ms\n",
+        native.read,
+        native.tangent,
+        native.total);
+
+    // the same arrays through both, so vertices correspond one to one
+    Model reference(path, profile, false, false, TangentSource::ASSIMP);
+    if(reference.meshes.empty())
+    {
+        printf("Could not read %s\n", path);
+        return 1;
+    }
+
+    ImportSettings settings  = importSettings(profile);
+    TangentSpace   generator;
+    Difference     normals;
+    Difference     tangents;
+    float          ms = 0.0f;
+
+    for(const Mesh& mesh : reference.meshes)
+    {
+        std::vector<Vertex> vertices = mesh.vertices;
+
+        bool texcoords = false;
+        for(auto& vertex : vertices)
+        {
+            texcoords |= vertex.TexCoords != glm::vec2(0.0f);
+            vertex.Tangent   = glm::vec3(0.0f);
+            vertex.Bitangent = glm::vec3(0.0f);
+        }
+
+        {
+            StageTimer timer(ms);
+            generator.generate(
+                vertices,
+                mesh.indices,
+                false,
+                settings.flags & aiProcess_CalcTangentSpace,
+                texcoords);
+        }
+
+        for(size_t v = 0; v < vertices.size(); v++)
+        {
+            const Vertex& expected = mesh.vertices[v];
+            const Vertex& actual   = vertices[v];
+            if(expected.Tangent == glm::vec3(0.0f))
+                continue;
+
+            tangents.add(expected.Tangent, actual.Tangent);
+
+            glm::vec3 n = expected.Normal;
+            float     a = glm::dot(glm::cross(n, expected.Tangent), expected.Bitangent);
+            float     b = glm::dot(glm::cross(n, actual.Tangent), actual.Bitangent);
+            tangents.flipped += (a < 0.0f) != (b < 0.0f);
+        }
+
+        // as if the file had no normals at all
+        std::vector<Vertex> smoothed = mesh.vertices;
+        for(auto& vertex : smoothed)
+            vertex.Normal = glm::vec3(0.0f);
+        {
+            StageTimer timer(ms);
+            generator.generateNormals(smoothed, mesh.indices);
+        }
+        for(size_t v = 0; v < smoothed.size(); v++)
+            normals.add(mesh.vertices[v].Normal, smoothed[v].Normal);
+    }
+
+    printf("Native generation on the Assimp arrays %.2f ms\n", ms);
+    normals.print("Normals");
+    tangents.print("Tangents");
+
+    WeldTiming joined = measureWeld(path, settings, true, runs);
+    WeldTiming welded = measureWeld(path, settings, false, runs);
+    printf(
+        "Join    read %8.2f ms                      %10zu vertices\n",
+        joined.read,
+        joined.vertices);
+    printf(
+        "Weld    read %8.2f ms, weld     %8.2f ms, %10zu vertices\n",
+        welded.read,
+        welded.weld,
+        welded.vertices);
+
+    reference.materials.releaseImages();
+    return 0;
+}